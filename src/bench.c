@@ -0,0 +1,606 @@
+#include "instruction.h"
+#include "block.h"
+#include "cpu.h"
+#include "jit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// pwrxe-bench [filter]: microbenchmarks of the decoder, the memory
+// accessors and the TLB, and whole-CPU throughput on small PowerPC
+// kernels, printed as one JSON object on stdout. Inputs come from fixed
+// seeds and each figure is the best and the median of BENCH_RUNS timed
+// runs, so results can be compared across builds on the same host. With
+// a filter, only benchmarks whose name contains it run.
+
+#define BENCH_RUNS      7
+
+#define DECODE_WORDS    (64 * 1024)
+#define MEMORY_ACCESSES (1024 * 1024)
+#define HIT_PAGES       16          // Fits the fast TLB entries
+#define MISS_PAGES      16384       // Far more than every way of the TLB
+#define TLB_LOOKUPS     (1024 * 1024)
+
+static const char* filter;
+static bool first_result = true;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*, restarted from the same seed by every benchmark
+static uint64_t rng_state;
+
+static void rng_seed(uint64_t seed) {
+    rng_state = seed;
+}
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static bool selected(const char* name) {
+    return !filter || strstr(name, filter);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Times fn over BENCH_RUNS runs; best and median are in ns per run
+typedef struct {
+    double best;
+    double median;
+} timing_t;
+
+static timing_t measure(void (*fn)(void* ctx), void* ctx) {
+    double ns[BENCH_RUNS];
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start = now_ns();
+        fn(ctx);
+        ns[i] = (double)(now_ns() - start);
+    }
+    qsort(ns, BENCH_RUNS, sizeof(ns[0]), compare_double);
+    return (timing_t){ ns[0], ns[BENCH_RUNS / 2] };
+}
+
+static void print_result_start(const char* name) {
+    printf("%s\n    {\"name\": \"%s\"", first_result ? "" : ",", name);
+    first_result = false;
+}
+
+// ops operations per run, reported as ns per operation
+static void report_ns(const char* name, timing_t t, uint64_t ops) {
+    print_result_start(name);
+    printf(", \"ops\": %llu, \"ns_per_op_best\": %.3f, \"ns_per_op_median\": %.3f}",
+           (unsigned long long)ops, t.best / (double)ops, t.median / (double)ops);
+}
+
+// insns guest instructions per run, reported as millions per second
+static void report_mips(const char* name, timing_t t, uint64_t insns, bool verified) {
+    print_result_start(name);
+    printf(", \"insns\": %llu, \"mips_best\": %.2f, \"mips_median\": %.2f, \"verified\": %s}",
+           (unsigned long long)insns, (double)insns * 1e3 / t.best,
+           (double)insns * 1e3 / t.median, verified ? "true" : "false");
+}
+
+static volatile uint64_t sink;
+
+// Decoder: words drawn from a fixed mix of common encodings, with random
+// register and immediate fields (the bits in mask)
+typedef struct {
+    uint32_t match;
+    uint32_t mask;
+    unsigned weight;
+} encoding_t;
+
+static const encoding_t decode_mix[] = {
+    {0x38000000, 0x03FFFFFF, 12},   // addi
+    {0x80000000, 0x03FFFFFF, 10},   // lwz
+    {0x90000000, 0x03FFFFFF, 6},    // stw
+    {0xE8000000, 0x03FFFFFC, 8},    // ld
+    {0xF8000000, 0x03FFFFFC, 5},    // std
+    {0x7C000214, 0x03FFF800, 6},    // add
+    {0x7C000378, 0x03FFF800, 5},    // or
+    {0x54000000, 0x03FFFFFE, 5},    // rlwinm
+    {0x78000000, 0x03FFFFE2, 4},    // rldicl
+    {0x7C000000, 0x0381F800, 5},    // cmpw
+    {0x2C000000, 0x039FFFFF, 5},    // cmpwi
+    {0x40000000, 0x03FFFFFC, 10},   // bc
+    {0x48000000, 0x03FFFFFC, 3},    // b
+    {0x4E800020, 0x00000000, 3},    // blr
+    {0x7C0802A6, 0x03E00000, 1},    // mflr
+    {0x7C0903A6, 0x03E00000, 1},    // mtctr
+    {0xC8000000, 0x03FFFFFF, 3},    // lfd
+    {0xFC00003A, 0x03FFFFC0, 2},    // fmadd
+    {0xFC00002A, 0x03FFF800, 2},    // fadd
+    {0x10000000, 0x03FFF800, 1},    // vaddubm
+    {0xF0000300, 0x03FFF807, 1},    // xvadddp
+};
+
+static void run_decode(void* ctx) {
+    const uint32_t* words = ctx;
+    uint64_t acc = 0;
+    for (int i = 0; i < DECODE_WORDS; i++) {
+        ppc_instruction_t inst = decode_instruction(words[i]);
+        acc += inst.id ^ inst.rt;
+    }
+    sink = acc;
+}
+
+static void bench_decode(void) {
+    if (!selected("decode/mix")) return;
+    unsigned total = 0;
+    for (size_t i = 0; i < sizeof(decode_mix) / sizeof(decode_mix[0]); i++) {
+        total += decode_mix[i].weight;
+    }
+
+    uint32_t* words = malloc(DECODE_WORDS * sizeof(uint32_t));
+    if (!words) return;
+    rng_seed(1);
+    for (int i = 0; i < DECODE_WORDS; i++) {
+        unsigned pick = (unsigned)(rng() % total);
+        const encoding_t* enc = decode_mix;
+        while (pick >= enc->weight) pick -= (enc++)->weight;
+        words[i] = enc->match | ((uint32_t)rng() & enc->mask);
+    }
+    run_decode(words);
+    report_ns("decode/mix", measure(run_decode, words), DECODE_WORDS);
+    free(words);
+}
+
+// The same mix through decode_instructions, from guest byte order
+typedef struct {
+    uint32_t* words;
+    ppc_decode_batch_t out;
+} decode_batch_ctx_t;
+
+static void run_decode_batch(void* ctx) {
+    decode_batch_ctx_t* d = ctx;
+    decode_instructions(d->words, DECODE_WORDS, &d->out);
+    sink = d->out.id[DECODE_WORDS - 1];
+}
+
+static void bench_decode_batch(void) {
+    if (!selected("decode/batch")) return;
+    unsigned total = 0;
+    for (size_t i = 0; i < sizeof(decode_mix) / sizeof(decode_mix[0]); i++) {
+        total += decode_mix[i].weight;
+    }
+
+    // One allocation for the input and every output array
+    size_t per_word = 2 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + 4 * sizeof(uint8_t) +
+                      sizeof(int16_t);
+    uint8_t* buf = malloc(DECODE_WORDS * per_word);
+    if (!buf) return;
+    decode_batch_ctx_t d;
+    d.words = (uint32_t*)buf;
+    d.out.raw = d.words + DECODE_WORDS;
+    d.out.id = (uint16_t*)(d.out.raw + DECODE_WORDS);
+    d.out.xo = d.out.id + DECODE_WORDS;
+    d.out.simm = (int16_t*)(d.out.xo + DECODE_WORDS);
+    d.out.opcode = (uint8_t*)(d.out.simm + DECODE_WORDS);
+    d.out.rt = d.out.opcode + DECODE_WORDS;
+    d.out.ra = d.out.rt + DECODE_WORDS;
+    d.out.rb = d.out.ra + DECODE_WORDS;
+
+    rng_seed(1);
+    for (int i = 0; i < DECODE_WORDS; i++) {
+        unsigned pick = (unsigned)(rng() % total);
+        const encoding_t* enc = decode_mix;
+        while (pick >= enc->weight) pick -= (enc++)->weight;
+        d.words[i] = __builtin_bswap32(enc->match | ((uint32_t)rng() & enc->mask));
+    }
+    run_decode_batch(&d);
+    report_ns("decode/batch", measure(run_decode_batch, &d), DECODE_WORDS);
+    free(buf);
+}
+
+// Memory accessors over precomputed addresses: HIT_PAGES pages stay in
+// the fast TLB entries, MISS_PAGES pages miss them and the ways
+typedef struct {
+    memory_system_t* mem;
+    uint64_t* addrs;
+} memory_ctx_t;
+
+static void run_read32(void* ctx) {
+    memory_ctx_t* m = ctx;
+    uint64_t acc = 0;
+    for (int i = 0; i < MEMORY_ACCESSES; i++) acc += memory_read32(m->mem, m->addrs[i]);
+    sink = acc;
+}
+
+static void run_write64(void* ctx) {
+    memory_ctx_t* m = ctx;
+    for (int i = 0; i < MEMORY_ACCESSES; i++) memory_write64(m->mem, m->addrs[i], (uint64_t)i);
+}
+
+static void fill_addrs(uint64_t* addrs, unsigned pages, unsigned align) {
+    rng_seed(2);
+    for (int i = 0; i < MEMORY_ACCESSES; i++) {
+        uint64_t page = rng() % pages;
+        addrs[i] = (page << PAGE_SHIFT) | (rng() & (PAGE_MASK & ~(uint64_t)(align - 1)));
+    }
+}
+
+static void bench_memory(memory_system_t* mem) {
+    static const struct {
+        const char* name;
+        void (*fn)(void*);
+        unsigned pages;
+        unsigned align;
+    } cases[] = {
+        {"memory/read32/tlb_hit",   run_read32,  HIT_PAGES,  4},
+        {"memory/read32/tlb_miss",  run_read32,  MISS_PAGES, 4},
+        {"memory/write64/tlb_hit",  run_write64, HIT_PAGES,  8},
+        {"memory/write64/tlb_miss", run_write64, MISS_PAGES, 8},
+    };
+    memory_ctx_t m = { mem, malloc(MEMORY_ACCESSES * sizeof(uint64_t)) };
+    if (!m.addrs) return;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (!selected(cases[i].name)) continue;
+        fill_addrs(m.addrs, cases[i].pages, cases[i].align);
+        run_write64(&m);    // Commits the pages
+        cases[i].fn(&m);
+        report_ns(cases[i].name, measure(cases[i].fn, &m), MEMORY_ACCESSES);
+    }
+    free(m.addrs);
+}
+
+// tlb_lookup on the data TLB, for pages it holds and pages it does not
+static void run_tlb_lookup(void* ctx) {
+    memory_ctx_t* m = ctx;
+    uint64_t acc = 0, paddr;
+    for (int i = 0; i < TLB_LOOKUPS; i++) {
+        if (tlb_lookup(m->mem, &m->mem->dtlb, m->addrs[i & (MEMORY_ACCESSES - 1)], &paddr)) {
+            acc += paddr;
+        }
+    }
+    sink = acc;
+}
+
+static void bench_tlb(memory_system_t* mem) {
+    memory_ctx_t m = { mem, malloc(MEMORY_ACCESSES * sizeof(uint64_t)) };
+    if (!m.addrs) return;
+
+    if (selected("tlb/lookup/hit")) {
+        fill_addrs(m.addrs, HIT_PAGES, 4);
+        run_read32(&m);     // Inserts the translations
+        report_ns("tlb/lookup/hit", measure(run_tlb_lookup, &m), TLB_LOOKUPS);
+    }
+    if (selected("tlb/lookup/miss")) {
+        fill_addrs(m.addrs, MISS_PAGES, 4);
+        for (int i = 0; i < MEMORY_ACCESSES; i++) m.addrs[i] += (uint64_t)MISS_PAGES << PAGE_SHIFT;
+        report_ns("tlb/lookup/miss", measure(run_tlb_lookup, &m), TLB_LOOKUPS);
+    }
+    free(m.addrs);
+}
+
+// Guest kernels, assembled here
+typedef struct {
+    uint32_t words[64];
+    int n;
+} program_t;
+
+static int emit(program_t* p, uint32_t word) {
+    p->words[p->n] = word;
+    return p->n++;
+}
+
+static uint32_t D(unsigned op, unsigned rt, unsigned ra, int imm) {
+    return (op << 26) | (rt << 21) | (ra << 16) | ((uint32_t)imm & 0xFFFF);
+}
+
+static uint32_t DS(unsigned op, unsigned rt, unsigned ra, int ds, unsigned xo) {
+    return (op << 26) | (rt << 21) | (ra << 16) | ((uint32_t)ds & 0xFFFC) | xo;
+}
+
+static uint32_t X(unsigned rt, unsigned ra, unsigned rb, unsigned xo) {
+    return (PPC_OP_X_FORM << 26) | (rt << 21) | (ra << 16) | (rb << 11) | (xo << 1);
+}
+
+static uint32_t BC(unsigned bo, unsigned bi, int from, int to) {
+    return (PPC_OP_BC << 26) | (bo << 21) | (bi << 16) | ((uint32_t)((to - from) * 4) & 0xFFFC);
+}
+
+static uint32_t B(int from, int to) {
+    return (PPC_OP_B << 26) | ((uint32_t)((to - from) * 4) & 0x3FFFFFC);
+}
+
+#define SC          0x44000002
+#define MTCTR(rs)   X(rs, SPR_CTR, 0, 467)
+#define CMPW(a, b)  X(0, a, b, 0)
+#define CMPLW(a, b) X(0, a, b, 32)
+#define BO_TRUE     12
+#define BO_FALSE    4
+#define BO_DNZ      16
+#define BI_LT       0
+#define BI_GT       1
+#define BI_EQ       2
+
+#define CODE_ADDR   0x10000
+#define DATA_A      0x100000
+#define DATA_B      0x800000
+
+#define LOOP_ITERS  2000000
+#define COPY_BYTES  (64 * 1024)
+#define COPY_REPS   64
+#define SORT_WORDS  1024
+#define DOT_LEN     4096
+#define DOT_REPS    64
+
+typedef struct kernel kernel_t;
+
+struct kernel {
+    const char* name;
+    void (*assemble)(program_t* p);
+    void (*setup)(ppc_cpu_state_t* cpu, memory_system_t* mem);
+    bool (*verify)(ppc_cpu_state_t* cpu, memory_system_t* mem);
+};
+
+// loop: integer add/shift/xor with a compare and branch per iteration
+static void loop_assemble(program_t* p) {
+    emit(p, D(PPC_OP_ADDI, 3, 0, 0));
+    emit(p, D(PPC_OP_ADDI, 4, 0, 0));
+    emit(p, D(PPC_OP_ADDIS, 5, 0, LOOP_ITERS >> 16));
+    emit(p, D(PPC_OP_ORI, 5, 5, LOOP_ITERS & 0xFFFF));
+    int top = emit(p, D(PPC_OP_ADDI, 3, 3, 1));
+    emit(p, X(4, 3, 4, 266));                           // add r4, r3, r4
+    emit(p, (PPC_OP_RLWINM << 26) | (4 << 21) | (6 << 16) | (3 << 11) | (28 << 1));
+    emit(p, X(4, 4, 6, 316));                           // xor r4, r4, r6
+    emit(p, CMPW(3, 5));
+    emit(p, BC(BO_TRUE, BI_LT, p->n, top));
+    emit(p, SC);
+}
+
+static void loop_setup(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    (void)cpu;
+    (void)mem;
+}
+
+static bool loop_verify(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    (void)mem;
+    uint64_t r4 = 0;
+    for (uint64_t i = 1; i <= LOOP_ITERS; i++) {
+        r4 += i;
+        r4 ^= (uint32_t)(r4 << 3);
+    }
+    return cpu->gpr[3] == LOOP_ITERS && cpu->gpr[4] == r4;
+}
+
+// memcpy: ldu/stdu with bdnz, COPY_REPS times over COPY_BYTES
+static void memcpy_assemble(program_t* p) {
+    int outer = emit(p, D(PPC_OP_ADDI, 5, 3, -8));
+    emit(p, D(PPC_OP_ADDI, 6, 4, -8));
+    emit(p, MTCTR(8));
+    int inner = emit(p, DS(PPC_OP_LD, 9, 5, 8, 1));     // ldu r9, 8(r5)
+    emit(p, DS(PPC_OP_STD, 9, 6, 8, 1));                // stdu r9, 8(r6)
+    emit(p, BC(BO_DNZ, 0, p->n, inner));
+    emit(p, D(PPC_OP_ADDI, 7, 7, -1));
+    emit(p, D(PPC_OP_CMPI, 0, 7, 0));
+    emit(p, BC(BO_FALSE, BI_EQ, p->n, outer));
+    emit(p, SC);
+}
+
+static void memcpy_setup(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    rng_seed(3);
+    for (int i = 0; i < COPY_BYTES; i += 8) memory_write64(mem, DATA_A + i, rng());
+    cpu->gpr[3] = DATA_A;
+    cpu->gpr[4] = DATA_B;
+    cpu->gpr[7] = COPY_REPS;
+    cpu->gpr[8] = COPY_BYTES / 8;
+}
+
+static bool memcpy_verify(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    (void)cpu;
+    for (int i = 0; i < COPY_BYTES; i += 8) {
+        if (memory_read64(mem, DATA_A + i) != memory_read64(mem, DATA_B + i)) return false;
+    }
+    return true;
+}
+
+// sort: fills SORT_WORDS words from an LCG, then insertion sorts them
+static void sort_assemble(program_t* p) {
+    emit(p, D(PPC_OP_ADDI, 10, 0, 1));
+    emit(p, D(PPC_OP_ADDIS, 11, 0, 0x41C6));
+    emit(p, D(PPC_OP_ORI, 11, 11, 0x4E6D));              // 1103515245
+    emit(p, MTCTR(4));
+    emit(p, D(PPC_OP_ADDI, 5, 3, -4));
+    int fill = emit(p, X(10, 10, 11, 235));             // mullw r10, r10, r11
+    emit(p, D(PPC_OP_ADDI, 10, 10, 12345));
+    emit(p, D(PPC_OP_STWU, 10, 5, 4));
+    emit(p, BC(BO_DNZ, 0, p->n, fill));
+
+    emit(p, D(PPC_OP_ADDI, 6, 0, 4));
+    int outer = emit(p, CMPW(6, 12));
+    int to_done = emit(p, 0);
+    emit(p, X(7, 3, 6, 23));                            // lwzx r7, r3, r6
+    emit(p, D(PPC_OP_ADDI, 8, 6, -4));
+    int inner = emit(p, D(PPC_OP_CMPI, 0, 8, 0));
+    int to_place1 = emit(p, 0);
+    emit(p, X(9, 3, 8, 23));                            // lwzx r9, r3, r8
+    emit(p, CMPLW(9, 7));
+    int to_place2 = emit(p, 0);
+    emit(p, D(PPC_OP_ADDI, 13, 8, 4));
+    emit(p, X(9, 3, 13, 151));                          // stwx r9, r3, r13
+    emit(p, D(PPC_OP_ADDI, 8, 8, -4));
+    emit(p, B(p->n, inner));
+    int place = emit(p, D(PPC_OP_ADDI, 13, 8, 4));
+    emit(p, X(7, 3, 13, 151));                          // stwx r7, r3, r13
+    emit(p, D(PPC_OP_ADDI, 6, 6, 4));
+    emit(p, B(p->n, outer));
+    int done = emit(p, SC);
+
+    p->words[to_done] = BC(BO_FALSE, BI_LT, to_done, done);         // bge
+    p->words[to_place1] = BC(BO_TRUE, BI_LT, to_place1, place);     // blt
+    p->words[to_place2] = BC(BO_FALSE, BI_GT, to_place2, place);    // ble
+}
+
+static void sort_setup(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    (void)mem;
+    cpu->gpr[3] = DATA_A;
+    cpu->gpr[4] = SORT_WORDS;
+    cpu->gpr[12] = SORT_WORDS * 4;
+}
+
+static bool sort_verify(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    (void)cpu;
+    uint32_t x = 1, prev = 0;
+    uint64_t expect = 0, sum = 0;
+    for (int i = 0; i < SORT_WORDS; i++) {
+        x = x * 1103515245U + 12345U;
+        expect += x;
+        uint32_t v = memory_read32(mem, DATA_A + i * 4);
+        if (v < prev) return false;
+        prev = v;
+        sum += v;
+    }
+    return sum == expect;
+}
+
+// dot: lfdu/fmadd over two double vectors, DOT_REPS times; the values
+// are small integers so the sum is exact
+static void dot_assemble(program_t* p) {
+    int outer = emit(p, D(PPC_OP_ADDI, 5, 3, -8));
+    emit(p, D(PPC_OP_ADDI, 6, 4, -8));
+    emit(p, MTCTR(8));
+    int inner = emit(p, D(PPC_OP_LFDU, 1, 5, 8));
+    emit(p, D(PPC_OP_LFDU, 2, 6, 8));
+    emit(p, (PPC_OP_FP_DOUBLE << 26) | (1 << 16) | (2 << 6) | (29 << 1));  // fmadd f0, f1, f2, f0
+    emit(p, BC(BO_DNZ, 0, p->n, inner));
+    emit(p, D(PPC_OP_ADDI, 7, 7, -1));
+    emit(p, D(PPC_OP_CMPI, 0, 7, 0));
+    emit(p, BC(BO_FALSE, BI_EQ, p->n, outer));
+    emit(p, SC);
+}
+
+static double dot_value(int i, int m) {
+    return (double)(i % m);
+}
+
+static void dot_setup(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    for (int i = 0; i < DOT_LEN; i++) {
+        double a = dot_value(i, 7), b = dot_value(i, 5);
+        uint64_t bits;
+        memcpy(&bits, &a, sizeof(bits));
+        memory_write64(mem, DATA_A + i * 8, bits);
+        memcpy(&bits, &b, sizeof(bits));
+        memory_write64(mem, DATA_B + i * 8, bits);
+    }
+    cpu->gpr[3] = DATA_A;
+    cpu->gpr[4] = DATA_B;
+    cpu->gpr[7] = DOT_REPS;
+    cpu->gpr[8] = DOT_LEN;
+    cpu->fpr[0] = 0;
+}
+
+static bool dot_verify(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    (void)mem;
+    double sum = 0;
+    for (int i = 0; i < DOT_LEN; i++) sum += dot_value(i, 7) * dot_value(i, 5);
+    return cpu->fpr[0] == sum * DOT_REPS;
+}
+
+static const kernel_t kernels[] = {
+    {"loop",   loop_assemble,   loop_setup,   loop_verify},
+    {"memcpy", memcpy_assemble, memcpy_setup, memcpy_verify},
+    {"sort",   sort_assemble,   sort_setup,   sort_verify},
+    {"dot",    dot_assemble,    dot_setup,    dot_verify},
+};
+
+typedef struct {
+    const kernel_t* kernel;
+    ppc_cpu_state_t* cpu;
+    memory_system_t* mem;
+    uint64_t insns;
+    bool ok;
+} exec_ctx_t;
+
+// One run of a kernel from its first instruction to its sc
+static void run_kernel(void* ctx) {
+    exec_ctx_t* x = ctx;
+    cpu_reset(x->cpu);
+    x->kernel->setup(x->cpu, x->mem);
+    x->cpu->pc = CODE_ADDR;
+
+    uint64_t start = x->cpu->exec_state.icount;
+    cpu_exit_t reason;
+    do {
+        reason = cpu_run(x->cpu, x->mem, UINT64_MAX);
+    } while (reason == CPU_EXIT_BUDGET);
+    x->insns = x->cpu->exec_state.icount - start;
+    x->ok = reason == CPU_EXIT_SYSCALL && x->kernel->verify(x->cpu, x->mem);
+}
+
+static void bench_exec(bool use_jit) {
+    const char* engine = use_jit ? "jit" : "interp";
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        char name[64];
+        snprintf(name, sizeof(name), "exec/%s/%s", engine, kernels[k].name);
+        if (!selected(name)) continue;
+
+        memory_system_t* mem = malloc(sizeof(memory_system_t));
+        block_cache_t* blocks = malloc(sizeof(block_cache_t));
+        ppc_cpu_state_t* cpu = aligned_alloc(64, sizeof(ppc_cpu_state_t));
+        if (!mem || !blocks || !cpu || !memory_init(mem, MEMORY_SIZE)) {
+            fprintf(stderr, "failed to allocate guest memory\n");
+            exit(1);
+        }
+        block_cache_init(blocks, mem);
+        if (!use_jit || !blocks->jit) {
+            jit_destroy(blocks->jit);
+            blocks->jit = NULL;
+        }
+
+        program_t p = { .n = 0 };
+        kernels[k].assemble(&p);
+        for (int i = 0; i < p.n; i++) memory_write32(mem, CODE_ADDR + i * 4, p.words[i]);
+
+        exec_ctx_t x = { &kernels[k], cpu, mem, 0, false };
+        run_kernel(&x);     // Decodes, and translates when it can
+        bool ok = x.ok;
+        timing_t t = measure(run_kernel, &x);
+        if (!use_jit || blocks->jit) report_mips(name, t, x.insns, ok && x.ok);
+
+        block_cache_destroy(blocks);
+        memory_destroy(mem);
+        free(cpu);
+        free(blocks);
+        free(mem);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) filter = argv[1];
+
+    memory_system_t* mem = malloc(sizeof(memory_system_t));
+    if (!mem || !memory_init(mem, MEMORY_SIZE)) {
+        fprintf(stderr, "failed to allocate guest memory\n");
+        return 1;
+    }
+
+    printf("{\n  \"benchmark\": \"pwrxe-bench\",\n  \"format\": 1,\n");
+    printf("  \"runs\": %d,\n  \"tlb_sets\": %d,\n  \"tlb_ways\": %d,\n", BENCH_RUNS, TLB_SETS,
+           TLB_WAYS);
+    printf("  \"results\": [");
+
+    bench_decode();
+    bench_decode_batch();
+    bench_memory(mem);
+    bench_tlb(mem);
+    bench_exec(false);
+    bench_exec(true);
+
+    printf("\n  ]\n}\n");
+    memory_destroy(mem);
+    free(mem);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "block.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Instructions that may leave the straight-line path, or change the
+// translation of the code that follows, end a block; so do reads and
+// writes of the time (spr_is_timer)
+static bool ends_block(const ppc_packed_inst_t* inst) {
+    switch (inst->id) {
+        case PPC_INST_B:
+        case PPC_INST_BC:
+        case PPC_INST_BCLR:
+        case PPC_INST_BCCTR:
+        case PPC_INST_SC:
+        case PPC_INST_TWI:
+        case PPC_INST_MTMSR:
+        case PPC_INST_MTMSRD:
+        case PPC_INST_RFID:
+        case PPC_INST_TLBIE:
+        case PPC_INST_TLBIEL:
+        case PPC_INST_INVALID:
+            return true;
+        case PPC_INST_MTSPR:
+            return inst->spr == SPR_PID || inst->spr == SPR_LPIDR || spr_is_timer(inst->spr);
+        case PPC_INST_MFSPR:
+            return spr_is_timer(inst->spr);
+        default:
+            return false;
+    }
+}
+
+bool block_cache_init(block_cache_t* cache, memory_system_t* mem) {
+    memset(cache, 0, sizeof(*cache));
+    cache->mem = mem;
+    mem->blocks = cache;
+
+    // Without a code buffer everything stays interpreted
+    if (!getenv("PWRXE_NO_JIT")) cache->jit = jit_create(cache);
+    return true;
+}
+
+static void free_retired(block_cache_t* cache) {
+    ppc_block_t* block = cache->retired;
+    while (block) {
+        ppc_block_t* next = block->hash_next;
+        profile_fold_block(cache->mem, block);
+        jit_block_free(block);
+        free(block);
+        block = next;
+    }
+    cache->retired = NULL;
+}
+
+void block_cache_flush(block_cache_t* cache) {
+    for (int i = 0; i < BLOCK_HASH_SIZE; i++) {
+        ppc_block_t* block = cache->hash[i];
+        while (block) {
+            ppc_block_t* next = block->hash_next;
+            memory_clear_code_page(cache->mem, block->paddr >> PAGE_SHIFT);
+            block->hash_next = cache->retired;
+            cache->retired = block;
+            block = next;
+        }
+        cache->hash[i] = NULL;
+        cache->pages[i] = NULL;
+    }
+    block_cache_flush_jump_cache(cache);
+    cache->generation++;
+}
+
+void block_cache_destroy(block_cache_t* cache) {
+    block_cache_flush(cache);
+    free_retired(cache);
+    jit_destroy(cache->jit);
+    cache->jit = NULL;
+    if (cache->mem && cache->mem->blocks == cache) {
+        cache->mem->blocks = NULL;
+    }
+}
+
+void block_cache_flush_jump_cache(block_cache_t* cache) {
+    memset(cache->jump_cache, 0, sizeof(cache->jump_cache));
+
+    // Chains are by virtual PC, which a flush may have remapped
+    jit_unchain_all(cache);
+    cache->generation++;
+}
+
+static ppc_block_t* translate_block(block_cache_t* cache, uint64_t paddr) {
+    memory_system_t* mem = cache->mem;
+    uint32_t words[BLOCK_MAX_INSNS];
+    ppc_packed_inst_t insns[BLOCK_MAX_INSNS];
+    uint32_t n = 0;
+
+    // Stop at the first control transfer, the length limit or the page end
+    uint64_t page_end = (paddr & ~(uint64_t)PAGE_MASK) + PAGE_SIZE;
+    for (uint64_t addr = paddr; n < BLOCK_MAX_INSNS && addr < page_end; addr += 4) {
+        words[n] = memory_fetch_phys32(mem, addr);
+        insns[n] = decode_packed(words[n]);
+        if (ends_block(&insns[n++])) break;
+    }
+    // Never split a prefixed instruction at the length limit
+    if (n == BLOCK_MAX_INSNS && insns[n - 1].id == PPC_INST_PREFIX) n--;
+
+    ppc_block_t* block = malloc(sizeof(ppc_block_t) + (n + 1) * sizeof(ppc_op_t));
+    if (!block) return NULL;
+
+    block->paddr = paddr;
+    block->n_insns = n;
+    block->exec_count = 0;
+    block->jit = NULL;
+    block->trace_pc = UINT64_MAX;
+#ifdef PWRXE_PROFILE
+    block->prof_runs = 0;
+#endif
+    for (uint32_t i = 0; i < n; i++) {
+        block->ops[i].handler = interp_get_handler(insns[i].id);
+        block->ops[i].pc_off = i * 4;
+        block->ops[i].inst = insns[i];
+        block->ops[i].raw = words[i];
+    }
+    // Falls through to the next block when the last instruction does
+    block->ops[n].handler = interp_block_end_handler();
+    block->ops[n].pc_off = n * 4;
+    block->ops[n].inst = decode_packed(0);
+    block->ops[n].raw = 0;
+    interp_fuse(block->ops, n);
+
+    uint64_t page = paddr >> PAGE_SHIFT;
+    uint64_t h = paddr_to_block_hash(paddr);
+    uint64_t p = page_to_block_hash(page);
+    block->hash_next = cache->hash[h];
+    cache->hash[h] = block;
+    block->page_next = cache->pages[p];
+    cache->pages[p] = block;
+
+    // Only pages that are actually in RAM can be written
+    if (memory_is_ram(mem, paddr)) memory_set_code_page(mem, page);
+
+    cache->translations++;
+    return block;
+}
+
+ppc_block_t* block_cache_lookup(block_cache_t* cache, uint64_t pc) {
+    jump_cache_entry_t* jc = &cache->jump_cache[pc_to_jump_cache_index(pc)];
+    if (jc->block && jc->pc == pc) {
+        cache->jump_cache_hits++;
+        return jc->block;
+    }
+
+    // Between two blocks nothing can still be running a retired one
+    if (cache->retired) free_retired(cache);
+
+    uint64_t paddr = memory_translate_fetch(cache->mem, pc);
+    ppc_block_t* block = cache->hash[paddr_to_block_hash(paddr)];
+    while (block && block->paddr != paddr) {
+        block = block->hash_next;
+    }
+    if (!block) {
+        uint64_t start = profile_start();
+        block = translate_block(cache, paddr);
+        profile_end(cache->mem, PROFILE_PATH_DECODE, start);
+        if (!block) return NULL;
+    }
+
+    jc->pc = pc;
+    jc->block = block;
+    return block;
+}
+
+static void unlink_hash(block_cache_t* cache, ppc_block_t* block) {
+    ppc_block_t** link = &cache->hash[paddr_to_block_hash(block->paddr)];
+    while (*link != block) {
+        link = &(*link)->hash_next;
+    }
+    *link = block->hash_next;
+}
+
+void block_cache_invalidate_page(block_cache_t* cache, uint64_t page) {
+    if (!cache) return;
+
+    ppc_block_t** link = &cache->pages[page_to_block_hash(page)];
+    bool dropped = false;
+    while (*link) {
+        ppc_block_t* block = *link;
+        if ((block->paddr >> PAGE_SHIFT) != page) {
+            link = &block->page_next;
+            continue;
+        }
+        *link = block->page_next;
+        unlink_hash(cache, block);
+        jit_block_unlink(block);
+
+        // The current block may be the one being overwritten; keep it alive
+        block->hash_next = cache->retired;
+        cache->retired = block;
+        cache->invalidations++;
+        dropped = true;
+    }
+
+    memory_clear_code_page(cache->mem, page);
+    if (dropped) {
+        cache->generation++;
+        for (int i = 0; i < JUMP_CACHE_SIZE; i++) {
+            ppc_block_t* block = cache->jump_cache[i].block;
+            if (block && (block->paddr >> PAGE_SHIFT) == page) {
+                cache->jump_cache[i].block = NULL;
+            }
+        }
+    }
+}
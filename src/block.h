@@ -0,0 +1,106 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "instruction.h"
+#include "memory.h"
+#include "cpu.h"
+
+// Decoded basic blocks never cross a guest page, so invalidating a page
+// only ever has to look at the blocks that start on it
+#define BLOCK_MAX_INSNS 64
+
+#define BLOCK_HASH_BITS 12
+#define BLOCK_HASH_SIZE (1 << BLOCK_HASH_BITS)
+#define BLOCK_HASH_MASK (BLOCK_HASH_SIZE - 1)
+
+#define JUMP_CACHE_BITS 12
+#define JUMP_CACHE_SIZE (1 << JUMP_CACHE_BITS)
+#define JUMP_CACHE_MASK (JUMP_CACHE_SIZE - 1)
+
+typedef struct ppc_op ppc_op_t;
+
+// Threaded-code handler: executes op, then tail-calls op[1].handler.
+// Handlers that leave the block return instead (see interpreter.c).
+typedef void (*ppc_handler_t)(ppc_cpu_state_t* cpu, memory_system_t* mem, const ppc_op_t* op);
+
+// Decoded instruction plus the handler that executes it; two ops to a
+// cache line
+struct ppc_op {
+    ppc_handler_t handler;
+    ppc_packed_inst_t inst;
+    uint32_t raw;               // Instruction word, for fields left packed
+    uint32_t pc_off;            // Byte offset from the start of the block
+};
+
+_Static_assert(sizeof(struct ppc_op) == 32, "ppc_op_t grew");
+
+// Pre-decoded basic block, keyed by the guest physical address of its
+// first instruction
+typedef struct ppc_block {
+    uint64_t paddr;                 // Guest physical address (cache key)
+    uint32_t n_insns;               // Number of decoded instructions
+    struct ppc_block* hash_next;    // Physical address hash chain
+    struct ppc_block* page_next;    // Blocks starting on the same page
+    uint32_t exec_count;            // Interpreted executions, for the JIT
+    struct jit_block* jit;          // Native translation, if any
+#ifdef PWRXE_PROFILE
+    uint64_t prof_runs;             // Entries not yet counted (profile.h)
+#endif
+    uint64_t trace_pc;              // PC its code was last traced at (trace.h)
+    ppc_op_t ops[];                 // n_insns ops plus a block-end op
+} ppc_block_t;
+
+// Direct-mapped PC -> block cache in front of the physical hash
+typedef struct {
+    uint64_t pc;
+    ppc_block_t* block;
+} jump_cache_entry_t;
+
+typedef struct block_cache {
+    memory_system_t* mem;
+
+    jump_cache_entry_t jump_cache[JUMP_CACHE_SIZE];
+    ppc_block_t* hash[BLOCK_HASH_SIZE];     // Keyed by physical address
+    ppc_block_t* pages[BLOCK_HASH_SIZE];    // Keyed by physical page
+
+    // Invalidated blocks wait here until no block can be executing
+    ppc_block_t* retired;
+
+    // Bumped whenever blocks are invalidated or chains are broken
+    uint64_t generation;
+
+    struct jit* jit;
+
+    // Stats
+    uint64_t jump_cache_hits;
+    uint64_t translations;
+    uint64_t invalidations;
+} block_cache_t;
+
+static inline uint64_t pc_to_jump_cache_index(uint64_t pc) {
+    return (pc >> 2) & JUMP_CACHE_MASK;
+}
+
+static inline uint64_t paddr_to_block_hash(uint64_t paddr) {
+    return ((paddr >> 2) ^ (paddr >> (2 + BLOCK_HASH_BITS))) & BLOCK_HASH_MASK;
+}
+
+static inline uint64_t page_to_block_hash(uint64_t page) {
+    return (page ^ (page >> BLOCK_HASH_BITS)) & BLOCK_HASH_MASK;
+}
+
+// Function prototypes
+bool block_cache_init(block_cache_t* cache, memory_system_t* mem);
+void block_cache_destroy(block_cache_t* cache);
+
+// Returns the decoded block starting at guest PC, decoding it on a miss
+ppc_block_t* block_cache_lookup(block_cache_t* cache, uint64_t pc);
+
+// Invalidation
+void block_cache_invalidate_page(block_cache_t* cache, uint64_t page);
+void block_cache_flush_jump_cache(block_cache_t* cache);
+void block_cache_flush(block_cache_t* cache);
+
+#endif
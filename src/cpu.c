@@ -0,0 +1,24 @@
+#include "cpu.h"
+#include <stdio.h>
+#include <string.h>
+
+void cpu_reset(ppc_cpu_state_t* cpu) {
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->msr = MSR_SF;
+    cpu->vscr = VSCR_NJ;
+    cpu->dec_zero = INT32_MAX;
+}
+
+void cpu_dump_state(const ppc_cpu_state_t* cpu) {
+    for (int i = 0; i < 32; i++) {
+        printf("r%-2d=%016llx%s", i, (unsigned long long)cpu->gpr[i],
+               (i % 4 == 3) ? "\n" : "  ");
+    }
+    printf("pc =%016llx  lr =%016llx  ctr=%016llx\n",
+           (unsigned long long)cpu->pc,
+           (unsigned long long)cpu->lr,
+           (unsigned long long)cpu->ctr);
+    printf("msr=%016llx  cr =%08x  xer=%08x  icount=%llu\n",
+           (unsigned long long)cpu->msr, cpu_eval_cr(cpu), cpu_eval_xer(cpu),
+           (unsigned long long)cpu->exec_state.icount);
+}
@@ -3,6 +3,36 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "memory.h"
+
+// Why cpu_run returned
+typedef enum {
+    CPU_EXIT_NONE = 0,
+    CPU_EXIT_BUDGET,    // max_insns instructions executed
+    CPU_EXIT_SYSCALL,   // sc executed, pc points past it
+    CPU_EXIT_TRAP,      // Trap condition met, pc points at the trap
+    CPU_EXIT_ILLEGAL,   // Unknown or unimplemented instruction at pc
+    CPU_EXIT_MCHECK,    // Host fault past the end of RAM; state is imprecise
+    CPU_EXIT_FAULT,     // Translation refused an access; pc points at the
+                        // instruction, dar/dsisr describe the access
+    CPU_EXIT_FP,        // Enabled floating-point exception; pc points at the
+                        // instruction (past it for mtfsf and friends)
+    CPU_EXIT_REQUEST,   // Another thread asked it to return (events.h)
+} cpu_exit_t;
+
+// 128-bit vector-scalar register, held with its bytes reversed against
+// the architected big-endian order: element i of an n-element vector is
+// host lane n-1-i (doubleword 0 is d[1]). Element-wise operations then
+// run on host SIMD lanes as they are, and loads and stores are a single
+// byte reversal.
+typedef union {
+    uint8_t b[16];
+    uint16_t h[8];
+    uint32_t w[4];
+    uint64_t d[2];
+    float f[4];
+    double fd[2];
+} __attribute__((aligned(16))) ppc_vsr_t;
 
 // PowerPC Register File - optimized for cache alignment
 typedef struct {
@@ -16,23 +46,66 @@ typedef struct {
     uint64_t pc;        // Program Counter
     uint64_t lr;        // Link Register  
     uint64_t ctr;       // Count Register
-    uint32_t cr;        // Condition Register
-    uint32_t xer;       // Fixed-Point Exception Register
+    uint32_t cr;        // Condition Register (CR0 may be stale, see lazy)
+    uint32_t xer;       // Fixed-Point Exception Register (CA may be stale)
     uint64_t msr;       // Machine State Register
     uint32_t vrsave;
-    double fpscr;
+    uint32_t fpscr;     // Floating-Point Status and Control (see fpu.h)
     // Memory Management
     uint64_t dar;       // Data Address Register
     uint32_t dsisr;     // Data Storage Interrupt Status Register
+    uint32_t pir;       // Processor Identification Register
+
+    // Interrupts and time. The timebase ticks once per instruction retired:
+    // TB is icount + tb_offset, and DEC reads dec_zero - icount, so neither
+    // is updated as instructions run (events.h).
+    uint64_t srr0;      // Save/Restore Registers: where the last interrupt
+    uint64_t srr1;      // struck and the MSR it found
+    uint64_t tb_offset;
+    uint64_t dec_zero;  // icount at which DEC reads zero
     
+    // Deferred CR0 and XER[CA]. Record forms and carrying adds only store
+    // their result here; the bits are computed when something reads them
+    // (cpu_get_cr, cpu_get_xer). SO changes only through OE forms and
+    // mtxer, which settle CR0 first, so CR0 can take SO from xer later.
+    struct {
+        int64_t cr0_result;     // Result CR0 is compared against zero
+        uint64_t ca_x;          // CA = carry out of ca_x + y + ca_in,
+        uint64_t ca_r;          //      given the sum ca_r
+        bool cr0_pending;
+        bool ca_pending;
+        bool ca_in;
+
+        // Floating point: FPSCR exception bits collect in the host MXCSR
+        // while cpu_run executes, and FPRF describes fprf_result until it
+        // is settled (fpu.h)
+        double fprf_result;
+        bool fprf_pending;
+        bool fp_precise;    // Enabled FP exceptions can interrupt
+    } lazy;
+
     // Cache-aligned execution state
     struct {
         bool reservation_valid;
+        uint8_t reservation_size;
         uint64_t reservation_addr;
-        uint32_t fpscr;     // Floating Point Status Control Register
-        uint32_t _padding;
+        uint64_t reservation_value;     // Loaded value, as it sits in RAM
+        uint32_t retired;   // Instructions retired by the last block
+        uint32_t mem_pc_off;    // Block offset of the access in progress
+        uint32_t charged;   // Instructions the running block was charged
+        uint32_t exit_reason;
+        uint64_t icount;    // Total instructions retired
+        int64_t jit_budget; // Instructions translated code may still run
+        uint64_t budget_end;    // icount once jit_budget runs out (cpu_icount_now)
+        void* jit_exit;     // Chainable exit translated code left through
     } exec_state;
-    
+
+    // Vector-scalar registers; VMX register n is vsr[32 + n]. Doubleword 0
+    // of VSRs 0-31 is the FPR of the same number and lives in fpr[], so
+    // vsr[0-31].d[1] is unused (see vector.h for accessors).
+    uint32_t vscr;      // Vector Status and Control Register
+    ppc_vsr_t vsr[64];
+
 } __attribute__((aligned(64))) ppc_cpu_state_t;
 
 // Condition Register field extraction macros
@@ -47,14 +120,175 @@ typedef struct {
 #define XER_OV  (1U << 30)  // Overflow
 #define XER_CA  (1U << 29)  // Carry
 
-// MSR register bits (key ones)
+// MSR register bits (key ones), by IBM bit number: bit n is 1 << (63 - n)
 #define MSR_SF  (1ULL << 63) // 64-bit mode
-#define MSR_EE  (1ULL << 48) // External Interrupt Enable
-#define MSR_PR  (1ULL << 49) // Problem State
-#define MSR_IR  (1ULL << 58) // Instruction Relocate
-#define MSR_DR  (1ULL << 59) // Data Relocate
+#define MSR_EE  (1ULL << 15) // External Interrupt Enable (bit 48)
+#define MSR_PR  (1ULL << 14) // Problem State (bit 49)
+#define MSR_IR  (1ULL << 5)  // Instruction Relocate (bit 58)
+#define MSR_DR  (1ULL << 4)  // Data Relocate (bit 59)
+#define MSR_LE  (1ULL << 0)  // Little-Endian mode
+#define MSR_RI  (1ULL << 1)  // Recoverable Interrupt
+#define MSR_ME  (1ULL << 12) // Machine Check Enable
+#define MSR_FE0 (1ULL << 11) // Floating-Point Exception Mode 0
+#define MSR_FE1 (1ULL << 8)  // Floating-Point Exception Mode 1
+
+// FPSCR bits (the low word of the architected register)
+#define FPSCR_FX        (1U << 31)  // Exception summary
+#define FPSCR_FEX       (1U << 30)  // Enabled exception summary
+#define FPSCR_VX        (1U << 29)  // Invalid operation summary
+#define FPSCR_OX        (1U << 28)  // Overflow
+#define FPSCR_UX        (1U << 27)  // Underflow
+#define FPSCR_ZX        (1U << 26)  // Zero divide
+#define FPSCR_XX        (1U << 25)  // Inexact
+#define FPSCR_VXSNAN    (1U << 24)
+#define FPSCR_VXISI     (1U << 23)
+#define FPSCR_VXIDI     (1U << 22)
+#define FPSCR_VXZDZ     (1U << 21)
+#define FPSCR_VXIMZ     (1U << 20)
+#define FPSCR_VXVC      (1U << 19)
+#define FPSCR_FR        (1U << 18)  // Fraction rounded
+#define FPSCR_FI        (1U << 17)  // Fraction inexact
+#define FPSCR_FPRF      (0x1FU << 12)   // Result class and FPCC
+#define FPSCR_FPCC      (0xFU << 12)
+#define FPSCR_VXSOFT    (1U << 10)
+#define FPSCR_VXSQRT    (1U << 9)
+#define FPSCR_VXCVI     (1U << 8)
+#define FPSCR_VE        (1U << 7)   // Exception enables
+#define FPSCR_OE        (1U << 6)
+#define FPSCR_UE        (1U << 5)
+#define FPSCR_ZE        (1U << 4)
+#define FPSCR_XE        (1U << 3)
+#define FPSCR_NI        (1U << 2)   // Non-IEEE mode
+#define FPSCR_RN        (3U << 0)   // Rounding mode
+
+#define FPSCR_VX_ALL    (FPSCR_VXSNAN | FPSCR_VXISI | FPSCR_VXIDI | FPSCR_VXZDZ | \
+                         FPSCR_VXIMZ | FPSCR_VXVC | FPSCR_VXSOFT | FPSCR_VXSQRT | \
+                         FPSCR_VXCVI)
+#define FPSCR_ENABLES   (FPSCR_VE | FPSCR_OE | FPSCR_UE | FPSCR_ZE | FPSCR_XE)
+
+// VSCR bits
+#define VSCR_NJ     (1U << 16)  // Non-Java mode (denormals flush to zero)
+#define VSCR_SAT    (1U << 0)   // A saturating operation saturated
+
+// SPR numbers
+#define SPR_XER     1
+#define SPR_DSISR   18
+#define SPR_DAR     19
+#define SPR_DEC     22
+#define SPR_SRR0    26
+#define SPR_SRR1    27
+#define SPR_LR      8
+#define SPR_CTR     9
+#define SPR_PID     48
+#define SPR_VRSAVE  256
+#define SPR_TB      268     // Read-only: mftb
+#define SPR_TBU     269     // Read-only: mftbu
+#define SPR_LPIDR   319
+#define SPR_PTCR    464
+#define SPR_PIR     1023
+
+// Interrupt vectors (real addresses)
+#define VECTOR_EXTERNAL     0x500
+#define VECTOR_DECREMENTER  0x900
+
+// SPRs that read or set the time. They end their block, so their
+// handlers run with the block charged in full (cpu_icount_now).
+static inline bool spr_is_timer(unsigned spr) {
+    return spr == SPR_DEC || spr == SPR_TB || spr == SPR_TBU;
+}
+
+// Mask of IBM bits mb..me (bit 0 is the MSB), wrapping when mb > me
+static inline uint64_t ppc_mask64(unsigned mb, unsigned me) {
+    uint64_t lo = ~0ULL >> mb;
+    uint64_t hi = ~0ULL << (63 - me);
+    return mb <= me ? (lo & hi) : (lo | hi);
+}
+
+static inline uint32_t cr_get_bit(uint32_t cr, unsigned bit) {
+    return (cr >> (31 - bit)) & 1;
+}
+
+static inline uint32_t cr_set_field(uint32_t cr, unsigned field, uint32_t value) {
+    unsigned shift = 28 - field * 4;
+    return (cr & ~(0xFU << shift)) | (value << shift);
+}
+
+// Lazy condition state
+static inline uint32_t cpu_eval_cr(const ppc_cpu_state_t* cpu) {
+    if (!cpu->lazy.cr0_pending) return cpu->cr;
+    int64_t r = cpu->lazy.cr0_result;
+    uint32_t c = r < 0 ? 8 : r > 0 ? 4 : 2;
+    return cr_set_field(cpu->cr, 0, c | (cpu->xer >> 31));
+}
+
+static inline uint32_t cpu_eval_xer(const ppc_cpu_state_t* cpu) {
+    if (!cpu->lazy.ca_pending) return cpu->xer;
+    bool ca = cpu->lazy.ca_in ? cpu->lazy.ca_r <= cpu->lazy.ca_x
+                              : cpu->lazy.ca_r < cpu->lazy.ca_x;
+    return ca ? (cpu->xer | XER_CA) : (cpu->xer & ~XER_CA);
+}
+
+static inline uint32_t cpu_get_cr(ppc_cpu_state_t* cpu) {
+    if (__builtin_expect(cpu->lazy.cr0_pending, 0)) {
+        cpu->cr = cpu_eval_cr(cpu);
+        cpu->lazy.cr0_pending = false;
+    }
+    return cpu->cr;
+}
+
+static inline uint32_t cpu_get_xer(ppc_cpu_state_t* cpu) {
+    if (cpu->lazy.ca_pending) {
+        cpu->xer = cpu_eval_xer(cpu);
+        cpu->lazy.ca_pending = false;
+    }
+    return cpu->xer;
+}
+
+static inline void cpu_set_cr(ppc_cpu_state_t* cpu, uint32_t cr) {
+    cpu->cr = cr;
+    cpu->lazy.cr0_pending = false;
+}
+
+// SO may change, so a pending CR0 has to be settled with the old one
+static inline void cpu_set_xer(ppc_cpu_state_t* cpu, uint32_t xer) {
+    cpu_get_cr(cpu);
+    cpu->xer = xer;
+    cpu->lazy.ca_pending = false;
+}
+
+// Reads one CR bit, settling CR0 only when the bit is in it
+static inline uint32_t cpu_get_cr_bit(ppc_cpu_state_t* cpu, unsigned bit) {
+    if (bit < 4) cpu_get_cr(cpu);
+    return cr_get_bit(cpu->cr, bit);
+}
+
+// Makes address translation follow MSR[IR], MSR[DR] and MSR[PR]
+static inline void cpu_sync_translation(const ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    memory_set_translation(mem, cpu->msr & MSR_IR, cpu->msr & MSR_DR, cpu->msr & MSR_PR);
+}
+
+// Instructions retired before the one executing, for the handler of an
+// instruction that ends its block. Blocks, interpreted or translated, are
+// charged against exec_state.jit_budget before they run.
+static inline uint64_t cpu_icount_now(const ppc_cpu_state_t* cpu) {
+    return cpu->exec_state.budget_end - (uint64_t)cpu->exec_state.jit_budget - 1;
+}
+
+static inline uint64_t cpu_get_tb(const ppc_cpu_state_t* cpu, uint64_t now) {
+    return now + cpu->tb_offset;
+}
+
+// DEC is 32 bits; it reads sign-extended, and a decrementer interrupt is
+// pending while it is negative
+static inline int32_t cpu_get_dec(const ppc_cpu_state_t* cpu, uint64_t now) {
+    return (int32_t)(uint32_t)(cpu->dec_zero - now);
+}
 
 void cpu_reset(ppc_cpu_state_t* cpu);
 void cpu_dump_state(const ppc_cpu_state_t* cpu);
 
+// Execution (interpreter.c); needs a block cache attached to mem
+cpu_exit_t cpu_run(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t max_insns);
+cpu_exit_t cpu_step(ppc_cpu_state_t* cpu, memory_system_t* mem);
+
 #endif
\ No newline at end of file
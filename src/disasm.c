@@ -0,0 +1,717 @@
+#include "disasm.h"
+#include "cpu.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary output: an 8-byte magic, then LEB128 fields:
+//   flags                   DISASM_BIN_* bits
+//   sections, and for each: address, words, name length, name bytes
+//   blocks, and for each a tag byte (disasm_end_t, DISASM_TAG_* above
+//   it) and its instructions, then as the tag says
+//     zigzag(next - block)    if the fall-through block is not block + 1
+//     zigzag(taken - block)   if the branch target is a block
+//     target address          if it is outside the text
+//   the instruction IDs, two little-endian bytes per word, unless CFG only
+// Blocks are contiguous within a section, so their addresses follow from
+// the sections and the instruction counts.
+static const char disasm_magic[8] = { 'P', 'W', 'R', 'X', 'C', 'F', 'G', '1' };
+
+#define DISASM_BIN_IDS          (1U << 0)
+#define DISASM_BIN_LITTLE       (1U << 1)   // Little-endian file
+
+#define DISASM_TAG_NEXT         0x10        // Falls through to block + 1
+#define DISASM_TAG_NEXT_FAR     0x20
+#define DISASM_TAG_TAKEN        0x40
+#define DISASM_TAG_TARGET       0x80
+
+// decode_instructions runs over this many words at a time, so that the
+// fields nobody keeps stay in L1
+#define DECODE_TILE     1024
+
+// Chunks each output round holds in memory, per thread
+#define OUTPUT_CHUNKS   4
+
+#define TEXT_BUF        16384
+#define TEXT_LINE_MAX   96      // Two addresses, the word and a mnemonic cut to 32
+
+static const char* const end_names[DISASM_END_KINDS] = {
+    "fall", "jump", "cond", "call", "return", "indirect", "syscall", "trap", "context",
+    "invalid",
+};
+
+static inline uint16_t file16(bool le, uint16_t v) {
+    return le ? v : __builtin_bswap16(v);
+}
+
+static inline uint32_t file32(bool le, uint32_t v) {
+    return le ? v : __builtin_bswap32(v);
+}
+
+static inline uint64_t file64(bool le, uint64_t v) {
+    return le ? v : __builtin_bswap64(v);
+}
+
+static bool fail(const char** error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+static disasm_t* open_failed(disasm_t* dis, const char** error, const char* message) {
+    disasm_close(dis);
+    fail(error, message);
+    return NULL;
+}
+
+static inline uint32_t n_chunks(const disasm_t* dis) {
+    return (dis->n_words + DISASM_CHUNK - 1) >> DISASM_CHUNK_BITS;
+}
+
+// Worker pool: each phase hands out chunks from a shared counter until
+// they run out. The calling thread works too.
+typedef struct {
+    void (*fn)(void* ctx, uint32_t chunk);
+    void* ctx;
+    uint32_t next;
+    uint32_t end;
+} phase_t;
+
+static void* phase_worker(void* arg) {
+    phase_t* phase = arg;
+    for (;;) {
+        uint32_t chunk = __atomic_fetch_add(&phase->next, 1, __ATOMIC_RELAXED);
+        if (chunk >= phase->end) return NULL;
+        phase->fn(phase->ctx, chunk);
+    }
+}
+
+static void run_phase(unsigned threads, void (*fn)(void*, uint32_t), void* ctx,
+                      uint32_t begin, uint32_t end) {
+    phase_t phase = { fn, ctx, begin, end };
+    if (threads > end - begin) threads = end - begin;
+    pthread_t workers[threads ? threads : 1];
+    unsigned started = 0;
+    while (started + 1 < threads &&
+           !pthread_create(&workers[started], NULL, phase_worker, &phase)) {
+        started++;
+    }
+    phase_worker(&phase);
+    for (unsigned i = 0; i < started; i++) pthread_join(workers[i], NULL);
+}
+
+// The section holding word index i
+static const disasm_section_t* section_of(const disasm_t* dis, uint32_t i) {
+    unsigned lo = 0, hi = dis->n_sections;
+    while (hi - lo > 1) {
+        unsigned mid = (lo + hi) / 2;
+        if (dis->sections[mid].first <= i) lo = mid;
+        else hi = mid;
+    }
+    return &dis->sections[lo];
+}
+
+// The word index of the instruction at addr, or DISASM_NO_BLOCK
+static uint32_t index_of(const disasm_t* dis, uint64_t addr) {
+    if (addr & 3) return DISASM_NO_BLOCK;
+    unsigned lo = 0, hi = dis->n_sections;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        const disasm_section_t* sec = &dis->sections[mid];
+        if (addr < sec->addr) hi = mid;
+        else if ((addr - sec->addr) / 4 >= sec->n_words) lo = mid + 1;
+        else return sec->first + (uint32_t)((addr - sec->addr) / 4);
+    }
+    return DISASM_NO_BLOCK;
+}
+
+static inline bool is_leader(const disasm_t* dis, uint32_t i) {
+    return (dis->leaders[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void mark_leader(disasm_t* dis, uint32_t i) {
+    __atomic_fetch_or(&dis->leaders[i >> 6], 1ULL << (i & 63), __ATOMIC_RELAXED);
+}
+
+// Blocks starting before word index i
+static inline uint32_t leaders_before(const disasm_t* dis, uint32_t i) {
+    uint64_t below = dis->leaders[i >> 6] & ((1ULL << (i & 63)) - 1);
+    return dis->chunk_base[i >> DISASM_CHUNK_BITS] + dis->rank[i >> 6] +
+           (uint32_t)__builtin_popcountll(below);
+}
+
+static inline uint64_t address_of(const disasm_t* dis, uint32_t i) {
+    const disasm_section_t* sec = section_of(dis, i);
+    return sec->addr + (uint64_t)(i - sec->first) * 4;
+}
+
+// The instructions translate_block ends a block at
+static bool ends_block(uint16_t id, uint32_t raw) {
+    switch (id) {
+        case PPC_INST_B:
+        case PPC_INST_BC:
+        case PPC_INST_BCLR:
+        case PPC_INST_BCCTR:
+        case PPC_INST_SC:
+        case PPC_INST_TWI:
+        case PPC_INST_MTMSR:
+        case PPC_INST_MTMSRD:
+        case PPC_INST_RFID:
+        case PPC_INST_TLBIE:
+        case PPC_INST_TLBIEL:
+        case PPC_INST_INVALID:
+            return true;
+        case PPC_INST_MTSPR:
+            return INST_SPR(raw) == SPR_PID || INST_SPR(raw) == SPR_LPIDR || spr_is_timer(INST_SPR(raw));
+        case PPC_INST_MFSPR:
+            return spr_is_timer(INST_SPR(raw));
+        default:
+            return false;
+    }
+}
+
+static uint64_t branch_target(uint32_t raw, uint64_t pc) {
+    ppc_instruction_t inst = decode_instruction(raw);
+    int64_t disp = (int32_t)inst.addr;
+    return inst.aa ? (uint64_t)disp : pc + (uint64_t)disp;
+}
+
+// Phase 1: decode the chunk, and mark the words after block-ending
+// instructions and the targets of direct branches as block starts
+static void decode_chunk(void* ctx, uint32_t chunk) {
+    disasm_t* dis = ctx;
+    uint32_t begin = chunk << DISASM_CHUNK_BITS;
+    uint32_t end = begin + DISASM_CHUNK < dis->n_words ? begin + DISASM_CHUNK : dis->n_words;
+
+    uint32_t swapped[DECODE_TILE];
+    uint8_t opcode[DECODE_TILE], rt[DECODE_TILE], ra[DECODE_TILE], rb[DECODE_TILE];
+    int16_t simm[DECODE_TILE];
+    uint16_t xo[DECODE_TILE];
+
+    const disasm_section_t* sec = section_of(dis, begin);
+    for (uint32_t i = begin; i < end;) {
+        uint32_t sec_end = sec->first + sec->n_words;
+        if (i == sec_end) {
+            sec++;
+            continue;
+        }
+        uint32_t n = end - i;
+        if (n > sec_end - i) n = sec_end - i;
+        if (n > DECODE_TILE) n = DECODE_TILE;
+
+        // decode_instructions takes words as they sit in a big-endian guest
+        const uint32_t* words = sec->data + (i - sec->first);
+        if (dis->little_endian) {
+            for (uint32_t j = 0; j < n; j++) swapped[j] = __builtin_bswap32(words[j]);
+            words = swapped;
+        }
+        ppc_decode_batch_t out = {
+            .raw = dis->raw + i, .id = dis->id + i, .opcode = opcode,
+            .rt = rt, .ra = ra, .rb = rb, .simm = simm, .xo = xo,
+        };
+        decode_instructions(words, n, &out);
+
+        for (uint32_t j = i; j < i + n; j++) {
+            uint16_t id = dis->id[j];
+            if (!ends_block(id, dis->raw[j])) continue;
+            if (j + 1 < sec_end) mark_leader(dis, j + 1);
+            if (id == PPC_INST_B || id == PPC_INST_BC) {
+                uint64_t pc = sec->addr + (uint64_t)(j - sec->first) * 4;
+                uint32_t target = index_of(dis, branch_target(dis->raw[j], pc));
+                if (target != DISASM_NO_BLOCK) mark_leader(dis, target);
+            }
+        }
+        i += n;
+    }
+}
+
+// Phase 2: count the block starts in the chunk; the caller turns the
+// totals into chunk_base
+static void rank_chunk(void* ctx, uint32_t chunk) {
+    disasm_t* dis = ctx;
+    uint32_t begin = chunk << (DISASM_CHUNK_BITS - 6);
+    uint32_t end = begin + (DISASM_CHUNK >> 6);
+    uint32_t limit = (dis->n_words + 63) >> 6;
+    if (end > limit) end = limit;
+
+    uint32_t count = 0;
+    for (uint32_t w = begin; w < end; w++) {
+        dis->rank[w] = count;
+        count += (uint32_t)__builtin_popcountll(dis->leaders[w]);
+    }
+    dis->chunk_base[chunk] = count;
+}
+
+// How the block ends, from its last word at pc
+static void classify(const disasm_t* dis, disasm_block_t* block, uint32_t last, uint64_t pc) {
+    uint32_t raw = dis->raw[last];
+    uint16_t id = dis->id[last];
+    bool always = (INST_RT(raw) & 0x14) == 0x14;   // BO ignores both CR and CTR
+
+    block->end = DISASM_END_FALL;
+    block->has_next = true;
+    block->has_target = false;
+    block->target = 0;
+    switch (id) {
+        case PPC_INST_B:
+        case PPC_INST_BC:
+            block->has_target = true;
+            block->target = branch_target(raw, pc);
+            if (id == PPC_INST_B) always = true;
+            if (INST_LK(raw)) {
+                block->end = DISASM_END_CALL;
+            } else {
+                block->end = always ? DISASM_END_JUMP : DISASM_END_COND;
+                block->has_next = !always;
+            }
+            break;
+        case PPC_INST_BCLR:
+        case PPC_INST_BCCTR:
+            if (INST_LK(raw)) {
+                block->end = DISASM_END_CALL;
+            } else {
+                block->end = id == PPC_INST_BCLR ? DISASM_END_RETURN : DISASM_END_INDIRECT;
+                block->has_next = !always;
+            }
+            break;
+        case PPC_INST_SC:
+            block->end = DISASM_END_SYSCALL;
+            break;
+        case PPC_INST_TWI:
+            block->end = DISASM_END_TRAP;
+            block->has_next = INST_RT(raw) != 31;  // TO of all ones always traps
+            break;
+        case PPC_INST_RFID:
+            block->end = DISASM_END_RETURN;
+            block->has_next = false;
+            break;
+        case PPC_INST_MTSPR:
+            if (INST_SPR(raw) != SPR_PID && INST_SPR(raw) != SPR_LPIDR) break;
+            // Fall through
+        case PPC_INST_MTMSR:
+        case PPC_INST_MTMSRD:
+        case PPC_INST_TLBIE:
+        case PPC_INST_TLBIEL:
+            block->end = DISASM_END_CONTEXT;
+            break;
+        case PPC_INST_INVALID:
+            block->end = DISASM_END_INVALID;
+            block->has_next = false;
+            break;
+        default:
+            break;
+    }
+}
+
+// Phase 3: build the blocks starting in the chunk. A block runs to the
+// next start; sections begin with one, so none spans two.
+static void build_chunk(void* ctx, uint32_t chunk) {
+    disasm_t* dis = ctx;
+    uint32_t begin = chunk << DISASM_CHUNK_BITS;
+    uint32_t end = begin + DISASM_CHUNK < dis->n_words ? begin + DISASM_CHUNK : dis->n_words;
+    uint32_t n_bitmap = (dis->n_words + 63) >> 6;
+    uint32_t b = dis->chunk_base[chunk];
+
+    for (uint32_t w = begin >> 6; w < (end + 63) >> 6; w++) {
+        for (uint64_t bits = dis->leaders[w]; bits; bits &= bits - 1) {
+            uint32_t first = (w << 6) + (uint32_t)__builtin_ctzll(bits);
+
+            // The next start, or the end of the text
+            uint32_t next_w = first >> 6;
+            uint64_t rest = dis->leaders[next_w] & ~((2ULL << (first & 63)) - 1);
+            while (!rest && ++next_w < n_bitmap) rest = dis->leaders[next_w];
+            uint32_t stop = rest ? (next_w << 6) + (uint32_t)__builtin_ctzll(rest) : dis->n_words;
+
+            disasm_block_t* block = &dis->blocks[b];
+            block->first = first;
+            block->n_insns = stop - first;
+            block->start = address_of(dis, first);
+            uint32_t last = stop - 1;
+            uint64_t last_pc = block->start + (uint64_t)(last - first) * 4;
+            classify(dis, block, last, last_pc);
+
+            block->taken = DISASM_NO_BLOCK;
+            if (block->has_target) {
+                uint32_t target = index_of(dis, block->target);
+                if (target != DISASM_NO_BLOCK) block->taken = leaders_before(dis, target);
+            }
+            block->next = DISASM_NO_BLOCK;
+            if (block->has_next) {
+                uint32_t next = index_of(dis, last_pc + 4);
+                if (next != DISASM_NO_BLOCK && is_leader(dis, next)) {
+                    block->next = leaders_before(dis, next);
+                }
+            }
+            b++;
+        }
+    }
+}
+
+static int by_address(const void* a, const void* b) {
+    uint64_t x = ((const disasm_section_t*)a)->addr, y = ((const disasm_section_t*)b)->addr;
+    return (x > y) - (x < y);
+}
+
+static bool add_section(disasm_t* dis, uint64_t addr, uint64_t offset, uint64_t size,
+                        const char* name, const char** error) {
+    if (size < 4) return true;
+    if (dis->n_sections == DISASM_MAX_SECTIONS) return fail(error, "too many executable sections");
+    if (offset > dis->map_size || size > dis->map_size - offset) {
+        return fail(error, "executable section outside the file");
+    }
+    if ((offset | addr) & 3) return fail(error, "misaligned executable section");
+    disasm_section_t* sec = &dis->sections[dis->n_sections++];
+    sec->addr = addr;
+    sec->n_words = (uint32_t)(size / 4);
+    sec->data = (const uint32_t*)((const uint8_t*)dis->map + offset);
+    snprintf(sec->name, sizeof(sec->name), "%s", name);
+    return true;
+}
+
+// Executable sections, or executable segments if the file has no section
+// headers. Relocatable objects have every section at 0, so theirs are
+// laid out one after the other, the way a linker would start.
+static bool find_text(disasm_t* dis, const char** error) {
+    const uint8_t* file = dis->map;
+    const Elf64_Ehdr* eh = (const Elf64_Ehdr*)file;
+    bool le = dis->little_endian;
+    bool relocatable = file16(le, eh->e_type) == ET_REL;
+
+    uint64_t shoff = file64(le, eh->e_shoff);
+    uint32_t shnum = file16(le, eh->e_shnum);
+    uint32_t shstrndx = file16(le, eh->e_shstrndx);
+    if (shoff && shnum) {
+        if (file16(le, eh->e_shentsize) != sizeof(Elf64_Shdr) || shoff > dis->map_size ||
+            shnum > (dis->map_size - shoff) / sizeof(Elf64_Shdr)) {
+            return fail(error, "bad section headers");
+        }
+        const Elf64_Shdr* sh = (const Elf64_Shdr*)(file + shoff);
+        const char* names = NULL;
+        uint64_t names_size = 0;
+        if (shstrndx < shnum) {
+            uint64_t off = file64(le, sh[shstrndx].sh_offset);
+            names_size = file64(le, sh[shstrndx].sh_size);
+            if (off <= dis->map_size && names_size <= dis->map_size - off) {
+                names = (const char*)file + off;
+            }
+        }
+
+        uint64_t next_addr = 0;
+        for (uint32_t i = 0; i < shnum; i++) {
+            uint64_t flags = file64(le, sh[i].sh_flags);
+            if (file32(le, sh[i].sh_type) != SHT_PROGBITS || !(flags & SHF_EXECINSTR)) continue;
+            uint32_t name_off = file32(le, sh[i].sh_name);
+            const char* name = names && name_off < names_size &&
+                               memchr(names + name_off, 0, names_size - name_off)
+                               ? names + name_off : "?";
+            uint64_t addr = file64(le, sh[i].sh_addr);
+            uint64_t size = file64(le, sh[i].sh_size);
+            if (relocatable) {
+                uint64_t align = file64(le, sh[i].sh_addralign);
+                if (align > 1) next_addr = (next_addr + align - 1) & ~(align - 1);
+                addr = next_addr;
+                next_addr += size;
+            }
+            if (!add_section(dis, addr, file64(le, sh[i].sh_offset), size, name, error)) {
+                return false;
+            }
+        }
+    }
+
+    if (!dis->n_sections) {
+        uint64_t phoff = file64(le, eh->e_phoff);
+        uint32_t phnum = file16(le, eh->e_phnum);
+        if (phnum && (file16(le, eh->e_phentsize) != sizeof(Elf64_Phdr) || phoff > dis->map_size ||
+                      phnum > (dis->map_size - phoff) / sizeof(Elf64_Phdr))) {
+            return fail(error, "bad program headers");
+        }
+        const Elf64_Phdr* ph = (const Elf64_Phdr*)(file + phoff);
+        for (uint32_t i = 0; i < phnum; i++) {
+            if (file32(le, ph[i].p_type) != PT_LOAD || !(file32(le, ph[i].p_flags) & PF_X)) continue;
+            if (!add_section(dis, file64(le, ph[i].p_vaddr), file64(le, ph[i].p_offset),
+                             file64(le, ph[i].p_filesz), "segment", error)) {
+                return false;
+            }
+        }
+    }
+    if (!dis->n_sections) return fail(error, "no executable sections");
+
+    qsort(dis->sections, dis->n_sections, sizeof(dis->sections[0]), by_address);
+    uint64_t total = 0;
+    for (unsigned i = 0; i < dis->n_sections; i++) {
+        disasm_section_t* sec = &dis->sections[i];
+        if (i && sec->addr < dis->sections[i - 1].addr + (uint64_t)dis->sections[i - 1].n_words * 4) {
+            return fail(error, "overlapping executable sections");
+        }
+        sec->first = (uint32_t)total;
+        total += sec->n_words;
+        if (total >= UINT32_MAX - DISASM_CHUNK) return fail(error, "text too large");
+    }
+    dis->n_words = (uint32_t)total;
+    return true;
+}
+
+disasm_t* disasm_open(const char* path, unsigned threads, const char** error) {
+    disasm_t* dis = calloc(1, sizeof(disasm_t));
+    if (!dis) {
+        fail(error, "out of memory");
+        return NULL;
+    }
+    if (!threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    dis->threads = threads;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) close(fd);
+        return open_failed(dis, error, "cannot open file");
+    }
+    dis->map_size = (size_t)st.st_size;
+    dis->map = dis->map_size >= sizeof(Elf64_Ehdr)
+               ? mmap(NULL, dis->map_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (dis->map == MAP_FAILED) {
+        dis->map = NULL;
+        return open_failed(dis, error, "not an ELF file");
+    }
+
+    const Elf64_Ehdr* eh = dis->map;
+    bool le = eh->e_ident[EI_DATA] == ELFDATA2LSB;
+    dis->little_endian = le;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0) return open_failed(dis, error, "not an ELF file");
+    if (eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        (eh->e_ident[EI_DATA] != ELFDATA2LSB && eh->e_ident[EI_DATA] != ELFDATA2MSB) ||
+        file16(le, eh->e_machine) != EM_PPC64) {
+        return open_failed(dis, error, "not a 64-bit PowerPC ELF file");
+    }
+    if (!find_text(dis, error)) {
+        disasm_close(dis);
+        return NULL;
+    }
+
+    uint32_t chunks = n_chunks(dis);
+    size_t bitmap = ((size_t)chunks << DISASM_CHUNK_BITS) >> 6;
+    dis->raw = malloc((size_t)dis->n_words * sizeof(uint32_t));
+    dis->id = malloc((size_t)dis->n_words * sizeof(uint16_t));
+    dis->leaders = calloc(bitmap, sizeof(uint64_t));
+    dis->rank = malloc(bitmap * sizeof(uint32_t));
+    dis->chunk_base = malloc(((size_t)chunks + 1) * sizeof(uint32_t));
+    if (!dis->raw || !dis->id || !dis->leaders || !dis->rank || !dis->chunk_base) {
+        return open_failed(dis, error, "out of memory");
+    }
+
+    for (unsigned i = 0; i < dis->n_sections; i++) mark_leader(dis, dis->sections[i].first);
+    run_phase(threads, decode_chunk, dis, 0, chunks);
+    run_phase(threads, rank_chunk, dis, 0, chunks);
+
+    uint32_t base = 0;
+    for (uint32_t c = 0; c < chunks; c++) {
+        uint32_t count = dis->chunk_base[c];
+        dis->chunk_base[c] = base;
+        base += count;
+    }
+    dis->chunk_base[chunks] = base;
+    dis->n_blocks = base;
+
+    dis->blocks = malloc((size_t)dis->n_blocks * sizeof(disasm_block_t));
+    if (!dis->blocks) return open_failed(dis, error, "out of memory");
+    run_phase(threads, build_chunk, dis, 0, chunks);
+    return dis;
+}
+
+void disasm_close(disasm_t* dis) {
+    if (!dis) return;
+    free(dis->raw);
+    free(dis->id);
+    free(dis->leaders);
+    free(dis->rank);
+    free(dis->chunk_base);
+    free(dis->blocks);
+    if (dis->map) munmap(dis->map, dis->map_size);
+    free(dis);
+}
+
+// Output is rendered a round of chunks at a time, each chunk into its own
+// buffer, and written in order
+typedef struct {
+    const disasm_t* dis;
+    bool cfg_only;
+    uint32_t begin;             // First chunk of the round
+    char** bufs;
+    size_t* sizes;
+    bool failed;
+} output_t;
+
+static void write_rounds(output_t* o, FILE* out, void (*render)(void*, uint32_t)) {
+    const disasm_t* dis = o->dis;
+    uint32_t chunks = n_chunks(dis);
+    uint32_t round = dis->threads * OUTPUT_CHUNKS;
+    char* bufs[round];
+    size_t sizes[round];
+    o->bufs = bufs;
+    o->sizes = sizes;
+
+    for (uint32_t begin = 0; begin < chunks && !o->failed; begin += round) {
+        uint32_t end = chunks - begin < round ? chunks : begin + round;
+        memset(bufs, 0, sizeof(bufs));
+        o->begin = begin;
+        run_phase(dis->threads, render, o, begin, end);
+        for (uint32_t c = 0; c < end - begin; c++) {
+            if (bufs[c] && fwrite(bufs[c], 1, sizes[c], out) != sizes[c]) o->failed = true;
+            free(bufs[c]);
+        }
+    }
+}
+
+// Blocks starting in the chunk, in order
+#define FOR_EACH_BLOCK(dis, chunk, b)                                                   \
+    for (uint32_t b = (dis)->chunk_base[chunk]; b < (dis)->chunk_base[(chunk) + 1]; b++)
+
+static FILE* chunk_stream(output_t* o, uint32_t chunk) {
+    uint32_t slot = chunk - o->begin;
+    FILE* f = open_memstream(&o->bufs[slot], &o->sizes[slot]);
+    if (!f) __atomic_store_n(&o->failed, true, __ATOMIC_RELAXED);
+    return f;
+}
+
+// Lower-case hex, at least digits long
+static char* put_hex(char* p, uint64_t v, int digits) {
+    int n = 1;
+    while (n < 16 && v >> (n * 4)) n++;
+    if (n < digits) n = digits;
+    for (int i = n - 1; i >= 0; i--) *p++ = "0123456789abcdef"[(v >> (i * 4)) & 15];
+    return p;
+}
+
+static void render_text(void* ctx, uint32_t chunk) {
+    output_t* o = ctx;
+    const disasm_t* dis = o->dis;
+    FILE* f = chunk_stream(o, chunk);
+    if (!f) return;
+
+    FOR_EACH_BLOCK(dis, chunk, b) {
+        const disasm_block_t* block = &dis->blocks[b];
+        fprintf(f, "block %u 0x%llx-0x%llx: %s", b, (unsigned long long)block->start,
+                (unsigned long long)(block->start + (uint64_t)block->n_insns * 4),
+                end_names[block->end]);
+        if (block->taken != DISASM_NO_BLOCK) {
+            fprintf(f, ", taken %u", block->taken);
+        } else if (block->has_target) {
+            fprintf(f, ", taken 0x%llx (outside)", (unsigned long long)block->target);
+        }
+        if (block->next != DISASM_NO_BLOCK) fprintf(f, ", next %u", block->next);
+        fputc('\n', f);
+        if (o->cfg_only) continue;
+
+        // Most of the output, so formatted by hand and handed to the
+        // stream a buffer at a time
+        char buf[TEXT_BUF];
+        char* p = buf;
+        for (uint32_t i = 0; i < block->n_insns; i++) {
+            uint32_t w = block->first + i;
+            uint64_t pc = block->start + (uint64_t)i * 4;
+            const char* name = get_instruction_name_by_id(dis->id[w]);
+            if (p > buf + TEXT_BUF - TEXT_LINE_MAX) {
+                fwrite(buf, 1, (size_t)(p - buf), f);
+                p = buf;
+            }
+            *p++ = ' ';
+            *p++ = ' ';
+            p = put_hex(p, pc, 1);
+            memcpy(p, ":  ", 3);
+            p = put_hex(p + 3, dis->raw[w], 8);
+            *p++ = ' ';
+            *p++ = ' ';
+            size_t len = strlen(name ? name : "invalid");
+            memcpy(p, name ? name : "invalid", len < 32 ? len : 32);
+            p += len < 32 ? len : 32;
+            if (dis->id[w] == PPC_INST_B || dis->id[w] == PPC_INST_BC) {
+                memcpy(p, " 0x", 3);
+                p = put_hex(p + 3, branch_target(dis->raw[w], pc), 1);
+            }
+            *p++ = '\n';
+        }
+        *p++ = '\n';
+        fwrite(buf, 1, (size_t)(p - buf), f);
+    }
+    if (ferror(f)) __atomic_store_n(&o->failed, true, __ATOMIC_RELAXED);
+    fclose(f);
+}
+
+bool disasm_write_text(const disasm_t* dis, FILE* out, bool cfg_only) {
+    for (unsigned i = 0; i < dis->n_sections; i++) {
+        const disasm_section_t* sec = &dis->sections[i];
+        fprintf(out, "section %s 0x%llx-0x%llx\n", sec->name, (unsigned long long)sec->addr,
+                (unsigned long long)(sec->addr + (uint64_t)sec->n_words * 4));
+    }
+    fprintf(out, "%u blocks, %s-endian\n\n", dis->n_blocks, dis->little_endian ? "little" : "big");
+    output_t o = { .dis = dis, .cfg_only = cfg_only };
+    write_rounds(&o, out, render_text);
+    return !o.failed && !ferror(out);
+}
+
+static void put_uleb(FILE* f, uint64_t v) {
+    while (v >= 0x80) {
+        fputc((int)((v & 0x7F) | 0x80), f);
+        v >>= 7;
+    }
+    fputc((int)v, f);
+}
+
+static void put_sleb(FILE* f, int64_t v) {
+    put_uleb(f, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void render_binary(void* ctx, uint32_t chunk) {
+    output_t* o = ctx;
+    const disasm_t* dis = o->dis;
+    FILE* f = chunk_stream(o, chunk);
+    if (!f) return;
+
+    FOR_EACH_BLOCK(dis, chunk, b) {
+        const disasm_block_t* block = &dis->blocks[b];
+        uint8_t tag = block->end;
+        if (block->next == b + 1) tag |= DISASM_TAG_NEXT;
+        else if (block->next != DISASM_NO_BLOCK) tag |= DISASM_TAG_NEXT_FAR;
+        if (block->taken != DISASM_NO_BLOCK) tag |= DISASM_TAG_TAKEN;
+        else if (block->has_target) tag |= DISASM_TAG_TARGET;
+
+        fputc(tag, f);
+        put_uleb(f, block->n_insns);
+        if (tag & DISASM_TAG_NEXT_FAR) put_sleb(f, (int64_t)block->next - b);
+        if (tag & DISASM_TAG_TAKEN) put_sleb(f, (int64_t)block->taken - b);
+        if (tag & DISASM_TAG_TARGET) put_uleb(f, block->target);
+    }
+    if (ferror(f)) __atomic_store_n(&o->failed, true, __ATOMIC_RELAXED);
+    fclose(f);
+}
+
+bool disasm_write_binary(const disasm_t* dis, FILE* out, bool cfg_only) {
+    fwrite(disasm_magic, 1, sizeof(disasm_magic), out);
+    put_uleb(out, (cfg_only ? 0 : DISASM_BIN_IDS) | (dis->little_endian ? DISASM_BIN_LITTLE : 0));
+    put_uleb(out, dis->n_sections);
+    for (unsigned i = 0; i < dis->n_sections; i++) {
+        const disasm_section_t* sec = &dis->sections[i];
+        size_t len = strlen(sec->name);
+        put_uleb(out, sec->addr);
+        put_uleb(out, sec->n_words);
+        put_uleb(out, len);
+        fwrite(sec->name, 1, len, out);
+    }
+    put_uleb(out, dis->n_blocks);
+
+    output_t o = { .dis = dis, .cfg_only = cfg_only };
+    write_rounds(&o, out, render_binary);
+    if (!cfg_only && !o.failed) {
+        // x86 hosts: the IDs are little-endian already
+        fwrite(dis->id, sizeof(uint16_t), dis->n_words, out);
+    }
+    return !o.failed && !ferror(out);
+}
@@ -0,0 +1,102 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "instruction.h"
+
+// Static disassembly of a PowerPC ELF64 file, for offline analysis: its
+// executable sections (or executable segments, when it has no section
+// headers) are batch decoded, split into basic blocks at branch targets
+// and after the instructions translate_block ends a block at, and the
+// blocks linked into a control flow graph by following the I- and B-form
+// branch targets. The text is cut into DISASM_CHUNK-word chunks that a
+// pool of threads takes in turn; each phase (decode, block numbering,
+// block building, output) runs over the chunks in parallel.
+//
+// Nothing is executed or loaded into guest memory, so any ELF64 file
+// will do: dynamically linked executables, shared objects, kernels.
+
+#define DISASM_CHUNK_BITS   16
+#define DISASM_CHUNK        (1U << DISASM_CHUNK_BITS)   // Words per chunk
+
+// How a block ends. Calls (bl, bcl, bctrl, blrl) continue at the next
+// block; so does every other kind that can fall through (has_next).
+typedef enum {
+    DISASM_END_FALL,        // The next word starts another block
+    DISASM_END_JUMP,        // b, or a bc that always branches
+    DISASM_END_COND,        // Conditional bc
+    DISASM_END_CALL,        // Branch and link, direct or not
+    DISASM_END_RETURN,      // bclr, rfid
+    DISASM_END_INDIRECT,    // bcctr: switch tables, tail calls
+    DISASM_END_SYSCALL,     // sc
+    DISASM_END_TRAP,        // twi
+    DISASM_END_CONTEXT,     // mtmsr, tlbie, mtspr PID: context changes
+    DISASM_END_INVALID,     // Undecodable word, or data in the text
+    DISASM_END_KINDS
+} disasm_end_t;
+
+#define DISASM_NO_BLOCK     UINT32_MAX
+
+typedef struct {
+    uint64_t start;         // Address of the first instruction
+    uint64_t target;        // Direct branch target, whether or not a block is there
+    uint32_t first;         // Index of the first word in raw and id
+    uint32_t n_insns;       // Words, a prefixed instruction counting two
+    uint32_t taken;         // Block at target, or DISASM_NO_BLOCK
+    uint32_t next;          // Block at the fall-through address, or DISASM_NO_BLOCK
+    uint8_t end;            // disasm_end_t
+    bool has_target;        // An I- or B-form branch ends it
+    bool has_next;          // Execution can continue after the last word
+} disasm_block_t;
+
+// An executable range of the file; ranges are sorted by address and their
+// words laid end to end in raw and id
+typedef struct {
+    uint64_t addr;
+    uint32_t first;
+    uint32_t n_words;
+    const uint32_t* data;   // In the file, in its byte order
+    char name[24];
+} disasm_section_t;
+
+#define DISASM_MAX_SECTIONS 64
+
+typedef struct disasm {
+    bool little_endian;
+    unsigned threads;
+    disasm_section_t sections[DISASM_MAX_SECTIONS];
+    unsigned n_sections;
+
+    uint32_t n_words;
+    uint32_t* raw;          // Host order, from decode_instructions
+    uint16_t* id;
+
+    disasm_block_t* blocks; // In address order
+    uint32_t n_blocks;
+
+    // Block starts: one bit per word, and the number of starts before
+    // each bitmap word (within its chunk) and each chunk
+    uint64_t* leaders;
+    uint32_t* rank;
+    uint32_t* chunk_base;
+
+    void* map;              // The file, mapped read-only
+    size_t map_size;
+} disasm_t;
+
+// Decodes the file at path and builds its CFG with threads workers (0 for
+// one per online CPU). NULL on failure, with a message in error if given.
+disasm_t* disasm_open(const char* path, unsigned threads, const char** error);
+void disasm_close(disasm_t* dis);
+
+// Text: each block with its successors, then its instructions unless
+// cfg_only
+bool disasm_write_text(const disasm_t* dis, FILE* out, bool cfg_only);
+
+// Binary: sections and blocks in a compact form (see disasm.c), then
+// the instruction IDs unless cfg_only
+bool disasm_write_binary(const disasm_t* dis, FILE* out, bool cfg_only);
+
+#endif
@@ -0,0 +1,146 @@
+#include "events.h"
+#include "fpu.h"
+#include <string.h>
+
+bool events_init(event_queue_t* queue, memory_system_t* mem) {
+    memset(queue, 0, sizeof(*queue));
+    queue->mem = mem;
+    mem->events = queue;
+    return true;
+}
+
+void events_destroy(event_queue_t* queue) {
+    while (queue->n_events) events_cancel(queue, queue->heap[0]);
+    if (queue->mem && queue->mem->events == queue) {
+        queue->mem->events = NULL;
+    }
+}
+
+// Heap maintenance; every move updates the event's slot
+static void heap_place(event_queue_t* queue, event_t* event, unsigned slot) {
+    queue->heap[slot] = event;
+    event->slot = (int32_t)slot;
+}
+
+static void sift_up(event_queue_t* queue, unsigned slot) {
+    event_t* event = queue->heap[slot];
+    while (slot > 0) {
+        unsigned parent = (slot - 1) / 2;
+        if (queue->heap[parent]->when <= event->when) break;
+        heap_place(queue, queue->heap[parent], slot);
+        slot = parent;
+    }
+    heap_place(queue, event, slot);
+}
+
+static void sift_down(event_queue_t* queue, unsigned slot) {
+    event_t* event = queue->heap[slot];
+    for (;;) {
+        unsigned child = slot * 2 + 1;
+        if (child >= queue->n_events) break;
+        if (child + 1 < queue->n_events && queue->heap[child + 1]->when < queue->heap[child]->when) {
+            child++;
+        }
+        if (event->when <= queue->heap[child]->when) break;
+        heap_place(queue, queue->heap[child], slot);
+        slot = child;
+    }
+    heap_place(queue, event, slot);
+}
+
+bool events_schedule(event_queue_t* queue, event_t* event, uint64_t when) {
+    if (!event_scheduled(event)) {
+        if (queue->n_events == EVENTS_MAX) return false;
+        event->when = when;
+        heap_place(queue, event, queue->n_events++);
+        sift_up(queue, (unsigned)event->slot);
+        return true;
+    }
+    uint64_t old = event->when;
+    event->when = when;
+    if (when < old) sift_up(queue, (unsigned)event->slot);
+    else sift_down(queue, (unsigned)event->slot);
+    return true;
+}
+
+void events_cancel(event_queue_t* queue, event_t* event) {
+    if (!event_scheduled(event)) return;
+    unsigned slot = (unsigned)event->slot;
+    event->slot = -1;
+    event_t* last = queue->heap[--queue->n_events];
+    if (last == event) return;
+
+    // The last event fills the hole and moves whichever way it has to
+    heap_place(queue, last, slot);
+    if (slot > 0 && queue->heap[(slot - 1) / 2]->when > last->when) sift_up(queue, slot);
+    else sift_down(queue, slot);
+}
+
+void events_raise(event_queue_t* queue, uint32_t lines) {
+    __atomic_fetch_or(&queue->irq, lines, __ATOMIC_RELEASE);
+    events_kick(queue->mem);
+}
+
+// Lowering never needs the vCPU's attention; a line lowered before the
+// next slice boundary is simply not seen
+void events_lower(event_queue_t* queue, uint32_t lines) {
+    __atomic_fetch_and(&queue->irq, ~lines, __ATOMIC_RELEASE);
+}
+
+void events_request_exit(event_queue_t* queue) {
+    __atomic_store_n(&queue->exit_requested, true, __ATOMIC_RELEASE);
+    events_kick(queue->mem);
+}
+
+// Asynchronous interrupt at the instruction pc points at. SRR1 keeps the
+// whole MSR, as no cause bits apply; the handler runs in 64-bit
+// supervisor state with translation off, in the current byte order (as
+// if LPCR[ILE] matched it). Reservations do not survive an interrupt.
+static void deliver(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t vector) {
+    cpu->srr0 = cpu->pc;
+    cpu->srr1 = cpu->msr;
+    cpu->msr &= ~(MSR_EE | MSR_PR | MSR_IR | MSR_DR | MSR_FE0 | MSR_FE1 | MSR_RI);
+    cpu->msr |= MSR_SF;
+    cpu->pc = vector;
+    cpu->exec_state.reservation_valid = false;
+    cpu_sync_translation(cpu, mem);
+    fp_update_mode(cpu);
+}
+
+uint64_t events_run(event_queue_t* queue, ppc_cpu_state_t* cpu, uint64_t max_insns) {
+    memory_system_t* mem = queue->mem;
+    uint64_t now = cpu->exec_state.icount;
+
+    if (__atomic_load_n(&queue->exit_requested, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&queue->exit_requested, false, __ATOMIC_RELAXED);
+        cpu->exec_state.exit_reason = CPU_EXIT_REQUEST;
+        return 0;
+    }
+
+    // Events scheduled for now by the ones firing run in this pass too
+    while (queue->n_events && queue->heap[0]->when <= now) {
+        event_t* event = queue->heap[0];
+        events_cancel(queue, event);
+        event->fn(cpu, mem, event);
+    }
+
+    // External interrupts come before the decrementer
+    int32_t dec = cpu_get_dec(cpu, now);
+    if (cpu->msr & MSR_EE) {
+        if (__atomic_load_n(&queue->irq, __ATOMIC_ACQUIRE) & EVENTS_IRQ_EXTERNAL) {
+            deliver(cpu, mem, VECTOR_EXTERNAL);
+            queue->delivered++;
+        } else if (dec < 0) {
+            deliver(cpu, mem, VECTOR_DECREMENTER);
+            queue->delivered++;
+        }
+    }
+
+    // Up to the next timer, or the first instruction to see DEC negative
+    uint64_t slice = max_insns;
+    if (queue->n_events && queue->heap[0]->when - now < slice) {
+        slice = queue->heap[0]->when - now;
+    }
+    if (dec >= 0 && (uint64_t)dec + 1 < slice) slice = (uint64_t)dec + 1;
+    return slice;
+}
@@ -0,0 +1,88 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+// Timers and interrupts for one vCPU, in guest time: the instructions it
+// has retired (exec_state.icount). With a queue attached to its view,
+// cpu_run executes in slices that end at the next deadline, the earliest
+// timer or the decrementer going negative, and handles the queue between
+// them: due timers fire, then a pending interrupt is delivered if MSR[EE]
+// allows it. Inside a slice nothing is checked per instruction; the
+// deadline is only a shorter budget to the interpreter and translated
+// code.
+//
+// Other threads raise interrupt lines or ask cpu_run to return through
+// atomic flags here and MEMORY_PENDING_EVENTS in the view's pending word,
+// which the dispatcher and translated code already test at block entry.
+// The guest does the same when it changes what the queue decides on
+// (mtdec, MSR[EE]), so its next block boundary ends the slice.
+
+typedef struct event event_t;
+
+// Runs on the vCPU's thread between slices; it may schedule its event again
+typedef void (*event_fn_t)(ppc_cpu_state_t* cpu, memory_system_t* mem, event_t* event);
+
+// A timer. The caller owns it; the queue only keeps a pointer while it is
+// scheduled.
+struct event {
+    uint64_t when;      // icount it fires at
+    event_fn_t fn;
+    void* arg;
+    int32_t slot;       // Index in the heap, -1 while not scheduled
+};
+
+#define EVENTS_MAX  64
+
+// Interrupt lines, level-sensitive: raised until lowered. The decrementer
+// needs none; it interrupts while DEC is negative.
+#define EVENTS_IRQ_EXTERNAL (1U << 0)
+
+typedef struct event_queue {
+    memory_system_t* mem;
+    event_t* heap[EVENTS_MAX];  // Binary min-heap on when
+    unsigned n_events;
+    uint32_t irq;               // EVENTS_IRQ_* raised (any thread)
+    bool exit_requested;        // (any thread)
+    uint64_t delivered;         // Interrupts delivered
+} event_queue_t;
+
+// Attaches an empty queue to mem; cpu_run then runs in slices
+bool events_init(event_queue_t* queue, memory_system_t* mem);
+void events_destroy(event_queue_t* queue);
+
+static inline void event_init(event_t* event, event_fn_t fn, void* arg) {
+    event->when = 0;
+    event->fn = fn;
+    event->arg = arg;
+    event->slot = -1;
+}
+
+static inline bool event_scheduled(const event_t* event) {
+    return event->slot >= 0;
+}
+
+// (Re)schedules event to fire once icount reaches when (at once if it
+// already has). False if the queue is full. Only the vCPU's thread, or
+// any thread while it is not running, may schedule and cancel.
+bool events_schedule(event_queue_t* queue, event_t* event, uint64_t when);
+void events_cancel(event_queue_t* queue, event_t* event);
+
+// Any thread
+void events_raise(event_queue_t* queue, uint32_t lines);
+void events_lower(event_queue_t* queue, uint32_t lines);
+void events_request_exit(event_queue_t* queue);
+
+// Ends the running slice at the next block boundary
+static inline void events_kick(memory_system_t* mem) {
+    __atomic_fetch_or(&mem->pending, MEMORY_PENDING_EVENTS, __ATOMIC_RELEASE);
+}
+
+// cpu_run's work between slices: fires due events, delivers an interrupt
+// and returns how many of up to max_insns instructions may run before the
+// next deadline. An exit request sets exit_reason and returns 0.
+uint64_t events_run(event_queue_t* queue, ppc_cpu_state_t* cpu, uint64_t max_insns);
+
+#endif
@@ -0,0 +1,102 @@
+#include "fault.h"
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#define FAULT_MAX_RANGES 64
+
+// Ranges are published by their end address, so the signal handler can
+// walk the table without taking the lock
+typedef struct {
+    uintptr_t base;
+    uintptr_t end;              // 0 for a free slot
+    fault_handler_t handler;
+    void* ctx;
+} fault_range_t;
+
+static fault_range_t ranges[FAULT_MAX_RANGES];
+static pthread_mutex_t ranges_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool installed;
+static struct sigaction old_segv, old_bus;
+
+static _Thread_local sigjmp_buf* recovery;
+
+static void fault_signal(int sig, siginfo_t* info, void* uc) {
+    uintptr_t addr = (uintptr_t)info->si_addr;
+
+    for (int i = 0; i < FAULT_MAX_RANGES; i++) {
+        uintptr_t end = __atomic_load_n(&ranges[i].end, __ATOMIC_ACQUIRE);
+        if (!end || addr < ranges[i].base || addr >= end) continue;
+
+        switch (ranges[i].handler(ranges[i].ctx, info->si_addr)) {
+            case FAULT_RETRY:
+                return;
+            case FAULT_RECOVER:
+                if (recovery) siglongjmp(*recovery, FAULT_UNWIND_HOST);
+                break;
+            case FAULT_UNHANDLED:
+                break;
+        }
+        break;
+    }
+
+    // Not ours: hand over to whatever was installed before
+    const struct sigaction* old = sig == SIGBUS ? &old_bus : &old_segv;
+    if (old->sa_flags & SA_SIGINFO) {
+        old->sa_sigaction(sig, info, uc);
+    } else if (old->sa_handler != SIG_IGN && old->sa_handler != SIG_DFL) {
+        old->sa_handler(sig);
+    } else {
+        // Returning re-runs the access, which now takes the default action
+        signal(sig, SIG_DFL);
+    }
+}
+
+static void install_handler(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = fault_signal;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &old_segv);
+    sigaction(SIGBUS, &sa, &old_bus);
+    installed = true;
+}
+
+bool fault_register(void* base, size_t size, fault_handler_t handler, void* ctx) {
+    bool ok = false;
+    pthread_mutex_lock(&ranges_lock);
+    if (!installed) install_handler();
+    for (int i = 0; i < FAULT_MAX_RANGES; i++) {
+        if (ranges[i].end) continue;
+        ranges[i].base = (uintptr_t)base;
+        ranges[i].handler = handler;
+        ranges[i].ctx = ctx;
+        __atomic_store_n(&ranges[i].end, (uintptr_t)base + size, __ATOMIC_RELEASE);
+        ok = true;
+        break;
+    }
+    pthread_mutex_unlock(&ranges_lock);
+    return ok;
+}
+
+void fault_unregister(void* base) {
+    pthread_mutex_lock(&ranges_lock);
+    for (int i = 0; i < FAULT_MAX_RANGES; i++) {
+        if (ranges[i].end && ranges[i].base == (uintptr_t)base) {
+            __atomic_store_n(&ranges[i].end, 0, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&ranges_lock);
+}
+
+sigjmp_buf* fault_set_recovery(sigjmp_buf* env) {
+    sigjmp_buf* old = recovery;
+    recovery = env;
+    return old;
+}
+
+void fault_unwind(int code) {
+    if (recovery) siglongjmp(*recovery, code);
+}
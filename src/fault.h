@@ -0,0 +1,32 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+// Host memory faults (SIGSEGV/SIGBUS) inside registered ranges are routed
+// to the range's handler instead of killing the process
+typedef enum {
+    FAULT_UNHANDLED = 0,    // Not ours; take the default action
+    FAULT_RETRY,            // Fixed up; re-execute the faulting access
+    FAULT_RECOVER,          // Unwind to the thread's recovery point
+} fault_action_t;
+
+typedef fault_action_t (*fault_handler_t)(void* ctx, void* addr);
+
+bool fault_register(void* base, size_t size, fault_handler_t handler, void* ctx);
+void fault_unregister(void* base);
+
+// Recovery point for FAULT_RECOVER on the calling thread (NULL to disarm).
+// Returns the previous one so calls can nest.
+sigjmp_buf* fault_set_recovery(sigjmp_buf* env);
+
+// Values sigsetjmp returns at a recovery point
+#define FAULT_UNWIND_HOST   1   // FAULT_RECOVER from a host fault
+#define FAULT_UNWIND_GUEST  2   // Guest access refused by translation
+
+// Unwinds to the recovery point with code; returns if none is armed
+void fault_unwind(int code);
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <immintrin.h>
+#include <string.h>
+#include "cpu.h"
+
+// Floating point runs on the host FPU (SSE2 scalar doubles). Rather than
+// working out FPSCR after every instruction, the guest's exception bits
+// collect in the host MXCSR flags while cpu_run executes, with MXCSR set
+// up for the guest's rounding mode. fp_sync folds them into FPSCR when
+// something reads it (mffs, mcrfs, record forms) and when cpu_run returns.
+// FPRF is kept as the last result and classified on the same occasions.
+//
+// The host does not say which kind of invalid operation it saw, so those
+// found in MXCSR set VXSOFT. Instructions that know their class (the
+// integer conversions) set it directly. FR and FI are not tracked.
+//
+// Instructions check FPSCR[FEX] after every operation only while an
+// enabled exception can actually interrupt (MSR[FE0|FE1] and an FPSCR
+// enable bit both set), which is what lazy.fp_precise caches.
+
+#define MXCSR_IE        (1U << 0)
+#define MXCSR_ZE        (1U << 2)
+#define MXCSR_OE        (1U << 3)
+#define MXCSR_UE        (1U << 4)
+#define MXCSR_PE        (1U << 5)
+#define MXCSR_FLAGS     0x3FU
+#define MXCSR_MASKED    0x1F80U     // Every exception masked
+#define MXCSR_RC_SHIFT  13
+
+// Recomputes VX and FEX, which are summaries of the other bits
+static inline uint32_t fpscr_summarize(uint32_t fpscr) {
+    fpscr &= ~(FPSCR_VX | FPSCR_FEX);
+    if (fpscr & FPSCR_VX_ALL) fpscr |= FPSCR_VX;
+    // Each enable sits 22 bits below its exception bit
+    if ((fpscr >> 22) & fpscr & FPSCR_ENABLES) fpscr |= FPSCR_FEX;
+    return fpscr;
+}
+
+// Sets exception bits; FX records any that were clear
+static inline void fp_raise(ppc_cpu_state_t* cpu, uint32_t bits) {
+    uint32_t fpscr = cpu->fpscr;
+    if (bits & ~fpscr) fpscr |= FPSCR_FX;
+    cpu->fpscr = fpscr_summarize(fpscr | bits);
+}
+
+// MXCSR for the guest: all exceptions masked, no flags, RN mapped onto
+// RC (PowerPC orders the directed modes zero, +inf, -inf; SSE down, up,
+// zero)
+static inline uint32_t fp_guest_mxcsr(uint32_t fpscr) {
+    static const uint8_t rc[4] = {0, 3, 2, 1};
+    return MXCSR_MASKED | ((uint32_t)rc[fpscr & FPSCR_RN] << MXCSR_RC_SHIFT);
+}
+
+// Moves MXCSR flags raised since the last call into FPSCR
+static inline void fp_sync(ppc_cpu_state_t* cpu) {
+    uint32_t csr = _mm_getcsr();
+    uint32_t flags = csr & MXCSR_FLAGS;
+    if (!flags) return;
+    _mm_setcsr(csr & ~MXCSR_FLAGS);
+
+    uint32_t bits = 0;
+    if (flags & MXCSR_IE) bits |= FPSCR_VXSOFT;
+    if (flags & MXCSR_ZE) bits |= FPSCR_ZX;
+    if (flags & MXCSR_OE) bits |= FPSCR_OX;
+    if (flags & MXCSR_UE) bits |= FPSCR_UX;
+    if (flags & MXCSR_PE) bits |= FPSCR_XX;
+    if (bits) fp_raise(cpu, bits);
+}
+
+// FPRF for a result: class bit, then FL FG FE FU
+static inline uint32_t fp_classify(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bool neg = bits >> 63;
+    uint64_t exp = (bits >> 52) & 0x7FF;
+    uint64_t frac = bits & ((1ULL << 52) - 1);
+
+    if (exp == 0x7FF) {
+        if (frac) return 0x11;                  // QNaN
+        return neg ? 0x09 : 0x05;               // -inf, +inf
+    }
+    if (exp == 0) {
+        if (!frac) return neg ? 0x12 : 0x02;    // -0, +0
+        return neg ? 0x18 : 0x14;               // Denormals
+    }
+    return neg ? 0x08 : 0x04;                   // Normals
+}
+
+// Records the result that FPRF describes
+static inline void fp_set_fprf(ppc_cpu_state_t* cpu, double result) {
+    cpu->lazy.fprf_result = result;
+    cpu->lazy.fprf_pending = true;
+}
+
+static inline void fp_settle_fprf(ppc_cpu_state_t* cpu) {
+    if (!cpu->lazy.fprf_pending) return;
+    cpu->fpscr = (cpu->fpscr & ~FPSCR_FPRF) | (fp_classify(cpu->lazy.fprf_result) << 12);
+    cpu->lazy.fprf_pending = false;
+}
+
+// FPSCR as the guest sees it; only valid inside cpu_run, where MXCSR
+// holds the guest's flags
+static inline uint32_t fp_read_fpscr(ppc_cpu_state_t* cpu) {
+    fp_sync(cpu);
+    fp_settle_fprf(cpu);
+    return cpu->fpscr;
+}
+
+static inline void fp_update_mode(ppc_cpu_state_t* cpu) {
+    cpu->lazy.fp_precise = (cpu->msr & (MSR_FE0 | MSR_FE1)) &&
+                           (cpu->fpscr & FPSCR_ENABLES);
+}
+
+// Replaces FPSCR (after fp_read_fpscr) and reloads the rounding mode
+static inline void fp_write_fpscr(ppc_cpu_state_t* cpu, uint32_t fpscr) {
+    cpu->fpscr = fpscr_summarize(fpscr);
+    _mm_setcsr(fp_guest_mxcsr(cpu->fpscr));
+    fp_update_mode(cpu);
+}
+
+// Whether an enabled exception is waiting to interrupt
+static inline bool fp_trap_pending(ppc_cpu_state_t* cpu) {
+    if (!cpu->lazy.fp_precise) return false;
+    fp_sync(cpu);
+    return cpu->fpscr & FPSCR_FEX;
+}
+
+// Around cpu_run: switch MXCSR to the guest's and back, keeping the flags
+static inline uint32_t fp_enter(ppc_cpu_state_t* cpu) {
+    uint32_t host = _mm_getcsr();
+    _mm_setcsr(fp_guest_mxcsr(cpu->fpscr));
+    fp_update_mode(cpu);
+    return host;
+}
+
+static inline void fp_leave(ppc_cpu_state_t* cpu, uint32_t host) {
+    fp_sync(cpu);
+    fp_settle_fprf(cpu);
+    _mm_setcsr(host);
+}
+
+// By the bits, so that no host compare raises invalid for an SNaN
+static inline bool fp_is_nan(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits << 1) > 0xFFE0000000000000ULL;
+}
+
+static inline bool fp_is_snan(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7FF8000000000000ULL) == 0x7FF0000000000000ULL && (bits << 13);
+}
+
+// Host NaNs differ from PowerPC's: the default NaN is positive, and the
+// first NaN operand in instruction order wins. x, y, z are the operands
+// in that order (repeated when there are fewer).
+static inline double fp_nan_result(double x, double y, double z) {
+    uint64_t bits;
+    if (x != x) {
+        memcpy(&bits, &x, sizeof(bits));
+    } else if (y != y) {
+        memcpy(&bits, &y, sizeof(bits));
+    } else if (z != z) {
+        memcpy(&bits, &z, sizeof(bits));
+    } else {
+        bits = 0x7FF8000000000000ULL;
+    }
+    bits |= 1ULL << 51;     // Quiet
+    double r;
+    memcpy(&r, &bits, sizeof(r));
+    return r;
+}
+
+// Single-precision storage format. lfs expands and stfs truncates bit
+// patterns without rounding or raising anything, which the host's
+// conversions would do.
+static inline double fp_single_to_double(uint32_t word) {
+    if ((word & 0x7F800000) != 0x7F800000) {
+        float f;
+        memcpy(&f, &word, sizeof(f));
+        return f;   // Exact
+    }
+    // Infinities and NaNs keep their payload, signalling or not
+    uint64_t bits = ((uint64_t)(word & 0x80000000) << 32) | (0x7FFULL << 52) |
+                    ((uint64_t)(word & 0x7FFFFF) << 29);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline uint32_t fp_double_to_single(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned exp = (bits >> 52) & 0x7FF;
+    uint32_t sign = (uint32_t)(bits >> 32) & 0x80000000;
+
+    if (exp > 896 || !(bits << 1)) {
+        return (uint32_t)((bits >> 32) & 0xC0000000) | (uint32_t)((bits >> 29) & 0x3FFFFFFF);
+    }
+    if (exp >= 874) {
+        // Denormal in single precision
+        uint64_t frac = (1ULL << 52) | (bits & ((1ULL << 52) - 1));
+        return sign | (uint32_t)(frac >> (926 - exp));
+    }
+    return sign;    // Too small for single; undefined, stored as zero
+}
+
+#endif
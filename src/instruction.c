@@ -1,291 +1,662 @@
 #include "instruction.h"
+#include "cpu.h"
+#include <immintrin.h>
 #include <string.h>
 
 // Fast decode table for primary opcodes
 static const decode_entry_t primary_decode_table[] = {
+    // v3.1 prefix; the suffix that follows decodes on its own
+    {0xFC000000, 0x04000000, PPC_FMT_PREFIX, PPC_INST_PREFIX, "prefix"},
+
     // D-form instructions
-    {0xFC000000, 0x0C000000, PPC_FMT_D,  "twi"},
-    {0xFC000000, 0x1C000000, PPC_FMT_D,  "mulli"},
-    {0xFC000000, 0x20000000, PPC_FMT_D,  "subfic"},
-    {0xFC000000, 0x28000000, PPC_FMT_D,  "cmpli"},
-    {0xFC000000, 0x2C000000, PPC_FMT_D,  "cmpi"},
-    {0xFC000000, 0x30000000, PPC_FMT_D,  "addic"},
-    {0xFC000000, 0x34000000, PPC_FMT_D,  "addic."},
-    {0xFC000000, 0x38000000, PPC_FMT_D,  "addi"},
-    {0xFC000000, 0x3C000000, PPC_FMT_D,  "addis"},
+    {0xFC000000, 0x08000000, PPC_FMT_D, PPC_INST_TDI, "tdi"},
+    {0xFC000000, 0x0C000000, PPC_FMT_D, PPC_INST_TWI, "twi"},
+    {0xFC000000, 0x1C000000, PPC_FMT_D, PPC_INST_MULLI, "mulli"},
+    {0xFC000000, 0x20000000, PPC_FMT_D, PPC_INST_SUBFIC, "subfic"},
+    {0xFC000000, 0x28000000, PPC_FMT_D, PPC_INST_CMPLI, "cmpli"},
+    {0xFC000000, 0x2C000000, PPC_FMT_D, PPC_INST_CMPI, "cmpi"},
+    {0xFC000000, 0x30000000, PPC_FMT_D, PPC_INST_ADDIC, "addic"},
+    {0xFC000000, 0x34000000, PPC_FMT_D, PPC_INST_ADDIC_DOT, "addic."},
+    {0xFC000000, 0x38000000, PPC_FMT_D, PPC_INST_ADDI, "addi"},
+    {0xFC000000, 0x3C000000, PPC_FMT_D, PPC_INST_ADDIS, "addis"},
     
     // Branch instructions
-    {0xFC000000, 0x40000000, PPC_FMT_B,  "bc"},
-    {0xFC000000, 0x44000000, PPC_FMT_SC, "sc"},
-    {0xFC000000, 0x48000000, PPC_FMT_I,  "b"},
+    {0xFC000000, 0x40000000, PPC_FMT_B, PPC_INST_BC, "bc"},
+    {0xFC000000, 0x44000000, PPC_FMT_SC, PPC_INST_SC, "sc"},
+    {0xFC000000, 0x48000000, PPC_FMT_I, PPC_INST_B, "b"},
     
     // M-form rotate instructions
-    {0xFC000000, 0x50000000, PPC_FMT_M,  "rlwimi"},
-    {0xFC000000, 0x54000000, PPC_FMT_M,  "rlwinm"},
-    {0xFC000000, 0x5C000000, PPC_FMT_M,  "rlwnm"},
+    {0xFC000000, 0x50000000, PPC_FMT_M, PPC_INST_RLWIMI, "rlwimi"},
+    {0xFC000000, 0x54000000, PPC_FMT_M, PPC_INST_RLWINM, "rlwinm"},
+    {0xFC000000, 0x5C000000, PPC_FMT_M, PPC_INST_RLWNM, "rlwnm"},
     
     // More D-form
-    {0xFC000000, 0x60000000, PPC_FMT_D,  "ori"},
-    {0xFC000000, 0x64000000, PPC_FMT_D,  "oris"},
-    {0xFC000000, 0x68000000, PPC_FMT_D,  "xori"},
-    {0xFC000000, 0x6C000000, PPC_FMT_D,  "xoris"},
-    {0xFC000000, 0x70000000, PPC_FMT_D,  "andi."},
-    {0xFC000000, 0x74000000, PPC_FMT_D,  "andis."},
+    {0xFC000000, 0x60000000, PPC_FMT_D, PPC_INST_ORI, "ori"},
+    {0xFC000000, 0x64000000, PPC_FMT_D, PPC_INST_ORIS, "oris"},
+    {0xFC000000, 0x68000000, PPC_FMT_D, PPC_INST_XORI, "xori"},
+    {0xFC000000, 0x6C000000, PPC_FMT_D, PPC_INST_XORIS, "xoris"},
+    {0xFC000000, 0x70000000, PPC_FMT_D, PPC_INST_ANDI_DOT, "andi."},
+    {0xFC000000, 0x74000000, PPC_FMT_D, PPC_INST_ANDIS_DOT, "andis."},
     
     // Load/Store instructions
-    {0xFC000000, 0x80000000, PPC_FMT_D,  "lwz"},
-    {0xFC000000, 0x84000000, PPC_FMT_D,  "lwzu"},
-    {0xFC000000, 0x88000000, PPC_FMT_D,  "lbz"},
-    {0xFC000000, 0x8C000000, PPC_FMT_D,  "lbzu"},
-    {0xFC000000, 0x90000000, PPC_FMT_D,  "stw"},
-    {0xFC000000, 0x94000000, PPC_FMT_D,  "stwu"},
-    {0xFC000000, 0x98000000, PPC_FMT_D,  "stb"},
-    {0xFC000000, 0x9C000000, PPC_FMT_D,  "stbu"},
-    {0xFC000000, 0xA0000000, PPC_FMT_D,  "lhz"},
-    {0xFC000000, 0xA4000000, PPC_FMT_D,  "lhzu"},
-    {0xFC000000, 0xA8000000, PPC_FMT_D,  "lha"},
-    {0xFC000000, 0xAC000000, PPC_FMT_D,  "lhau"},
-    {0xFC000000, 0xB0000000, PPC_FMT_D,  "sth"},
-    {0xFC000000, 0xB4000000, PPC_FMT_D,  "sthu"},
-    {0xFC000000, 0xB8000000, PPC_FMT_D,  "lmw"},
-    {0xFC000000, 0xBC000000, PPC_FMT_D,  "stmw"},
+    {0xFC000000, 0x80000000, PPC_FMT_D, PPC_INST_LWZ, "lwz"},
+    {0xFC000000, 0x84000000, PPC_FMT_D, PPC_INST_LWZU, "lwzu"},
+    {0xFC000000, 0x88000000, PPC_FMT_D, PPC_INST_LBZ, "lbz"},
+    {0xFC000000, 0x8C000000, PPC_FMT_D, PPC_INST_LBZU, "lbzu"},
+    {0xFC000000, 0x90000000, PPC_FMT_D, PPC_INST_STW, "stw"},
+    {0xFC000000, 0x94000000, PPC_FMT_D, PPC_INST_STWU, "stwu"},
+    {0xFC000000, 0x98000000, PPC_FMT_D, PPC_INST_STB, "stb"},
+    {0xFC000000, 0x9C000000, PPC_FMT_D, PPC_INST_STBU, "stbu"},
+    {0xFC000000, 0xA0000000, PPC_FMT_D, PPC_INST_LHZ, "lhz"},
+    {0xFC000000, 0xA4000000, PPC_FMT_D, PPC_INST_LHZU, "lhzu"},
+    {0xFC000000, 0xA8000000, PPC_FMT_D, PPC_INST_LHA, "lha"},
+    {0xFC000000, 0xAC000000, PPC_FMT_D, PPC_INST_LHAU, "lhau"},
+    {0xFC000000, 0xB0000000, PPC_FMT_D, PPC_INST_STH, "sth"},
+    {0xFC000000, 0xB4000000, PPC_FMT_D, PPC_INST_STHU, "sthu"},
+    {0xFC000000, 0xB8000000, PPC_FMT_D, PPC_INST_LMW, "lmw"},
+    {0xFC000000, 0xBC000000, PPC_FMT_D, PPC_INST_STMW, "stmw"},
     
     // Floating point
-    {0xFC000000, 0xC0000000, PPC_FMT_D,  "lfs"},
-    {0xFC000000, 0xC4000000, PPC_FMT_D,  "lfsu"},
-    {0xFC000000, 0xC8000000, PPC_FMT_D,  "lfd"},
-    {0xFC000000, 0xCC000000, PPC_FMT_D,  "lfdu"},
-    {0xFC000000, 0xD0000000, PPC_FMT_D,  "stfs"},
-    {0xFC000000, 0xD4000000, PPC_FMT_D,  "stfsu"},
-    {0xFC000000, 0xD8000000, PPC_FMT_D,  "stfd"},
-    {0xFC000000, 0xDC000000, PPC_FMT_D,  "stfdu"},
+    {0xFC000000, 0xC0000000, PPC_FMT_D, PPC_INST_LFS, "lfs"},
+    {0xFC000000, 0xC4000000, PPC_FMT_D, PPC_INST_LFSU, "lfsu"},
+    {0xFC000000, 0xC8000000, PPC_FMT_D, PPC_INST_LFD, "lfd"},
+    {0xFC000000, 0xCC000000, PPC_FMT_D, PPC_INST_LFDU, "lfdu"},
+    {0xFC000000, 0xD0000000, PPC_FMT_D, PPC_INST_STFS, "stfs"},
+    {0xFC000000, 0xD4000000, PPC_FMT_D, PPC_INST_STFSU, "stfsu"},
+    {0xFC000000, 0xD8000000, PPC_FMT_D, PPC_INST_STFD, "stfd"},
+    {0xFC000000, 0xDC000000, PPC_FMT_D, PPC_INST_STFDU, "stfdu"},
     
-    {0, 0, PPC_FMT_UNKNOWN, NULL}
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
 };
 
 // X-form extended opcodes (opcode 31)
 static const decode_entry_t x_form_decode_table[] = {
     // Arithmetic
-    {0xFC0007FE, 0x7C000214, PPC_FMT_X, "add"},
-    {0xFC0007FE, 0x7C000014, PPC_FMT_X, "addc"},
-    {0xFC0007FE, 0x7C000114, PPC_FMT_X, "adde"},
-    {0xFC0007FE, 0x7C000194, PPC_FMT_X, "addze"},
-    {0xFC0007FE, 0x7C0001D4, PPC_FMT_X, "addme"},
-    {0xFC0007FE, 0x7C000050, PPC_FMT_X, "subf"},
-    {0xFC0007FE, 0x7C000010, PPC_FMT_X, "subfc"},
-    {0xFC0007FE, 0x7C000110, PPC_FMT_X, "subfe"},
-    {0xFC0007FE, 0x7C000190, PPC_FMT_X, "subfze"},
-    {0xFC0007FE, 0x7C0001D0, PPC_FMT_X, "subfme"},
-    {0xFC0007FE, 0x7C000034, PPC_FMT_X, "cntlzw"},
+    {0xFC0003FE, 0x7C000214, PPC_FMT_X, PPC_INST_ADD, "add"},
+    {0xFC0003FE, 0x7C000014, PPC_FMT_X, PPC_INST_ADDC, "addc"},
+    {0xFC0003FE, 0x7C000114, PPC_FMT_X, PPC_INST_ADDE, "adde"},
+    {0xFC0003FE, 0x7C000194, PPC_FMT_X, PPC_INST_ADDZE, "addze"},
+    {0xFC0003FE, 0x7C0001D4, PPC_FMT_X, PPC_INST_ADDME, "addme"},
+    {0xFC0003FE, 0x7C000050, PPC_FMT_X, PPC_INST_SUBF, "subf"},
+    {0xFC0003FE, 0x7C000010, PPC_FMT_X, PPC_INST_SUBFC, "subfc"},
+    {0xFC0003FE, 0x7C000110, PPC_FMT_X, PPC_INST_SUBFE, "subfe"},
+    {0xFC0003FE, 0x7C000190, PPC_FMT_X, PPC_INST_SUBFZE, "subfze"},
+    {0xFC0003FE, 0x7C0001D0, PPC_FMT_X, PPC_INST_SUBFME, "subfme"},
+    {0xFC0007FE, 0x7C000034, PPC_FMT_X, PPC_INST_CNTLZW, "cntlzw"},
+    {0xFC0007FE, 0x7C000074, PPC_FMT_X, PPC_INST_CNTLZD, "cntlzd"},
+    {0xFC0003FE, 0x7C0000D0, PPC_FMT_X, PPC_INST_NEG, "neg"},
+    {0xFC0007FE, 0x7C000774, PPC_FMT_X, PPC_INST_EXTSB, "extsb"},
+    {0xFC0007FE, 0x7C000734, PPC_FMT_X, PPC_INST_EXTSH, "extsh"},
+    {0xFC0007FE, 0x7C0007B4, PPC_FMT_X, PPC_INST_EXTSW, "extsw"},
     
     // Logical
-    {0xFC0007FE, 0x7C000038, PPC_FMT_X, "and"},
-    {0xFC0007FE, 0x7C000078, PPC_FMT_X, "andc"},
-    {0xFC0007FE, 0x7C000378, PPC_FMT_X, "or"},
-    {0xFC0007FE, 0x7C000338, PPC_FMT_X, "orc"},
-    {0xFC0007FE, 0x7C000278, PPC_FMT_X, "xor"},
-    {0xFC0007FE, 0x7C0000F8, PPC_FMT_X, "nor"},
-    {0xFC0007FE, 0x7C000238, PPC_FMT_X, "eqv"},
-    {0xFC0007FE, 0x7C0003B8, PPC_FMT_X, "nand"},
+    {0xFC0007FE, 0x7C000038, PPC_FMT_X, PPC_INST_AND, "and"},
+    {0xFC0007FE, 0x7C000078, PPC_FMT_X, PPC_INST_ANDC, "andc"},
+    {0xFC0007FE, 0x7C000378, PPC_FMT_X, PPC_INST_OR, "or"},
+    {0xFC0007FE, 0x7C000338, PPC_FMT_X, PPC_INST_ORC, "orc"},
+    {0xFC0007FE, 0x7C000278, PPC_FMT_X, PPC_INST_XOR, "xor"},
+    {0xFC0007FE, 0x7C0000F8, PPC_FMT_X, PPC_INST_NOR, "nor"},
+    {0xFC0007FE, 0x7C000238, PPC_FMT_X, PPC_INST_EQV, "eqv"},
+    {0xFC0007FE, 0x7C0003B8, PPC_FMT_X, PPC_INST_NAND, "nand"},
     
     // Shifts
-    {0xFC0007FE, 0x7C000030, PPC_FMT_X, "slw"},
-    {0xFC0007FE, 0x7C000430, PPC_FMT_X, "srw"},
-    {0xFC0007FE, 0x7C000630, PPC_FMT_X, "sraw"},
-    {0xFC0007FE, 0x7C000670, PPC_FMT_X, "srawi"},
+    {0xFC0007FE, 0x7C000030, PPC_FMT_X, PPC_INST_SLW, "slw"},
+    {0xFC0007FE, 0x7C000430, PPC_FMT_X, PPC_INST_SRW, "srw"},
+    {0xFC0007FE, 0x7C000630, PPC_FMT_X, PPC_INST_SRAW, "sraw"},
+    {0xFC0007FE, 0x7C000670, PPC_FMT_X, PPC_INST_SRAWI, "srawi"},
+    {0xFC0007FE, 0x7C000036, PPC_FMT_X, PPC_INST_SLD, "sld"},
+    {0xFC0007FE, 0x7C000436, PPC_FMT_X, PPC_INST_SRD, "srd"},
+    {0xFC0007FE, 0x7C000634, PPC_FMT_X, PPC_INST_SRAD, "srad"},
+    {0xFC0007FC, 0x7C000674, PPC_FMT_X, PPC_INST_SRADI, "sradi"},
     
     // Multiply/Divide
-    {0xFC0007FE, 0x7C0002D6, PPC_FMT_X, "mulhw"},
-    {0xFC0007FE, 0x7C000296, PPC_FMT_X, "mulhwu"},
-    {0xFC0007FE, 0x7C0001D6, PPC_FMT_X, "mullw"},
-    {0xFC0007FE, 0x7C0003D6, PPC_FMT_X, "divw"},
-    {0xFC0007FE, 0x7C000396, PPC_FMT_X, "divwu"},
+    {0xFC0007FE, 0x7C000096, PPC_FMT_X, PPC_INST_MULHW, "mulhw"},
+    {0xFC0007FE, 0x7C000016, PPC_FMT_X, PPC_INST_MULHWU, "mulhwu"},
+    {0xFC0003FE, 0x7C0001D6, PPC_FMT_X, PPC_INST_MULLW, "mullw"},
+    {0xFC0003FE, 0x7C0003D6, PPC_FMT_X, PPC_INST_DIVW, "divw"},
+    {0xFC0003FE, 0x7C000396, PPC_FMT_X, PPC_INST_DIVWU, "divwu"},
+    {0xFC0007FE, 0x7C000092, PPC_FMT_X, PPC_INST_MULHD, "mulhd"},
+    {0xFC0007FE, 0x7C000012, PPC_FMT_X, PPC_INST_MULHDU, "mulhdu"},
+    {0xFC0003FE, 0x7C0001D2, PPC_FMT_X, PPC_INST_MULLD, "mulld"},
+    {0xFC0003FE, 0x7C0003D2, PPC_FMT_X, PPC_INST_DIVD, "divd"},
+    {0xFC0003FE, 0x7C000392, PPC_FMT_X, PPC_INST_DIVDU, "divdu"},
     
     // Compare
-    {0xFC0007FE, 0x7C000000, PPC_FMT_X, "cmp"},
-    {0xFC0007FE, 0x7C000040, PPC_FMT_X, "cmpl"},
+    {0xFC0007FE, 0x7C000000, PPC_FMT_X, PPC_INST_CMP, "cmp"},
+    {0xFC0007FE, 0x7C000040, PPC_FMT_X, PPC_INST_CMPL, "cmpl"},
+
+    // Trap
+    {0xFC0007FE, 0x7C000008, PPC_FMT_X, PPC_INST_TW, "tw"},
+    {0xFC0007FE, 0x7C000088, PPC_FMT_X, PPC_INST_TD, "td"},
     
     // Load/Store indexed
-    {0xFC0007FE, 0x7C00002E, PPC_FMT_X, "lwzx"},
-    {0xFC0007FE, 0x7C00006E, PPC_FMT_X, "lwzux"},
-    {0xFC0007FE, 0x7C0000AE, PPC_FMT_X, "lbzx"},
-    {0xFC0007FE, 0x7C0000EE, PPC_FMT_X, "lbzux"},
-    {0xFC0007FE, 0x7C00012E, PPC_FMT_X, "stwx"},
-    {0xFC0007FE, 0x7C00016E, PPC_FMT_X, "stwux"},
-    {0xFC0007FE, 0x7C0001AE, PPC_FMT_X, "stbx"},
-    {0xFC0007FE, 0x7C0001EE, PPC_FMT_X, "stbux"},
-    {0xFC0007FE, 0x7C00022E, PPC_FMT_X, "lhzx"},
-    {0xFC0007FE, 0x7C00026E, PPC_FMT_X, "lhzux"},
-    {0xFC0007FE, 0x7C0002AE, PPC_FMT_X, "lhax"},
-    {0xFC0007FE, 0x7C0002EE, PPC_FMT_X, "lhaux"},
-    {0xFC0007FE, 0x7C00032E, PPC_FMT_X, "sthx"},
-    {0xFC0007FE, 0x7C00036E, PPC_FMT_X, "sthux"},
+    {0xFC0007FE, 0x7C00002E, PPC_FMT_X, PPC_INST_LWZX, "lwzx"},
+    {0xFC0007FE, 0x7C00006E, PPC_FMT_X, PPC_INST_LWZUX, "lwzux"},
+    {0xFC0007FE, 0x7C0000AE, PPC_FMT_X, PPC_INST_LBZX, "lbzx"},
+    {0xFC0007FE, 0x7C0000EE, PPC_FMT_X, PPC_INST_LBZUX, "lbzux"},
+    {0xFC0007FE, 0x7C00012E, PPC_FMT_X, PPC_INST_STWX, "stwx"},
+    {0xFC0007FE, 0x7C00016E, PPC_FMT_X, PPC_INST_STWUX, "stwux"},
+    {0xFC0007FE, 0x7C0001AE, PPC_FMT_X, PPC_INST_STBX, "stbx"},
+    {0xFC0007FE, 0x7C0001EE, PPC_FMT_X, PPC_INST_STBUX, "stbux"},
+    {0xFC0007FE, 0x7C00022E, PPC_FMT_X, PPC_INST_LHZX, "lhzx"},
+    {0xFC0007FE, 0x7C00026E, PPC_FMT_X, PPC_INST_LHZUX, "lhzux"},
+    {0xFC0007FE, 0x7C0002AE, PPC_FMT_X, PPC_INST_LHAX, "lhax"},
+    {0xFC0007FE, 0x7C0002EE, PPC_FMT_X, PPC_INST_LHAUX, "lhaux"},
+    {0xFC0007FE, 0x7C00032E, PPC_FMT_X, PPC_INST_STHX, "sthx"},
+    {0xFC0007FE, 0x7C00036E, PPC_FMT_X, PPC_INST_STHUX, "sthux"},
+    {0xFC0007FE, 0x7C00002A, PPC_FMT_X, PPC_INST_LDX, "ldx"},
+    {0xFC0007FE, 0x7C00006A, PPC_FMT_X, PPC_INST_LDUX, "ldux"},
+    {0xFC0007FE, 0x7C0002AA, PPC_FMT_X, PPC_INST_LWAX, "lwax"},
+    {0xFC0007FE, 0x7C00012A, PPC_FMT_X, PPC_INST_STDX, "stdx"},
+    {0xFC0007FE, 0x7C00016A, PPC_FMT_X, PPC_INST_STDUX, "stdux"},
+
+    // Load and reserve, store conditional (always Rc=1)
+    {0xFC0007FE, 0x7C000068, PPC_FMT_X, PPC_INST_LBARX, "lbarx"},
+    {0xFC0007FE, 0x7C0000E8, PPC_FMT_X, PPC_INST_LHARX, "lharx"},
+    {0xFC0007FE, 0x7C000028, PPC_FMT_X, PPC_INST_LWARX, "lwarx"},
+    {0xFC0007FE, 0x7C0000A8, PPC_FMT_X, PPC_INST_LDARX, "ldarx"},
+    {0xFC0007FF, 0x7C00056D, PPC_FMT_X, PPC_INST_STBCX, "stbcx."},
+    {0xFC0007FF, 0x7C0005AD, PPC_FMT_X, PPC_INST_STHCX, "sthcx."},
+    {0xFC0007FF, 0x7C00012D, PPC_FMT_X, PPC_INST_STWCX, "stwcx."},
+    {0xFC0007FF, 0x7C0001AD, PPC_FMT_X, PPC_INST_STDCX, "stdcx."},
+
+    // Cache management (only dcbz has an architectural effect here)
+    {0xFC0007FE, 0x7C00006C, PPC_FMT_X, PPC_INST_DCBST, "dcbst"},
+    {0xFC0007FE, 0x7C0000AC, PPC_FMT_X, PPC_INST_DCBF, "dcbf"},
+    {0xFC0007FE, 0x7C00022C, PPC_FMT_X, PPC_INST_DCBT, "dcbt"},
+    {0xFC0007FE, 0x7C0001EC, PPC_FMT_X, PPC_INST_DCBTST, "dcbtst"},
+    {0xFC0007FE, 0x7C0007AC, PPC_FMT_X, PPC_INST_ICBI, "icbi"},
+    {0xFC0007FE, 0x7C0007EC, PPC_FMT_X, PPC_INST_DCBZ, "dcbz"},
+
+    // TLB management
+    {0xFC0007FE, 0x7C000264, PPC_FMT_X, PPC_INST_TLBIE, "tlbie"},
+    {0xFC0007FE, 0x7C000224, PPC_FMT_X, PPC_INST_TLBIEL, "tlbiel"},
+    {0xFC0007FE, 0x7C00046C, PPC_FMT_X, PPC_INST_TLBSYNC, "tlbsync"},
     
     // Special
-    {0xFC0007FE, 0x7C0004AC, PPC_FMT_X, "sync"},
-    {0xFC0007FE, 0x7C0000A6, PPC_FMT_X, "mfmsr"},
-    {0xFC0007FE, 0x7C000124, PPC_FMT_X, "mtmsr"},
+    {0xFC0007FE, 0x7C0004AC, PPC_FMT_X, PPC_INST_SYNC, "sync"},
+    {0xFC0007FE, 0x7C0000A6, PPC_FMT_X, PPC_INST_MFMSR, "mfmsr"},
+    {0xFC0007FE, 0x7C000124, PPC_FMT_X, PPC_INST_MTMSR, "mtmsr"},
+    {0xFC0007FE, 0x7C000164, PPC_FMT_X, PPC_INST_MTMSRD, "mtmsrd"},
     
-    {0, 0, PPC_FMT_UNKNOWN, NULL}
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
 };
 
 // XL-form opcodes (opcode 19)
 static const decode_entry_t xl_form_decode_table[] = {
-    {0xFC0007FE, 0x4C000020, PPC_FMT_XL, "bclr"},
-    {0xFC0007FE, 0x4C000420, PPC_FMT_XL, "bcctr"},
-    {0xFC0007FE, 0x4C000202, PPC_FMT_XL, "crand"},
-    {0xFC0007FE, 0x4C000102, PPC_FMT_XL, "crandc"},
-    {0xFC0007FE, 0x4C000242, PPC_FMT_XL, "creqv"},
-    {0xFC0007FE, 0x4C0001C2, PPC_FMT_XL, "crnand"},
-    {0xFC0007FE, 0x4C000042, PPC_FMT_XL, "crnor"},
-    {0xFC0007FE, 0x4C000382, PPC_FMT_XL, "cror"},
-    {0xFC0007FE, 0x4C000342, PPC_FMT_XL, "crorc"},
-    {0xFC0007FE, 0x4C000282, PPC_FMT_XL, "crxor"},
-    {0xFC0007FE, 0x4C000000, PPC_FMT_XL, "mcrf"},
-    {0, 0, PPC_FMT_UNKNOWN, NULL}
+    {0xFC0007FE, 0x4C000020, PPC_FMT_XL, PPC_INST_BCLR, "bclr"},
+    {0xFC0007FE, 0x4C000420, PPC_FMT_XL, PPC_INST_BCCTR, "bcctr"},
+    {0xFC0007FE, 0x4C000202, PPC_FMT_XL, PPC_INST_CRAND, "crand"},
+    {0xFC0007FE, 0x4C000102, PPC_FMT_XL, PPC_INST_CRANDC, "crandc"},
+    {0xFC0007FE, 0x4C000242, PPC_FMT_XL, PPC_INST_CREQV, "creqv"},
+    {0xFC0007FE, 0x4C0001C2, PPC_FMT_XL, PPC_INST_CRNAND, "crnand"},
+    {0xFC0007FE, 0x4C000042, PPC_FMT_XL, PPC_INST_CRNOR, "crnor"},
+    {0xFC0007FE, 0x4C000382, PPC_FMT_XL, PPC_INST_CROR, "cror"},
+    {0xFC0007FE, 0x4C000342, PPC_FMT_XL, PPC_INST_CRORC, "crorc"},
+    {0xFC0007FE, 0x4C000182, PPC_FMT_XL, PPC_INST_CRXOR, "crxor"},
+    {0xFC0007FE, 0x4C000000, PPC_FMT_XL, PPC_INST_MCRF, "mcrf"},
+    {0xFC0007FE, 0x4C00012C, PPC_FMT_XL, PPC_INST_ISYNC, "isync"},
+    {0xFC0007FE, 0x4C000024, PPC_FMT_XL, PPC_INST_RFID, "rfid"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
 };
 
 // XFX-form opcodes (opcode 31)
 static const decode_entry_t xfx_form_decode_table[] = {
-    {0xFC0007FE, 0x7C0002A6, PPC_FMT_XFX, "mfspr"},
-    {0xFC0007FE, 0x7C0003A6, PPC_FMT_XFX, "mtspr"},
-    {0xFC0007FE, 0x7C000026, PPC_FMT_XFX, "mfcr"},
-    {0xFC0007FE, 0x7C000120, PPC_FMT_XFX, "mtcrf"},
-    {0, 0, PPC_FMT_UNKNOWN, NULL}
+    {0xFC0007FE, 0x7C0002A6, PPC_FMT_XFX, PPC_INST_MFSPR, "mfspr"},
+    {0xFC0007FE, 0x7C0003A6, PPC_FMT_XFX, PPC_INST_MTSPR, "mtspr"},
+    {0xFC0007FE, 0x7C000026, PPC_FMT_XFX, PPC_INST_MFCR, "mfcr"},
+    {0xFC0007FE, 0x7C000120, PPC_FMT_XFX, PPC_INST_MTCRF, "mtcrf"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
 };
 
 // A-form floating point opcodes
 static const decode_entry_t a_form_decode_table[] = {
-    {0xFC00003E, 0xFC00002A, PPC_FMT_A, "fadd"},
-    {0xFC00003E, 0xFC000028, PPC_FMT_A, "fsub"},
-    {0xFC00003E, 0xFC000032, PPC_FMT_A, "fmul"},
-    {0xFC00003E, 0xFC000024, PPC_FMT_A, "fdiv"},
-    {0xFC00003E, 0xFC00002E, PPC_FMT_A, "fsel"},
-    {0xFC00003E, 0xFC00003A, PPC_FMT_A, "fmadd"},
-    {0xFC00003E, 0xFC000038, PPC_FMT_A, "fmsub"},
-    {0xFC00003E, 0xFC00003E, PPC_FMT_A, "fnmadd"},
-    {0xFC00003E, 0xFC00003C, PPC_FMT_A, "fnmsub"},
-    {0, 0, PPC_FMT_UNKNOWN, NULL}
+    {0xFC00003E, 0xFC00002A, PPC_FMT_A, PPC_INST_FADD, "fadd"},
+    {0xFC00003E, 0xFC000028, PPC_FMT_A, PPC_INST_FSUB, "fsub"},
+    {0xFC00003E, 0xFC000032, PPC_FMT_A, PPC_INST_FMUL, "fmul"},
+    {0xFC00003E, 0xFC000024, PPC_FMT_A, PPC_INST_FDIV, "fdiv"},
+    {0xFC00003E, 0xFC00002E, PPC_FMT_A, PPC_INST_FSEL, "fsel"},
+    {0xFC00003E, 0xFC00003A, PPC_FMT_A, PPC_INST_FMADD, "fmadd"},
+    {0xFC00003E, 0xFC000038, PPC_FMT_A, PPC_INST_FMSUB, "fmsub"},
+    {0xFC00003E, 0xFC00003E, PPC_FMT_A, PPC_INST_FNMADD, "fnmadd"},
+    {0xFC00003E, 0xFC00003C, PPC_FMT_A, PPC_INST_FNMSUB, "fnmsub"},
+    {0xFC00003E, 0xFC00002C, PPC_FMT_A, PPC_INST_FSQRT, "fsqrt"},
+    {0xFC00003E, 0xFC000030, PPC_FMT_A, PPC_INST_FRE, "fre"},
+    {0xFC00003E, 0xFC000034, PPC_FMT_A, PPC_INST_FRSQRTE, "frsqrte"},
+
+    // Single precision (opcode 59)
+    {0xFC00003E, 0xEC00002A, PPC_FMT_A, PPC_INST_FADDS, "fadds"},
+    {0xFC00003E, 0xEC000028, PPC_FMT_A, PPC_INST_FSUBS, "fsubs"},
+    {0xFC00003E, 0xEC000032, PPC_FMT_A, PPC_INST_FMULS, "fmuls"},
+    {0xFC00003E, 0xEC000024, PPC_FMT_A, PPC_INST_FDIVS, "fdivs"},
+    {0xFC00003E, 0xEC00003A, PPC_FMT_A, PPC_INST_FMADDS, "fmadds"},
+    {0xFC00003E, 0xEC000038, PPC_FMT_A, PPC_INST_FMSUBS, "fmsubs"},
+    {0xFC00003E, 0xEC00003E, PPC_FMT_A, PPC_INST_FNMADDS, "fnmadds"},
+    {0xFC00003E, 0xEC00003C, PPC_FMT_A, PPC_INST_FNMSUBS, "fnmsubs"},
+    {0xFC00003E, 0xEC00002C, PPC_FMT_A, PPC_INST_FSQRTS, "fsqrts"},
+    {0xFC00003E, 0xEC000030, PPC_FMT_A, PPC_INST_FRES, "fres"},
+    {0xFC00003E, 0xEC000034, PPC_FMT_A, PPC_INST_FRSQRTES, "frsqrtes"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
 };
 
-ppc_instruction_t decode_instruction(uint32_t raw_inst) {
-    ppc_instruction_t inst = {0};
-    inst.raw = raw_inst;
-    inst.opcode = INST_OPCODE(raw_inst);
-    // Try primary opcode table first
-    for (const decode_entry_t* entry = primary_decode_table; entry->mnemonic; entry++) {
-        if ((raw_inst & entry->mask) == entry->match) {
-            inst.fmt = entry->format;
-            break;
-        }
-    }
+// X-form floating point (opcodes 59 and 63). Their extended opcodes never
+// collide with the A-form ones above, which all have bit 4 of XO set.
+static const decode_entry_t fp_x_form_decode_table[] = {
+    {0xFC0007FE, 0xFC000000, PPC_FMT_X, PPC_INST_FCMPU, "fcmpu"},
+    {0xFC0007FE, 0xFC000040, PPC_FMT_X, PPC_INST_FCMPO, "fcmpo"},
+    {0xFC0007FE, 0xFC000018, PPC_FMT_X, PPC_INST_FRSP, "frsp"},
+    {0xFC0007FE, 0xFC00001C, PPC_FMT_X, PPC_INST_FCTIW, "fctiw"},
+    {0xFC0007FE, 0xFC00001E, PPC_FMT_X, PPC_INST_FCTIWZ, "fctiwz"},
+    {0xFC0007FE, 0xFC00065C, PPC_FMT_X, PPC_INST_FCTID, "fctid"},
+    {0xFC0007FE, 0xFC00065E, PPC_FMT_X, PPC_INST_FCTIDZ, "fctidz"},
+    {0xFC0007FE, 0xFC00069C, PPC_FMT_X, PPC_INST_FCFID, "fcfid"},
+    {0xFC0007FE, 0xFC00079C, PPC_FMT_X, PPC_INST_FCFIDU, "fcfidu"},
+    {0xFC0007FE, 0xEC00069C, PPC_FMT_X, PPC_INST_FCFIDS, "fcfids"},
+    {0xFC0007FE, 0xFC000090, PPC_FMT_X, PPC_INST_FMR, "fmr"},
+    {0xFC0007FE, 0xFC000050, PPC_FMT_X, PPC_INST_FNEG, "fneg"},
+    {0xFC0007FE, 0xFC000210, PPC_FMT_X, PPC_INST_FABS, "fabs"},
+    {0xFC0007FE, 0xFC000110, PPC_FMT_X, PPC_INST_FNABS, "fnabs"},
+    {0xFC0007FE, 0xFC000010, PPC_FMT_X, PPC_INST_FCPSGN, "fcpsgn"},
+    {0xFC0007FE, 0xFC00048E, PPC_FMT_X, PPC_INST_MFFS, "mffs"},
+    {0xFC0007FE, 0xFC00058E, PPC_FMT_XFL, PPC_INST_MTFSF, "mtfsf"},
+    {0xFC0007FE, 0xFC00010C, PPC_FMT_X, PPC_INST_MTFSFI, "mtfsfi"},
+    {0xFC0007FE, 0xFC00008C, PPC_FMT_X, PPC_INST_MTFSB0, "mtfsb0"},
+    {0xFC0007FE, 0xFC00004C, PPC_FMT_X, PPC_INST_MTFSB1, "mtfsb1"},
+    {0xFC0007FE, 0xFC000080, PPC_FMT_X, PPC_INST_MCRFS, "mcrfs"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
+};
 
-    switch (inst.opcode) {
-        case 0:   break; // Reserved
-        case 1:   break; // Reserved
-        case 2:   break; // tdi (64-bit)
-        case 3:   break; // twi (handled in primary table)
-        case 4:   break; // Vector/VMX instructions
-        case 5:   break; // Reserved
-        case 6:   break; // Reserved
-        case 7:   break; // mulli (handled in primary table)
-        case 8:   break; // subfic (handled in primary table)
-        case 9:   break; // Reserved
-        case 10:  break; // cmpli (handled in primary table)
-        case 11:  break; // cmpi (handled in primary table)
-        case 12:  break; // addic (handled in primary table)
-        case 13:  break; // addic. (handled in primary table)
-        case 14:  break; // addi (handled in primary table)
-        case 15:  break; // addis (handled in primary table)
-        case 16:  break; // bc (handled in primary table)
-        case 17:  break; // sc (handled in primary table)
-        case 18:  break; // b (handled in primary table)
-        case 19: {
-            inst.extended_op = INST_XO_XL(raw_inst);
-            for (const decode_entry_t* entry = xl_form_decode_table; entry->mnemonic; entry++) {
-                if ((raw_inst & entry->mask) == entry->match) {
-                    inst.fmt = entry->format;
-                    break;
-                }
-            }
-        } break;
-        case 20:  break; // rlwimi (handled in primary table)
-        case 21:  break; // rlwinm (handled in primary table)
-        case 22:  break; // Reserved
-        case 23:  break; // rlwnm (handled in primary table)
-        case 24:  break; // ori (handled in primary table)
-        case 25:  break; // oris (handled in primary table)
-        case 26:  break; // xori (handled in primary table)
-        case 27:  break; // xoris (handled in primary table)
-        case 28:  break; // andi. (handled in primary table)
-        case 29:  break; // andis. (handled in primary table)
-        case 30:  break; // 64-bit rotate instructions
-        case 31: {
-            inst.extended_op = INST_XO_X(raw_inst);
-            for (const decode_entry_t* entry = x_form_decode_table; entry->mnemonic; entry++) {
-                if ((raw_inst & entry->mask) == entry->match) {
-                    inst.fmt = entry->format;
-                    break;
-                }
-            }
-            // Try XFX-form if not found
-            if (inst.fmt == PPC_FMT_UNKNOWN) {
-                for (const decode_entry_t* entry = xfx_form_decode_table; entry->mnemonic; entry++) {
-                    if ((raw_inst & entry->mask) == entry->match) {
-                        inst.fmt = entry->format;
-                        break;
-                    }
+// MD-form 64-bit rotates (opcode 30)
+static const decode_entry_t md_form_decode_table[] = {
+    {0xFC00001C, 0x78000000, PPC_FMT_MD, PPC_INST_RLDICL, "rldicl"},
+    {0xFC00001C, 0x78000004, PPC_FMT_MD, PPC_INST_RLDICR, "rldicr"},
+    {0xFC00001C, 0x78000008, PPC_FMT_MD, PPC_INST_RLDIC, "rldic"},
+    {0xFC00001C, 0x7800000C, PPC_FMT_MD, PPC_INST_RLDIMI, "rldimi"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
+};
+
+// DS-form 64-bit load/store (opcodes 58 and 62)
+static const decode_entry_t ds_form_decode_table[] = {
+    {0xFC000003, 0xE8000000, PPC_FMT_DS, PPC_INST_LD, "ld"},
+    {0xFC000003, 0xE8000001, PPC_FMT_DS, PPC_INST_LDU, "ldu"},
+    {0xFC000003, 0xE8000002, PPC_FMT_DS, PPC_INST_LWA, "lwa"},
+    {0xFC000003, 0xF8000000, PPC_FMT_DS, PPC_INST_STD, "std"},
+    {0xFC000003, 0xF8000001, PPC_FMT_DS, PPC_INST_STDU, "stdu"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
+};
+
+// VX-form vector opcodes (opcode 4)
+static const decode_entry_t vx_form_decode_table[] = {
+    // Integer arithmetic
+    {0xFC0007FF, 0x10000000, PPC_FMT_VX, PPC_INST_VADDUBM, "vaddubm"},
+    {0xFC0007FF, 0x10000040, PPC_FMT_VX, PPC_INST_VADDUHM, "vadduhm"},
+    {0xFC0007FF, 0x10000080, PPC_FMT_VX, PPC_INST_VADDUWM, "vadduwm"},
+    {0xFC0007FF, 0x100000C0, PPC_FMT_VX, PPC_INST_VADDUDM, "vaddudm"},
+    {0xFC0007FF, 0x10000200, PPC_FMT_VX, PPC_INST_VADDUBS, "vaddubs"},
+    {0xFC0007FF, 0x10000240, PPC_FMT_VX, PPC_INST_VADDUHS, "vadduhs"},
+    {0xFC0007FF, 0x10000300, PPC_FMT_VX, PPC_INST_VADDSBS, "vaddsbs"},
+    {0xFC0007FF, 0x10000340, PPC_FMT_VX, PPC_INST_VADDSHS, "vaddshs"},
+    {0xFC0007FF, 0x10000400, PPC_FMT_VX, PPC_INST_VSUBUBM, "vsububm"},
+    {0xFC0007FF, 0x10000440, PPC_FMT_VX, PPC_INST_VSUBUHM, "vsubuhm"},
+    {0xFC0007FF, 0x10000480, PPC_FMT_VX, PPC_INST_VSUBUWM, "vsubuwm"},
+    {0xFC0007FF, 0x100004C0, PPC_FMT_VX, PPC_INST_VSUBUDM, "vsubudm"},
+    {0xFC0007FF, 0x10000600, PPC_FMT_VX, PPC_INST_VSUBUBS, "vsububs"},
+    {0xFC0007FF, 0x10000640, PPC_FMT_VX, PPC_INST_VSUBUHS, "vsubuhs"},
+    {0xFC0007FF, 0x10000700, PPC_FMT_VX, PPC_INST_VSUBSBS, "vsubsbs"},
+    {0xFC0007FF, 0x10000740, PPC_FMT_VX, PPC_INST_VSUBSHS, "vsubshs"},
+    {0xFC0007FF, 0x10000002, PPC_FMT_VX, PPC_INST_VMAXUB, "vmaxub"},
+    {0xFC0007FF, 0x10000042, PPC_FMT_VX, PPC_INST_VMAXUH, "vmaxuh"},
+    {0xFC0007FF, 0x10000082, PPC_FMT_VX, PPC_INST_VMAXUW, "vmaxuw"},
+    {0xFC0007FF, 0x10000102, PPC_FMT_VX, PPC_INST_VMAXSB, "vmaxsb"},
+    {0xFC0007FF, 0x10000142, PPC_FMT_VX, PPC_INST_VMAXSH, "vmaxsh"},
+    {0xFC0007FF, 0x10000182, PPC_FMT_VX, PPC_INST_VMAXSW, "vmaxsw"},
+    {0xFC0007FF, 0x10000202, PPC_FMT_VX, PPC_INST_VMINUB, "vminub"},
+    {0xFC0007FF, 0x10000242, PPC_FMT_VX, PPC_INST_VMINUH, "vminuh"},
+    {0xFC0007FF, 0x10000282, PPC_FMT_VX, PPC_INST_VMINUW, "vminuw"},
+    {0xFC0007FF, 0x10000302, PPC_FMT_VX, PPC_INST_VMINSB, "vminsb"},
+    {0xFC0007FF, 0x10000342, PPC_FMT_VX, PPC_INST_VMINSH, "vminsh"},
+    {0xFC0007FF, 0x10000382, PPC_FMT_VX, PPC_INST_VMINSW, "vminsw"},
+    {0xFC0007FF, 0x10000402, PPC_FMT_VX, PPC_INST_VAVGUB, "vavgub"},
+    {0xFC0007FF, 0x10000442, PPC_FMT_VX, PPC_INST_VAVGUH, "vavguh"},
+    {0xFC0007FF, 0x10000089, PPC_FMT_VX, PPC_INST_VMULUWM, "vmuluwm"},
+    {0xFC0007FF, 0x10000048, PPC_FMT_VX, PPC_INST_VMULOUH, "vmulouh"},
+    {0xFC0007FF, 0x10000148, PPC_FMT_VX, PPC_INST_VMULOSH, "vmulosh"},
+    {0xFC0007FF, 0x10000248, PPC_FMT_VX, PPC_INST_VMULEUH, "vmuleuh"},
+    {0xFC0007FF, 0x10000348, PPC_FMT_VX, PPC_INST_VMULESH, "vmulesh"},
+    {0xFC0007FF, 0x10000088, PPC_FMT_VX, PPC_INST_VMULOUW, "vmulouw"},
+    {0xFC0007FF, 0x10000188, PPC_FMT_VX, PPC_INST_VMULOSW, "vmulosw"},
+    {0xFC0007FF, 0x10000288, PPC_FMT_VX, PPC_INST_VMULEUW, "vmuleuw"},
+    {0xFC0007FF, 0x10000388, PPC_FMT_VX, PPC_INST_VMULESW, "vmulesw"},
+
+    // Shifts, rotates and logical
+    {0xFC0007FF, 0x10000084, PPC_FMT_VX, PPC_INST_VRLW, "vrlw"},
+    {0xFC0007FF, 0x10000184, PPC_FMT_VX, PPC_INST_VSLW, "vslw"},
+    {0xFC0007FF, 0x10000284, PPC_FMT_VX, PPC_INST_VSRW, "vsrw"},
+    {0xFC0007FF, 0x10000384, PPC_FMT_VX, PPC_INST_VSRAW, "vsraw"},
+    {0xFC0007FF, 0x100005C4, PPC_FMT_VX, PPC_INST_VSLD, "vsld"},
+    {0xFC0007FF, 0x100006C4, PPC_FMT_VX, PPC_INST_VSRD, "vsrd"},
+    {0xFC0007FF, 0x10000404, PPC_FMT_VX, PPC_INST_VAND, "vand"},
+    {0xFC0007FF, 0x10000444, PPC_FMT_VX, PPC_INST_VANDC, "vandc"},
+    {0xFC0007FF, 0x10000484, PPC_FMT_VX, PPC_INST_VOR, "vor"},
+    {0xFC0007FF, 0x100004C4, PPC_FMT_VX, PPC_INST_VXOR, "vxor"},
+    {0xFC0007FF, 0x10000504, PPC_FMT_VX, PPC_INST_VNOR, "vnor"},
+    {0xFC0007FF, 0x10000544, PPC_FMT_VX, PPC_INST_VORC, "vorc"},
+    {0xFC0007FF, 0x10000584, PPC_FMT_VX, PPC_INST_VNAND, "vnand"},
+    {0xFC0007FF, 0x10000684, PPC_FMT_VX, PPC_INST_VEQV, "veqv"},
+
+    // Permutes
+    {0xFC0007FF, 0x1000000C, PPC_FMT_VX, PPC_INST_VMRGHB, "vmrghb"},
+    {0xFC0007FF, 0x1000004C, PPC_FMT_VX, PPC_INST_VMRGHH, "vmrghh"},
+    {0xFC0007FF, 0x1000008C, PPC_FMT_VX, PPC_INST_VMRGHW, "vmrghw"},
+    {0xFC0007FF, 0x1000010C, PPC_FMT_VX, PPC_INST_VMRGLB, "vmrglb"},
+    {0xFC0007FF, 0x1000014C, PPC_FMT_VX, PPC_INST_VMRGLH, "vmrglh"},
+    {0xFC0007FF, 0x1000018C, PPC_FMT_VX, PPC_INST_VMRGLW, "vmrglw"},
+    {0xFC0007FF, 0x1000020C, PPC_FMT_VX, PPC_INST_VSPLTB, "vspltb"},
+    {0xFC0007FF, 0x1000024C, PPC_FMT_VX, PPC_INST_VSPLTH, "vsplth"},
+    {0xFC0007FF, 0x1000028C, PPC_FMT_VX, PPC_INST_VSPLTW, "vspltw"},
+    {0xFC0007FF, 0x1000030C, PPC_FMT_VX, PPC_INST_VSPLTISB, "vspltisb"},
+    {0xFC0007FF, 0x1000034C, PPC_FMT_VX, PPC_INST_VSPLTISH, "vspltish"},
+    {0xFC0007FF, 0x1000038C, PPC_FMT_VX, PPC_INST_VSPLTISW, "vspltisw"},
+    {0xFC0007FF, 0x1000000E, PPC_FMT_VX, PPC_INST_VPKUHUM, "vpkuhum"},
+    {0xFC0007FF, 0x1000004E, PPC_FMT_VX, PPC_INST_VPKUWUM, "vpkuwum"},
+    {0xFC0007FF, 0x1000018E, PPC_FMT_VX, PPC_INST_VPKSHSS, "vpkshss"},
+    {0xFC0007FF, 0x100001CE, PPC_FMT_VX, PPC_INST_VPKSWSS, "vpkswss"},
+    {0xFC0007FF, 0x1000010E, PPC_FMT_VX, PPC_INST_VPKSHUS, "vpkshus"},
+    {0xFC0007FF, 0x1000014E, PPC_FMT_VX, PPC_INST_VPKSWUS, "vpkswus"},
+    {0xFC0007FF, 0x1000020E, PPC_FMT_VX, PPC_INST_VUPKHSB, "vupkhsb"},
+    {0xFC0007FF, 0x1000024E, PPC_FMT_VX, PPC_INST_VUPKHSH, "vupkhsh"},
+    {0xFC0007FF, 0x1000028E, PPC_FMT_VX, PPC_INST_VUPKLSB, "vupklsb"},
+    {0xFC0007FF, 0x100002CE, PPC_FMT_VX, PPC_INST_VUPKLSH, "vupklsh"},
+
+    // Floating point
+    {0xFC0007FF, 0x1000000A, PPC_FMT_VX, PPC_INST_VADDFP, "vaddfp"},
+    {0xFC0007FF, 0x1000004A, PPC_FMT_VX, PPC_INST_VSUBFP, "vsubfp"},
+    {0xFC0007FF, 0x1000040A, PPC_FMT_VX, PPC_INST_VMAXFP, "vmaxfp"},
+    {0xFC0007FF, 0x1000044A, PPC_FMT_VX, PPC_INST_VMINFP, "vminfp"},
+    {0xFC0007FF, 0x1000030A, PPC_FMT_VX, PPC_INST_VCFUX, "vcfux"},
+    {0xFC0007FF, 0x1000034A, PPC_FMT_VX, PPC_INST_VCFSX, "vcfsx"},
+    {0xFC0007FF, 0x1000038A, PPC_FMT_VX, PPC_INST_VCTUXS, "vctuxs"},
+    {0xFC0007FF, 0x100003CA, PPC_FMT_VX, PPC_INST_VCTSXS, "vctsxs"},
+
+    // Status and control
+    {0xFC0007FF, 0x10000604, PPC_FMT_VX, PPC_INST_MFVSCR, "mfvscr"},
+    {0xFC0007FF, 0x10000644, PPC_FMT_VX, PPC_INST_MTVSCR, "mtvscr"},
+
+    // Compares; bit 21 is the record bit
+    {0xFC0003FF, 0x10000006, PPC_FMT_VC, PPC_INST_VCMPEQUB, "vcmpequb"},
+    {0xFC0003FF, 0x10000046, PPC_FMT_VC, PPC_INST_VCMPEQUH, "vcmpequh"},
+    {0xFC0003FF, 0x10000086, PPC_FMT_VC, PPC_INST_VCMPEQUW, "vcmpequw"},
+    {0xFC0003FF, 0x100000C7, PPC_FMT_VC, PPC_INST_VCMPEQUD, "vcmpequd"},
+    {0xFC0003FF, 0x10000206, PPC_FMT_VC, PPC_INST_VCMPGTUB, "vcmpgtub"},
+    {0xFC0003FF, 0x10000246, PPC_FMT_VC, PPC_INST_VCMPGTUH, "vcmpgtuh"},
+    {0xFC0003FF, 0x10000286, PPC_FMT_VC, PPC_INST_VCMPGTUW, "vcmpgtuw"},
+    {0xFC0003FF, 0x100002C7, PPC_FMT_VC, PPC_INST_VCMPGTUD, "vcmpgtud"},
+    {0xFC0003FF, 0x10000306, PPC_FMT_VC, PPC_INST_VCMPGTSB, "vcmpgtsb"},
+    {0xFC0003FF, 0x10000346, PPC_FMT_VC, PPC_INST_VCMPGTSH, "vcmpgtsh"},
+    {0xFC0003FF, 0x10000386, PPC_FMT_VC, PPC_INST_VCMPGTSW, "vcmpgtsw"},
+    {0xFC0003FF, 0x100003C7, PPC_FMT_VC, PPC_INST_VCMPGTSD, "vcmpgtsd"},
+    {0xFC0003FF, 0x100000C6, PPC_FMT_VC, PPC_INST_VCMPEQFP, "vcmpeqfp"},
+    {0xFC0003FF, 0x100001C6, PPC_FMT_VC, PPC_INST_VCMPGEFP, "vcmpgefp"},
+    {0xFC0003FF, 0x100002C6, PPC_FMT_VC, PPC_INST_VCMPGTFP, "vcmpgtfp"},
+
+    // VA-form, matched on the low 6 bits after everything above
+    {0xFC00003F, 0x10000022, PPC_FMT_VA, PPC_INST_VMLADDUHM, "vmladduhm"},
+    {0xFC00003F, 0x1000002A, PPC_FMT_VA, PPC_INST_VSEL, "vsel"},
+    {0xFC00003F, 0x1000002B, PPC_FMT_VA, PPC_INST_VPERM, "vperm"},
+    {0xFC00003F, 0x1000002C, PPC_FMT_VA, PPC_INST_VSLDOI, "vsldoi"},
+    {0xFC00003F, 0x1000002E, PPC_FMT_VA, PPC_INST_VMADDFP, "vmaddfp"},
+    {0xFC00003F, 0x1000002F, PPC_FMT_VA, PPC_INST_VNMSUBFP, "vnmsubfp"},
+    {0xFC00003F, 0x1000003B, PPC_FMT_VA, PPC_INST_VPERMR, "vpermr"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
+};
+
+// Vector loads, stores and moves: X-form with TX/SX in bit 31 (opcode 31),
+// DQ-form and DS-form (opcodes 57 and 61)
+static const decode_entry_t vsx_memory_decode_table[] = {
+    {0xFC0007FE, 0x7C0000CE, PPC_FMT_XX1, PPC_INST_LVX, "lvx"},
+    {0xFC0007FE, 0x7C0002CE, PPC_FMT_XX1, PPC_INST_LVXL, "lvxl"},
+    {0xFC0007FE, 0x7C0001CE, PPC_FMT_XX1, PPC_INST_STVX, "stvx"},
+    {0xFC0007FE, 0x7C0003CE, PPC_FMT_XX1, PPC_INST_STVXL, "stvxl"},
+    {0xFC0007FE, 0x7C00000C, PPC_FMT_XX1, PPC_INST_LVSL, "lvsl"},
+    {0xFC0007FE, 0x7C00004C, PPC_FMT_XX1, PPC_INST_LVSR, "lvsr"},
+    {0xFC0007FE, 0x7C00000E, PPC_FMT_XX1, PPC_INST_LVEBX, "lvebx"},
+    {0xFC0007FE, 0x7C00004E, PPC_FMT_XX1, PPC_INST_LVEHX, "lvehx"},
+    {0xFC0007FE, 0x7C00008E, PPC_FMT_XX1, PPC_INST_LVEWX, "lvewx"},
+    {0xFC0007FE, 0x7C00010E, PPC_FMT_XX1, PPC_INST_STVEBX, "stvebx"},
+    {0xFC0007FE, 0x7C00014E, PPC_FMT_XX1, PPC_INST_STVEHX, "stvehx"},
+    {0xFC0007FE, 0x7C00018E, PPC_FMT_XX1, PPC_INST_STVEWX, "stvewx"},
+    {0xFC0007FE, 0x7C000698, PPC_FMT_XX1, PPC_INST_LXVD2X, "lxvd2x"},
+    {0xFC0007FE, 0x7C000618, PPC_FMT_XX1, PPC_INST_LXVW4X, "lxvw4x"},
+    {0xFC0007FE, 0x7C000658, PPC_FMT_XX1, PPC_INST_LXVH8X, "lxvh8x"},
+    {0xFC0007FE, 0x7C0006D8, PPC_FMT_XX1, PPC_INST_LXVB16X, "lxvb16x"},
+    {0xFC0007FE, 0x7C000218, PPC_FMT_XX1, PPC_INST_LXVX, "lxvx"},
+    {0xFC0007FE, 0x7C000298, PPC_FMT_XX1, PPC_INST_LXVDSX, "lxvdsx"},
+    {0xFC0007FE, 0x7C000498, PPC_FMT_XX1, PPC_INST_LXSDX, "lxsdx"},
+    {0xFC0007FE, 0x7C000018, PPC_FMT_XX1, PPC_INST_LXSIWZX, "lxsiwzx"},
+    {0xFC0007FE, 0x7C000098, PPC_FMT_XX1, PPC_INST_LXSIWAX, "lxsiwax"},
+    {0xFC0007FE, 0x7C000798, PPC_FMT_XX1, PPC_INST_STXVD2X, "stxvd2x"},
+    {0xFC0007FE, 0x7C000718, PPC_FMT_XX1, PPC_INST_STXVW4X, "stxvw4x"},
+    {0xFC0007FE, 0x7C000758, PPC_FMT_XX1, PPC_INST_STXVH8X, "stxvh8x"},
+    {0xFC0007FE, 0x7C0007D8, PPC_FMT_XX1, PPC_INST_STXVB16X, "stxvb16x"},
+    {0xFC0007FE, 0x7C000318, PPC_FMT_XX1, PPC_INST_STXVX, "stxvx"},
+    {0xFC0007FE, 0x7C000598, PPC_FMT_XX1, PPC_INST_STXSDX, "stxsdx"},
+    {0xFC0007FE, 0x7C000118, PPC_FMT_XX1, PPC_INST_STXSIWX, "stxsiwx"},
+    {0xFC0007FE, 0x7C000066, PPC_FMT_XX1, PPC_INST_MFVSRD, "mfvsrd"},
+    {0xFC0007FE, 0x7C0000E6, PPC_FMT_XX1, PPC_INST_MFVSRWZ, "mfvsrwz"},
+    {0xFC0007FE, 0x7C000266, PPC_FMT_XX1, PPC_INST_MFVSRLD, "mfvsrld"},
+    {0xFC0007FE, 0x7C000166, PPC_FMT_XX1, PPC_INST_MTVSRD, "mtvsrd"},
+    {0xFC0007FE, 0x7C0001A6, PPC_FMT_XX1, PPC_INST_MTVSRWA, "mtvsrwa"},
+    {0xFC0007FE, 0x7C0001E6, PPC_FMT_XX1, PPC_INST_MTVSRWZ, "mtvsrwz"},
+    {0xFC0007FE, 0x7C000366, PPC_FMT_XX1, PPC_INST_MTVSRDD, "mtvsrdd"},
+    {0xFC0007FE, 0x7C000326, PPC_FMT_XX1, PPC_INST_MTVSRWS, "mtvsrws"},
+    {0xFC000007, 0xF4000001, PPC_FMT_DQ, PPC_INST_LXV, "lxv"},
+    {0xFC000007, 0xF4000005, PPC_FMT_DQ, PPC_INST_STXV, "stxv"},
+    {0xFC000003, 0xE4000002, PPC_FMT_DS, PPC_INST_LXSD, "lxsd"},
+    {0xFC000003, 0xF4000002, PPC_FMT_DS, PPC_INST_STXSD, "stxsd"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
+};
+
+// VSX opcodes (opcode 60). The low bits of XX3 and XX2 forms extend the
+// register fields to 6 bits, so the masks leave them out.
+static const decode_entry_t vsx_decode_table[] = {
+    // Scalar double precision
+    {0xFC0007F8, 0xF0000100, PPC_FMT_XX3, PPC_INST_XSADDDP, "xsadddp"},
+    {0xFC0007F8, 0xF0000140, PPC_FMT_XX3, PPC_INST_XSSUBDP, "xssubdp"},
+    {0xFC0007F8, 0xF0000180, PPC_FMT_XX3, PPC_INST_XSMULDP, "xsmuldp"},
+    {0xFC0007F8, 0xF00001C0, PPC_FMT_XX3, PPC_INST_XSDIVDP, "xsdivdp"},
+    {0xFC0007F8, 0xF0000108, PPC_FMT_XX3, PPC_INST_XSMADDADP, "xsmaddadp"},
+    {0xFC0007F8, 0xF0000148, PPC_FMT_XX3, PPC_INST_XSMADDMDP, "xsmaddmdp"},
+    {0xFC0007F8, 0xF0000188, PPC_FMT_XX3, PPC_INST_XSMSUBADP, "xsmsubadp"},
+    {0xFC0007F8, 0xF00001C8, PPC_FMT_XX3, PPC_INST_XSMSUBMDP, "xsmsubmdp"},
+    {0xFC0007F8, 0xF0000508, PPC_FMT_XX3, PPC_INST_XSNMADDADP, "xsnmaddadp"},
+    {0xFC0007F8, 0xF0000588, PPC_FMT_XX3, PPC_INST_XSNMSUBADP, "xsnmsubadp"},
+    {0xFC0007F8, 0xF0000500, PPC_FMT_XX3, PPC_INST_XSMAXDP, "xsmaxdp"},
+    {0xFC0007F8, 0xF0000540, PPC_FMT_XX3, PPC_INST_XSMINDP, "xsmindp"},
+    {0xFC0007F8, 0xF0000580, PPC_FMT_XX3, PPC_INST_XSCPSGNDP, "xscpsgndp"},
+    {0xFC0007FC, 0xF000012C, PPC_FMT_XX2, PPC_INST_XSSQRTDP, "xssqrtdp"},
+    {0xFC0007FC, 0xF0000564, PPC_FMT_XX2, PPC_INST_XSABSDP, "xsabsdp"},
+    {0xFC0007FC, 0xF00005A4, PPC_FMT_XX2, PPC_INST_XSNABSDP, "xsnabsdp"},
+    {0xFC0007FC, 0xF00005E4, PPC_FMT_XX2, PPC_INST_XSNEGDP, "xsnegdp"},
+    {0xFC0007FC, 0xF0000424, PPC_FMT_XX2, PPC_INST_XSCVDPSP, "xscvdpsp"},
+    {0xFC0007FC, 0xF000042C, PPC_FMT_XX2, PPC_INST_XSCVDPSPN, "xscvdpspn"},
+    {0xFC0007FC, 0xF0000524, PPC_FMT_XX2, PPC_INST_XSCVSPDP, "xscvspdp"},
+    {0xFC0007FC, 0xF000052C, PPC_FMT_XX2, PPC_INST_XSCVSPDPN, "xscvspdpn"},
+
+    // Vector floating point
+    {0xFC0007F8, 0xF0000300, PPC_FMT_XX3, PPC_INST_XVADDDP, "xvadddp"},
+    {0xFC0007F8, 0xF0000340, PPC_FMT_XX3, PPC_INST_XVSUBDP, "xvsubdp"},
+    {0xFC0007F8, 0xF0000380, PPC_FMT_XX3, PPC_INST_XVMULDP, "xvmuldp"},
+    {0xFC0007F8, 0xF00003C0, PPC_FMT_XX3, PPC_INST_XVDIVDP, "xvdivdp"},
+    {0xFC0007F8, 0xF0000200, PPC_FMT_XX3, PPC_INST_XVADDSP, "xvaddsp"},
+    {0xFC0007F8, 0xF0000240, PPC_FMT_XX3, PPC_INST_XVSUBSP, "xvsubsp"},
+    {0xFC0007F8, 0xF0000280, PPC_FMT_XX3, PPC_INST_XVMULSP, "xvmulsp"},
+    {0xFC0007F8, 0xF00002C0, PPC_FMT_XX3, PPC_INST_XVDIVSP, "xvdivsp"},
+    {0xFC0007F8, 0xF0000308, PPC_FMT_XX3, PPC_INST_XVMADDADP, "xvmaddadp"},
+    {0xFC0007F8, 0xF0000348, PPC_FMT_XX3, PPC_INST_XVMADDMDP, "xvmaddmdp"},
+    {0xFC0007F8, 0xF0000388, PPC_FMT_XX3, PPC_INST_XVMSUBADP, "xvmsubadp"},
+    {0xFC0007F8, 0xF00003C8, PPC_FMT_XX3, PPC_INST_XVMSUBMDP, "xvmsubmdp"},
+    {0xFC0007F8, 0xF0000708, PPC_FMT_XX3, PPC_INST_XVNMADDADP, "xvnmaddadp"},
+    {0xFC0007F8, 0xF0000788, PPC_FMT_XX3, PPC_INST_XVNMSUBADP, "xvnmsubadp"},
+    {0xFC0007F8, 0xF0000208, PPC_FMT_XX3, PPC_INST_XVMADDASP, "xvmaddasp"},
+    {0xFC0007F8, 0xF0000248, PPC_FMT_XX3, PPC_INST_XVMADDMSP, "xvmaddmsp"},
+    {0xFC0007F8, 0xF0000288, PPC_FMT_XX3, PPC_INST_XVMSUBASP, "xvmsubasp"},
+    {0xFC0007F8, 0xF00002C8, PPC_FMT_XX3, PPC_INST_XVMSUBMSP, "xvmsubmsp"},
+    {0xFC0007F8, 0xF0000608, PPC_FMT_XX3, PPC_INST_XVNMADDASP, "xvnmaddasp"},
+    {0xFC0007F8, 0xF0000688, PPC_FMT_XX3, PPC_INST_XVNMSUBASP, "xvnmsubasp"},
+    {0xFC0007F8, 0xF0000700, PPC_FMT_XX3, PPC_INST_XVMAXDP, "xvmaxdp"},
+    {0xFC0007F8, 0xF0000740, PPC_FMT_XX3, PPC_INST_XVMINDP, "xvmindp"},
+    {0xFC0007F8, 0xF0000600, PPC_FMT_XX3, PPC_INST_XVMAXSP, "xvmaxsp"},
+    {0xFC0007F8, 0xF0000640, PPC_FMT_XX3, PPC_INST_XVMINSP, "xvminsp"},
+    {0xFC0003F8, 0xF0000318, PPC_FMT_XX3, PPC_INST_XVCMPEQDP, "xvcmpeqdp"},
+    {0xFC0003F8, 0xF0000358, PPC_FMT_XX3, PPC_INST_XVCMPGTDP, "xvcmpgtdp"},
+    {0xFC0003F8, 0xF0000398, PPC_FMT_XX3, PPC_INST_XVCMPGEDP, "xvcmpgedp"},
+    {0xFC0003F8, 0xF0000218, PPC_FMT_XX3, PPC_INST_XVCMPEQSP, "xvcmpeqsp"},
+    {0xFC0003F8, 0xF0000258, PPC_FMT_XX3, PPC_INST_XVCMPGTSP, "xvcmpgtsp"},
+    {0xFC0003F8, 0xF0000298, PPC_FMT_XX3, PPC_INST_XVCMPGESP, "xvcmpgesp"},
+    {0xFC0007FC, 0xF000032C, PPC_FMT_XX2, PPC_INST_XVSQRTDP, "xvsqrtdp"},
+    {0xFC0007FC, 0xF000022C, PPC_FMT_XX2, PPC_INST_XVSQRTSP, "xvsqrtsp"},
+    {0xFC0007FC, 0xF0000764, PPC_FMT_XX2, PPC_INST_XVABSDP, "xvabsdp"},
+    {0xFC0007FC, 0xF00007A4, PPC_FMT_XX2, PPC_INST_XVNABSDP, "xvnabsdp"},
+    {0xFC0007FC, 0xF00007E4, PPC_FMT_XX2, PPC_INST_XVNEGDP, "xvnegdp"},
+    {0xFC0007FC, 0xF0000664, PPC_FMT_XX2, PPC_INST_XVABSSP, "xvabssp"},
+    {0xFC0007FC, 0xF00006A4, PPC_FMT_XX2, PPC_INST_XVNABSSP, "xvnabssp"},
+    {0xFC0007FC, 0xF00006E4, PPC_FMT_XX2, PPC_INST_XVNEGSP, "xvnegsp"},
+    {0xFC0007FC, 0xF0000724, PPC_FMT_XX2, PPC_INST_XVCVSPDP, "xvcvspdp"},
+    {0xFC0007FC, 0xF0000624, PPC_FMT_XX2, PPC_INST_XVCVDPSP, "xvcvdpsp"},
+    {0xFC0007FC, 0xF00003E0, PPC_FMT_XX2, PPC_INST_XVCVSXWDP, "xvcvsxwdp"},
+    {0xFC0007FC, 0xF00003A0, PPC_FMT_XX2, PPC_INST_XVCVUXWDP, "xvcvuxwdp"},
+    {0xFC0007FC, 0xF0000360, PPC_FMT_XX2, PPC_INST_XVCVDPSXWS, "xvcvdpsxws"},
+    {0xFC0007FC, 0xF00007E0, PPC_FMT_XX2, PPC_INST_XVCVSXDDP, "xvcvsxddp"},
+    {0xFC0007FC, 0xF0000760, PPC_FMT_XX2, PPC_INST_XVCVDPSXDS, "xvcvdpsxds"},
+    {0xFC0007FC, 0xF00002E0, PPC_FMT_XX2, PPC_INST_XVCVSXWSP, "xvcvsxwsp"},
+    {0xFC0007FC, 0xF0000260, PPC_FMT_XX2, PPC_INST_XVCVSPSXWS, "xvcvspsxws"},
+
+    // Logical and permutes
+    {0xFC0007F8, 0xF0000410, PPC_FMT_XX3, PPC_INST_XXLAND, "xxland"},
+    {0xFC0007F8, 0xF0000450, PPC_FMT_XX3, PPC_INST_XXLANDC, "xxlandc"},
+    {0xFC0007F8, 0xF0000490, PPC_FMT_XX3, PPC_INST_XXLOR, "xxlor"},
+    {0xFC0007F8, 0xF00004D0, PPC_FMT_XX3, PPC_INST_XXLXOR, "xxlxor"},
+    {0xFC0007F8, 0xF0000510, PPC_FMT_XX3, PPC_INST_XXLNOR, "xxlnor"},
+    {0xFC0007F8, 0xF0000550, PPC_FMT_XX3, PPC_INST_XXLORC, "xxlorc"},
+    {0xFC0007F8, 0xF0000590, PPC_FMT_XX3, PPC_INST_XXLNAND, "xxlnand"},
+    {0xFC0007F8, 0xF00005D0, PPC_FMT_XX3, PPC_INST_XXLEQV, "xxleqv"},
+    {0xFC0007F8, 0xF0000090, PPC_FMT_XX3, PPC_INST_XXMRGHW, "xxmrghw"},
+    {0xFC0007F8, 0xF0000190, PPC_FMT_XX3, PPC_INST_XXMRGLW, "xxmrglw"},
+    {0xFC0007F8, 0xF00000D0, PPC_FMT_XX3, PPC_INST_XXPERM, "xxperm"},
+    {0xFC0007F8, 0xF00001D0, PPC_FMT_XX3, PPC_INST_XXPERMR, "xxpermr"},
+    {0xFC0004F8, 0xF0000050, PPC_FMT_XX3, PPC_INST_XXPERMDI, "xxpermdi"},
+    {0xFC0004F8, 0xF0000010, PPC_FMT_XX3, PPC_INST_XXSLDWI, "xxsldwi"},
+    {0xFC0007FC, 0xF0000290, PPC_FMT_XX2, PPC_INST_XXSPLTW, "xxspltw"},
+    {0xFC1807FE, 0xF00002D0, PPC_FMT_XX2, PPC_INST_XXSPLTIB, "xxspltib"},
+    {0xFC000030, 0xF0000030, PPC_FMT_XX4, PPC_INST_XXSEL, "xxsel"},
+    {0, 0, PPC_FMT_UNKNOWN, PPC_INST_INVALID, NULL}
+};
+
+// Every source table, in the order the decoder used to scan them
+static const decode_entry_t* const decode_tables[] = {
+    primary_decode_table,
+    xl_form_decode_table,
+    x_form_decode_table,
+    xfx_form_decode_table,
+    a_form_decode_table,
+    fp_x_form_decode_table,
+    md_form_decode_table,
+    ds_form_decode_table,
+    vx_form_decode_table,
+    vsx_memory_decode_table,
+    vsx_decode_table,
+    NULL
+};
+
+#define DECODE_EXT_TABLES 16
+
+// Per-ID format and mnemonic, filled in from the source tables
+static struct {
+    ppc_inst_format_t format;
+    const char* mnemonic;
+} inst_info[PPC_INST_COUNT];
+
+// Generated two-level decoder. The primary table and the extended ones
+// share an array, so the batch decoder finds any ID from one per-opcode
+// entry of decode_index: the table's base in decode_ids, and the mask
+// of the word's low bits (none without an extended table) above it.
+// The spare slot at the end is read by 32-bit gathers of the last ID.
+static uint16_t decode_ids[64 + DECODE_EXT_TABLES * DECODE_EXT_SIZE + 1];
+static uint16_t* const primary_decode = decode_ids;
+static uint16_t* extended_decode[64];
+static uint32_t decode_index[64];
+
+// Builds the dense tables from the decode_entry_t lists before main() runs.
+// An entry whose mask covers only the primary opcode fills the 64-entry
+// table; anything else fills every extended slot compatible with its mask.
+// The first matching entry wins, exactly like the linear scans did.
+__attribute__((constructor))
+static void decode_tables_init(void) {
+    int pool_used = 0;
+
+    inst_info[PPC_INST_INVALID].format = PPC_FMT_UNKNOWN;
+    inst_info[PPC_INST_INVALID].mnemonic = "unknown";
+
+    for (const decode_entry_t* const* table = decode_tables; *table; table++) {
+        for (const decode_entry_t* entry = *table; entry->mnemonic; entry++) {
+            uint32_t opcode = INST_OPCODE(entry->match);
+            uint32_t ext_mask = entry->mask & DECODE_EXT_MASK;
+
+            inst_info[entry->id].format = entry->format;
+            inst_info[entry->id].mnemonic = entry->mnemonic;
+
+            if (ext_mask == 0) {
+                if (primary_decode[opcode] == PPC_INST_INVALID) {
+                    primary_decode[opcode] = entry->id;
                 }
+                continue;
             }
-        } break;
-        case 32:  break; // lwz (handled in primary table)
-        case 33:  break; // lwzu (handled in primary table)
-        case 34:  break; // lbz (handled in primary table)
-        case 35:  break; // lbzu (handled in primary table)
-        case 36:  break; // stw (handled in primary table)
-        case 37:  break; // stwu (handled in primary table)
-        case 38:  break; // stb (handled in primary table)
-        case 39:  break; // stbu (handled in primary table)
-        case 40:  break; // lhz (handled in primary table)
-        case 41:  break; // lhzu (handled in primary table)
-        case 42:  break; // lha (handled in primary table)
-        case 43:  break; // lhau (handled in primary table)
-        case 44:  break; // sth (handled in primary table)
-        case 45:  break; // sthu (handled in primary table)
-        case 46:  break; // lmw (handled in primary table)
-        case 47:  break; // stmw (handled in primary table)
-        case 48:  break; // lfs (handled in primary table)
-        case 49:  break; // lfsu (handled in primary table)
-        case 50:  break; // lfd (handled in primary table)
-        case 51:  break; // lfdu (handled in primary table)
-        case 52:  break; // stfs (handled in primary table)
-        case 53:  break; // stfsu (handled in primary table)
-        case 54:  break; // stfd (handled in primary table)
-        case 55:  break; // stfdu (handled in primary table)
-        case 56:  break; // 64-bit load/store
-        case 57:  break; // 64-bit load/store
-        case 58:  break; // 64-bit load/store
-        case 59: {
-            for (const decode_entry_t* entry = a_form_decode_table; entry->mnemonic; entry++) {
-                if ((raw_inst & entry->mask) == entry->match) {
-                    inst.fmt = entry->format;
-                    break;
-                }
+
+            if (!extended_decode[opcode]) {
+                if (pool_used == DECODE_EXT_TABLES) continue;
+                extended_decode[opcode] = decode_ids + 64 + pool_used++ * DECODE_EXT_SIZE;
             }
-        } break;
-        case 60:  break; // Reserved
-        case 61:  break; // Reserved
-        case 62:  break; // 64-bit load/store
-        case 63: {
-            for (const decode_entry_t* entry = a_form_decode_table; entry->mnemonic; entry++) {
-                if ((raw_inst & entry->mask) == entry->match) {
-                    inst.fmt = entry->format;
-                    break;
+
+            uint16_t* ext = extended_decode[opcode];
+            for (uint32_t xo = 0; xo < DECODE_EXT_SIZE; xo++) {
+                if ((xo & ext_mask) == (entry->match & ext_mask) &&
+                    ext[xo] == PPC_INST_INVALID) {
+                    ext[xo] = entry->id;
                 }
             }
-        } break;
-        default:  break; // Unknown opcode
+        }
+    }
+
+    // Extended opcodes that match nothing fall back to the primary entry
+    for (int opcode = 0; opcode < 64; opcode++) {
+        uint16_t* ext = extended_decode[opcode];
+        if (!ext) continue;
+        for (uint32_t xo = 0; xo < DECODE_EXT_SIZE; xo++) {
+            if (ext[xo] == PPC_INST_INVALID) ext[xo] = primary_decode[opcode];
+        }
     }
+
+    for (int opcode = 0; opcode < 64; opcode++) {
+        uint16_t* ext = extended_decode[opcode];
+        decode_index[opcode] = ext ? (uint32_t)(ext - decode_ids) | (DECODE_EXT_MASK << 16) :
+                                     (uint32_t)opcode;
+    }
+}
+
+ppc_instruction_t decode_instruction(uint32_t raw_inst) {
+    ppc_instruction_t inst = {0};
+    inst.raw = raw_inst;
+    inst.opcode = INST_OPCODE(raw_inst);
+
+    // Two table lookups replace the per-format linear scans
+    const uint16_t* ext = extended_decode[inst.opcode];
+    if (ext) {
+        inst.id = ext[raw_inst & DECODE_EXT_MASK];
+        inst.extended_op = INST_XO_X(raw_inst);
+    } else {
+        inst.id = primary_decode[inst.opcode];
+    }
+    inst.fmt = inst_info[inst.id].format;
     
     // Extract common fields based on format
     inst.rt = INST_RT(raw_inst);
@@ -353,11 +724,45 @@ ppc_instruction_t decode_instruction(uint32_t raw_inst) {
             inst.rc = raw_inst & 1;
             break;
         case PPC_FMT_MD:
-            // 64-bit rotate and mask
+            // 64-bit rotate and mask, split 6-bit sh and mb/me fields
+            inst.sh = INST_SH64(raw_inst);
+            inst.mb = INST_MB64(raw_inst);
+            inst.me = inst.mb;
+            inst.rc = raw_inst & 1;
             break;
         case PPC_FMT_MDS:
             // 64-bit rotate and mask with variable shift
             break;
+        case PPC_FMT_VX:
+        case PPC_FMT_VA:
+            // VRT, VRA, VRB in rt/ra/rb; VA-form adds VRC and SHB
+            inst.frc = INST_FRC(raw_inst);
+            inst.sh = (raw_inst >> 6) & 0xF;
+            inst.rc = false;
+            break;
+        case PPC_FMT_VC:
+            inst.rc = (raw_inst >> 10) & 1;
+            break;
+        case PPC_FMT_XX1:
+            // 6-bit XT/XS, RA and RB stay GPR numbers
+            inst.rt |= (raw_inst & 1) << 5;
+            inst.rc = false;
+            break;
+        case PPC_FMT_XX2:
+        case PPC_FMT_XX3:
+        case PPC_FMT_XX4:
+            // 6-bit VSR numbers; XX3 compares keep their record bit
+            inst.rt |= (raw_inst & 1) << 5;
+            inst.ra |= ((raw_inst >> 2) & 1) << 5;
+            inst.rb |= ((raw_inst >> 1) & 1) << 5;
+            inst.frc = INST_FRC(raw_inst) | (((raw_inst >> 3) & 1) << 5);
+            inst.rc = (raw_inst >> 10) & 1;
+            break;
+        case PPC_FMT_DQ:
+            inst.rt |= ((raw_inst >> 3) & 1) << 5;
+            inst.simm = (int16_t)(raw_inst & 0xFFF0);
+            inst.rc = false;
+            break;
         case PPC_FMT_UNKNOWN:
         default:
             break;
@@ -366,46 +771,208 @@ ppc_instruction_t decode_instruction(uint32_t raw_inst) {
     return inst;
 }
 
+// The same through a single index lookup, into the compact form
+ppc_packed_inst_t decode_packed(uint32_t raw_inst) {
+    ppc_packed_inst_t p = {0};
+    uint32_t index = decode_index[INST_OPCODE(raw_inst)];
+    p.id = decode_ids[(index & 0xFFFF) + (raw_inst & (index >> 16))];
+    p.rt = INST_RT(raw_inst);
+    p.ra = INST_RA(raw_inst);
+    p.rb = INST_RB(raw_inst);
+    p.rc = INST_RC(raw_inst);
+    p.simm = INST_SIMM(raw_inst);
 
-const char* get_instruction_name(const ppc_instruction_t* inst) {
-    // Try primary opcodes first
-    for (const decode_entry_t* entry = primary_decode_table; entry->mnemonic; entry++) {
-        if ((inst->raw & entry->mask) == entry->match) {
-            return entry->mnemonic;
-        }
-    }
-    
-    // Try extended opcodes
-    if (inst->opcode == 31) {
-        // Try X-form
-        for (const decode_entry_t* entry = x_form_decode_table; entry->mnemonic; entry++) {
-            if ((inst->raw & entry->mask) == entry->match) {
-                return entry->mnemonic;
-            }
-        }
-        // Try XFX-form
-        for (const decode_entry_t* entry = xfx_form_decode_table; entry->mnemonic; entry++) {
-            if ((inst->raw & entry->mask) == entry->match) {
-                return entry->mnemonic;
-            }
-        }
-    }
-    // Try XL-form opcodes
-    else if (inst->opcode == 19) {
-        for (const decode_entry_t* entry = xl_form_decode_table; entry->mnemonic; entry++) {
-            if ((inst->raw & entry->mask) == entry->match) {
-                return entry->mnemonic;
+    switch (inst_info[p.id].format) {
+        case PPC_FMT_I:
+            p.addr = INST_LI(raw_inst);
+            p.lk = INST_LK(raw_inst);
+            p.aa = INST_AA(raw_inst);
+            break;
+        case PPC_FMT_B:
+            p.addr = INST_BD(raw_inst);
+            p.lk = INST_LK(raw_inst);
+            p.aa = INST_AA(raw_inst);
+            break;
+        case PPC_FMT_DS:
+            p.simm = INST_DS(raw_inst);
+            break;
+        case PPC_FMT_X:
+            p.oe = INST_OE(raw_inst);
+            break;
+        case PPC_FMT_XL:
+            p.lk = INST_LK(raw_inst);
+            break;
+        case PPC_FMT_XFX:
+            p.spr = INST_SPR(raw_inst);
+            break;
+        case PPC_FMT_A:
+            p.frc = INST_FRC(raw_inst);
+            break;
+        case PPC_FMT_M:
+            // rlwnm shifts by RB; the others by SH, in the same place
+            p.sh = INST_SH(raw_inst);
+            p.mask = ppc_mask64(INST_MB(raw_inst) + 32, INST_ME(raw_inst) + 32);
+            break;
+        case PPC_FMT_MD:
+            p.sh = INST_SH64(raw_inst);
+            p.mb = INST_MB64(raw_inst);
+            switch (p.id) {
+                case PPC_INST_RLDICL: p.mask = ppc_mask64(p.mb, 63); break;
+                case PPC_INST_RLDICR: p.mask = ppc_mask64(0, p.me); break;
+                default:              p.mask = ppc_mask64(p.mb, 63 - p.sh); break;
             }
-        }
+            break;
+        case PPC_FMT_VX:
+        case PPC_FMT_VA:
+            p.frc = INST_FRC(raw_inst);
+            p.sh = (raw_inst >> 6) & 0xF;
+            p.rc = false;
+            break;
+        case PPC_FMT_VC:
+            p.rc = (raw_inst >> 10) & 1;
+            break;
+        case PPC_FMT_XX1:
+            p.rt |= (raw_inst & 1) << 5;
+            p.rc = false;
+            break;
+        case PPC_FMT_XX2:
+        case PPC_FMT_XX3:
+        case PPC_FMT_XX4:
+            p.rt |= (raw_inst & 1) << 5;
+            p.ra |= ((raw_inst >> 2) & 1) << 5;
+            p.rb |= ((raw_inst >> 1) & 1) << 5;
+            p.frc = INST_FRC(raw_inst) | (((raw_inst >> 3) & 1) << 5);
+            p.rc = (raw_inst >> 10) & 1;
+            break;
+        case PPC_FMT_DQ:
+            p.rt |= ((raw_inst >> 3) & 1) << 5;
+            p.simm = (int16_t)(raw_inst & 0xFFF0);
+            p.rc = false;
+            break;
+        default:
+            break;
     }
-    // Try A-form floating point
-    else if (inst->opcode == 59 || inst->opcode == 63) {
-        for (const decode_entry_t* entry = a_form_decode_table; entry->mnemonic; entry++) {
-            if ((inst->raw & entry->mask) == entry->match) {
-                return entry->mnemonic;
-            }
-        }
+    return p;
+}
+
+// Batch decoding. The vector paths byte-swap 16 words at a time, look
+// the IDs up with two gathers (decode_index, then decode_ids) and narrow
+// each field to its array; whatever is left over goes through the
+// scalar loop, which is also the whole decoder without AVX2.
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+static void decode_batch16(const uint32_t* words, const ppc_decode_batch_t* out, size_t i) {
+    const __m512i bswap = _mm512_broadcast_i32x4(
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+    const __m512i field = _mm512_set1_epi32(0x1F);
+    __m512i raw = _mm512_shuffle_epi8(_mm512_loadu_si512(words + i), bswap);
+    __m512i opcode = _mm512_srli_epi32(raw, 26);
+    __m512i index = _mm512_i32gather_epi32(opcode, decode_index, 4);
+    __m512i slot = _mm512_add_epi32(_mm512_and_si512(index, _mm512_set1_epi32(0xFFFF)),
+                                    _mm512_and_si512(raw, _mm512_srli_epi32(index, 16)));
+    __m512i id = _mm512_i32gather_epi32(slot, decode_ids, 2);
+
+    _mm512_storeu_si512(out->raw + i, raw);
+    _mm256_storeu_si256((__m256i*)(out->id + i), _mm512_cvtepi32_epi16(id));
+    _mm_storeu_si128((__m128i*)(out->opcode + i), _mm512_cvtepi32_epi8(opcode));
+    _mm_storeu_si128((__m128i*)(out->rt + i),
+                     _mm512_cvtepi32_epi8(_mm512_and_si512(_mm512_srli_epi32(raw, 21), field)));
+    _mm_storeu_si128((__m128i*)(out->ra + i),
+                     _mm512_cvtepi32_epi8(_mm512_and_si512(_mm512_srli_epi32(raw, 16), field)));
+    _mm_storeu_si128((__m128i*)(out->rb + i),
+                     _mm512_cvtepi32_epi8(_mm512_and_si512(_mm512_srli_epi32(raw, 11), field)));
+    _mm256_storeu_si256((__m256i*)(out->simm + i), _mm512_cvtepi32_epi16(raw));
+    _mm256_storeu_si256((__m256i*)(out->xo + i),
+                        _mm512_cvtepi32_epi16(_mm512_and_si512(_mm512_srli_epi32(raw, 1),
+                                                               _mm512_set1_epi32(0x3FF))));
+}
+
+#elif defined(__AVX2__)
+
+// Two vectors of eight 32-bit lanes, each under 0x10000 (0x100 for
+// narrow8), into sixteen 16-bit or 8-bit lanes in order
+static inline __m256i narrow16(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+}
+
+static inline __m128i narrow8(__m256i lo, __m256i hi) {
+    __m256i half = narrow16(lo, hi);
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(half, half), 0xD8));
+}
+
+typedef struct {
+    __m256i raw, opcode, id;
+} decode_half_t;
+
+static inline decode_half_t decode_batch8(const uint32_t* words) {
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    decode_half_t h;
+    h.raw = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)words), bswap);
+    h.opcode = _mm256_srli_epi32(h.raw, 26);
+    __m256i index = _mm256_i32gather_epi32((const int*)decode_index, h.opcode, 4);
+    __m256i slot = _mm256_add_epi32(_mm256_and_si256(index, _mm256_set1_epi32(0xFFFF)),
+                                    _mm256_and_si256(h.raw, _mm256_srli_epi32(index, 16)));
+    h.id = _mm256_and_si256(_mm256_i32gather_epi32((const int*)decode_ids, slot, 2),
+                            _mm256_set1_epi32(0xFFFF));
+    return h;
+}
+
+static inline __m256i field_at(__m256i raw, int shift, int mask) {
+    return _mm256_and_si256(_mm256_srli_epi32(raw, shift), _mm256_set1_epi32(mask));
+}
+
+static void decode_batch16(const uint32_t* words, const ppc_decode_batch_t* out, size_t i) {
+    decode_half_t lo = decode_batch8(words + i);
+    decode_half_t hi = decode_batch8(words + i + 8);
+
+    _mm256_storeu_si256((__m256i*)(out->raw + i), lo.raw);
+    _mm256_storeu_si256((__m256i*)(out->raw + i + 8), hi.raw);
+    _mm256_storeu_si256((__m256i*)(out->id + i), narrow16(lo.id, hi.id));
+    _mm_storeu_si128((__m128i*)(out->opcode + i), narrow8(lo.opcode, hi.opcode));
+    _mm_storeu_si128((__m128i*)(out->rt + i),
+                     narrow8(field_at(lo.raw, 21, 0x1F), field_at(hi.raw, 21, 0x1F)));
+    _mm_storeu_si128((__m128i*)(out->ra + i),
+                     narrow8(field_at(lo.raw, 16, 0x1F), field_at(hi.raw, 16, 0x1F)));
+    _mm_storeu_si128((__m128i*)(out->rb + i),
+                     narrow8(field_at(lo.raw, 11, 0x1F), field_at(hi.raw, 11, 0x1F)));
+    _mm256_storeu_si256((__m256i*)(out->simm + i), narrow16(field_at(lo.raw, 0, 0xFFFF),
+                                                             field_at(hi.raw, 0, 0xFFFF)));
+    _mm256_storeu_si256((__m256i*)(out->xo + i),
+                        narrow16(field_at(lo.raw, 1, 0x3FF), field_at(hi.raw, 1, 0x3FF)));
+}
+
+#endif
+
+void decode_instructions(const uint32_t* words, size_t n, const ppc_decode_batch_t* out) {
+    size_t i = 0;
+#if (defined(__AVX512F__) && defined(__AVX512BW__)) || defined(__AVX2__)
+    for (; i + 16 <= n; i += 16) decode_batch16(words, out, i);
+#endif
+    for (; i < n; i++) {
+        uint32_t raw = __builtin_bswap32(words[i]);
+        uint32_t index = decode_index[INST_OPCODE(raw)];
+        out->raw[i] = raw;
+        out->id[i] = decode_ids[(index & 0xFFFF) + (raw & (index >> 16))];
+        out->opcode[i] = (uint8_t)INST_OPCODE(raw);
+        out->rt[i] = (uint8_t)INST_RT(raw);
+        out->ra[i] = (uint8_t)INST_RA(raw);
+        out->rb[i] = (uint8_t)INST_RB(raw);
+        out->simm[i] = INST_SIMM(raw);
+        out->xo[i] = (uint16_t)INST_XO_X(raw);
     }
-    
-    return "unknown";
-}
\ No newline at end of file
+}
+
+const char* get_instruction_name(const ppc_instruction_t* inst) {
+    return inst_info[inst->id].mnemonic;
+}
+
+const char* get_instruction_name_by_id(uint16_t id) {
+    if (id >= PPC_INST_COUNT) return inst_info[PPC_INST_INVALID].mnemonic;
+    return inst_info[id].mnemonic;
+}
+
+ppc_inst_format_t get_instruction_format(uint16_t id) {
+    if (id >= PPC_INST_COUNT) return PPC_FMT_UNKNOWN;
+    return inst_info[id].format;
+}
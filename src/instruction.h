@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // PowerPC instruction formats
 typedef enum {
@@ -19,15 +20,181 @@ typedef enum {
     PPC_FMT_M,      // M-form (rotate and mask)
     PPC_FMT_MD,     // MD-form (64-bit rotate and mask)
     PPC_FMT_MDS,    // MDS-form (64-bit rotate and mask)
+    PPC_FMT_VX,     // VX-form (vector, 11-bit extended opcode)
+    PPC_FMT_VA,     // VA-form (vector, three sources)
+    PPC_FMT_VC,     // VC-form (vector compare, record bit 21)
+    PPC_FMT_XX1,    // XX1-form (VSX load/store and moves, opcode 31)
+    PPC_FMT_XX2,    // XX2-form (VSX unary)
+    PPC_FMT_XX3,    // XX3-form (VSX binary)
+    PPC_FMT_XX4,    // XX4-form (VSX select)
+    PPC_FMT_DQ,     // DQ-form (VSX quadword load/store)
+    PPC_FMT_PREFIX, // Prefix word of a v3.1 8-byte instruction
     PPC_FMT_UNKNOWN
 } ppc_inst_format_t;
 
+// Stable instruction identifiers, assigned by the decoder
+// (index into the per-instruction info table)
+typedef enum {
+    PPC_INST_INVALID = 0,
+
+    // Primary opcodes
+    PPC_INST_TWI, PPC_INST_MULLI, PPC_INST_SUBFIC, PPC_INST_CMPLI, PPC_INST_CMPI,
+    PPC_INST_ADDIC, PPC_INST_ADDIC_DOT, PPC_INST_ADDI, PPC_INST_ADDIS,
+    PPC_INST_BC, PPC_INST_SC, PPC_INST_B,
+    PPC_INST_RLWIMI, PPC_INST_RLWINM, PPC_INST_RLWNM,
+    PPC_INST_ORI, PPC_INST_ORIS, PPC_INST_XORI, PPC_INST_XORIS,
+    PPC_INST_ANDI_DOT, PPC_INST_ANDIS_DOT,
+    PPC_INST_LWZ, PPC_INST_LWZU, PPC_INST_LBZ, PPC_INST_LBZU,
+    PPC_INST_STW, PPC_INST_STWU, PPC_INST_STB, PPC_INST_STBU,
+    PPC_INST_LHZ, PPC_INST_LHZU, PPC_INST_LHA, PPC_INST_LHAU,
+    PPC_INST_STH, PPC_INST_STHU, PPC_INST_LMW, PPC_INST_STMW,
+    PPC_INST_LFS, PPC_INST_LFSU, PPC_INST_LFD, PPC_INST_LFDU,
+    PPC_INST_STFS, PPC_INST_STFSU, PPC_INST_STFD, PPC_INST_STFDU,
+
+    // X-form (opcode 31)
+    PPC_INST_ADD, PPC_INST_ADDC, PPC_INST_ADDE, PPC_INST_ADDZE, PPC_INST_ADDME,
+    PPC_INST_SUBF, PPC_INST_SUBFC, PPC_INST_SUBFE, PPC_INST_SUBFZE, PPC_INST_SUBFME,
+    PPC_INST_CNTLZW,
+    PPC_INST_AND, PPC_INST_ANDC, PPC_INST_OR, PPC_INST_ORC, PPC_INST_XOR,
+    PPC_INST_NOR, PPC_INST_EQV, PPC_INST_NAND,
+    PPC_INST_SLW, PPC_INST_SRW, PPC_INST_SRAW, PPC_INST_SRAWI,
+    PPC_INST_MULHW, PPC_INST_MULHWU, PPC_INST_MULLW, PPC_INST_DIVW, PPC_INST_DIVWU,
+    PPC_INST_CMP, PPC_INST_CMPL,
+    PPC_INST_LWZX, PPC_INST_LWZUX, PPC_INST_LBZX, PPC_INST_LBZUX,
+    PPC_INST_STWX, PPC_INST_STWUX, PPC_INST_STBX, PPC_INST_STBUX,
+    PPC_INST_LHZX, PPC_INST_LHZUX, PPC_INST_LHAX, PPC_INST_LHAUX,
+    PPC_INST_STHX, PPC_INST_STHUX,
+    PPC_INST_SYNC, PPC_INST_MFMSR, PPC_INST_MTMSR, PPC_INST_MTMSRD,
+
+    // XL-form (opcode 19)
+    PPC_INST_BCLR, PPC_INST_BCCTR,
+    PPC_INST_CRAND, PPC_INST_CRANDC, PPC_INST_CREQV, PPC_INST_CRNAND,
+    PPC_INST_CRNOR, PPC_INST_CROR, PPC_INST_CRORC, PPC_INST_CRXOR,
+    PPC_INST_MCRF, PPC_INST_RFID,
+
+    // XFX-form (opcode 31)
+    PPC_INST_MFSPR, PPC_INST_MTSPR, PPC_INST_MFCR, PPC_INST_MTCRF,
+
+    // A-form (opcode 63)
+    PPC_INST_FADD, PPC_INST_FSUB, PPC_INST_FMUL, PPC_INST_FDIV, PPC_INST_FSEL,
+    PPC_INST_FMADD, PPC_INST_FMSUB, PPC_INST_FNMADD, PPC_INST_FNMSUB,
+
+    // 64-bit and storage control additions
+    PPC_INST_TDI, PPC_INST_ISYNC,
+    PPC_INST_RLDICL, PPC_INST_RLDICR, PPC_INST_RLDIC, PPC_INST_RLDIMI,
+    PPC_INST_LD, PPC_INST_LDU, PPC_INST_LWA, PPC_INST_STD, PPC_INST_STDU,
+    PPC_INST_NEG, PPC_INST_EXTSB, PPC_INST_EXTSH, PPC_INST_EXTSW, PPC_INST_CNTLZD,
+    PPC_INST_MULLD, PPC_INST_MULHD, PPC_INST_MULHDU, PPC_INST_DIVD, PPC_INST_DIVDU,
+    PPC_INST_SLD, PPC_INST_SRD, PPC_INST_SRAD, PPC_INST_SRADI,
+    PPC_INST_TW, PPC_INST_TD,
+    PPC_INST_LDX, PPC_INST_LDUX, PPC_INST_LWAX, PPC_INST_STDX, PPC_INST_STDUX,
+    PPC_INST_DCBST, PPC_INST_DCBF, PPC_INST_DCBT, PPC_INST_DCBTST, PPC_INST_ICBI,
+    PPC_INST_DCBZ,
+
+    // Storage management
+    PPC_INST_TLBIE, PPC_INST_TLBIEL, PPC_INST_TLBSYNC,
+
+    // Load and reserve, store conditional
+    PPC_INST_LBARX, PPC_INST_LHARX, PPC_INST_LWARX, PPC_INST_LDARX,
+    PPC_INST_STBCX, PPC_INST_STHCX, PPC_INST_STWCX, PPC_INST_STDCX,
+
+    // VMX (opcode 4)
+    PPC_INST_VADDUBM, PPC_INST_VADDUHM, PPC_INST_VADDUWM, PPC_INST_VADDUDM,
+    PPC_INST_VADDUBS, PPC_INST_VADDUHS, PPC_INST_VADDSBS, PPC_INST_VADDSHS,
+    PPC_INST_VSUBUBM, PPC_INST_VSUBUHM, PPC_INST_VSUBUWM, PPC_INST_VSUBUDM,
+    PPC_INST_VSUBUBS, PPC_INST_VSUBUHS, PPC_INST_VSUBSBS, PPC_INST_VSUBSHS,
+    PPC_INST_VMAXUB, PPC_INST_VMAXUH, PPC_INST_VMAXUW,
+    PPC_INST_VMAXSB, PPC_INST_VMAXSH, PPC_INST_VMAXSW,
+    PPC_INST_VMINUB, PPC_INST_VMINUH, PPC_INST_VMINUW,
+    PPC_INST_VMINSB, PPC_INST_VMINSH, PPC_INST_VMINSW,
+    PPC_INST_VAVGUB, PPC_INST_VAVGUH,
+    PPC_INST_VMULUWM, PPC_INST_VMULOUH, PPC_INST_VMULOSH, PPC_INST_VMULEUH, PPC_INST_VMULESH,
+    PPC_INST_VMULOUW, PPC_INST_VMULOSW, PPC_INST_VMULEUW, PPC_INST_VMULESW,
+    PPC_INST_VMLADDUHM,
+    PPC_INST_VRLW, PPC_INST_VSLW, PPC_INST_VSRW, PPC_INST_VSRAW, PPC_INST_VSLD, PPC_INST_VSRD,
+    PPC_INST_VAND, PPC_INST_VANDC, PPC_INST_VOR, PPC_INST_VXOR,
+    PPC_INST_VNOR, PPC_INST_VORC, PPC_INST_VNAND, PPC_INST_VEQV, PPC_INST_VSEL,
+    PPC_INST_VMRGHB, PPC_INST_VMRGHH, PPC_INST_VMRGHW,
+    PPC_INST_VMRGLB, PPC_INST_VMRGLH, PPC_INST_VMRGLW,
+    PPC_INST_VSPLTB, PPC_INST_VSPLTH, PPC_INST_VSPLTW,
+    PPC_INST_VSPLTISB, PPC_INST_VSPLTISH, PPC_INST_VSPLTISW,
+    PPC_INST_VPERM, PPC_INST_VPERMR, PPC_INST_VSLDOI,
+    PPC_INST_VPKUHUM, PPC_INST_VPKUWUM, PPC_INST_VPKSHSS, PPC_INST_VPKSWSS,
+    PPC_INST_VPKSHUS, PPC_INST_VPKSWUS,
+    PPC_INST_VUPKHSB, PPC_INST_VUPKHSH, PPC_INST_VUPKLSB, PPC_INST_VUPKLSH,
+    PPC_INST_VCMPEQUB, PPC_INST_VCMPEQUH, PPC_INST_VCMPEQUW, PPC_INST_VCMPEQUD,
+    PPC_INST_VCMPGTUB, PPC_INST_VCMPGTUH, PPC_INST_VCMPGTUW, PPC_INST_VCMPGTUD,
+    PPC_INST_VCMPGTSB, PPC_INST_VCMPGTSH, PPC_INST_VCMPGTSW, PPC_INST_VCMPGTSD,
+    PPC_INST_VCMPEQFP, PPC_INST_VCMPGEFP, PPC_INST_VCMPGTFP,
+    PPC_INST_VADDFP, PPC_INST_VSUBFP, PPC_INST_VMADDFP, PPC_INST_VNMSUBFP,
+    PPC_INST_VMAXFP, PPC_INST_VMINFP,
+    PPC_INST_VCFUX, PPC_INST_VCFSX, PPC_INST_VCTUXS, PPC_INST_VCTSXS,
+    PPC_INST_MFVSCR, PPC_INST_MTVSCR,
+
+    // Vector loads, stores and moves (opcodes 31, 57 and 61)
+    PPC_INST_LVX, PPC_INST_LVXL, PPC_INST_STVX, PPC_INST_STVXL, PPC_INST_LVSL, PPC_INST_LVSR,
+    PPC_INST_LVEBX, PPC_INST_LVEHX, PPC_INST_LVEWX,
+    PPC_INST_STVEBX, PPC_INST_STVEHX, PPC_INST_STVEWX,
+    PPC_INST_LXVD2X, PPC_INST_LXVW4X, PPC_INST_LXVH8X, PPC_INST_LXVB16X, PPC_INST_LXVX,
+    PPC_INST_LXVDSX, PPC_INST_LXSDX, PPC_INST_LXSIWZX, PPC_INST_LXSIWAX,
+    PPC_INST_STXVD2X, PPC_INST_STXVW4X, PPC_INST_STXVH8X, PPC_INST_STXVB16X, PPC_INST_STXVX,
+    PPC_INST_STXSDX, PPC_INST_STXSIWX,
+    PPC_INST_LXV, PPC_INST_STXV, PPC_INST_LXSD, PPC_INST_STXSD,
+    PPC_INST_MFVSRD, PPC_INST_MFVSRWZ, PPC_INST_MFVSRLD,
+    PPC_INST_MTVSRD, PPC_INST_MTVSRWA, PPC_INST_MTVSRWZ, PPC_INST_MTVSRDD, PPC_INST_MTVSRWS,
+
+    // VSX (opcode 60)
+    PPC_INST_XSADDDP, PPC_INST_XSSUBDP, PPC_INST_XSMULDP, PPC_INST_XSDIVDP,
+    PPC_INST_XSMADDADP, PPC_INST_XSMADDMDP, PPC_INST_XSMSUBADP, PPC_INST_XSMSUBMDP,
+    PPC_INST_XSNMADDADP, PPC_INST_XSNMSUBADP,
+    PPC_INST_XSMAXDP, PPC_INST_XSMINDP, PPC_INST_XSCPSGNDP,
+    PPC_INST_XSSQRTDP, PPC_INST_XSABSDP, PPC_INST_XSNABSDP, PPC_INST_XSNEGDP,
+    PPC_INST_XSCVDPSP, PPC_INST_XSCVDPSPN, PPC_INST_XSCVSPDP, PPC_INST_XSCVSPDPN,
+    PPC_INST_XVADDDP, PPC_INST_XVSUBDP, PPC_INST_XVMULDP, PPC_INST_XVDIVDP,
+    PPC_INST_XVADDSP, PPC_INST_XVSUBSP, PPC_INST_XVMULSP, PPC_INST_XVDIVSP,
+    PPC_INST_XVMADDADP, PPC_INST_XVMADDMDP, PPC_INST_XVMSUBADP, PPC_INST_XVMSUBMDP,
+    PPC_INST_XVNMADDADP, PPC_INST_XVNMSUBADP,
+    PPC_INST_XVMADDASP, PPC_INST_XVMADDMSP, PPC_INST_XVMSUBASP, PPC_INST_XVMSUBMSP,
+    PPC_INST_XVNMADDASP, PPC_INST_XVNMSUBASP,
+    PPC_INST_XVMAXDP, PPC_INST_XVMINDP, PPC_INST_XVMAXSP, PPC_INST_XVMINSP,
+    PPC_INST_XVSQRTDP, PPC_INST_XVSQRTSP,
+    PPC_INST_XVABSDP, PPC_INST_XVNABSDP, PPC_INST_XVNEGDP,
+    PPC_INST_XVABSSP, PPC_INST_XVNABSSP, PPC_INST_XVNEGSP,
+    PPC_INST_XVCMPEQDP, PPC_INST_XVCMPGTDP, PPC_INST_XVCMPGEDP,
+    PPC_INST_XVCMPEQSP, PPC_INST_XVCMPGTSP, PPC_INST_XVCMPGESP,
+    PPC_INST_XVCVSPDP, PPC_INST_XVCVDPSP, PPC_INST_XVCVSXWDP, PPC_INST_XVCVUXWDP,
+    PPC_INST_XVCVDPSXWS, PPC_INST_XVCVSXDDP, PPC_INST_XVCVDPSXDS,
+    PPC_INST_XVCVSXWSP, PPC_INST_XVCVSPSXWS,
+    PPC_INST_XXLAND, PPC_INST_XXLANDC, PPC_INST_XXLOR, PPC_INST_XXLXOR,
+    PPC_INST_XXLNOR, PPC_INST_XXLORC, PPC_INST_XXLNAND, PPC_INST_XXLEQV, PPC_INST_XXSEL,
+    PPC_INST_XXMRGHW, PPC_INST_XXMRGLW, PPC_INST_XXPERMDI, PPC_INST_XXSLDWI,
+    PPC_INST_XXPERM, PPC_INST_XXPERMR, PPC_INST_XXSPLTW, PPC_INST_XXSPLTIB,
+
+    // Floating point: single precision (opcode 59), and the rest of opcode 63
+    PPC_INST_FADDS, PPC_INST_FSUBS, PPC_INST_FMULS, PPC_INST_FDIVS,
+    PPC_INST_FMADDS, PPC_INST_FMSUBS, PPC_INST_FNMADDS, PPC_INST_FNMSUBS,
+    PPC_INST_FSQRTS, PPC_INST_FRES, PPC_INST_FRSQRTES, PPC_INST_FCFIDS,
+    PPC_INST_FSQRT, PPC_INST_FRE, PPC_INST_FRSQRTE,
+    PPC_INST_FCMPU, PPC_INST_FCMPO, PPC_INST_FRSP,
+    PPC_INST_FCTIW, PPC_INST_FCTIWZ, PPC_INST_FCTID, PPC_INST_FCTIDZ,
+    PPC_INST_FCFID, PPC_INST_FCFIDU,
+    PPC_INST_FMR, PPC_INST_FNEG, PPC_INST_FABS, PPC_INST_FNABS, PPC_INST_FCPSGN,
+    PPC_INST_MFFS, PPC_INST_MTFSF, PPC_INST_MTFSFI, PPC_INST_MTFSB0, PPC_INST_MTFSB1,
+    PPC_INST_MCRFS,
+
+    // Prefix word (opcode 1); executes fused with its suffix
+    PPC_INST_PREFIX,
+
+    PPC_INST_COUNT
+} ppc_inst_id_t;
+
 // Decoded instruction structure
 typedef struct {
     uint32_t raw;           // Raw 32-bit instruction
     ppc_inst_format_t fmt;  // Instruction format
     uint16_t opcode;        // Primary opcode
     uint16_t extended_op;   // Extended opcode for X-form, etc.
+    uint16_t id;            // Stable instruction ID (ppc_inst_id_t)
     
     // Operand fields (not all used for every instruction)
     uint8_t rt, ra, rb;     // Register operands
@@ -46,17 +213,72 @@ typedef struct {
     bool aa;                // Absolute address
 } ppc_instruction_t;
 
+// Compact form of a decoded instruction, what decoded blocks hold: the
+// ID and, in 16 bytes, the operands its handler reads. Fields that no
+// format uses together share a byte, and the 8-byte union holds the one
+// value a format needs worked out from the word: immediates and branch
+// displacements sign-extended, rotate masks built from MB and ME (or SH
+// for rldic), the SPR number with its halves swapped. Formats not listed
+// there keep the sign-extended low halfword in simm, as decode_instruction
+// does.
+typedef struct {
+    uint16_t id;
+    union { uint8_t rt, bt, frt; };     // 6-bit XT for VSX
+    union { uint8_t ra, ba, fra; };
+    union { uint8_t rb, bb, frb; };
+    bool rc;
+    union { uint8_t sh; bool lk; };
+    union { uint8_t mb, me, frc; bool oe, aa; };
+    union {
+        int64_t simm;       // D, DS, DQ forms; imm is its low half (x86 hosts)
+        uint16_t imm;
+        int64_t addr;       // I, B forms: displacement
+        uint64_t mask;      // M and MD-form immediate rotates
+        uint16_t spr;       // XFX form
+    };
+} ppc_packed_inst_t;
+
+_Static_assert(sizeof(ppc_packed_inst_t) == 16, "packed instruction grew");
+
 // Instruction decode table entry
 typedef struct {
     uint32_t mask;
     uint32_t match;
     ppc_inst_format_t format;
+    uint16_t id;
     const char* mnemonic;
 } decode_entry_t;
 
+// Dense decoder layout: 64-entry primary dispatch, plus one table per
+// primary opcode with extended opcodes, indexed by the low 11 bits
+#define DECODE_EXT_BITS     11
+#define DECODE_EXT_SIZE     (1 << DECODE_EXT_BITS)
+#define DECODE_EXT_MASK     (DECODE_EXT_SIZE - 1)
+
 // Fast instruction decoding
 ppc_instruction_t decode_instruction(uint32_t raw_inst);
+ppc_packed_inst_t decode_packed(uint32_t raw_inst);
 const char* get_instruction_name(const ppc_instruction_t* inst);
+const char* get_instruction_name_by_id(uint16_t id);
+ppc_inst_format_t get_instruction_format(uint16_t id);
+
+// Batch decoding, for whole text segments: n words as they sit in guest
+// memory (big-endian) into parallel arrays the caller sizes for n. id is
+// the one decode_instruction assigns; the other fields are taken from
+// the word whatever its format, so the rest of an instruction can be
+// read from raw with the INST_* macros, or decode_instruction.
+typedef struct {
+    uint32_t* raw;          // Host order
+    uint16_t* id;
+    uint8_t* opcode;
+    uint8_t* rt;
+    uint8_t* ra;
+    uint8_t* rb;
+    int16_t* simm;
+    uint16_t* xo;           // INST_XO_X
+} ppc_decode_batch_t;
+
+void decode_instructions(const uint32_t* words, size_t n, const ppc_decode_batch_t* out);
 
 // Instruction field extraction macros
 #define INST_OPCODE(x)      (((x) >> 26) & 0x3F)
@@ -86,9 +308,19 @@ const char* get_instruction_name(const ppc_instruction_t* inst);
 #define INST_OE(x)          (((x) >> 10) & 1)
 #define INST_AA(x)          (((x) >> 1) & 1)
 #define INST_LK(x)          ((x) & 1)
+#define INST_L(x)           (((x) >> 21) & 1)
+#define INST_BF(x)          (((x) >> 23) & 0x7)
+#define INST_BFA(x)         (((x) >> 18) & 0x7)
+#define INST_FXM(x)         (((x) >> 12) & 0xFF)
+#define INST_DS(x)          ((int16_t)((x) & 0xFFFC))
+#define INST_SH64(x)        ((((x) >> 11) & 0x1F) | (((x) << 4) & 0x20))
+#define INST_MB64(x)        ((((x) >> 6) & 0x1F) | ((x) & 0x20))
 
 // Common PowerPC opcodes
+#define PPC_OP_PREFIX       1
+#define PPC_OP_TDI          2
 #define PPC_OP_TWI          3
+#define PPC_OP_VECTOR       4
 #define PPC_OP_MULLI        7
 #define PPC_OP_SUBFIC       8
 #define PPC_OP_CMPLI        10
@@ -130,5 +362,20 @@ const char* get_instruction_name(const ppc_instruction_t* inst);
 #define PPC_OP_STHU         45
 #define PPC_OP_LMW          46
 #define PPC_OP_STMW         47
+#define PPC_OP_LFS          48
+#define PPC_OP_LFSU         49
+#define PPC_OP_LFD          50
+#define PPC_OP_LFDU         51
+#define PPC_OP_STFS         52
+#define PPC_OP_STFSU        53
+#define PPC_OP_STFD         54
+#define PPC_OP_STFDU        55
+#define PPC_OP_LXSD         57
+#define PPC_OP_LD           58
+#define PPC_OP_FP_SINGLE    59
+#define PPC_OP_VSX          60
+#define PPC_OP_STXV         61
+#define PPC_OP_STD          62
+#define PPC_OP_FP_DOUBLE    63
 
 #endif
\ No newline at end of file
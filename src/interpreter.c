@@ -0,0 +1,2485 @@
+#include "interpreter.h"
+#include "jit.h"
+#include "events.h"
+#include "fault.h"
+#include "fpu.h"
+#include "profile.h"
+#include "trace.h"
+#include "vector.h"
+#include <math.h>
+#include <string.h>
+
+// Threaded-code interpreter. Every decoded op carries its handler; a
+// handler does its work and tail-calls the next op's handler directly, so
+// there is no central dispatch loop or switch on the opcode. Handlers that
+// leave the block (branches, sc, traps, the block-end op) return instead,
+// after recording how many instructions retired and where to continue.
+//
+// While a block runs, cpu->pc holds the address of its first instruction;
+// an instruction's own address is cpu->pc + op->pc_off.
+
+#define HANDLER(name) \
+    static void name(ppc_cpu_state_t* cpu, memory_system_t* mem __attribute__((unused)), \
+                     const ppc_op_t* op)
+
+#define NEXT()  return op[1].handler(cpu, mem, op + 1)
+
+#define I       (op->inst)
+#define GPR(n)  (cpu->gpr[n])
+#define RA0     (I.ra ? GPR(I.ra) : 0)      // (RA|0)
+
+static inline uint64_t insn_pc(const ppc_cpu_state_t* cpu, const ppc_op_t* op) {
+    return cpu->pc + op->pc_off;
+}
+
+// Leaves the block after op has executed, continuing at next_pc
+static inline void exit_to(ppc_cpu_state_t* cpu, const ppc_op_t* op, uint64_t next_pc) {
+    cpu->exec_state.retired = (op->pc_off >> 2) + 1;
+    cpu->pc = next_pc;
+}
+
+// Leaves the block without executing op; execution resumes at op
+static inline void exit_at(ppc_cpu_state_t* cpu, const ppc_op_t* op, cpu_exit_t reason) {
+    cpu->exec_state.retired = op->pc_off >> 2;
+    cpu->pc += op->pc_off;
+    cpu->exec_state.exit_reason = reason;
+}
+
+// Fixed-point status helpers. CR0 and CA are only recorded here and
+// computed on demand (see cpu.h); OV and SO stay eager, as OE forms are
+// rare and SO feeds into every CR field.
+static inline void update_cr0(ppc_cpu_state_t* cpu, uint64_t value) {
+    cpu->lazy.cr0_result = (int64_t)value;
+    cpu->lazy.cr0_pending = true;
+}
+
+// Returns the field written, for fused compare-and-branch ops
+static inline uint32_t update_cr_cmp(ppc_cpu_state_t* cpu, unsigned bf, bool lt, bool gt) {
+    uint32_t c = (lt ? 8 : gt ? 4 : 2) | (cpu->xer >> 31);
+    cpu->cr = cr_set_field(cpu->cr, bf, c);
+    if (bf == 0) cpu->lazy.cr0_pending = false;
+    return c;
+}
+
+static inline uint32_t get_ca(ppc_cpu_state_t* cpu) {
+    return (cpu_get_xer(cpu) >> 29) & 1;
+}
+
+static inline void set_ca(ppc_cpu_state_t* cpu, bool ca) {
+    cpu->xer = ca ? (cpu->xer | XER_CA) : (cpu->xer & ~XER_CA);
+    cpu->lazy.ca_pending = false;
+}
+
+// Carry out of x + y + cin, given the sum r
+static inline void set_ca_add(ppc_cpu_state_t* cpu, uint64_t x, uint64_t r, uint32_t cin) {
+    cpu->lazy.ca_x = x;
+    cpu->lazy.ca_r = r;
+    cpu->lazy.ca_in = cin;
+    cpu->lazy.ca_pending = true;
+}
+
+static inline void set_ov(ppc_cpu_state_t* cpu, bool ov) {
+    cpu_get_cr(cpu);
+    cpu->xer = ov ? (cpu->xer | XER_OV | XER_SO) : (cpu->xer & ~XER_OV);
+}
+
+static inline uint64_t rotl64(uint64_t x, unsigned n) {
+    n &= 63;
+    return n ? (x << n) | (x >> (64 - n)) : x;
+}
+
+// 32-bit rotate with the word replicated in both halves, as rlw* specify
+static inline uint64_t rotl32_dup(uint64_t x, unsigned n) {
+    uint32_t w = (uint32_t)x;
+    n &= 31;
+    w = n ? (w << n) | (w >> (32 - n)) : w;
+    return ((uint64_t)w << 32) | w;
+}
+
+// Invalid and unimplemented instructions
+HANDLER(op_illegal) {
+    exit_at(cpu, op, CPU_EXIT_ILLEGAL);
+}
+
+HANDLER(op_nop) {
+    NEXT();
+}
+
+// Falls through to the instruction after the block
+HANDLER(op_block_end) {
+    cpu->exec_state.retired = op->pc_off >> 2;
+    cpu->pc += op->pc_off;
+}
+
+// Returns to the caller without touching the state; translated code runs
+// single ops through their handlers with this op after them
+HANDLER(op_return) {
+    (void)cpu;
+    (void)op;
+}
+
+// Add family: every form is x + y + carry-in
+#define ADD3(name, X, Y, C, SETS_CA, RECORD, OVERFLOW)                   \
+    HANDLER(op_##name) {                                                \
+        uint64_t x = (X), y = (Y);                                      \
+        uint32_t c = (C);                                               \
+        uint64_t r = x + y + c;                                         \
+        GPR(I.rt) = r;                                                  \
+        if (SETS_CA) set_ca_add(cpu, x, r, c);                          \
+        if (OVERFLOW) set_ov(cpu, ((x ^ r) & (y ^ r)) >> 63);           \
+        if (RECORD) update_cr0(cpu, r);                                 \
+        NEXT();                                                         \
+    }
+
+#define RA  GPR(I.ra)
+#define RB  GPR(I.rb)
+#define SIMM ((uint64_t)(int64_t)I.simm)
+
+ADD3(add,     RA,  RB,   0,           false, I.rc, I.oe)
+ADD3(addc,    RA,  RB,   0,           true,  I.rc, I.oe)
+ADD3(adde,    RA,  RB,   get_ca(cpu), true,  I.rc, I.oe)
+ADD3(addze,   RA,  0,    get_ca(cpu), true,  I.rc, I.oe)
+ADD3(addme,   RA,  ~0ULL, get_ca(cpu), true, I.rc, I.oe)
+ADD3(subf,    ~RA, RB,   1,           false, I.rc, I.oe)
+ADD3(subfc,   ~RA, RB,   1,           true,  I.rc, I.oe)
+ADD3(subfe,   ~RA, RB,   get_ca(cpu), true,  I.rc, I.oe)
+ADD3(subfze,  ~RA, 0,    get_ca(cpu), true,  I.rc, I.oe)
+ADD3(subfme,  ~RA, ~0ULL, get_ca(cpu), true, I.rc, I.oe)
+ADD3(neg,     ~RA, 0,    1,           false, I.rc, I.oe)
+ADD3(addic,   RA,  SIMM, 0,           true,  false, false)
+ADD3(addic_dot, RA, SIMM, 0,          true,  true,  false)
+ADD3(subfic,  ~RA, SIMM, 1,           true,  false, false)
+
+HANDLER(op_addi) {
+    GPR(I.rt) = RA0 + SIMM;
+    NEXT();
+}
+
+HANDLER(op_addis) {
+    GPR(I.rt) = RA0 + (SIMM << 16);
+    NEXT();
+}
+
+// Multiply and divide
+HANDLER(op_mulli) {
+    GPR(I.rt) = RA * SIMM;
+    NEXT();
+}
+
+HANDLER(op_mullw) {
+    int64_t r = (int64_t)(int32_t)RA * (int32_t)RB;
+    GPR(I.rt) = (uint64_t)r;
+    if (I.oe) set_ov(cpu, r != (int32_t)r);
+    if (I.rc) update_cr0(cpu, (uint64_t)r);
+    NEXT();
+}
+
+HANDLER(op_mulld) {
+    int64_t r;
+    bool ov = __builtin_mul_overflow((int64_t)RA, (int64_t)RB, &r);
+    GPR(I.rt) = (uint64_t)r;
+    if (I.oe) set_ov(cpu, ov);
+    if (I.rc) update_cr0(cpu, (uint64_t)r);
+    NEXT();
+}
+
+HANDLER(op_mulhw) {
+    int64_t r = ((int64_t)(int32_t)RA * (int32_t)RB) >> 32;
+    GPR(I.rt) = (uint64_t)r;
+    if (I.rc) update_cr0(cpu, (uint64_t)r);
+    NEXT();
+}
+
+HANDLER(op_mulhwu) {
+    uint64_t r = ((uint64_t)(uint32_t)RA * (uint32_t)RB) >> 32;
+    GPR(I.rt) = r;
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+HANDLER(op_mulhd) {
+    uint64_t r = (uint64_t)(((__int128)(int64_t)RA * (int64_t)RB) >> 64);
+    GPR(I.rt) = r;
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+HANDLER(op_mulhdu) {
+    uint64_t r = (uint64_t)(((unsigned __int128)RA * RB) >> 64);
+    GPR(I.rt) = r;
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+// Undefined quotients (divide by zero, overflow) read as zero
+HANDLER(op_divw) {
+    int32_t a = (int32_t)RA, b = (int32_t)RB;
+    bool ov = b == 0 || (a == INT32_MIN && b == -1);
+    uint64_t r = ov ? 0 : (uint32_t)(a / b);
+    GPR(I.rt) = r;
+    if (I.oe) set_ov(cpu, ov);
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+HANDLER(op_divwu) {
+    uint32_t a = (uint32_t)RA, b = (uint32_t)RB;
+    uint64_t r = b ? a / b : 0;
+    GPR(I.rt) = r;
+    if (I.oe) set_ov(cpu, b == 0);
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+HANDLER(op_divd) {
+    int64_t a = (int64_t)RA, b = (int64_t)RB;
+    bool ov = b == 0 || (a == INT64_MIN && b == -1);
+    uint64_t r = ov ? 0 : (uint64_t)(a / b);
+    GPR(I.rt) = r;
+    if (I.oe) set_ov(cpu, ov);
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+HANDLER(op_divdu) {
+    uint64_t a = RA, b = RB;
+    uint64_t r = b ? a / b : 0;
+    GPR(I.rt) = r;
+    if (I.oe) set_ov(cpu, b == 0);
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+// Logical: RS is in the RT field, the result goes to RA
+#define RS  GPR(I.rt)
+
+#define LOGICAL(name, EXPR)                                             \
+    HANDLER(op_##name) {                                                \
+        uint64_t r = (EXPR);                                            \
+        GPR(I.ra) = r;                                                  \
+        if (I.rc) update_cr0(cpu, r);                                   \
+        NEXT();                                                         \
+    }
+
+LOGICAL(and,    RS & RB)
+LOGICAL(andc,   RS & ~RB)
+LOGICAL(or,     RS | RB)
+LOGICAL(orc,    RS | ~RB)
+LOGICAL(xor,    RS ^ RB)
+LOGICAL(nor,    ~(RS | RB))
+LOGICAL(eqv,    ~(RS ^ RB))
+LOGICAL(nand,   ~(RS & RB))
+LOGICAL(extsb,  (uint64_t)(int64_t)(int8_t)RS)
+LOGICAL(extsh,  (uint64_t)(int64_t)(int16_t)RS)
+LOGICAL(extsw,  (uint64_t)(int64_t)(int32_t)RS)
+LOGICAL(cntlzw, (uint32_t)RS ? (uint64_t)__builtin_clz((uint32_t)RS) : 32)
+LOGICAL(cntlzd, RS ? (uint64_t)__builtin_clzll(RS) : 64)
+
+#define LOGICAL_IMM(name, EXPR, RECORD)                                 \
+    HANDLER(op_##name) {                                                \
+        uint64_t r = (EXPR);                                            \
+        GPR(I.ra) = r;                                                  \
+        if (RECORD) update_cr0(cpu, r);                                 \
+        NEXT();                                                         \
+    }
+
+LOGICAL_IMM(ori,       RS | I.imm,                   false)
+LOGICAL_IMM(oris,      RS | ((uint64_t)I.imm << 16), false)
+LOGICAL_IMM(xori,      RS ^ I.imm,                   false)
+LOGICAL_IMM(xoris,     RS ^ ((uint64_t)I.imm << 16), false)
+LOGICAL_IMM(andi_dot,  RS & I.imm,                   true)
+LOGICAL_IMM(andis_dot, RS & ((uint64_t)I.imm << 16), true)
+
+// Shifts
+LOGICAL(slw, (RB & 0x20) ? 0 : (uint32_t)(RS << (RB & 0x1F)))
+LOGICAL(srw, (RB & 0x20) ? 0 : (uint32_t)RS >> (RB & 0x1F))
+LOGICAL(sld, (RB & 0x40) ? 0 : RS << (RB & 0x3F))
+LOGICAL(srd, (RB & 0x40) ? 0 : RS >> (RB & 0x3F))
+
+// Algebraic shift of a 32-bit value; CA is set when a negative value
+// loses one bits
+static inline uint64_t sraw_common(ppc_cpu_state_t* cpu, uint64_t rs, unsigned n) {
+    int32_t s = (int32_t)rs;
+    if (n > 31) {
+        set_ca(cpu, s < 0);
+        return (uint64_t)(int64_t)(s >> 31);
+    }
+    set_ca(cpu, s < 0 && (s & ((1U << n) - 1)) != 0);
+    return (uint64_t)(int64_t)(s >> n);
+}
+
+static inline uint64_t srad_common(ppc_cpu_state_t* cpu, uint64_t rs, unsigned n) {
+    int64_t s = (int64_t)rs;
+    if (n > 63) {
+        set_ca(cpu, s < 0);
+        return (uint64_t)(s >> 63);
+    }
+    set_ca(cpu, s < 0 && (rs & ((1ULL << n) - 1)) != 0);
+    return (uint64_t)(s >> n);
+}
+
+LOGICAL(sraw,  sraw_common(cpu, RS, RB & 0x3F))
+LOGICAL(srawi, sraw_common(cpu, RS, I.rb))
+LOGICAL(srad,  srad_common(cpu, RS, RB & 0x7F))
+LOGICAL(sradi, srad_common(cpu, RS, INST_SH64(op->raw)))
+
+// Rotates; the masks were built at decode time
+LOGICAL(rlwinm, rotl32_dup(RS, I.sh) & I.mask)
+LOGICAL(rlwnm,  rotl32_dup(RS, RB & 0x1F) & I.mask)
+LOGICAL(rldicl, rotl64(RS, I.sh) & I.mask)
+LOGICAL(rldicr, rotl64(RS, I.sh) & I.mask)
+LOGICAL(rldic,  rotl64(RS, I.sh) & I.mask)
+
+HANDLER(op_rlwimi) {
+    uint64_t m = I.mask;
+    uint64_t r = (rotl32_dup(RS, I.sh) & m) | (GPR(I.ra) & ~m);
+    GPR(I.ra) = r;
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+HANDLER(op_rldimi) {
+    uint64_t m = I.mask;
+    uint64_t r = (rotl64(RS, I.sh) & m) | (GPR(I.ra) & ~m);
+    GPR(I.ra) = r;
+    if (I.rc) update_cr0(cpu, r);
+    NEXT();
+}
+
+// Compares: BF is the top three bits of the RT field, L the low bit
+static inline uint32_t compare_signed(ppc_cpu_state_t* cpu, const ppc_op_t* op, uint64_t a, uint64_t b) {
+    int64_t x = (int64_t)a, y = (int64_t)b;
+    if (!(I.rt & 1)) {
+        x = (int32_t)x;
+        y = (int32_t)y;
+    }
+    return update_cr_cmp(cpu, I.rt >> 2, x < y, x > y);
+}
+
+static inline uint32_t compare_unsigned(ppc_cpu_state_t* cpu, const ppc_op_t* op, uint64_t a, uint64_t b) {
+    if (!(I.rt & 1)) {
+        a = (uint32_t)a;
+        b = (uint32_t)b;
+    }
+    return update_cr_cmp(cpu, I.rt >> 2, a < b, a > b);
+}
+
+HANDLER(op_cmp) {
+    compare_signed(cpu, op, RA, RB);
+    NEXT();
+}
+
+HANDLER(op_cmpl) {
+    compare_unsigned(cpu, op, RA, RB);
+    NEXT();
+}
+
+HANDLER(op_cmpi) {
+    compare_signed(cpu, op, RA, SIMM);
+    NEXT();
+}
+
+HANDLER(op_cmpli) {
+    compare_unsigned(cpu, op, RA, I.imm);
+    NEXT();
+}
+
+// Traps: TO is in the RT field
+static inline bool trap_taken(unsigned to, int64_t a, int64_t b) {
+    return ((to & 0x10) && a < b) ||
+           ((to & 0x08) && a > b) ||
+           ((to & 0x04) && a == b) ||
+           ((to & 0x02) && (uint64_t)a < (uint64_t)b) ||
+           ((to & 0x01) && (uint64_t)a > (uint64_t)b);
+}
+
+#define TRAP(name, A, B)                                                \
+    HANDLER(op_##name) {                                                \
+        if (trap_taken(I.rt, (A), (B))) {                               \
+            exit_at(cpu, op, CPU_EXIT_TRAP);                            \
+            return;                                                     \
+        }                                                               \
+        NEXT();                                                         \
+    }
+
+TRAP(twi, (int32_t)RA, (int32_t)I.simm)
+TRAP(tw,  (int32_t)RA, (int32_t)RB)
+TRAP(tdi, (int64_t)RA, (int64_t)I.simm)
+TRAP(td,  (int64_t)RA, (int64_t)RB)
+
+// Loads and stores
+#define EA_D    (RA0 + SIMM)
+#define EA_DU   (GPR(I.ra) + SIMM)
+#define EA_X    (RA0 + RB)
+#define EA_XU   (GPR(I.ra) + RB)
+
+// Records which instruction is accessing memory, so that a translation
+// fault unwinding out of the access can be reported precisely
+#define MEM_AT()    (cpu->exec_state.mem_pc_off = op->pc_off)
+
+#define LOAD(name, EA, VALUE, UPDATE)                                   \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        GPR(I.rt) = (VALUE);                                            \
+        if (UPDATE) GPR(I.ra) = ea;                                     \
+        NEXT();                                                         \
+    }
+
+#define STORE(name, EA, WRITE, UPDATE)                                  \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        WRITE;                                                          \
+        if (UPDATE) GPR(I.ra) = ea;                                     \
+        NEXT();                                                         \
+    }
+
+#define LD8(ea)     ((uint64_t)memory_read8(mem, ea))
+#define LD16(ea)    ((uint64_t)memory_read16(mem, ea))
+#define LD16S(ea)   ((uint64_t)(int64_t)(int16_t)memory_read16(mem, ea))
+#define LD32(ea)    ((uint64_t)memory_read32(mem, ea))
+#define LD32S(ea)   ((uint64_t)(int64_t)(int32_t)memory_read32(mem, ea))
+#define LD64(ea)    memory_read64(mem, ea)
+
+LOAD(lbz,   EA_D,  LD8(ea),   false)
+LOAD(lbzu,  EA_DU, LD8(ea),   true)
+LOAD(lbzx,  EA_X,  LD8(ea),   false)
+LOAD(lbzux, EA_XU, LD8(ea),   true)
+LOAD(lhz,   EA_D,  LD16(ea),  false)
+LOAD(lhzu,  EA_DU, LD16(ea),  true)
+LOAD(lhzx,  EA_X,  LD16(ea),  false)
+LOAD(lhzux, EA_XU, LD16(ea),  true)
+LOAD(lha,   EA_D,  LD16S(ea), false)
+LOAD(lhau,  EA_DU, LD16S(ea), true)
+LOAD(lhax,  EA_X,  LD16S(ea), false)
+LOAD(lhaux, EA_XU, LD16S(ea), true)
+LOAD(lwz,   EA_D,  LD32(ea),  false)
+LOAD(lwzu,  EA_DU, LD32(ea),  true)
+LOAD(lwzx,  EA_X,  LD32(ea),  false)
+LOAD(lwzux, EA_XU, LD32(ea),  true)
+LOAD(lwa,   EA_D,  LD32S(ea), false)
+LOAD(lwax,  EA_X,  LD32S(ea), false)
+LOAD(ld,    EA_D,  LD64(ea),  false)
+LOAD(ldu,   EA_DU, LD64(ea),  true)
+LOAD(ldx,   EA_X,  LD64(ea),  false)
+LOAD(ldux,  EA_XU, LD64(ea),  true)
+
+STORE(stb,   EA_D,  memory_write8(mem, ea, (uint8_t)RS),   false)
+STORE(stbu,  EA_DU, memory_write8(mem, ea, (uint8_t)RS),   true)
+STORE(stbx,  EA_X,  memory_write8(mem, ea, (uint8_t)RS),   false)
+STORE(stbux, EA_XU, memory_write8(mem, ea, (uint8_t)RS),   true)
+STORE(sth,   EA_D,  memory_write16(mem, ea, (uint16_t)RS), false)
+STORE(sthu,  EA_DU, memory_write16(mem, ea, (uint16_t)RS), true)
+STORE(sthx,  EA_X,  memory_write16(mem, ea, (uint16_t)RS), false)
+STORE(sthux, EA_XU, memory_write16(mem, ea, (uint16_t)RS), true)
+STORE(stw,   EA_D,  memory_write32(mem, ea, (uint32_t)RS), false)
+STORE(stwu,  EA_DU, memory_write32(mem, ea, (uint32_t)RS), true)
+STORE(stwx,  EA_X,  memory_write32(mem, ea, (uint32_t)RS), false)
+STORE(stwux, EA_XU, memory_write32(mem, ea, (uint32_t)RS), true)
+STORE(std,   EA_D,  memory_write64(mem, ea, RS),           false)
+STORE(stdu,  EA_DU, memory_write64(mem, ea, RS),           true)
+STORE(stdx,  EA_X,  memory_write64(mem, ea, RS),           false)
+STORE(stdux, EA_XU, memory_write64(mem, ea, RS),           true)
+
+// Multiple words go through the bulk accessors, one translation per page
+HANDLER(op_lmw) {
+    uint64_t ea = EA_D;
+    uint32_t words[32];
+    MEM_AT();
+    memory_read_be32(mem, ea, words, 32 - I.rt);
+    for (unsigned r = I.rt; r < 32; r++) {
+        GPR(r) = words[r - I.rt];
+    }
+    NEXT();
+}
+
+HANDLER(op_stmw) {
+    uint64_t ea = EA_D;
+    uint32_t words[32];
+    MEM_AT();
+    for (unsigned r = I.rt; r < 32; r++) {
+        words[r - I.rt] = (uint32_t)GPR(r);
+    }
+    memory_write_be32(mem, ea, words, 32 - I.rt);
+    NEXT();
+}
+
+// Zeroes the 128-byte cache block holding the address
+HANDLER(op_dcbz) {
+    uint64_t ea = EA_X & ~127ULL;
+    MEM_AT();
+    memory_fill(mem, ea, 0, 128);
+    NEXT();
+}
+
+// Load and reserve, store conditional. The reservation remembers the
+// value larx loaded, and stcx. succeeds if memory still holds it, with a
+// host compare-and-swap; that makes them atomic against other vCPUs. A
+// store of the same value in between goes unnoticed, which code written
+// for LL/SC tolerates. Accesses outside RAM get no reservation, so their
+// stcx. fails.
+static uint64_t atomic_load_be(const void* host, unsigned size) {
+    switch (size) {
+        case 1:  return __atomic_load_n((const uint8_t*)host, __ATOMIC_ACQUIRE);
+        case 2:  return __builtin_bswap16(__atomic_load_n((const uint16_t*)host, __ATOMIC_ACQUIRE));
+        case 4:  return __builtin_bswap32(__atomic_load_n((const uint32_t*)host, __ATOMIC_ACQUIRE));
+        default: return __builtin_bswap64(__atomic_load_n((const uint64_t*)host, __ATOMIC_ACQUIRE));
+    }
+}
+
+static bool atomic_cas_be(void* host, unsigned size, uint64_t expected, uint64_t value) {
+    switch (size) {
+        case 1: {
+            uint8_t old = (uint8_t)expected;
+            return __atomic_compare_exchange_n((uint8_t*)host, &old, (uint8_t)value, false,
+                                               __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+        case 2: {
+            uint16_t old = __builtin_bswap16((uint16_t)expected);
+            return __atomic_compare_exchange_n((uint16_t*)host, &old, __builtin_bswap16((uint16_t)value),
+                                               false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+        case 4: {
+            uint32_t old = __builtin_bswap32((uint32_t)expected);
+            return __atomic_compare_exchange_n((uint32_t*)host, &old, __builtin_bswap32((uint32_t)value),
+                                               false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+        default: {
+            uint64_t old = __builtin_bswap64(expected);
+            return __atomic_compare_exchange_n((uint64_t*)host, &old, __builtin_bswap64(value), false,
+                                               __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static uint64_t load_reserve(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t ea, unsigned size) {
+    void* host = memory_atomic_ptr(mem, ea, size, MEM_READ);
+    if (!host) {
+        cpu->exec_state.reservation_valid = false;
+        return memory_read_slow(mem, ea, size);
+    }
+    uint64_t value = atomic_load_be(host, size);
+    cpu->exec_state.reservation_valid = true;
+    cpu->exec_state.reservation_addr = ea;
+    cpu->exec_state.reservation_size = (uint8_t)size;
+    cpu->exec_state.reservation_value = value;
+    return value;
+}
+
+static void store_conditional(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t ea,
+                              unsigned size, uint64_t value) {
+    bool stored = false;
+    if (cpu->exec_state.reservation_valid && cpu->exec_state.reservation_addr == ea &&
+        cpu->exec_state.reservation_size == size) {
+        void* host = memory_atomic_ptr(mem, ea, size, MEM_WRITE);
+        stored = host && atomic_cas_be(host, size, cpu->exec_state.reservation_value, value);
+    }
+    cpu->exec_state.reservation_valid = false;
+    cpu_set_cr(cpu, cr_set_field(cpu_get_cr(cpu), 0, (stored ? 2 : 0) | (cpu->xer >> 31)));
+}
+
+#define LARX(name, SIZE)                                                \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = EA_X;                                             \
+        MEM_AT();                                                       \
+        GPR(I.rt) = load_reserve(cpu, mem, ea, SIZE);                   \
+        NEXT();                                                         \
+    }
+
+#define STCX(name, SIZE)                                                \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = EA_X;                                             \
+        MEM_AT();                                                       \
+        store_conditional(cpu, mem, ea, SIZE, RS);                      \
+        NEXT();                                                         \
+    }
+
+LARX(lbarx, 1)
+LARX(lharx, 2)
+LARX(lwarx, 4)
+LARX(ldarx, 8)
+STCX(stbcx, 1)
+STCX(sthcx, 2)
+STCX(stwcx, 4)
+STCX(stdcx, 8)
+
+// sync orders this vCPU's accesses against the others'. lwsync (L=1)
+// does not order stores before loads, which the host does anyway.
+HANDLER(op_sync) {
+    if (((op->raw >> 21) & 3) == 1) {
+        __atomic_thread_fence(__ATOMIC_ACQ_REL);
+    } else {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    NEXT();
+}
+
+// Floating-point loads and stores move raw bit patterns
+static inline double load_single(memory_system_t* mem, uint64_t ea) {
+    return fp_single_to_double(memory_read32(mem, ea));
+}
+
+static inline double load_double(memory_system_t* mem, uint64_t ea) {
+    uint64_t bits = memory_read64(mem, ea);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline void store_single(memory_system_t* mem, uint64_t ea, double value) {
+    memory_write32(mem, ea, fp_double_to_single(value));
+}
+
+static inline void store_double(memory_system_t* mem, uint64_t ea, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    memory_write64(mem, ea, bits);
+}
+
+#define FP_LOAD(name, EA, LOADER, UPDATE)                               \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        cpu->fpr[I.rt] = LOADER(mem, ea);                               \
+        if (UPDATE) GPR(I.ra) = ea;                                     \
+        NEXT();                                                         \
+    }
+
+#define FP_STORE(name, EA, STORER, UPDATE)                              \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        STORER(mem, ea, cpu->fpr[I.rt]);                                \
+        if (UPDATE) GPR(I.ra) = ea;                                     \
+        NEXT();                                                         \
+    }
+
+FP_LOAD(lfs,    EA_D,  load_single,  false)
+FP_LOAD(lfsu,   EA_DU, load_single,  true)
+FP_LOAD(lfd,    EA_D,  load_double,  false)
+FP_LOAD(lfdu,   EA_DU, load_double,  true)
+FP_STORE(stfs,  EA_D,  store_single, false)
+FP_STORE(stfsu, EA_DU, store_single, true)
+FP_STORE(stfd,  EA_D,  store_double, false)
+FP_STORE(stfdu, EA_DU, store_double, true)
+
+// Floating-point arithmetic, straight on the host FPU; see fpu.h for how
+// FPSCR keeps up. Single-precision forms round the double result once
+// more, to single.
+#define FPR(n)  (cpu->fpr[n])
+
+static inline double round_single(double x) {
+    return (float)x;
+}
+
+// Writes an arithmetic result. Record forms copy FX, FEX, VX and OX into
+// CR1, which needs FPSCR up to date; so does an enabled exception check.
+#define FP_RESULT(VALUE)                                                \
+    do {                                                                \
+        double r_ = (VALUE);                                            \
+        FPR(I.rt) = r_;                                                 \
+        fp_set_fprf(cpu, r_);                                           \
+        if (__builtin_expect(I.rc || cpu->lazy.fp_precise, 0)) {        \
+            if (fp_finish(cpu, op)) return;                             \
+        }                                                               \
+        NEXT();                                                         \
+    } while (0)
+
+static inline void fp_update_cr1(ppc_cpu_state_t* cpu) {
+    fp_sync(cpu);
+    cpu->cr = cr_set_field(cpu->cr, 1, cpu->fpscr >> 28);
+}
+
+static bool fp_finish(ppc_cpu_state_t* cpu, const ppc_op_t* op) {
+    if (I.rc) fp_update_cr1(cpu);
+    if (fp_trap_pending(cpu)) {
+        exit_at(cpu, op, CPU_EXIT_FP);
+        return true;
+    }
+    return false;
+}
+
+// EXPR over a, b, c (frA, frB, frC); X, Y, Z name the operands it reads,
+// in the order PowerPC picks a NaN operand from
+#define FP_OP(name, EXPR, X, Y, Z, SINGLE)                              \
+    HANDLER(op_##name) {                                                \
+        double a = FPR(I.ra), b = FPR(I.rb), c = FPR(I.frc);            \
+        (void)a; (void)b; (void)c;                                      \
+        double r = (EXPR);                                              \
+        if (__builtin_expect(r != r, 0)) r = fp_nan_result(X, Y, Z);    \
+        FP_RESULT(SINGLE ? round_single(r) : r);                        \
+    }
+
+static inline double fp_sqrt(double x) {
+    return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+}
+
+FP_OP(fadd,    a + b,           a, b, b, false)
+FP_OP(fsub,    a - b,           a, b, b, false)
+FP_OP(fmul,    a * c,           a, c, c, false)
+FP_OP(fdiv,    a / b,           a, b, b, false)
+FP_OP(fmadd,   fma(a, c, b),    a, b, c, false)
+FP_OP(fmsub,   fma(a, c, -b),   a, b, c, false)
+FP_OP(fnmadd,  -fma(a, c, b),   a, b, c, false)
+FP_OP(fnmsub,  -fma(a, c, -b),  a, b, c, false)
+FP_OP(fsqrt,   fp_sqrt(b),      b, b, b, false)
+FP_OP(fre,     1.0 / b,         b, b, b, false)
+FP_OP(frsqrte, 1.0 / fp_sqrt(b), b, b, b, false)
+FP_OP(fadds,   a + b,           a, b, b, true)
+FP_OP(fsubs,   a - b,           a, b, b, true)
+FP_OP(fmuls,   a * c,           a, c, c, true)
+FP_OP(fdivs,   a / b,           a, b, b, true)
+FP_OP(fmadds,  fma(a, c, b),    a, b, c, true)
+FP_OP(fmsubs,  fma(a, c, -b),   a, b, c, true)
+FP_OP(fnmadds, -fma(a, c, b),   a, b, c, true)
+FP_OP(fnmsubs, -fma(a, c, -b),  a, b, c, true)
+FP_OP(fsqrts,  fp_sqrt(b),      b, b, b, true)
+FP_OP(fres,    1.0 / b,         b, b, b, true)
+FP_OP(frsqrtes, 1.0 / fp_sqrt(b), b, b, b, true)
+
+// frsp of a NaN keeps its payload, which the host conversion does too
+HANDLER(op_frsp) {
+    FP_RESULT(round_single(FPR(I.rb)));
+}
+
+// fsel never raises anything; NaN selects frB
+HANDLER(op_fsel) {
+    FPR(I.rt) = isgreaterequal(FPR(I.ra), 0.0) ? FPR(I.frc) : FPR(I.rb);
+    if (I.rc) fp_update_cr1(cpu);
+    NEXT();
+}
+
+// Moves and sign operations change no FPSCR bits
+#define FP_MOVE(name, EXPR)                                             \
+    HANDLER(op_##name) {                                                \
+        double b = FPR(I.rb);                                           \
+        FPR(I.rt) = (EXPR);                                             \
+        if (I.rc) fp_update_cr1(cpu);                                   \
+        NEXT();                                                         \
+    }
+
+FP_MOVE(fmr,    b)
+FP_MOVE(fneg,   -b)
+FP_MOVE(fabs,   fabs(b))
+FP_MOVE(fnabs,  -fabs(b))
+FP_MOVE(fcpsgn, copysign(b, FPR(I.ra)))
+
+// Compares set CR[BF] and FPCC. Unordered operands are found first, as
+// the host compare intrinsics do not agree across compilers on what a NaN
+// gives. Both compares flag SNaNs; fcmpo (ordered) also flags QNaNs, and
+// SNaNs too unless VXSNAN is enabled.
+static inline void fp_compare(ppc_cpu_state_t* cpu, const ppc_op_t* op, bool ordered) {
+    double a = FPR(I.ra), b = FPR(I.rb);
+    uint32_t c;
+    if (fp_is_nan(a) || fp_is_nan(b)) {
+        bool snan = fp_is_snan(a) || fp_is_snan(b);
+        uint32_t bits = snan ? FPSCR_VXSNAN : 0;
+        if (ordered && (!snan || !(cpu->fpscr & FPSCR_VE))) bits |= FPSCR_VXVC;
+        if (bits) fp_raise(cpu, bits);
+        c = 1;
+    } else {
+        c = isless(a, b) ? 8 : isgreater(a, b) ? 4 : 2;
+    }
+    fp_settle_fprf(cpu);
+    cpu->fpscr = (cpu->fpscr & ~FPSCR_FPCC) | (c << 12);
+    unsigned bf = I.rt >> 2;
+    cpu->cr = cr_set_field(cpu_get_cr(cpu), bf, c);
+}
+
+HANDLER(op_fcmpu) {
+    fp_compare(cpu, op, false);
+    NEXT();
+}
+
+HANDLER(op_fcmpo) {
+    fp_compare(cpu, op, true);
+    NEXT();
+}
+
+// Integer conversions saturate, with NaN giving the minimum. Out-of-range
+// inputs never reach the host conversion, so VXCVI is set here.
+static inline uint64_t fp_to_int(ppc_cpu_state_t* cpu, double x, double lo, double hi,
+                                 uint64_t min, uint64_t max) {
+    if (__builtin_expect(isgreaterequal(x, lo) && isless(x, hi), 1)) {
+        return (uint64_t)(int64_t)x;    // Truncates; raises inexact
+    }
+    fp_raise(cpu, FPSCR_VXCVI | (fp_is_snan(x) ? FPSCR_VXSNAN : 0));
+    return isgreater(x, 0.0) ? max : min;
+}
+
+static inline uint64_t fp_to_int32(ppc_cpu_state_t* cpu, double x) {
+    return fp_to_int(cpu, x, -2147483648.0, 2147483648.0, 0x80000000ULL, 0x7FFFFFFFULL);
+}
+
+static inline uint64_t fp_to_int64(ppc_cpu_state_t* cpu, double x) {
+    return fp_to_int(cpu, x, -9223372036854775808.0, 9223372036854775808.0,
+                     0x8000000000000000ULL, 0x7FFFFFFFFFFFFFFFULL);
+}
+
+// The non-z forms round in the current mode first (rint raises inexact).
+// fctiw* leave the upper word undefined.
+#define FP_TO_INT(name, ROUND, CONVERT)                                 \
+    HANDLER(op_##name) {                                                \
+        uint64_t v = CONVERT(cpu, ROUND(FPR(I.rb)));                    \
+        memcpy(&FPR(I.rt), &v, sizeof(v));                              \
+        if (__builtin_expect(I.rc || cpu->lazy.fp_precise, 0)) {        \
+            if (fp_finish(cpu, op)) return;                             \
+        }                                                               \
+        NEXT();                                                         \
+    }
+
+#define NO_ROUND(x)     (x)
+
+FP_TO_INT(fctiw,  rint,     fp_to_int32)
+FP_TO_INT(fctiwz, NO_ROUND, fp_to_int32)
+FP_TO_INT(fctid,  rint,     fp_to_int64)
+FP_TO_INT(fctidz, NO_ROUND, fp_to_int64)
+
+#define FP_FROM_INT(name, TYPE, SINGLE)                                 \
+    HANDLER(op_##name) {                                                \
+        uint64_t v;                                                     \
+        memcpy(&v, &FPR(I.rb), sizeof(v));                              \
+        FP_RESULT(SINGLE ? (double)(float)(TYPE)v : (double)(TYPE)v);   \
+    }
+
+FP_FROM_INT(fcfid,  int64_t,  false)
+FP_FROM_INT(fcfidu, uint64_t, false)
+FP_FROM_INT(fcfids, int64_t,  true)
+
+// FPSCR moves. The FEX and VX summaries are never written directly.
+HANDLER(op_mffs) {
+    uint32_t fpscr = fp_read_fpscr(cpu);
+    uint64_t v;
+    switch (I.ra) {
+        case 1:     // mffsce: clears the enables as well
+            fp_write_fpscr(cpu, fpscr & ~FPSCR_ENABLES);
+            break;
+        case 22:    // mffscrn: new rounding mode from frB
+        case 23: {  // mffscrni: from the instruction
+            uint64_t rn;
+            memcpy(&rn, &FPR(I.rb), sizeof(rn));
+            if (I.ra == 23) rn = I.rb;
+            fp_write_fpscr(cpu, (fpscr & ~FPSCR_RN) | (rn & FPSCR_RN));
+            fpscr &= FPSCR_ENABLES | FPSCR_NI | FPSCR_RN;
+            break;
+        }
+        case 24:    // mffsl: the light form returns mode and FPRF bits
+            fpscr &= FPSCR_ENABLES | FPSCR_NI | FPSCR_RN | FPSCR_FPRF;
+            break;
+        default:
+            break;
+    }
+    v = fpscr;
+    memcpy(&FPR(I.rt), &v, sizeof(v));
+    if (I.rc) fp_update_cr1(cpu);
+    NEXT();
+}
+
+// mtfs* end the block when they make an enabled exception interrupt
+static void fp_store_fpscr(ppc_cpu_state_t* cpu, const ppc_op_t* op, uint32_t fpscr) {
+    fp_write_fpscr(cpu, fpscr);
+    if (I.rc) cpu->cr = cr_set_field(cpu->cr, 1, cpu->fpscr >> 28);
+}
+
+#define FPSCR_MOVE_DONE()                                               \
+    do {                                                                \
+        if (__builtin_expect(cpu->lazy.fp_precise && (cpu->fpscr & FPSCR_FEX), 0)) { \
+            exit_to(cpu, op, insn_pc(cpu, op) + 4);                     \
+            cpu->exec_state.exit_reason = CPU_EXIT_FP;                  \
+            return;                                                     \
+        }                                                               \
+        NEXT();                                                         \
+    } while (0)
+
+// FLM picks the fields to copy from frB, or L all of them
+HANDLER(op_mtfsf) {
+    uint32_t fpscr = fp_read_fpscr(cpu);
+    uint64_t v;
+    memcpy(&v, &FPR(I.rb), sizeof(v));
+    uint32_t mask = 0;
+    if ((op->raw >> 25) & 1) {
+        mask = ~0U;
+    } else if (!((op->raw >> 16) & 1)) {  // W=1 names the decimal upper word
+        unsigned flm = (op->raw >> 17) & 0xFF;
+        for (unsigned field = 0; field < 8; field++) {
+            if (flm & (0x80 >> field)) mask |= 0xFU << (28 - field * 4);
+        }
+    }
+    fp_store_fpscr(cpu, op, (fpscr & ~mask) | ((uint32_t)v & mask));
+    FPSCR_MOVE_DONE();
+}
+
+HANDLER(op_mtfsfi) {
+    uint32_t fpscr = fp_read_fpscr(cpu);
+    if (!((op->raw >> 16) & 1)) {
+        unsigned shift = 28 - ((op->raw >> 23) & 7) * 4;
+        uint32_t u = (op->raw >> 12) & 0xF;
+        fpscr = (fpscr & ~(0xFU << shift)) | (u << shift);
+    }
+    fp_store_fpscr(cpu, op, fpscr);
+    FPSCR_MOVE_DONE();
+}
+
+HANDLER(op_mtfsb0) {
+    uint32_t fpscr = fp_read_fpscr(cpu);
+    fp_store_fpscr(cpu, op, fpscr & ~(0x80000000U >> I.rt));
+    FPSCR_MOVE_DONE();
+}
+
+// Setting an exception bit also sets FX
+HANDLER(op_mtfsb1) {
+    uint32_t fpscr = fp_read_fpscr(cpu);
+    uint32_t bit = 0x80000000U >> I.rt;
+    if ((bit & (FPSCR_OX | FPSCR_UX | FPSCR_ZX | FPSCR_XX | FPSCR_VX_ALL)) && !(fpscr & bit)) {
+        fpscr |= FPSCR_FX;
+    }
+    fp_store_fpscr(cpu, op, fpscr | bit);
+    FPSCR_MOVE_DONE();
+}
+
+// mcrfs copies a field to CR and clears the exception bits in it
+HANDLER(op_mcrfs) {
+    uint32_t fpscr = fp_read_fpscr(cpu);
+    unsigned shift = 28 - (I.ra >> 2) * 4;
+    uint32_t exceptions = FPSCR_FX | FPSCR_OX | FPSCR_UX | FPSCR_ZX | FPSCR_XX | FPSCR_VX_ALL;
+    cpu->cr = cr_set_field(cpu_get_cr(cpu), I.rt >> 2, (fpscr >> shift) & 0xF);
+    fp_write_fpscr(cpu, fpscr & ~(exceptions & (0xFU << shift)));
+    NEXT();
+}
+
+// Branches
+static inline bool branch_taken(ppc_cpu_state_t* cpu, unsigned bo, unsigned bi) {
+    if (!(bo & 0x04)) cpu->ctr--;
+    bool ctr_ok = (bo & 0x04) || ((cpu->ctr != 0) != ((bo >> 1) & 1));
+    bool cond_ok = (bo & 0x10) || (cpu_get_cr_bit(cpu, bi) == ((bo >> 3) & 1));
+    return ctr_ok && cond_ok;
+}
+
+HANDLER(op_b) {
+    uint64_t pc = insn_pc(cpu, op);
+    int64_t disp = (int32_t)I.addr;
+    uint64_t target = I.aa ? (uint64_t)disp : pc + disp;
+    if (I.lk) cpu->lr = pc + 4;
+    exit_to(cpu, op, target);
+}
+
+HANDLER(op_bc) {
+    uint64_t pc = insn_pc(cpu, op);
+    int64_t disp = (int32_t)I.addr;
+    uint64_t target = I.aa ? (uint64_t)disp : pc + disp;
+    bool taken = branch_taken(cpu, I.bt, I.ba);
+    if (I.lk) cpu->lr = pc + 4;
+    exit_to(cpu, op, taken ? target : pc + 4);
+}
+
+HANDLER(op_bclr) {
+    uint64_t pc = insn_pc(cpu, op);
+    uint64_t target = cpu->lr & ~3ULL;
+    bool taken = branch_taken(cpu, I.bt, I.ba);
+    if (I.lk) cpu->lr = pc + 4;
+    exit_to(cpu, op, taken ? target : pc + 4);
+}
+
+HANDLER(op_bcctr) {
+    uint64_t pc = insn_pc(cpu, op);
+    uint64_t target = cpu->ctr & ~3ULL;
+    bool taken = (I.bt & 0x10) || (cpu_get_cr_bit(cpu, I.ba) == ((I.bt >> 3) & 1));
+    if (I.lk) cpu->lr = pc + 4;
+    exit_to(cpu, op, taken ? target : pc + 4);
+}
+
+HANDLER(op_sc) {
+    exit_to(cpu, op, insn_pc(cpu, op) + 4);
+    cpu->exec_state.exit_reason = CPU_EXIT_SYSCALL;
+}
+
+// Condition register logical: BT/BA/BB are CR bit numbers
+#define CR_LOGICAL(name, EXPR)                                          \
+    HANDLER(op_##name) {                                                \
+        uint32_t a = cpu_get_cr_bit(cpu, I.ba);                         \
+        uint32_t b = cpu_get_cr_bit(cpu, I.bb);                         \
+        uint32_t bit = (EXPR) & 1;                                      \
+        uint32_t mask = 1U << (31 - I.bt);                              \
+        if (I.bt < 4) cpu_get_cr(cpu);                                  \
+        cpu->cr = (cpu->cr & ~mask) | (bit << (31 - I.bt));             \
+        NEXT();                                                         \
+    }
+
+CR_LOGICAL(crand,  a & b)
+CR_LOGICAL(crandc, a & ~b)
+CR_LOGICAL(creqv,  ~(a ^ b))
+CR_LOGICAL(crnand, ~(a & b))
+CR_LOGICAL(crnor,  ~(a | b))
+CR_LOGICAL(cror,   a | b)
+CR_LOGICAL(crorc,  a | ~b)
+CR_LOGICAL(crxor,  a ^ b)
+
+HANDLER(op_mcrf) {
+    uint32_t cr = cpu_get_cr(cpu);
+    cpu->cr = cr_set_field(cr, INST_BF(op->raw), CR_FIELD(cr, INST_BFA(op->raw)));
+    NEXT();
+}
+
+HANDLER(op_mfcr) {
+    GPR(I.rt) = cpu_get_cr(cpu);
+    NEXT();
+}
+
+HANDLER(op_mtcrf) {
+    uint32_t fxm = INST_FXM(op->raw);
+    uint32_t mask = 0;
+    for (int field = 0; field < 8; field++) {
+        if (fxm & (0x80 >> field)) mask |= 0xF0000000U >> (field * 4);
+    }
+    cpu_set_cr(cpu, (cpu_get_cr(cpu) & ~mask) | ((uint32_t)RS & mask));
+    NEXT();
+}
+
+// Special purpose registers. The timer SPRs end their block
+// (spr_is_timer), which cpu_icount_now relies on.
+HANDLER(op_mfspr) {
+    uint64_t value;
+    switch (I.spr) {
+        case SPR_XER:    value = cpu_get_xer(cpu); break;
+        case SPR_LR:     value = cpu->lr; break;
+        case SPR_CTR:    value = cpu->ctr; break;
+        case SPR_DSISR:  value = cpu->dsisr; break;
+        case SPR_DAR:    value = cpu->dar; break;
+        case SPR_VRSAVE: value = cpu->vrsave; break;
+        case SPR_PID:    value = mem->pid; break;
+        case SPR_LPIDR:  value = mem->lpid; break;
+        case SPR_PTCR:   value = mem->mmu.ptcr; break;
+        case SPR_PIR:    value = cpu->pir; break;
+        case SPR_SRR0:   value = cpu->srr0; break;
+        case SPR_SRR1:   value = cpu->srr1; break;
+        case SPR_DEC:    value = (uint64_t)(int64_t)cpu_get_dec(cpu, cpu_icount_now(cpu)); break;
+        case SPR_TB:     value = cpu_get_tb(cpu, cpu_icount_now(cpu)); break;
+        case SPR_TBU:    value = cpu_get_tb(cpu, cpu_icount_now(cpu)) >> 32; break;
+        default:
+            exit_at(cpu, op, CPU_EXIT_ILLEGAL);
+            return;
+    }
+    GPR(I.rt) = value;
+    NEXT();
+}
+
+HANDLER(op_mtspr) {
+    uint64_t value = RS;
+    switch (I.spr) {
+        case SPR_XER:    cpu_set_xer(cpu, (uint32_t)value); break;
+        case SPR_LR:     cpu->lr = value; break;
+        case SPR_CTR:    cpu->ctr = value; break;
+        case SPR_DSISR:  cpu->dsisr = (uint32_t)value; break;
+        case SPR_DAR:    cpu->dar = value; break;
+        case SPR_VRSAVE: cpu->vrsave = (uint32_t)value; break;
+        case SPR_SRR0:   cpu->srr0 = value; break;
+        case SPR_SRR1:   cpu->srr1 = value; break;
+        // The event queue picks the new deadline up after this block
+        case SPR_DEC:
+            cpu->dec_zero = cpu_icount_now(cpu) + (uint64_t)(int64_t)(int32_t)value;
+            events_kick(mem);
+            break;
+        // Context switches end the block, as the next PC maps differently
+        case SPR_PID:
+            memory_set_context(mem, mem->lpid, (uint32_t)value);
+            exit_to(cpu, op, insn_pc(cpu, op) + 4);
+            return;
+        case SPR_LPIDR:
+            memory_set_context(mem, (uint32_t)value, mem->pid);
+            exit_to(cpu, op, insn_pc(cpu, op) + 4);
+            return;
+        case SPR_PTCR:
+            memory_set_ptcr(mem, value);
+            exit_to(cpu, op, insn_pc(cpu, op) + 4);
+            return;
+        default:
+            exit_at(cpu, op, CPU_EXIT_ILLEGAL);
+            return;
+    }
+    NEXT();
+}
+
+HANDLER(op_mfmsr) {
+    GPR(I.rt) = cpu->msr;
+    NEXT();
+}
+
+// MSR changes can alter translation, so mtmsr ends the block. Setting
+// EE lets the event queue deliver what is pending.
+static void set_msr(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t msr) {
+    if (msr & ~cpu->msr & MSR_EE) events_kick(mem);
+    cpu->msr = msr;
+    cpu_sync_translation(cpu, mem);
+    fp_update_mode(cpu);
+}
+
+// With L=1 only EE and RI change, as around critical sections. Otherwise
+// mtmsr sets the low word and leaves SF and the other high bits alone;
+// mtmsrd sets the whole MSR.
+static uint64_t msr_from(const ppc_cpu_state_t* cpu, const ppc_op_t* op, uint64_t rs, uint64_t mask) {
+    if ((op->raw >> 16) & 1) mask = MSR_EE | MSR_RI;
+    return (cpu->msr & ~mask) | (rs & mask);
+}
+
+HANDLER(op_mtmsr) {
+    set_msr(cpu, mem, msr_from(cpu, op, RS, 0xFFFFFFFFULL));
+    exit_to(cpu, op, insn_pc(cpu, op) + 4);
+}
+
+HANDLER(op_mtmsrd) {
+    set_msr(cpu, mem, msr_from(cpu, op, RS, UINT64_MAX));
+    exit_to(cpu, op, insn_pc(cpu, op) + 4);
+}
+
+// Return from interrupt (events.c): SRR1 becomes the MSR, SF included
+HANDLER(op_rfid) {
+    set_msr(cpu, mem, cpu->srr1);
+    exit_to(cpu, op, cpu->srr0 & ~3ULL);
+}
+
+// TLB invalidation. RB holds the effective page, its size (AP) and, in
+// IS, the scope; RS names the context (PID in the high word, LPID in the
+// low word). tlbiel only affects this vCPU; tlbie also makes every other
+// vCPU flush its TLBs before its next block, which covers the (smaller)
+// invalidation asked for. Cached page table entries are always dropped
+// as well.
+static unsigned tlbie_page_shift(uint64_t rb) {
+    switch ((rb >> 5) & 7) {
+        case 1:  return 21;     // 2M
+        case 2:  return 30;     // 1G
+        case 5:  return 16;     // 64K
+        default: return PAGE_SHIFT;
+    }
+}
+
+static void tlbiel(memory_system_t* mem, uint64_t rb, uint64_t rs) {
+    uint32_t lpid = (uint32_t)rs;
+    uint32_t pid = (uint32_t)(rs >> 32);
+    switch ((rb >> 10) & 3) {
+        case 0:
+            tlb_invalidate_page(mem, rb & ~(uint64_t)PAGE_MASK, lpid, pid, tlbie_page_shift(rb));
+            break;
+        case 1: tlb_invalidate_pid(mem, lpid, pid); break;
+        case 2: tlb_invalidate_lpid(mem, lpid); break;
+        default: tlb_flush(mem); break;
+    }
+}
+
+HANDLER(op_tlbiel) {
+    tlbiel(mem, GPR(I.rb), RS);
+    exit_to(cpu, op, insn_pc(cpu, op) + 4);
+}
+
+HANDLER(op_tlbie) {
+    tlbiel(mem, GPR(I.rb), RS);
+    tlb_broadcast_flush(mem);
+    exit_to(cpu, op, insn_pc(cpu, op) + 4);
+}
+
+// Vector unit (VMX and VSX), on host SIMD; see vector.h for the register
+// layout. VMX names VSRs 32-63, VSX all 64 (decoded as 6-bit numbers).
+#define VRA     vr_read(cpu, I.ra)
+#define VRB     vr_read(cpu, I.rb)
+#define VRC     vr_read(cpu, I.frc)
+#define XA      vsr_read(cpu, I.ra)
+#define XB      vsr_read(cpu, I.rb)
+#define XC      vsr_read(cpu, I.frc)
+#define XT      vsr_read(cpu, I.rt)
+#define UIM     (I.ra)
+#define SIMM5   ((int)((I.ra ^ 0x10) - 0x10))
+
+// VX-form: VRT = f(VRA, VRB)
+#define VX_OP(name, EXPR)                                               \
+    HANDLER(op_##name) {                                                \
+        __m128i a = VRA, b = VRB;                                       \
+        vr_write(cpu, I.rt, (EXPR));                                    \
+        NEXT();                                                         \
+    }
+
+// VX-form reading VRB only
+#define VX_UNARY(name, EXPR)                                            \
+    HANDLER(op_##name) {                                                \
+        __m128i b = VRB;                                                \
+        vr_write(cpu, I.rt, (EXPR));                                    \
+        NEXT();                                                         \
+    }
+
+// Saturating forms record in VSCR[SAT] whether the modulo result differs
+#define VX_SAT(name, SAT_EXPR, MOD_EXPR)                                \
+    HANDLER(op_##name) {                                                \
+        __m128i a = VRA, b = VRB;                                       \
+        __m128i r = (SAT_EXPR);                                         \
+        vec_saturated(cpu, !vec_all_ones(_mm_cmpeq_epi8(r, (MOD_EXPR)))); \
+        vr_write(cpu, I.rt, r);                                         \
+        NEXT();                                                         \
+    }
+
+#define VX_PACK(name, KERNEL)                                           \
+    HANDLER(op_##name) {                                                \
+        bool sat;                                                       \
+        __m128i r = KERNEL(VRA, VRB, &sat);                             \
+        vec_saturated(cpu, sat);                                        \
+        vr_write(cpu, I.rt, r);                                         \
+        NEXT();                                                         \
+    }
+
+// VA-form: VRT = f(VRA, VRB, VRC)
+#define VA_OP(name, EXPR)                                               \
+    HANDLER(op_##name) {                                                \
+        __m128i a = VRA, b = VRB, c = VRC;                              \
+        vr_write(cpu, I.rt, (EXPR));                                    \
+        NEXT();                                                         \
+    }
+
+// VC-form compares set CR6 when Rc is set
+#define VC_OP(name, EXPR)                                               \
+    HANDLER(op_##name) {                                                \
+        __m128i a = VRA, b = VRB;                                       \
+        __m128i r = (EXPR);                                             \
+        vr_write(cpu, I.rt, r);                                         \
+        if (I.rc) vec_set_cr6(cpu, r);                                  \
+        NEXT();                                                         \
+    }
+
+VX_OP(vaddubm, _mm_add_epi8(a, b))
+VX_OP(vadduhm, _mm_add_epi16(a, b))
+VX_OP(vadduwm, _mm_add_epi32(a, b))
+VX_OP(vaddudm, _mm_add_epi64(a, b))
+VX_OP(vsububm, _mm_sub_epi8(a, b))
+VX_OP(vsubuhm, _mm_sub_epi16(a, b))
+VX_OP(vsubuwm, _mm_sub_epi32(a, b))
+VX_OP(vsubudm, _mm_sub_epi64(a, b))
+VX_SAT(vaddubs, _mm_adds_epu8(a, b),  _mm_add_epi8(a, b))
+VX_SAT(vadduhs, _mm_adds_epu16(a, b), _mm_add_epi16(a, b))
+VX_SAT(vaddsbs, _mm_adds_epi8(a, b),  _mm_add_epi8(a, b))
+VX_SAT(vaddshs, _mm_adds_epi16(a, b), _mm_add_epi16(a, b))
+VX_SAT(vsububs, _mm_subs_epu8(a, b),  _mm_sub_epi8(a, b))
+VX_SAT(vsubuhs, _mm_subs_epu16(a, b), _mm_sub_epi16(a, b))
+VX_SAT(vsubsbs, _mm_subs_epi8(a, b),  _mm_sub_epi8(a, b))
+VX_SAT(vsubshs, _mm_subs_epi16(a, b), _mm_sub_epi16(a, b))
+
+VX_OP(vmaxub, _mm_max_epu8(a, b))
+VX_OP(vmaxuh, _mm_max_epu16(a, b))
+VX_OP(vmaxuw, _mm_max_epu32(a, b))
+VX_OP(vmaxsb, _mm_max_epi8(a, b))
+VX_OP(vmaxsh, _mm_max_epi16(a, b))
+VX_OP(vmaxsw, _mm_max_epi32(a, b))
+VX_OP(vminub, _mm_min_epu8(a, b))
+VX_OP(vminuh, _mm_min_epu16(a, b))
+VX_OP(vminuw, _mm_min_epu32(a, b))
+VX_OP(vminsb, _mm_min_epi8(a, b))
+VX_OP(vminsh, _mm_min_epi16(a, b))
+VX_OP(vminsw, _mm_min_epi32(a, b))
+VX_OP(vavgub, _mm_avg_epu8(a, b))
+VX_OP(vavguh, _mm_avg_epu16(a, b))
+
+// Even guest elements are the odd host lanes, so "odd" multiplies use
+// the low half of each host pair and "even" ones shift the high half down
+static inline __m128i vec_mul_uh(__m128i a, __m128i b) {
+    __m128i lo = _mm_and_si128(_mm_mullo_epi16(a, b), _mm_set1_epi32(0xFFFF));
+    return _mm_or_si128(lo, _mm_slli_epi32(_mm_mulhi_epu16(a, b), 16));
+}
+
+VX_OP(vmuluwm, _mm_mullo_epi32(a, b))
+VX_OP(vmulouh, vec_mul_uh(a, b))
+VX_OP(vmuleuh, vec_mul_uh(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)))
+VX_OP(vmulosh, _mm_madd_epi16(_mm_and_si128(a, _mm_set1_epi32(0xFFFF)), b))
+VX_OP(vmulesh, _mm_madd_epi16(_mm_andnot_si128(_mm_set1_epi32(0xFFFF), a), b))
+VX_OP(vmulouw, _mm_mul_epu32(a, b))
+VX_OP(vmuleuw, _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)))
+VX_OP(vmulosw, _mm_mul_epi32(a, b))
+VX_OP(vmulesw, _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)))
+VA_OP(vmladduhm, _mm_add_epi16(_mm_mullo_epi16(a, b), c))
+
+VX_OP(vrlw,  vec_rlv32(a, b))
+VX_OP(vslw,  vec_sllv32(a, b))
+VX_OP(vsrw,  vec_srlv32(a, b))
+VX_OP(vsraw, vec_srav32(a, b))
+VX_OP(vsld,  vec_sllv64(a, b))
+VX_OP(vsrd,  vec_srlv64(a, b))
+
+VX_OP(vand,  _mm_and_si128(a, b))
+VX_OP(vandc, _mm_andnot_si128(b, a))
+VX_OP(vor,   _mm_or_si128(a, b))
+VX_OP(vxor,  _mm_xor_si128(a, b))
+VX_OP(vnor,  vec_not(_mm_or_si128(a, b)))
+VX_OP(vorc,  _mm_or_si128(a, vec_not(b)))
+VX_OP(vnand, vec_not(_mm_and_si128(a, b)))
+VX_OP(veqv,  vec_not(_mm_xor_si128(a, b)))
+VA_OP(vsel,  _mm_or_si128(_mm_andnot_si128(c, a), _mm_and_si128(b, c)))
+
+// Merges interleave the guest-first (host upper) or guest-last halves
+VX_OP(vmrghb, _mm_unpackhi_epi8(b, a))
+VX_OP(vmrghh, _mm_unpackhi_epi16(b, a))
+VX_OP(vmrghw, _mm_unpackhi_epi32(b, a))
+VX_OP(vmrglb, _mm_unpacklo_epi8(b, a))
+VX_OP(vmrglh, _mm_unpacklo_epi16(b, a))
+VX_OP(vmrglw, _mm_unpacklo_epi32(b, a))
+
+VX_UNARY(vspltb, vec_splat8(b, UIM))
+VX_UNARY(vsplth, vec_splat16(b, UIM))
+VX_UNARY(vspltw, vec_splat32(b, UIM))
+
+HANDLER(op_vspltisb) {
+    vr_write(cpu, I.rt, _mm_set1_epi8((char)SIMM5));
+    NEXT();
+}
+
+HANDLER(op_vspltish) {
+    vr_write(cpu, I.rt, _mm_set1_epi16((short)SIMM5));
+    NEXT();
+}
+
+HANDLER(op_vspltisw) {
+    vr_write(cpu, I.rt, _mm_set1_epi32(SIMM5));
+    NEXT();
+}
+
+VA_OP(vperm,  vec_perm(a, b, c))
+VA_OP(vpermr, vec_permr(a, b, c))
+
+HANDLER(op_vsldoi) {
+    vr_write(cpu, I.rt, vec_sldoi(VRA, VRB, I.sh));
+    NEXT();
+}
+
+// Packs put VRA's elements first (host upper half)
+VX_OP(vpkuhum, _mm_packus_epi16(_mm_and_si128(b, _mm_set1_epi16(0xFF)),
+                                _mm_and_si128(a, _mm_set1_epi16(0xFF))))
+VX_OP(vpkuwum, _mm_packus_epi32(_mm_and_si128(b, _mm_set1_epi32(0xFFFF)),
+                                _mm_and_si128(a, _mm_set1_epi32(0xFFFF))))
+VX_PACK(vpkshss, vec_packs16)
+VX_PACK(vpkswss, vec_packs32)
+VX_PACK(vpkshus, vec_packus16)
+VX_PACK(vpkswus, vec_packus32)
+
+VX_UNARY(vupkhsb, _mm_cvtepi8_epi16(_mm_srli_si128(b, 8)))
+VX_UNARY(vupkhsh, _mm_cvtepi16_epi32(_mm_srli_si128(b, 8)))
+VX_UNARY(vupklsb, _mm_cvtepi8_epi16(b))
+VX_UNARY(vupklsh, _mm_cvtepi16_epi32(b))
+
+VC_OP(vcmpequb, _mm_cmpeq_epi8(a, b))
+VC_OP(vcmpequh, _mm_cmpeq_epi16(a, b))
+VC_OP(vcmpequw, _mm_cmpeq_epi32(a, b))
+VC_OP(vcmpequd, _mm_cmpeq_epi64(a, b))
+VC_OP(vcmpgtub, vec_cmpgt_epu8(a, b))
+VC_OP(vcmpgtuh, vec_cmpgt_epu16(a, b))
+VC_OP(vcmpgtuw, vec_cmpgt_epu32(a, b))
+VC_OP(vcmpgtud, vec_cmpgt_epu64(a, b))
+VC_OP(vcmpgtsb, _mm_cmpgt_epi8(a, b))
+VC_OP(vcmpgtsh, _mm_cmpgt_epi16(a, b))
+VC_OP(vcmpgtsw, _mm_cmpgt_epi32(a, b))
+VC_OP(vcmpgtsd, _mm_cmpgt_epi64(a, b))
+VC_OP(vcmpeqfp, VMX_FP(VEC_I(_mm_cmpeq_ps(VEC_PS(a), VEC_PS(b)))))
+VC_OP(vcmpgefp, VMX_FP(VEC_I(_mm_cmpge_ps(VEC_PS(a), VEC_PS(b)))))
+VC_OP(vcmpgtfp, VMX_FP(VEC_I(_mm_cmpgt_ps(VEC_PS(a), VEC_PS(b)))))
+
+// Single-precision arithmetic. vmaddfp is VRA * VRC + VRB, vnmsubfp
+// -(VRA * VRC - VRB), both fused.
+VX_OP(vaddfp, VMX_FP(VEC_I(_mm_add_ps(VEC_PS(a), VEC_PS(b)))))
+VX_OP(vsubfp, VMX_FP(VEC_I(_mm_sub_ps(VEC_PS(a), VEC_PS(b)))))
+VX_OP(vmaxfp, VMX_FP(VEC_I(_mm_max_ps(VEC_PS(a), VEC_PS(b)))))
+VX_OP(vminfp, VMX_FP(VEC_I(_mm_min_ps(VEC_PS(a), VEC_PS(b)))))
+VA_OP(vmaddfp, VMX_FP(VEC_I(vec_fmadd_ps(VEC_PS(a), VEC_PS(c), VEC_PS(b)))))
+VA_OP(vnmsubfp, VMX_FP(VEC_I(vec_fnmsub_ps(VEC_PS(a), VEC_PS(c), VEC_PS(b)))))
+
+// Fixed-point conversions scale by 2^UIM
+VX_UNARY(vcfsx, VMX_FP(VEC_I(_mm_mul_ps(_mm_cvtepi32_ps(b), vec_scale_ps(-(int)UIM)))))
+VX_UNARY(vcfux, VMX_FP(VEC_I(_mm_mul_ps(vec_cvt_uw_ps(b), vec_scale_ps(-(int)UIM)))))
+
+HANDLER(op_vctsxs) {
+    bool sat;
+    __m128i r = VMX_FP(vec_cvt_ps_sw(_mm_mul_ps(VEC_PS(VRB), vec_scale_ps(UIM)), &sat));
+    vec_saturated(cpu, sat);
+    vr_write(cpu, I.rt, r);
+    NEXT();
+}
+
+HANDLER(op_vctuxs) {
+    bool sat;
+    __m128i r = VMX_FP(vec_cvt_ps_uw(_mm_mul_ps(VEC_PS(VRB), vec_scale_ps(UIM)), &sat));
+    vec_saturated(cpu, sat);
+    vr_write(cpu, I.rt, r);
+    NEXT();
+}
+
+// VSCR sits in the last guest word
+HANDLER(op_mfvscr) {
+    vr_write(cpu, I.rt, _mm_cvtsi32_si128((int)cpu->vscr));
+    NEXT();
+}
+
+HANDLER(op_mtvscr) {
+    cpu->vscr = (uint32_t)_mm_cvtsi128_si32(VRB) & (VSCR_NJ | VSCR_SAT);
+    NEXT();
+}
+
+// Vector loads and stores. Memory is big-endian, so the element-ordered
+// forms (lxvd2x, lxvw4x, ...) all read the same as lxvx.
+#define VEC_LOAD(name, EA, WRITE)                                       \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        WRITE(cpu, I.rt, vec_load(mem, ea));                            \
+        NEXT();                                                         \
+    }
+
+#define VEC_STORE(name, EA, READ)                                       \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        vec_store(mem, ea, READ(cpu, I.rt));                            \
+        NEXT();                                                         \
+    }
+
+#define EA_VX   (EA_X & ~15ULL)     // lvx/stvx ignore the low 4 bits
+
+VEC_LOAD(lvx,      EA_VX, vr_write)
+VEC_LOAD(lxvx,     EA_X,  vsr_write)
+VEC_LOAD(lxv,      EA_D,  vsr_write)
+VEC_STORE(stvx,    EA_VX, vr_read)
+VEC_STORE(stxvx,   EA_X,  vsr_read)
+VEC_STORE(stxv,    EA_D,  vsr_read)
+
+// Element loads fill the element's slot; the rest of VRT is undefined,
+// so the whole aligned quadword (same page) is loaded
+HANDLER(op_lvex) {
+    uint64_t ea = EA_X;
+    MEM_AT();
+    vr_write(cpu, I.rt, vec_load(mem, ea & ~15ULL));
+    NEXT();
+}
+
+HANDLER(op_stvebx) {
+    uint64_t ea = EA_X;
+    MEM_AT();
+    memory_write8(mem, ea, cpu->vsr[32 + I.rt].b[15 - (ea & 15)]);
+    NEXT();
+}
+
+HANDLER(op_stvehx) {
+    uint64_t ea = EA_X & ~1ULL;
+    MEM_AT();
+    memory_write16(mem, ea, cpu->vsr[32 + I.rt].h[7 - ((ea & 15) >> 1)]);
+    NEXT();
+}
+
+HANDLER(op_stvewx) {
+    uint64_t ea = EA_X & ~3ULL;
+    MEM_AT();
+    memory_write32(mem, ea, cpu->vsr[32 + I.rt].w[3 - ((ea & 15) >> 2)]);
+    NEXT();
+}
+
+// Permute controls for unaligned accesses: bytes sh..sh+15 (lvsl) and
+// 16-sh..31-sh (lvsr)
+static inline __m128i vec_shift_control(unsigned first) {
+    return _mm_add_epi8(_mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                        _mm_set1_epi8((char)first));
+}
+
+HANDLER(op_lvsl) {
+    vr_write(cpu, I.rt, vec_shift_control(EA_X & 15));
+    NEXT();
+}
+
+HANDLER(op_lvsr) {
+    vr_write(cpu, I.rt, vec_shift_control(16 - (EA_X & 15)));
+    NEXT();
+}
+
+HANDLER(op_lxvdsx) {
+    uint64_t ea = EA_X;
+    MEM_AT();
+    vsr_write(cpu, I.rt, _mm_set1_epi64x((int64_t)LD64(ea)));
+    NEXT();
+}
+
+// Scalar loads and stores use doubleword 0. lxsd/stxsd name VSRs 32-63.
+static inline void vsr_write_bits(ppc_cpu_state_t* cpu, unsigned n, uint64_t bits) {
+    vsr_write(cpu, n, _mm_set_epi64x((int64_t)bits, 0));
+}
+
+static inline uint64_t vsr_read_bits(const ppc_cpu_state_t* cpu, unsigned n) {
+    return (uint64_t)_mm_extract_epi64(vsr_read(cpu, n), 1);
+}
+
+#define VSR_LOAD(name, EA, N, VALUE)                                    \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        vsr_write_bits(cpu, (N), (VALUE));                              \
+        NEXT();                                                         \
+    }
+
+#define VSR_STORE(name, EA, WRITE)                                      \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = (EA);                                             \
+        MEM_AT();                                                       \
+        WRITE;                                                          \
+        NEXT();                                                         \
+    }
+
+VSR_LOAD(lxsdx,   EA_X, I.rt,      LD64(ea))
+VSR_LOAD(lxsiwzx, EA_X, I.rt,      LD32(ea))
+VSR_LOAD(lxsiwax, EA_X, I.rt,      LD32S(ea))
+VSR_LOAD(lxsd,    EA_D, 32 + I.rt, LD64(ea))
+VSR_STORE(stxsdx,  EA_X, memory_write64(mem, ea, vsr_read_bits(cpu, I.rt)))
+VSR_STORE(stxsiwx, EA_X, memory_write32(mem, ea, (uint32_t)vsr_read_bits(cpu, I.rt)))
+VSR_STORE(stxsd,   EA_D, memory_write64(mem, ea, vsr_read_bits(cpu, 32 + I.rt)))
+
+// Moves between GPRs and VSRs. mf* name the GPR in RA.
+HANDLER(op_mfvsrd) {
+    GPR(I.ra) = vsr_read_bits(cpu, I.rt);
+    NEXT();
+}
+
+HANDLER(op_mfvsrwz) {
+    GPR(I.ra) = (uint32_t)vsr_read_bits(cpu, I.rt);
+    NEXT();
+}
+
+HANDLER(op_mfvsrld) {
+    GPR(I.ra) = (uint64_t)_mm_cvtsi128_si64(vsr_read(cpu, I.rt));
+    NEXT();
+}
+
+HANDLER(op_mtvsrd) {
+    vsr_write_bits(cpu, I.rt, RA);
+    NEXT();
+}
+
+HANDLER(op_mtvsrwa) {
+    vsr_write_bits(cpu, I.rt, (uint64_t)(int64_t)(int32_t)RA);
+    NEXT();
+}
+
+HANDLER(op_mtvsrwz) {
+    vsr_write_bits(cpu, I.rt, (uint32_t)RA);
+    NEXT();
+}
+
+HANDLER(op_mtvsrdd) {
+    vsr_write(cpu, I.rt, _mm_set_epi64x((int64_t)RA0, (int64_t)RB));
+    NEXT();
+}
+
+HANDLER(op_mtvsrws) {
+    vsr_write(cpu, I.rt, _mm_set1_epi32((int)RA));
+    NEXT();
+}
+
+// XX3-form: XT = f(XA, XB)
+#define XX3_OP(name, EXPR)                                              \
+    HANDLER(op_##name) {                                                \
+        __m128i a = XA, b = XB;                                         \
+        vsr_write(cpu, I.rt, (EXPR));                                   \
+        NEXT();                                                         \
+    }
+
+// Multiply-adds also read XT: "a" forms are XA * XB + XT, "m" forms
+// XA * XT + XB
+#define XX3_FMA(name, EXPR)                                             \
+    HANDLER(op_##name) {                                                \
+        __m128i a = XA, b = XB, t = XT;                                 \
+        vsr_write(cpu, I.rt, (EXPR));                                   \
+        NEXT();                                                         \
+    }
+
+#define XX2_OP(name, EXPR)                                              \
+    HANDLER(op_##name) {                                                \
+        __m128i b = XB;                                                 \
+        vsr_write(cpu, I.rt, (EXPR));                                   \
+        NEXT();                                                         \
+    }
+
+#define XX3_CMP(name, EXPR)                                             \
+    HANDLER(op_##name) {                                                \
+        __m128i a = XA, b = XB;                                         \
+        __m128i r = (EXPR);                                             \
+        vsr_write(cpu, I.rt, r);                                        \
+        if (I.rc) vec_set_cr6(cpu, r);                                  \
+        NEXT();                                                         \
+    }
+
+// Scalar double precision on doubleword 0
+#define XS_OP(name, EXPR)                                               \
+    HANDLER(op_##name) {                                                \
+        double a = vsr_read_dw0(cpu, I.ra), b = vsr_read_dw0(cpu, I.rb); \
+        vsr_write_dw0(cpu, I.rt, (EXPR));                               \
+        NEXT();                                                         \
+    }
+
+#define XS_FMA(name, EXPR)                                              \
+    HANDLER(op_##name) {                                                \
+        double a = vsr_read_dw0(cpu, I.ra), b = vsr_read_dw0(cpu, I.rb); \
+        double t = vsr_read_dw0(cpu, I.rt);                             \
+        vsr_write_dw0(cpu, I.rt, (EXPR));                               \
+        NEXT();                                                         \
+    }
+
+#define XS_UNARY(name, EXPR)                                            \
+    HANDLER(op_##name) {                                                \
+        double b = vsr_read_dw0(cpu, I.rb);                             \
+        vsr_write_dw0(cpu, I.rt, (EXPR));                               \
+        NEXT();                                                         \
+    }
+
+static inline double sd_fma(double a, double b, double c) {
+    return _mm_cvtsd_f64(vec_fmadd_pd(_mm_set_sd(a), _mm_set_sd(b), _mm_set_sd(c)));
+}
+
+XS_OP(xsadddp, a + b)
+XS_OP(xssubdp, a - b)
+XS_OP(xsmuldp, a * b)
+XS_OP(xsdivdp, a / b)
+XS_OP(xsmaxdp, _mm_cvtsd_f64(_mm_max_sd(_mm_set_sd(a), _mm_set_sd(b))))
+XS_OP(xsmindp, _mm_cvtsd_f64(_mm_min_sd(_mm_set_sd(a), _mm_set_sd(b))))
+XS_OP(xscpsgndp, copysign(b, a))
+XS_FMA(xsmaddadp, sd_fma(a, b, t))
+XS_FMA(xsmaddmdp, sd_fma(a, t, b))
+XS_FMA(xsmsubadp, sd_fma(a, b, -t))
+XS_FMA(xsmsubmdp, sd_fma(a, t, -b))
+XS_FMA(xsnmaddadp, -sd_fma(a, b, t))
+XS_FMA(xsnmsubadp, -sd_fma(a, b, -t))
+XS_UNARY(xssqrtdp, _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(b))))
+XS_UNARY(xsabsdp,  fabs(b))
+XS_UNARY(xsnabsdp, -fabs(b))
+XS_UNARY(xsnegdp,  -b)
+
+// Single-precision scalars sit in word 0; the other words are undefined
+// and get copies
+HANDLER(op_xscvdpsp) {
+    float f = (float)vsr_read_dw0(cpu, I.rb);
+    vsr_write(cpu, I.rt, VEC_I(_mm_set1_ps(f)));
+    NEXT();
+}
+
+HANDLER(op_xscvspdp) {
+    float f = _mm_cvtss_f32(VEC_PS(_mm_shuffle_epi32(XB, _MM_SHUFFLE(3, 3, 3, 3))));
+    vsr_write_dw0(cpu, I.rt, f);
+    NEXT();
+}
+
+// Vector floating point
+#define DP_OP(f)            VEC_ID(f(VEC_PD(a), VEC_PD(b)))
+#define SP_OP(f)            VEC_I(f(VEC_PS(a), VEC_PS(b)))
+#define FMA_DP(x, y, z)     VEC_ID(vec_fmadd_pd(VEC_PD(x), VEC_PD(y), VEC_PD(z)))
+#define FMA_SP(x, y, z)     VEC_I(vec_fmadd_ps(VEC_PS(x), VEC_PS(y), VEC_PS(z)))
+#define SIGN_DP             _mm_set1_epi64x((int64_t)0x8000000000000000ULL)
+#define SIGN_SP             _mm_set1_epi32((int)0x80000000)
+#define NEG_DP(x)           _mm_xor_si128((x), SIGN_DP)
+#define NEG_SP(x)           _mm_xor_si128((x), SIGN_SP)
+
+XX3_OP(xvadddp, DP_OP(_mm_add_pd))
+XX3_OP(xvsubdp, DP_OP(_mm_sub_pd))
+XX3_OP(xvmuldp, DP_OP(_mm_mul_pd))
+XX3_OP(xvdivdp, DP_OP(_mm_div_pd))
+XX3_OP(xvmaxdp, DP_OP(_mm_max_pd))
+XX3_OP(xvmindp, DP_OP(_mm_min_pd))
+XX3_OP(xvaddsp, SP_OP(_mm_add_ps))
+XX3_OP(xvsubsp, SP_OP(_mm_sub_ps))
+XX3_OP(xvmulsp, SP_OP(_mm_mul_ps))
+XX3_OP(xvdivsp, SP_OP(_mm_div_ps))
+XX3_OP(xvmaxsp, SP_OP(_mm_max_ps))
+XX3_OP(xvminsp, SP_OP(_mm_min_ps))
+
+XX3_FMA(xvmaddadp,  FMA_DP(a, b, t))
+XX3_FMA(xvmaddmdp,  FMA_DP(a, t, b))
+XX3_FMA(xvmsubadp,  FMA_DP(a, b, NEG_DP(t)))
+XX3_FMA(xvmsubmdp,  FMA_DP(a, t, NEG_DP(b)))
+XX3_FMA(xvnmaddadp, NEG_DP(FMA_DP(a, b, t)))
+XX3_FMA(xvnmsubadp, NEG_DP(FMA_DP(a, b, NEG_DP(t))))
+XX3_FMA(xvmaddasp,  FMA_SP(a, b, t))
+XX3_FMA(xvmaddmsp,  FMA_SP(a, t, b))
+XX3_FMA(xvmsubasp,  FMA_SP(a, b, NEG_SP(t)))
+XX3_FMA(xvmsubmsp,  FMA_SP(a, t, NEG_SP(b)))
+XX3_FMA(xvnmaddasp, NEG_SP(FMA_SP(a, b, t)))
+XX3_FMA(xvnmsubasp, NEG_SP(FMA_SP(a, b, NEG_SP(t))))
+
+XX3_CMP(xvcmpeqdp, DP_OP(_mm_cmpeq_pd))
+XX3_CMP(xvcmpgtdp, DP_OP(_mm_cmpgt_pd))
+XX3_CMP(xvcmpgedp, DP_OP(_mm_cmpge_pd))
+XX3_CMP(xvcmpeqsp, SP_OP(_mm_cmpeq_ps))
+XX3_CMP(xvcmpgtsp, SP_OP(_mm_cmpgt_ps))
+XX3_CMP(xvcmpgesp, SP_OP(_mm_cmpge_ps))
+
+XX2_OP(xvsqrtdp, VEC_ID(_mm_sqrt_pd(VEC_PD(b))))
+XX2_OP(xvsqrtsp, VEC_I(_mm_sqrt_ps(VEC_PS(b))))
+XX2_OP(xvabsdp,  _mm_andnot_si128(SIGN_DP, b))
+XX2_OP(xvnabsdp, _mm_or_si128(b, SIGN_DP))
+XX2_OP(xvnegdp,  NEG_DP(b))
+XX2_OP(xvabssp,  _mm_andnot_si128(SIGN_SP, b))
+XX2_OP(xvnabssp, _mm_or_si128(b, SIGN_SP))
+XX2_OP(xvnegsp,  NEG_SP(b))
+
+// Conversions between words 0 and 2 (host lanes 3 and 1) and doublewords
+#define WORDS_0_2(x)        _mm_shuffle_epi32((x), _MM_SHUFFLE(3, 3, 3, 1))
+#define TO_WORDS_0_2(x)     _mm_shuffle_epi32((x), _MM_SHUFFLE(1, 1, 0, 0))
+
+// Out-of-range conversions give the nearest bound; NaN gives the
+// minimum, which is what the host produces for both
+static inline __m128i vec_cvt_pd_sw(__m128d x) {
+    __m128i r = _mm_cvttpd_epi32(x);
+    __m128i big = _mm_castpd_si128(_mm_cmpge_pd(x, _mm_set1_pd(2147483648.0)));
+    big = _mm_shuffle_epi32(big, _MM_SHUFFLE(3, 3, 2, 0));
+    return _mm_blendv_epi8(r, _mm_set1_epi32(0x7FFFFFFF), big);
+}
+
+static inline __m128i vec_cvt_ps_sw_vsx(__m128 x) {
+    __m128i r = _mm_cvttps_epi32(x);
+    __m128 big = _mm_cmpge_ps(x, _mm_set1_ps(2147483648.0f));
+    return _mm_blendv_epi8(r, _mm_set1_epi32(0x7FFFFFFF), VEC_I(big));
+}
+
+static inline int64_t dp_to_sd(double x) {
+    if (x != x || x <= -9223372036854775808.0) return INT64_MIN;
+    if (x >= 9223372036854775808.0) return INT64_MAX;
+    return (int64_t)x;
+}
+
+XX2_OP(xvcvspdp,   VEC_ID(_mm_cvtps_pd(VEC_PS(WORDS_0_2(b)))))
+XX2_OP(xvcvdpsp,   TO_WORDS_0_2(VEC_I(_mm_cvtpd_ps(VEC_PD(b)))))
+XX2_OP(xvcvsxwdp,  VEC_ID(_mm_cvtepi32_pd(WORDS_0_2(b))))
+XX2_OP(xvcvuxwdp,  VEC_ID(_mm_add_pd(_mm_cvtepi32_pd(NEG_SP(WORDS_0_2(b))),
+                                     _mm_set1_pd(2147483648.0))))
+XX2_OP(xvcvdpsxws, TO_WORDS_0_2(vec_cvt_pd_sw(VEC_PD(b))))
+XX2_OP(xvcvsxwsp,  VEC_I(_mm_cvtepi32_ps(b)))
+XX2_OP(xvcvspsxws, vec_cvt_ps_sw_vsx(VEC_PS(b)))
+
+// No 64-bit integer conversions below AVX-512: two scalar ones
+XX2_OP(xvcvsxddp,  VEC_ID(_mm_set_pd((double)_mm_extract_epi64(b, 1),
+                                     (double)_mm_extract_epi64(b, 0))))
+
+HANDLER(op_xvcvdpsxds) {
+    __m128d b = VEC_PD(XB);
+    __m128d hi = _mm_unpackhi_pd(b, b);
+    vsr_write(cpu, I.rt, _mm_set_epi64x(dp_to_sd(_mm_cvtsd_f64(hi)), dp_to_sd(_mm_cvtsd_f64(b))));
+    NEXT();
+}
+
+// Logical and permutes
+XX3_OP(xxland,  _mm_and_si128(a, b))
+XX3_OP(xxlandc, _mm_andnot_si128(b, a))
+XX3_OP(xxlor,   _mm_or_si128(a, b))
+XX3_OP(xxlxor,  _mm_xor_si128(a, b))
+XX3_OP(xxlnor,  vec_not(_mm_or_si128(a, b)))
+XX3_OP(xxlorc,  _mm_or_si128(a, vec_not(b)))
+XX3_OP(xxlnand, vec_not(_mm_and_si128(a, b)))
+XX3_OP(xxleqv,  vec_not(_mm_xor_si128(a, b)))
+XX3_OP(xxmrghw, _mm_unpackhi_epi32(b, a))
+XX3_OP(xxmrglw, _mm_unpacklo_epi32(b, a))
+XX3_FMA(xxperm,  vec_perm(a, t, b))
+XX3_FMA(xxpermr, vec_permr(a, t, b))
+
+HANDLER(op_xxsel) {
+    __m128i c = XC;
+    vsr_write(cpu, I.rt, _mm_or_si128(_mm_andnot_si128(c, XA), _mm_and_si128(XB, c)));
+    NEXT();
+}
+
+// DM picks doubleword 0 or 1 of XA (bit 22) and of XB (bit 23)
+HANDLER(op_xxpermdi) {
+    __m128i a = XA, b = XB;
+    __m128i hi = (op->raw & 0x200) ? _mm_unpacklo_epi64(a, a) : a;
+    __m128i lo = (op->raw & 0x100) ? b : _mm_unpackhi_epi64(b, b);
+    vsr_write(cpu, I.rt, _mm_blend_epi16(lo, hi, 0xF0));
+    NEXT();
+}
+
+HANDLER(op_xxsldwi) {
+    vsr_write(cpu, I.rt, vec_sldoi(XA, XB, ((op->raw >> 8) & 3) * 4));
+    NEXT();
+}
+
+HANDLER(op_xxspltw) {
+    vsr_write(cpu, I.rt, vec_splat32(XB, (op->raw >> 16) & 3));
+    NEXT();
+}
+
+HANDLER(op_xxspltib) {
+    vsr_write(cpu, I.rt, _mm_set1_epi8((char)(op->raw >> 11)));
+    NEXT();
+}
+
+// Fused ops. When a block is decoded, interp_fuse gives the first op of
+// some common instruction pairs a handler that executes both and continues
+// at the op after the second, saving a dispatch and, for compares, the
+// trip through CR. The second op keeps its own handler and its pc_off, so
+// exits and faults in the second half are accounted to it as usual.
+#define NEXT2() return op[2].handler(cpu, mem, op + 2)
+
+// lis/addis + addi and lis + ori: building a 32-bit constant or address
+HANDLER(op_addis_addi) {
+    const ppc_packed_inst_t* lo = &op[1].inst;
+    GPR(I.rt) = RA0 + (SIMM << 16);
+    GPR(lo->rt) = GPR(lo->ra) + (uint64_t)(int64_t)lo->simm;
+    NEXT2();
+}
+
+HANDLER(op_addis_ori) {
+    const ppc_packed_inst_t* lo = &op[1].inst;
+    GPR(I.rt) = RA0 + (SIMM << 16);
+    GPR(lo->ra) = GPR(lo->rt) | lo->imm;
+    NEXT2();
+}
+
+// oris + ori: the low half of a 64-bit constant
+HANDLER(op_oris_ori) {
+    const ppc_packed_inst_t* lo = &op[1].inst;
+    GPR(I.ra) = RS | ((uint64_t)I.imm << 16);
+    GPR(lo->ra) = GPR(lo->rt) | lo->imm;
+    NEXT2();
+}
+
+// Compare + bc on the field just written. Only fused when the bc does not
+// touch CTR, so the outcome follows from the field without reading CR.
+static inline void fused_bc(ppc_cpu_state_t* cpu, const ppc_op_t* br, uint32_t field) {
+    const ppc_packed_inst_t* b = &br->inst;
+    uint64_t pc = insn_pc(cpu, br);
+    int64_t disp = (int32_t)b->addr;
+    uint64_t target = b->aa ? (uint64_t)disp : pc + disp;
+    bool taken = (b->bt & 0x10) || (((field >> (3 - (b->ba & 3))) & 1) == ((b->bt >> 3) & 1));
+    if (b->lk) cpu->lr = pc + 4;
+    exit_to(cpu, br, taken ? target : pc + 4);
+}
+
+#define COMPARE_BC(name, COMPARE, B)                                    \
+    HANDLER(op_##name##_bc) {                                           \
+        fused_bc(cpu, op + 1, COMPARE(cpu, op, RA, (B)));               \
+    }
+
+COMPARE_BC(cmp,   compare_signed,   RB)
+COMPARE_BC(cmpl,  compare_unsigned, RB)
+COMPARE_BC(cmpi,  compare_signed,   SIMM)
+COMPARE_BC(cmpli, compare_unsigned, I.imm)
+
+// mflr + std/stw: saving the return address in a prologue
+#define MFLR_STORE(name, WRITE)                                         \
+    HANDLER(op_mflr_##name) {                                           \
+        const ppc_op_t* st = op + 1;                                    \
+        GPR(I.rt) = cpu->lr;                                            \
+        uint64_t ea = (st->inst.ra ? GPR(st->inst.ra) : 0) +            \
+                      (uint64_t)(int64_t)st->inst.simm;                 \
+        cpu->exec_state.mem_pc_off = st->pc_off;                        \
+        WRITE;                                                          \
+        NEXT2();                                                        \
+    }
+
+MFLR_STORE(std, memory_write64(mem, ea, cpu->lr))
+MFLR_STORE(stw, memory_write32(mem, ea, (uint32_t)cpu->lr))
+
+// Prefixed instructions (v3.1) are a prefix word followed by a suffix,
+// one 8-byte instruction that decodes as two ops; the pair only means
+// something fused. The prefix holds R and the high 18 bits of the 34-bit
+// displacement, the suffix a D-form instruction with the low 16. R makes
+// the address relative to the instruction. Both words count as retired.
+#define PREFIX_R(raw)   (((raw) >> 20) & 1)
+
+// The suffix is decoded as whatever it would be on its own, so its fields
+// come from the raw word
+#define SUFFIX_RT   INST_RT(op[1].raw)
+
+static inline uint64_t prefixed_ea(ppc_cpu_state_t* cpu, const ppc_op_t* op) {
+    uint32_t suffix = op[1].raw;
+    uint64_t d = ((uint64_t)(op->raw & 0x3FFFF) << 16) | INST_UIMM(suffix);
+    d = (uint64_t)((int64_t)(d << 30) >> 30);
+    if (PREFIX_R(op->raw)) return insn_pc(cpu, op) + d;
+    return (INST_RA(suffix) ? GPR(INST_RA(suffix)) : 0) + d;
+}
+
+// Faults point at the prefix, as the pair is one instruction
+#define PLOAD(name, VALUE)                                              \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = prefixed_ea(cpu, op);                             \
+        MEM_AT();                                                       \
+        GPR(SUFFIX_RT) = (VALUE);                                       \
+        NEXT2();                                                        \
+    }
+
+#define PSTORE(name, WRITE)                                             \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = prefixed_ea(cpu, op);                             \
+        uint64_t rs = GPR(SUFFIX_RT);                                   \
+        MEM_AT();                                                       \
+        WRITE;                                                          \
+        NEXT2();                                                        \
+    }
+
+#define PFP_LOAD(name, LOADER)                                          \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = prefixed_ea(cpu, op);                             \
+        MEM_AT();                                                       \
+        cpu->fpr[SUFFIX_RT] = LOADER(mem, ea);                          \
+        NEXT2();                                                        \
+    }
+
+#define PFP_STORE(name, STORER)                                         \
+    HANDLER(op_##name) {                                                \
+        uint64_t ea = prefixed_ea(cpu, op);                             \
+        MEM_AT();                                                       \
+        STORER(mem, ea, cpu->fpr[SUFFIX_RT]);                           \
+        NEXT2();                                                        \
+    }
+
+// paddi, and pli/pla
+HANDLER(op_paddi) {
+    GPR(SUFFIX_RT) = prefixed_ea(cpu, op);
+    NEXT2();
+}
+
+PLOAD(plbz, LD8(ea))
+PLOAD(plhz, LD16(ea))
+PLOAD(plha, LD16S(ea))
+PLOAD(plwz, LD32(ea))
+PLOAD(plwa, LD32S(ea))
+PLOAD(pld,  LD64(ea))
+PSTORE(pstb, memory_write8(mem, ea, (uint8_t)rs))
+PSTORE(psth, memory_write16(mem, ea, (uint16_t)rs))
+PSTORE(pstw, memory_write32(mem, ea, (uint32_t)rs))
+PSTORE(pstd, memory_write64(mem, ea, rs))
+PFP_LOAD(plfs,   load_single)
+PFP_LOAD(plfd,   load_double)
+PFP_STORE(pstfs, store_single)
+PFP_STORE(pstfd, store_double)
+
+// Handler for a prefixed instruction, by prefix type (bits 6-7) and
+// suffix primary opcode; NULL when unsupported or an invalid form (bit 8
+// selects other subtypes)
+static ppc_handler_t prefixed_handler(uint32_t prefix, uint32_t suffix) {
+    if (PREFIX_R(prefix) && INST_RA(suffix)) return NULL;
+    if ((prefix >> 23) & 1) return NULL;
+    switch ((prefix >> 24) & 3) {
+        case 0:     // 8LS: eight-byte load/store
+            switch (INST_OPCODE(suffix)) {
+                case PPC_OP_LHZU: return op_plwa;   // Suffix opcodes mean other
+                case PPC_OP_LXSD: return op_pld;    // things under 8LS
+                case PPC_OP_STXV: return op_pstd;
+            }
+            break;
+        case 2:     // MLS: modified load/store and paddi
+            switch (INST_OPCODE(suffix)) {
+                case PPC_OP_ADDI: return op_paddi;
+                case PPC_OP_LBZ:  return op_plbz;
+                case PPC_OP_LHZ:  return op_plhz;
+                case PPC_OP_LHA:  return op_plha;
+                case PPC_OP_LWZ:  return op_plwz;
+                case PPC_OP_STB:  return op_pstb;
+                case PPC_OP_STH:  return op_psth;
+                case PPC_OP_STW:  return op_pstw;
+                case PPC_OP_LFS:  return op_plfs;
+                case PPC_OP_LFD:  return op_plfd;
+                case PPC_OP_STFS: return op_pstfs;
+                case PPC_OP_STFD: return op_pstfd;
+            }
+            break;
+    }
+    return NULL;
+}
+
+// Handler executing a and b together, or NULL
+static ppc_handler_t fused_handler(const ppc_op_t* first, const ppc_op_t* second) {
+    const ppc_packed_inst_t* a = &first->inst;
+    const ppc_packed_inst_t* b = &second->inst;
+    switch (a->id) {
+        case PPC_INST_PREFIX:
+            return prefixed_handler(first->raw, second->raw);
+        case PPC_INST_ADDIS:
+            if (b->id == PPC_INST_ADDI && b->ra == a->rt && b->ra) return op_addis_addi;
+            if (b->id == PPC_INST_ORI && b->rt == a->rt) return op_addis_ori;
+            return NULL;
+        case PPC_INST_ORIS:
+            if (b->id == PPC_INST_ORI && b->rt == a->ra) return op_oris_ori;
+            return NULL;
+        case PPC_INST_MFSPR:
+            if (a->spr != SPR_LR || b->rt != a->rt) return NULL;
+            if (b->id == PPC_INST_STD) return op_mflr_std;
+            if (b->id == PPC_INST_STW) return op_mflr_stw;
+            return NULL;
+        case PPC_INST_CMP:
+        case PPC_INST_CMPL:
+        case PPC_INST_CMPI:
+        case PPC_INST_CMPLI:
+            // bc testing a bit of the field compared, CTR untouched
+            if (b->id != PPC_INST_BC || !(b->bt & 0x04) || (b->ba >> 2) != (a->rt >> 2)) return NULL;
+            switch (a->id) {
+                case PPC_INST_CMP:  return op_cmp_bc;
+                case PPC_INST_CMPL: return op_cmpl_bc;
+                case PPC_INST_CMPI: return op_cmpi_bc;
+                default:            return op_cmpli_bc;
+            }
+        default:
+            return NULL;
+    }
+}
+
+static const ppc_handler_t handlers[PPC_INST_COUNT] = {
+    [PPC_INST_TDI] = op_tdi, [PPC_INST_TWI] = op_twi,
+    [PPC_INST_TD] = op_td, [PPC_INST_TW] = op_tw,
+
+    [PPC_INST_ADDI] = op_addi, [PPC_INST_ADDIS] = op_addis,
+    [PPC_INST_ADDIC] = op_addic, [PPC_INST_ADDIC_DOT] = op_addic_dot,
+    [PPC_INST_SUBFIC] = op_subfic, [PPC_INST_MULLI] = op_mulli,
+    [PPC_INST_ADD] = op_add, [PPC_INST_ADDC] = op_addc, [PPC_INST_ADDE] = op_adde,
+    [PPC_INST_ADDZE] = op_addze, [PPC_INST_ADDME] = op_addme,
+    [PPC_INST_SUBF] = op_subf, [PPC_INST_SUBFC] = op_subfc, [PPC_INST_SUBFE] = op_subfe,
+    [PPC_INST_SUBFZE] = op_subfze, [PPC_INST_SUBFME] = op_subfme, [PPC_INST_NEG] = op_neg,
+    [PPC_INST_MULLW] = op_mullw, [PPC_INST_MULLD] = op_mulld,
+    [PPC_INST_MULHW] = op_mulhw, [PPC_INST_MULHWU] = op_mulhwu,
+    [PPC_INST_MULHD] = op_mulhd, [PPC_INST_MULHDU] = op_mulhdu,
+    [PPC_INST_DIVW] = op_divw, [PPC_INST_DIVWU] = op_divwu,
+    [PPC_INST_DIVD] = op_divd, [PPC_INST_DIVDU] = op_divdu,
+
+    [PPC_INST_AND] = op_and, [PPC_INST_ANDC] = op_andc, [PPC_INST_OR] = op_or,
+    [PPC_INST_ORC] = op_orc, [PPC_INST_XOR] = op_xor, [PPC_INST_NOR] = op_nor,
+    [PPC_INST_EQV] = op_eqv, [PPC_INST_NAND] = op_nand,
+    [PPC_INST_EXTSB] = op_extsb, [PPC_INST_EXTSH] = op_extsh, [PPC_INST_EXTSW] = op_extsw,
+    [PPC_INST_CNTLZW] = op_cntlzw, [PPC_INST_CNTLZD] = op_cntlzd,
+    [PPC_INST_ORI] = op_ori, [PPC_INST_ORIS] = op_oris,
+    [PPC_INST_XORI] = op_xori, [PPC_INST_XORIS] = op_xoris,
+    [PPC_INST_ANDI_DOT] = op_andi_dot, [PPC_INST_ANDIS_DOT] = op_andis_dot,
+
+    [PPC_INST_SLW] = op_slw, [PPC_INST_SRW] = op_srw, [PPC_INST_SRAW] = op_sraw,
+    [PPC_INST_SRAWI] = op_srawi, [PPC_INST_SLD] = op_sld, [PPC_INST_SRD] = op_srd,
+    [PPC_INST_SRAD] = op_srad, [PPC_INST_SRADI] = op_sradi,
+    [PPC_INST_RLWINM] = op_rlwinm, [PPC_INST_RLWNM] = op_rlwnm, [PPC_INST_RLWIMI] = op_rlwimi,
+    [PPC_INST_RLDICL] = op_rldicl, [PPC_INST_RLDICR] = op_rldicr,
+    [PPC_INST_RLDIC] = op_rldic, [PPC_INST_RLDIMI] = op_rldimi,
+
+    [PPC_INST_CMP] = op_cmp, [PPC_INST_CMPL] = op_cmpl,
+    [PPC_INST_CMPI] = op_cmpi, [PPC_INST_CMPLI] = op_cmpli,
+
+    [PPC_INST_LBZ] = op_lbz, [PPC_INST_LBZU] = op_lbzu,
+    [PPC_INST_LBZX] = op_lbzx, [PPC_INST_LBZUX] = op_lbzux,
+    [PPC_INST_LHZ] = op_lhz, [PPC_INST_LHZU] = op_lhzu,
+    [PPC_INST_LHZX] = op_lhzx, [PPC_INST_LHZUX] = op_lhzux,
+    [PPC_INST_LHA] = op_lha, [PPC_INST_LHAU] = op_lhau,
+    [PPC_INST_LHAX] = op_lhax, [PPC_INST_LHAUX] = op_lhaux,
+    [PPC_INST_LWZ] = op_lwz, [PPC_INST_LWZU] = op_lwzu,
+    [PPC_INST_LWZX] = op_lwzx, [PPC_INST_LWZUX] = op_lwzux,
+    [PPC_INST_LWA] = op_lwa, [PPC_INST_LWAX] = op_lwax,
+    [PPC_INST_LD] = op_ld, [PPC_INST_LDU] = op_ldu,
+    [PPC_INST_LDX] = op_ldx, [PPC_INST_LDUX] = op_ldux,
+    [PPC_INST_STB] = op_stb, [PPC_INST_STBU] = op_stbu,
+    [PPC_INST_STBX] = op_stbx, [PPC_INST_STBUX] = op_stbux,
+    [PPC_INST_STH] = op_sth, [PPC_INST_STHU] = op_sthu,
+    [PPC_INST_STHX] = op_sthx, [PPC_INST_STHUX] = op_sthux,
+    [PPC_INST_STW] = op_stw, [PPC_INST_STWU] = op_stwu,
+    [PPC_INST_STWX] = op_stwx, [PPC_INST_STWUX] = op_stwux,
+    [PPC_INST_STD] = op_std, [PPC_INST_STDU] = op_stdu,
+    [PPC_INST_STDX] = op_stdx, [PPC_INST_STDUX] = op_stdux,
+    [PPC_INST_LMW] = op_lmw, [PPC_INST_STMW] = op_stmw,
+    [PPC_INST_LBARX] = op_lbarx, [PPC_INST_LHARX] = op_lharx,
+    [PPC_INST_LWARX] = op_lwarx, [PPC_INST_LDARX] = op_ldarx,
+    [PPC_INST_STBCX] = op_stbcx, [PPC_INST_STHCX] = op_sthcx,
+    [PPC_INST_STWCX] = op_stwcx, [PPC_INST_STDCX] = op_stdcx,
+    [PPC_INST_LFS] = op_lfs, [PPC_INST_LFSU] = op_lfsu,
+    [PPC_INST_LFD] = op_lfd, [PPC_INST_LFDU] = op_lfdu,
+    [PPC_INST_STFS] = op_stfs, [PPC_INST_STFSU] = op_stfsu,
+    [PPC_INST_STFD] = op_stfd, [PPC_INST_STFDU] = op_stfdu,
+    [PPC_INST_FADD] = op_fadd, [PPC_INST_FSUB] = op_fsub,
+    [PPC_INST_FMUL] = op_fmul, [PPC_INST_FDIV] = op_fdiv, [PPC_INST_FSEL] = op_fsel,
+    [PPC_INST_FMADD] = op_fmadd, [PPC_INST_FMSUB] = op_fmsub,
+    [PPC_INST_FNMADD] = op_fnmadd, [PPC_INST_FNMSUB] = op_fnmsub,
+
+    [PPC_INST_B] = op_b, [PPC_INST_BC] = op_bc,
+    [PPC_INST_BCLR] = op_bclr, [PPC_INST_BCCTR] = op_bcctr,
+    [PPC_INST_SC] = op_sc,
+
+    [PPC_INST_CRAND] = op_crand, [PPC_INST_CRANDC] = op_crandc,
+    [PPC_INST_CREQV] = op_creqv, [PPC_INST_CRNAND] = op_crnand,
+    [PPC_INST_CRNOR] = op_crnor, [PPC_INST_CROR] = op_cror,
+    [PPC_INST_CRORC] = op_crorc, [PPC_INST_CRXOR] = op_crxor,
+    [PPC_INST_MCRF] = op_mcrf, [PPC_INST_MFCR] = op_mfcr, [PPC_INST_MTCRF] = op_mtcrf,
+    [PPC_INST_MFSPR] = op_mfspr, [PPC_INST_MTSPR] = op_mtspr,
+    [PPC_INST_MFMSR] = op_mfmsr, [PPC_INST_MTMSR] = op_mtmsr, [PPC_INST_MTMSRD] = op_mtmsrd,
+    [PPC_INST_RFID] = op_rfid,
+
+    // In-order per vCPU: cache hints and instruction ordering have no
+    // effect. tlbsync has nothing to wait for, as other vCPUs flush
+    // before they run another block.
+    [PPC_INST_SYNC] = op_sync, [PPC_INST_ISYNC] = op_nop,
+    [PPC_INST_DCBST] = op_nop, [PPC_INST_DCBF] = op_nop, [PPC_INST_DCBT] = op_nop,
+    [PPC_INST_DCBTST] = op_nop, [PPC_INST_ICBI] = op_nop,
+    [PPC_INST_TLBSYNC] = op_nop, [PPC_INST_DCBZ] = op_dcbz,
+
+    [PPC_INST_TLBIE] = op_tlbie, [PPC_INST_TLBIEL] = op_tlbiel,
+    [PPC_INST_VADDUBM] = op_vaddubm, [PPC_INST_VADDUHM] = op_vadduhm,
+    [PPC_INST_VADDUWM] = op_vadduwm, [PPC_INST_VADDUDM] = op_vaddudm,
+    [PPC_INST_VADDUBS] = op_vaddubs, [PPC_INST_VADDUHS] = op_vadduhs,
+    [PPC_INST_VADDSBS] = op_vaddsbs, [PPC_INST_VADDSHS] = op_vaddshs,
+    [PPC_INST_VSUBUBM] = op_vsububm, [PPC_INST_VSUBUHM] = op_vsubuhm,
+    [PPC_INST_VSUBUWM] = op_vsubuwm, [PPC_INST_VSUBUDM] = op_vsubudm,
+    [PPC_INST_VSUBUBS] = op_vsububs, [PPC_INST_VSUBUHS] = op_vsubuhs,
+    [PPC_INST_VSUBSBS] = op_vsubsbs, [PPC_INST_VSUBSHS] = op_vsubshs,
+    [PPC_INST_VMAXUB] = op_vmaxub, [PPC_INST_VMAXUH] = op_vmaxuh, [PPC_INST_VMAXUW] = op_vmaxuw,
+    [PPC_INST_VMAXSB] = op_vmaxsb, [PPC_INST_VMAXSH] = op_vmaxsh, [PPC_INST_VMAXSW] = op_vmaxsw,
+    [PPC_INST_VMINUB] = op_vminub, [PPC_INST_VMINUH] = op_vminuh, [PPC_INST_VMINUW] = op_vminuw,
+    [PPC_INST_VMINSB] = op_vminsb, [PPC_INST_VMINSH] = op_vminsh, [PPC_INST_VMINSW] = op_vminsw,
+    [PPC_INST_VAVGUB] = op_vavgub, [PPC_INST_VAVGUH] = op_vavguh,
+    [PPC_INST_VMULUWM] = op_vmuluwm,
+    [PPC_INST_VMULOUH] = op_vmulouh, [PPC_INST_VMULOSH] = op_vmulosh,
+    [PPC_INST_VMULEUH] = op_vmuleuh, [PPC_INST_VMULESH] = op_vmulesh,
+    [PPC_INST_VMULOUW] = op_vmulouw, [PPC_INST_VMULOSW] = op_vmulosw,
+    [PPC_INST_VMULEUW] = op_vmuleuw, [PPC_INST_VMULESW] = op_vmulesw,
+    [PPC_INST_VMLADDUHM] = op_vmladduhm,
+    [PPC_INST_VRLW] = op_vrlw, [PPC_INST_VSLW] = op_vslw, [PPC_INST_VSRW] = op_vsrw,
+    [PPC_INST_VSRAW] = op_vsraw, [PPC_INST_VSLD] = op_vsld, [PPC_INST_VSRD] = op_vsrd,
+    [PPC_INST_VAND] = op_vand, [PPC_INST_VANDC] = op_vandc, [PPC_INST_VOR] = op_vor,
+    [PPC_INST_VXOR] = op_vxor, [PPC_INST_VNOR] = op_vnor, [PPC_INST_VORC] = op_vorc,
+    [PPC_INST_VNAND] = op_vnand, [PPC_INST_VEQV] = op_veqv, [PPC_INST_VSEL] = op_vsel,
+    [PPC_INST_VMRGHB] = op_vmrghb, [PPC_INST_VMRGHH] = op_vmrghh, [PPC_INST_VMRGHW] = op_vmrghw,
+    [PPC_INST_VMRGLB] = op_vmrglb, [PPC_INST_VMRGLH] = op_vmrglh, [PPC_INST_VMRGLW] = op_vmrglw,
+    [PPC_INST_VSPLTB] = op_vspltb, [PPC_INST_VSPLTH] = op_vsplth, [PPC_INST_VSPLTW] = op_vspltw,
+    [PPC_INST_VSPLTISB] = op_vspltisb, [PPC_INST_VSPLTISH] = op_vspltish,
+    [PPC_INST_VSPLTISW] = op_vspltisw,
+    [PPC_INST_VPERM] = op_vperm, [PPC_INST_VPERMR] = op_vpermr, [PPC_INST_VSLDOI] = op_vsldoi,
+    [PPC_INST_VPKUHUM] = op_vpkuhum, [PPC_INST_VPKUWUM] = op_vpkuwum,
+    [PPC_INST_VPKSHSS] = op_vpkshss, [PPC_INST_VPKSWSS] = op_vpkswss,
+    [PPC_INST_VPKSHUS] = op_vpkshus, [PPC_INST_VPKSWUS] = op_vpkswus,
+    [PPC_INST_VUPKHSB] = op_vupkhsb, [PPC_INST_VUPKHSH] = op_vupkhsh,
+    [PPC_INST_VUPKLSB] = op_vupklsb, [PPC_INST_VUPKLSH] = op_vupklsh,
+    [PPC_INST_VCMPEQUB] = op_vcmpequb, [PPC_INST_VCMPEQUH] = op_vcmpequh,
+    [PPC_INST_VCMPEQUW] = op_vcmpequw, [PPC_INST_VCMPEQUD] = op_vcmpequd,
+    [PPC_INST_VCMPGTUB] = op_vcmpgtub, [PPC_INST_VCMPGTUH] = op_vcmpgtuh,
+    [PPC_INST_VCMPGTUW] = op_vcmpgtuw, [PPC_INST_VCMPGTUD] = op_vcmpgtud,
+    [PPC_INST_VCMPGTSB] = op_vcmpgtsb, [PPC_INST_VCMPGTSH] = op_vcmpgtsh,
+    [PPC_INST_VCMPGTSW] = op_vcmpgtsw, [PPC_INST_VCMPGTSD] = op_vcmpgtsd,
+    [PPC_INST_VCMPEQFP] = op_vcmpeqfp, [PPC_INST_VCMPGEFP] = op_vcmpgefp,
+    [PPC_INST_VCMPGTFP] = op_vcmpgtfp,
+    [PPC_INST_VADDFP] = op_vaddfp, [PPC_INST_VSUBFP] = op_vsubfp,
+    [PPC_INST_VMADDFP] = op_vmaddfp, [PPC_INST_VNMSUBFP] = op_vnmsubfp,
+    [PPC_INST_VMAXFP] = op_vmaxfp, [PPC_INST_VMINFP] = op_vminfp,
+    [PPC_INST_VCFUX] = op_vcfux, [PPC_INST_VCFSX] = op_vcfsx,
+    [PPC_INST_VCTUXS] = op_vctuxs, [PPC_INST_VCTSXS] = op_vctsxs,
+    [PPC_INST_MFVSCR] = op_mfvscr, [PPC_INST_MTVSCR] = op_mtvscr,
+
+    // The LRU hint of lvxl/stvxl means nothing here
+    [PPC_INST_LVX] = op_lvx, [PPC_INST_LVXL] = op_lvx,
+    [PPC_INST_STVX] = op_stvx, [PPC_INST_STVXL] = op_stvx,
+    [PPC_INST_LVSL] = op_lvsl, [PPC_INST_LVSR] = op_lvsr,
+    [PPC_INST_LVEBX] = op_lvex, [PPC_INST_LVEHX] = op_lvex, [PPC_INST_LVEWX] = op_lvex,
+    [PPC_INST_STVEBX] = op_stvebx, [PPC_INST_STVEHX] = op_stvehx, [PPC_INST_STVEWX] = op_stvewx,
+    [PPC_INST_LXVD2X] = op_lxvx, [PPC_INST_LXVW4X] = op_lxvx, [PPC_INST_LXVH8X] = op_lxvx,
+    [PPC_INST_LXVB16X] = op_lxvx, [PPC_INST_LXVX] = op_lxvx, [PPC_INST_LXVDSX] = op_lxvdsx,
+    [PPC_INST_STXVD2X] = op_stxvx, [PPC_INST_STXVW4X] = op_stxvx, [PPC_INST_STXVH8X] = op_stxvx,
+    [PPC_INST_STXVB16X] = op_stxvx, [PPC_INST_STXVX] = op_stxvx,
+    [PPC_INST_LXSDX] = op_lxsdx, [PPC_INST_LXSIWZX] = op_lxsiwzx, [PPC_INST_LXSIWAX] = op_lxsiwax,
+    [PPC_INST_STXSDX] = op_stxsdx, [PPC_INST_STXSIWX] = op_stxsiwx,
+    [PPC_INST_LXV] = op_lxv, [PPC_INST_STXV] = op_stxv,
+    [PPC_INST_LXSD] = op_lxsd, [PPC_INST_STXSD] = op_stxsd,
+    [PPC_INST_MFVSRD] = op_mfvsrd, [PPC_INST_MFVSRWZ] = op_mfvsrwz, [PPC_INST_MFVSRLD] = op_mfvsrld,
+    [PPC_INST_MTVSRD] = op_mtvsrd, [PPC_INST_MTVSRWA] = op_mtvsrwa, [PPC_INST_MTVSRWZ] = op_mtvsrwz,
+    [PPC_INST_MTVSRDD] = op_mtvsrdd, [PPC_INST_MTVSRWS] = op_mtvsrws,
+
+    [PPC_INST_XSADDDP] = op_xsadddp, [PPC_INST_XSSUBDP] = op_xssubdp,
+    [PPC_INST_XSMULDP] = op_xsmuldp, [PPC_INST_XSDIVDP] = op_xsdivdp,
+    [PPC_INST_XSMADDADP] = op_xsmaddadp, [PPC_INST_XSMADDMDP] = op_xsmaddmdp,
+    [PPC_INST_XSMSUBADP] = op_xsmsubadp, [PPC_INST_XSMSUBMDP] = op_xsmsubmdp,
+    [PPC_INST_XSNMADDADP] = op_xsnmaddadp, [PPC_INST_XSNMSUBADP] = op_xsnmsubadp,
+    [PPC_INST_XSMAXDP] = op_xsmaxdp, [PPC_INST_XSMINDP] = op_xsmindp,
+    [PPC_INST_XSCPSGNDP] = op_xscpsgndp, [PPC_INST_XSSQRTDP] = op_xssqrtdp,
+    [PPC_INST_XSABSDP] = op_xsabsdp, [PPC_INST_XSNABSDP] = op_xsnabsdp, [PPC_INST_XSNEGDP] = op_xsnegdp,
+    [PPC_INST_XSCVDPSP] = op_xscvdpsp, [PPC_INST_XSCVDPSPN] = op_xscvdpsp,
+    [PPC_INST_XSCVSPDP] = op_xscvspdp, [PPC_INST_XSCVSPDPN] = op_xscvspdp,
+    [PPC_INST_XVADDDP] = op_xvadddp, [PPC_INST_XVSUBDP] = op_xvsubdp,
+    [PPC_INST_XVMULDP] = op_xvmuldp, [PPC_INST_XVDIVDP] = op_xvdivdp,
+    [PPC_INST_XVADDSP] = op_xvaddsp, [PPC_INST_XVSUBSP] = op_xvsubsp,
+    [PPC_INST_XVMULSP] = op_xvmulsp, [PPC_INST_XVDIVSP] = op_xvdivsp,
+    [PPC_INST_XVMADDADP] = op_xvmaddadp, [PPC_INST_XVMADDMDP] = op_xvmaddmdp,
+    [PPC_INST_XVMSUBADP] = op_xvmsubadp, [PPC_INST_XVMSUBMDP] = op_xvmsubmdp,
+    [PPC_INST_XVNMADDADP] = op_xvnmaddadp, [PPC_INST_XVNMSUBADP] = op_xvnmsubadp,
+    [PPC_INST_XVMADDASP] = op_xvmaddasp, [PPC_INST_XVMADDMSP] = op_xvmaddmsp,
+    [PPC_INST_XVMSUBASP] = op_xvmsubasp, [PPC_INST_XVMSUBMSP] = op_xvmsubmsp,
+    [PPC_INST_XVNMADDASP] = op_xvnmaddasp, [PPC_INST_XVNMSUBASP] = op_xvnmsubasp,
+    [PPC_INST_XVMAXDP] = op_xvmaxdp, [PPC_INST_XVMINDP] = op_xvmindp,
+    [PPC_INST_XVMAXSP] = op_xvmaxsp, [PPC_INST_XVMINSP] = op_xvminsp,
+    [PPC_INST_XVSQRTDP] = op_xvsqrtdp, [PPC_INST_XVSQRTSP] = op_xvsqrtsp,
+    [PPC_INST_XVABSDP] = op_xvabsdp, [PPC_INST_XVNABSDP] = op_xvnabsdp, [PPC_INST_XVNEGDP] = op_xvnegdp,
+    [PPC_INST_XVABSSP] = op_xvabssp, [PPC_INST_XVNABSSP] = op_xvnabssp, [PPC_INST_XVNEGSP] = op_xvnegsp,
+    [PPC_INST_XVCMPEQDP] = op_xvcmpeqdp, [PPC_INST_XVCMPGTDP] = op_xvcmpgtdp,
+    [PPC_INST_XVCMPGEDP] = op_xvcmpgedp, [PPC_INST_XVCMPEQSP] = op_xvcmpeqsp,
+    [PPC_INST_XVCMPGTSP] = op_xvcmpgtsp, [PPC_INST_XVCMPGESP] = op_xvcmpgesp,
+    [PPC_INST_XVCVSPDP] = op_xvcvspdp, [PPC_INST_XVCVDPSP] = op_xvcvdpsp,
+    [PPC_INST_XVCVSXWDP] = op_xvcvsxwdp, [PPC_INST_XVCVUXWDP] = op_xvcvuxwdp,
+    [PPC_INST_XVCVDPSXWS] = op_xvcvdpsxws, [PPC_INST_XVCVSXDDP] = op_xvcvsxddp,
+    [PPC_INST_XVCVDPSXDS] = op_xvcvdpsxds, [PPC_INST_XVCVSXWSP] = op_xvcvsxwsp,
+    [PPC_INST_XVCVSPSXWS] = op_xvcvspsxws,
+    [PPC_INST_XXLAND] = op_xxland, [PPC_INST_XXLANDC] = op_xxlandc, [PPC_INST_XXLOR] = op_xxlor,
+    [PPC_INST_XXLXOR] = op_xxlxor, [PPC_INST_XXLNOR] = op_xxlnor, [PPC_INST_XXLORC] = op_xxlorc,
+    [PPC_INST_XXLNAND] = op_xxlnand, [PPC_INST_XXLEQV] = op_xxleqv, [PPC_INST_XXSEL] = op_xxsel,
+    [PPC_INST_XXMRGHW] = op_xxmrghw, [PPC_INST_XXMRGLW] = op_xxmrglw,
+    [PPC_INST_XXPERMDI] = op_xxpermdi, [PPC_INST_XXSLDWI] = op_xxsldwi,
+    [PPC_INST_XXPERM] = op_xxperm, [PPC_INST_XXPERMR] = op_xxpermr,
+    [PPC_INST_XXSPLTW] = op_xxspltw, [PPC_INST_XXSPLTIB] = op_xxspltib,
+
+    [PPC_INST_FADDS] = op_fadds, [PPC_INST_FSUBS] = op_fsubs,
+    [PPC_INST_FMULS] = op_fmuls, [PPC_INST_FDIVS] = op_fdivs,
+    [PPC_INST_FMADDS] = op_fmadds, [PPC_INST_FMSUBS] = op_fmsubs,
+    [PPC_INST_FNMADDS] = op_fnmadds, [PPC_INST_FNMSUBS] = op_fnmsubs,
+    [PPC_INST_FSQRTS] = op_fsqrts, [PPC_INST_FRES] = op_fres,
+    [PPC_INST_FRSQRTES] = op_frsqrtes, [PPC_INST_FCFIDS] = op_fcfids,
+    [PPC_INST_FSQRT] = op_fsqrt, [PPC_INST_FRE] = op_fre, [PPC_INST_FRSQRTE] = op_frsqrte,
+    [PPC_INST_FCMPU] = op_fcmpu, [PPC_INST_FCMPO] = op_fcmpo, [PPC_INST_FRSP] = op_frsp,
+    [PPC_INST_FCTIW] = op_fctiw, [PPC_INST_FCTIWZ] = op_fctiwz,
+    [PPC_INST_FCTID] = op_fctid, [PPC_INST_FCTIDZ] = op_fctidz,
+    [PPC_INST_FCFID] = op_fcfid, [PPC_INST_FCFIDU] = op_fcfidu,
+    [PPC_INST_FMR] = op_fmr, [PPC_INST_FNEG] = op_fneg, [PPC_INST_FABS] = op_fabs,
+    [PPC_INST_FNABS] = op_fnabs, [PPC_INST_FCPSGN] = op_fcpsgn,
+    [PPC_INST_MFFS] = op_mffs, [PPC_INST_MTFSF] = op_mtfsf, [PPC_INST_MTFSFI] = op_mtfsfi,
+    [PPC_INST_MTFSB0] = op_mtfsb0, [PPC_INST_MTFSB1] = op_mtfsb1, [PPC_INST_MCRFS] = op_mcrfs,
+};
+
+ppc_handler_t interp_get_handler(uint16_t id) {
+    if (id >= PPC_INST_COUNT || !handlers[id]) return op_illegal;
+    return handlers[id];
+}
+
+void interp_fuse(ppc_op_t* ops, uint32_t n) {
+    for (uint32_t i = 0; i + 1 < n; i++) {
+        ppc_handler_t fused = fused_handler(&ops[i], &ops[i + 1]);
+        if (!fused) continue;
+        ops[i].handler = fused;
+        i++;
+    }
+}
+
+ppc_handler_t interp_block_end_handler(void) {
+    return op_block_end;
+}
+
+ppc_handler_t interp_return_handler(void) {
+    return op_return;
+}
+
+// Runs a chain of ops and returns how many instructions retired
+static inline uint32_t run_ops(ppc_cpu_state_t* cpu, memory_system_t* mem, const ppc_op_t* ops) {
+    ops->handler(cpu, mem, ops);
+    return cpu->exec_state.retired;
+}
+
+// Decodes and executes the single instruction at pc, bypassing the cache.
+// A prefixed instruction takes its suffix along (they never cross a
+// 64-byte boundary, so the suffix is on the same page).
+static uint32_t step_one(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    uint64_t paddr = memory_translate_fetch(mem, cpu->pc);
+    ppc_op_t ops[3];
+    uint32_t n = 1;
+
+    ops[0].raw = memory_fetch_phys32(mem, paddr);
+    ops[0].inst = decode_packed(ops[0].raw);
+    if (ops[0].inst.id == PPC_INST_PREFIX && (paddr & 63) != 60) {
+        ops[1].raw = memory_fetch_phys32(mem, paddr + 4);
+        ops[1].inst = decode_packed(ops[1].raw);
+        n = 2;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        ops[i].handler = interp_get_handler(ops[i].inst.id);
+        ops[i].pc_off = i * 4;
+    }
+    ops[n].raw = 0;
+    ops[n].inst = decode_packed(0);
+    ops[n].handler = op_block_end;
+    ops[n].pc_off = n * 4;
+    interp_fuse(ops, n);
+    profile_insn(mem, ops[0].inst.id);
+
+    trace_ring_t* ring = mem->trace;
+    if (!ring) return run_ops(cpu, mem, ops);
+    trace_code(ring, cpu->pc, ops, n);
+    trace_block_begin(ring, cpu->pc, n);
+    uint32_t retired = run_ops(cpu, mem, ops);
+    trace_block_end(ring, retired);
+    return retired;
+}
+
+// Exit after a fault unwound to cpu_run or cpu_step
+static cpu_exit_t unwound(ppc_cpu_state_t* cpu, cpu_exit_t reason) {
+    cpu->exec_state.exit_reason = reason;
+    return reason;
+}
+
+// Instructions retired when a fault unwound the running block: those up
+// to the end of the block, as charged, less the ones in it that never ran
+static void unwound_icount(ppc_cpu_state_t* cpu, uint32_t block_retired) {
+    cpu->exec_state.icount = cpu->exec_state.budget_end - (uint64_t)cpu->exec_state.jit_budget
+                             - cpu->exec_state.charged + block_retired;
+}
+
+// Points pc at the instruction whose access translation refused (cpu->pc
+// is still the start of its block) and reports the access like a DSI.
+// Instruction fetches happen at block starts.
+static cpu_exit_t translation_fault(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    uint32_t block_retired = 0;
+    if (mem->fault_access != MEM_EXEC) {
+        block_retired = cpu->exec_state.mem_pc_off / 4;
+        cpu->pc += cpu->exec_state.mem_pc_off;
+        cpu->dar = mem->fault_vaddr;
+    }
+    unwound_icount(cpu, block_retired);
+    if (mem->trace) trace_block_unwound(mem->trace, cpu->pc);
+    cpu->dsisr = mem->fault_status;
+    return unwound(cpu, CPU_EXIT_FAULT);
+}
+
+// A host fault past the end of RAM; pc is still the start of the block
+static cpu_exit_t machine_check(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    unwound_icount(cpu, 0);
+    if (mem->trace) trace_block_unwound(mem->trace, cpu->pc);
+    return unwound(cpu, CPU_EXIT_MCHECK);
+}
+
+cpu_exit_t cpu_step(ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    uint32_t host_mxcsr = fp_enter(cpu);
+    sigjmp_buf recover;
+    sigjmp_buf* outer = fault_set_recovery(&recover);
+    switch (sigsetjmp(recover, 0)) {
+        case 0:
+            break;
+        case FAULT_UNWIND_GUEST:
+            fault_set_recovery(outer);
+            fp_leave(cpu, host_mxcsr);
+            return translation_fault(cpu, mem);
+        default:
+            fault_set_recovery(outer);
+            fp_leave(cpu, host_mxcsr);
+            return machine_check(cpu, mem);
+    }
+
+    cpu->exec_state.exit_reason = CPU_EXIT_NONE;
+    cpu_sync_translation(cpu, mem);
+    if (__atomic_load_n(&mem->pending, __ATOMIC_ACQUIRE)) memory_service(mem);
+    if (mem->events && !events_run(mem->events, cpu, 1)) {
+        fault_set_recovery(outer);
+        fp_leave(cpu, host_mxcsr);
+        return (cpu_exit_t)cpu->exec_state.exit_reason;
+    }
+    cpu->exec_state.budget_end = cpu->exec_state.icount + 1;
+    cpu->exec_state.jit_budget = 0;
+    cpu->exec_state.charged = 1;
+    cpu->exec_state.icount += step_one(cpu, mem);
+    fault_set_recovery(outer);
+    fp_leave(cpu, host_mxcsr);
+    if (cpu->exec_state.exit_reason != CPU_EXIT_NONE) {
+        return (cpu_exit_t)cpu->exec_state.exit_reason;
+    }
+    return CPU_EXIT_BUDGET;
+}
+
+// Runs blocks until the budget is used up, one of them exits or the event
+// queue asks for attention. Every block is charged against jit_budget
+// before it runs, so handlers can tell the time (cpu_icount_now), and the
+// charge is kept in charged for a fault unwinding the block.
+static uint64_t run_blocks(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t max_insns) {
+    block_cache_t* cache = mem->blocks;
+    jit_t* jit = cache->jit;
+    uint64_t executed = 0;
+
+    // The budget is signed; unlimited runs pass UINT64_MAX
+    if (max_insns > INT64_MAX) max_insns = INT64_MAX;
+    cpu->exec_state.budget_end = cpu->exec_state.icount + max_insns;
+
+    // Exit of the translated block that ran last, chained to the next
+    // block unless anything was invalidated in between
+    jit_exit_t* prev_exit = NULL;
+    uint64_t prev_generation = 0;
+
+    while (executed < max_insns) {
+        // Invalidations other vCPUs asked for, before anything stale runs
+        if (__builtin_expect(__atomic_load_n(&mem->pending, __ATOMIC_ACQUIRE), 0)) {
+            if (memory_service(mem) & MEMORY_PENDING_EVENTS) break;
+            prev_exit = NULL;
+        }
+
+        // Nothing charged yet, should the lookup's fetch fault
+        uint64_t left = max_insns - executed;
+        cpu->exec_state.jit_budget = (int64_t)left;
+        cpu->exec_state.charged = 0;
+        uint64_t pc = cpu->pc;
+        ppc_block_t* block = block_cache_lookup(cache, pc);
+
+        trace_ring_t* ring = mem->trace;
+        if (block && block->jit && block->jit->pc == pc && block->n_insns <= left) {
+            if (prev_exit && prev_generation == cache->generation) {
+                jit_chain(prev_exit, block);
+            }
+            prev_generation = cache->generation;
+            int64_t budget = (int64_t)left;
+            if (ring) ring->jit_retired = 0;
+            jit_execute(jit, cpu, mem, block);
+            uint64_t retired = (uint64_t)(budget - cpu->exec_state.jit_budget);
+            executed += retired;
+            prev_exit = cpu->exec_state.jit_exit;
+            // Translated code recorded the blocks it entered (trace_jit_enter)
+            if (ring && ring->block_pc != TRACE_NO_BLOCK) {
+                trace_block_end(ring, retired - ring->jit_retired);
+            }
+        } else if (block && block->n_insns <= left) {
+            // Whole blocks while the budget allows, then single steps
+            profile_block_run(block);
+            if (ring) trace_block_enter(ring, block, pc);
+            cpu->exec_state.jit_budget = (int64_t)(left - block->n_insns);
+            cpu->exec_state.charged = block->n_insns;
+            uint32_t retired = run_ops(cpu, mem, block->ops);
+            executed += retired;
+            prev_exit = NULL;
+            if (ring) trace_block_end(ring, retired);
+            if (jit && ++block->exec_count == JIT_THRESHOLD) {
+                uint64_t start = profile_start();
+                jit_translate(jit, block, pc);
+                profile_end(mem, PROFILE_PATH_JIT, start);
+            }
+        } else {
+            cpu->exec_state.jit_budget = (int64_t)(left - 1);
+            cpu->exec_state.charged = 1;
+            executed += step_one(cpu, mem);
+            prev_exit = NULL;
+        }
+        if (cpu->exec_state.exit_reason != CPU_EXIT_NONE) break;
+    }
+    return executed;
+}
+
+cpu_exit_t cpu_run(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t max_insns) {
+    // A host fault in the RAM guard or an access the TLB refuses unwinds
+    // to here; icount then comes from the interrupted slice's budget.
+    // MXCSR belongs to the guest until we return.
+    uint32_t host_mxcsr = fp_enter(cpu);
+    sigjmp_buf recover;
+    sigjmp_buf* outer = fault_set_recovery(&recover);
+    switch (sigsetjmp(recover, 0)) {
+        case 0:
+            break;
+        case FAULT_UNWIND_GUEST:
+            fault_set_recovery(outer);
+            fp_leave(cpu, host_mxcsr);
+            return translation_fault(cpu, mem);
+        default:
+            fault_set_recovery(outer);
+            fp_leave(cpu, host_mxcsr);
+            return machine_check(cpu, mem);
+    }
+
+    cpu->exec_state.exit_reason = CPU_EXIT_NONE;
+    cpu_sync_translation(cpu, mem);
+
+    // With an event queue, slices end at its deadlines (events.h)
+    uint64_t executed = 0;
+    while (executed < max_insns) {
+        uint64_t slice = max_insns - executed;
+        if (mem->events) slice = events_run(mem->events, cpu, slice);
+        if (cpu->exec_state.exit_reason != CPU_EXIT_NONE) break;
+        uint64_t retired = run_blocks(cpu, mem, slice);
+        executed += retired;
+        cpu->exec_state.icount += retired;
+        if (cpu->exec_state.exit_reason != CPU_EXIT_NONE) break;
+    }
+    fault_set_recovery(outer);
+    fp_leave(cpu, host_mxcsr);
+
+    if (cpu->exec_state.exit_reason != CPU_EXIT_NONE) {
+        return (cpu_exit_t)cpu->exec_state.exit_reason;
+    }
+    return CPU_EXIT_BUDGET;
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "block.h"
+
+// Handler lookup used when a block is decoded
+ppc_handler_t interp_get_handler(uint16_t id);
+ppc_handler_t interp_block_end_handler(void);
+
+// Gives the first op of fusable instruction pairs among ops[0..n) a
+// handler that runs both; prefixed instructions only execute this way.
+// The pair's second op is skipped, but keeps its own handler.
+void interp_fuse(ppc_op_t* ops, uint32_t n);
+
+// Op that just returns; ends single-op chains called from translated code
+ppc_handler_t interp_return_handler(void);
+
+#endif
@@ -0,0 +1,1197 @@
+#define _DEFAULT_SOURCE    // MAP_ANONYMOUS
+#include "jit.h"
+#include "interpreter.h"
+#include "trace.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// x86-64 dynamic binary translator.
+//
+// Host register use inside translated code:
+//   rbx          ppc_cpu_state_t*
+//   rbp          memory_system_t*
+//   rax rcx rdx  scratch
+//   r10 r11      scratch (store value, EA save)
+//   r12-r15, rsi, rdi, r8, r9
+//                guest GPRs cached for the block, chosen by use count
+//
+// A shared trampoline saves the callee-saved registers and jumps into a
+// block; every block leaves through the shared epilogue. Chained blocks
+// jump directly into each other, so they all run inside one host frame.
+// Each block entry stores the guest PC and charges its length against
+// exec_state.jit_budget, returning to the dispatcher when that runs out,
+// and records the charge in exec_state.charged for a fault unwinding it.
+
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum {
+    CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5,
+    CC_BE = 0x6, CC_A = 0x7, CC_S = 0x8, CC_L = 0xC, CC_GE = 0xD,
+    CC_LE = 0xE, CC_G = 0xF
+};
+
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+enum { SHIFT_ROL = 0, SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+
+#define JIT_CACHED_REGS 8
+static const int cache_regs[JIT_CACHED_REGS] = { R12, R13, R14, R15, RSI, RDI, R8, R9 };
+
+// Caller-saved host registers among the cache registers
+#define IS_CALLER_SAVED(r) ((r) == RSI || (r) == RDI || (r) == R8 || (r) == R9)
+
+#define CPU_OFF(field)  ((int32_t)offsetof(ppc_cpu_state_t, field))
+#define GPR_OFF(n)      (CPU_OFF(gpr) + (int32_t)(n) * 8)
+#define MEM_OFF(field)  ((int32_t)offsetof(memory_system_t, field))
+
+// exec_state.retired while a fallback handler stays in the block
+#define FALLBACK_STAYED UINT32_MAX
+
+struct jit {
+    block_cache_t* cache;
+    uint8_t* code;
+    size_t used;
+    size_t size;
+    uint8_t* trampoline;
+    uint8_t* epilogue;
+    size_t reset_point;             // First byte after the shared stubs
+    FILE* perf_map;                 // /tmp/perf-<pid>.map, with PWRXE_PERF_MAP set
+};
+
+// Code emission
+typedef struct {
+    uint8_t* p;
+    uint8_t* end;
+} emit_t;
+
+static inline void e8(emit_t* e, uint8_t v) {
+    if (e->p < e->end) *e->p = v;
+    e->p++;
+}
+
+static inline void e32(emit_t* e, uint32_t v) {
+    for (int i = 0; i < 4; i++) e8(e, (uint8_t)(v >> (i * 8)));
+}
+
+static inline void e64(emit_t* e, uint64_t v) {
+    for (int i = 0; i < 8; i++) e8(e, (uint8_t)(v >> (i * 8)));
+}
+
+static inline bool fits_s8(int64_t v) {
+    return v >= -128 && v <= 127;
+}
+
+static inline bool fits_s32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static void rex(emit_t* e, int w, int reg, int index, int base) {
+    uint8_t r = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) |
+                (((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+    if (r != 0x40) e8(e, r);
+}
+
+static void modrm_rr(emit_t* e, int reg, int rm) {
+    e8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// [base + disp]
+static void modrm_mem(emit_t* e, int reg, int base, int32_t disp) {
+    int mod = (disp == 0 && (base & 7) != RBP) ? 0 : fits_s8(disp) ? 1 : 2;
+    e8(e, (mod << 6) | ((reg & 7) << 3) | ((base & 7) == RSP ? 4 : (base & 7)));
+    if ((base & 7) == RSP) e8(e, 0x24);
+    if (mod == 1) e8(e, (uint8_t)disp);
+    if (mod == 2) e32(e, (uint32_t)disp);
+}
+
+// [base + index * (1 << scale) + disp]
+static void modrm_sib(emit_t* e, int reg, int base, int index, int scale, int32_t disp) {
+    int mod = (disp == 0 && (base & 7) != RBP) ? 0 : fits_s8(disp) ? 1 : 2;
+    e8(e, (mod << 6) | ((reg & 7) << 3) | 4);
+    e8(e, (scale << 6) | ((index & 7) << 3) | (base & 7));
+    if (mod == 1) e8(e, (uint8_t)disp);
+    if (mod == 2) e32(e, (uint32_t)disp);
+}
+
+// op rm, reg
+static void emit_rr(emit_t* e, uint8_t opc, int w, int rm, int reg) {
+    rex(e, w, reg, 0, rm);
+    e8(e, opc);
+    modrm_rr(e, reg, rm);
+}
+
+// op reg, [base + disp]  /  op [base + disp], reg
+static void emit_rm(emit_t* e, uint8_t opc, int w, int reg, int base, int32_t disp) {
+    rex(e, w, reg, 0, base);
+    e8(e, opc);
+    modrm_mem(e, reg, base, disp);
+}
+
+// 0F-prefixed op reg, rm
+static void emit_rr0f(emit_t* e, uint8_t opc, int w, int reg, int rm) {
+    rex(e, w, reg, 0, rm);
+    e8(e, 0x0F);
+    e8(e, opc);
+    modrm_rr(e, reg, rm);
+}
+
+// movsxd reg, reg32
+static void emit_movsxd(emit_t* e, int reg) {
+    rex(e, 1, reg, 0, reg);
+    e8(e, 0x63);
+    modrm_rr(e, reg, reg);
+}
+
+static void emit_mov_rr(emit_t* e, int dst, int src) {
+    if (dst != src) emit_rr(e, 0x89, 1, dst, src);
+}
+
+static void emit_load64(emit_t* e, int reg, int base, int32_t disp) {
+    emit_rm(e, 0x8B, 1, reg, base, disp);
+}
+
+static void emit_store64(emit_t* e, int base, int32_t disp, int reg) {
+    emit_rm(e, 0x89, 1, reg, base, disp);
+}
+
+static void emit_load32(emit_t* e, int reg, int base, int32_t disp) {
+    emit_rm(e, 0x8B, 0, reg, base, disp);
+}
+
+static void emit_store32(emit_t* e, int base, int32_t disp, int reg) {
+    emit_rm(e, 0x89, 0, reg, base, disp);
+}
+
+static void emit_mov_ri(emit_t* e, int reg, uint64_t imm) {
+    if (imm <= UINT32_MAX) {
+        rex(e, 0, 0, 0, reg);
+        e8(e, 0xB8 + (reg & 7));
+        e32(e, (uint32_t)imm);
+    } else if (fits_s32((int64_t)imm)) {
+        rex(e, 1, 0, 0, reg);
+        e8(e, 0xC7);
+        modrm_rr(e, 0, reg);
+        e32(e, (uint32_t)imm);
+    } else {
+        rex(e, 1, 0, 0, reg);
+        e8(e, 0xB8 + (reg & 7));
+        e64(e, imm);
+    }
+}
+
+static void emit_alu_ri(emit_t* e, int ext, int w, int rm, int32_t imm) {
+    rex(e, w, 0, 0, rm);
+    if (fits_s8(imm)) {
+        e8(e, 0x83);
+        modrm_rr(e, ext, rm);
+        e8(e, (uint8_t)imm);
+    } else {
+        e8(e, 0x81);
+        modrm_rr(e, ext, rm);
+        e32(e, (uint32_t)imm);
+    }
+}
+
+static void emit_alu_mi(emit_t* e, int ext, int w, int base, int32_t disp, int32_t imm) {
+    rex(e, w, 0, 0, base);
+    if (fits_s8(imm)) {
+        e8(e, 0x83);
+        modrm_mem(e, ext, base, disp);
+        e8(e, (uint8_t)imm);
+    } else {
+        e8(e, 0x81);
+        modrm_mem(e, ext, base, disp);
+        e32(e, (uint32_t)imm);
+    }
+}
+
+// ALU op with a full 64-bit immediate, going through rcx when needed
+static void emit_alu_ri64(emit_t* e, int ext, int rm, uint64_t imm) {
+    if (fits_s32((int64_t)imm)) {
+        emit_alu_ri(e, ext, 1, rm, (int32_t)imm);
+    } else {
+        emit_mov_ri(e, RCX, imm);
+        emit_rr(e, (uint8_t)(ext * 8 + 1), 1, rm, RCX);
+    }
+}
+
+static void emit_shift_ri(emit_t* e, int ext, int w, int rm, uint8_t imm) {
+    if (imm == 0) return;
+    rex(e, w, 0, 0, rm);
+    e8(e, 0xC1);
+    modrm_rr(e, ext, rm);
+    e8(e, imm);
+}
+
+static void emit_unary(emit_t* e, int ext, int w, int rm) {
+    rex(e, w, 0, 0, rm);
+    e8(e, 0xF7);
+    modrm_rr(e, ext, rm);
+}
+
+static void emit_setcc(emit_t* e, int cc, int reg) {
+    rex(e, 0, 0, 0, reg);
+    e8(e, 0x0F);
+    e8(e, 0x90 + cc);
+    modrm_rr(e, 0, reg);
+}
+
+static void emit_bswap(emit_t* e, int w, int reg) {
+    rex(e, w, 0, 0, reg);
+    e8(e, 0x0F);
+    e8(e, 0xC8 + (reg & 7));
+}
+
+static void emit_push(emit_t* e, int reg) {
+    if (reg >= 8) e8(e, 0x41);
+    e8(e, 0x50 + (reg & 7));
+}
+
+static void emit_pop(emit_t* e, int reg) {
+    if (reg >= 8) e8(e, 0x41);
+    e8(e, 0x58 + (reg & 7));
+}
+
+static void emit_call(emit_t* e, const void* fn) {
+    emit_mov_ri(e, RAX, (uint64_t)(uintptr_t)fn);
+    e8(e, 0xFF);
+    modrm_rr(e, 2, RAX);
+}
+
+// Jumps return the address of their rel32 field for later patching
+static uint8_t* emit_jcc(emit_t* e, int cc) {
+    e8(e, 0x0F);
+    e8(e, 0x80 + cc);
+    uint8_t* site = e->p;
+    e32(e, 0);
+    return site;
+}
+
+static uint8_t* emit_jmp(emit_t* e) {
+    e8(e, 0xE9);
+    uint8_t* site = e->p;
+    e32(e, 0);
+    return site;
+}
+
+static void patch_rel32(uint8_t* site, const uint8_t* target) {
+    int32_t rel = (int32_t)(target - (site + 4));
+    memcpy(site, &rel, sizeof(rel));
+}
+
+// Translation state
+#define JIT_MAX_SLOW_PATHS (BLOCK_MAX_INSNS * 2)
+
+typedef struct {
+    uint8_t* site;                  // Jump from the fast path
+    uint8_t* resume;
+    uint32_t dirty;                 // Dirty cached GPRs at the access
+    uint32_t pc_off;                // Of the accessing instruction
+    uint8_t size;
+    bool is_store;
+} slow_path_t;
+
+typedef struct {
+    jit_t* jit;
+    emit_t e;
+    ppc_block_t* block;
+    jit_block_t* jb;
+    uint64_t pc;                    // Guest PC of the block
+    uint32_t pc_off;                // Of the op being translated
+    int8_t host[32];                // Host register caching each GPR, or -1
+    uint32_t cached;                // GPRs with a host register
+    uint32_t dirty;                 // Cached GPRs not yet written back
+    slow_path_t slow[JIT_MAX_SLOW_PATHS];
+    int n_slow;
+    uint8_t* fallback_exit_sites[BLOCK_MAX_INSNS + 1];
+    int n_fallback_exits;
+    uint8_t* chain_sites[2];        // Exit jumps, in exit-slot order
+    int n_exits;
+    int n_fallback_ops;             // fallback_ops slots used
+    bool failed;
+} translator_t;
+
+static void load_gpr(translator_t* t, int reg, int gpr) {
+    if (t->host[gpr] >= 0) {
+        emit_mov_rr(&t->e, reg, t->host[gpr]);
+    } else {
+        emit_load64(&t->e, reg, RBX, GPR_OFF(gpr));
+    }
+}
+
+static void store_gpr(translator_t* t, int gpr, int reg) {
+    if (t->host[gpr] >= 0) {
+        emit_mov_rr(&t->e, t->host[gpr], reg);
+        t->dirty |= 1U << gpr;
+    } else {
+        emit_store64(&t->e, RBX, GPR_OFF(gpr), reg);
+    }
+}
+
+// (RA|0) into reg
+static void load_ra0(translator_t* t, int reg, int ra) {
+    if (ra == 0) {
+        emit_mov_ri(&t->e, reg, 0);
+    } else {
+        load_gpr(t, reg, ra);
+    }
+}
+
+// Applies an ALU op with a guest register as the source operand
+static void alu_gpr(translator_t* t, uint8_t opc, int reg, int gpr) {
+    if (t->host[gpr] >= 0) {
+        emit_rr(&t->e, opc, 1, reg, t->host[gpr]);
+    } else {
+        emit_rm(&t->e, (uint8_t)(opc + 2), 1, reg, RBX, GPR_OFF(gpr));
+    }
+}
+
+static void write_back(translator_t* t, uint32_t dirty) {
+    for (int gpr = 0; gpr < 32; gpr++) {
+        if (dirty & (1U << gpr)) {
+            emit_store64(&t->e, RBX, GPR_OFF(gpr), t->host[gpr]);
+        }
+    }
+}
+
+static void reload(translator_t* t, bool caller_saved_only) {
+    for (int gpr = 0; gpr < 32; gpr++) {
+        int reg = t->host[gpr];
+        if (reg >= 0 && (!caller_saved_only || IS_CALLER_SAVED(reg))) {
+            emit_load64(&t->e, reg, RBX, GPR_OFF(gpr));
+        }
+    }
+}
+
+// Builds a CR field from flags set by cmp/test, using rax, rcx and rdx
+static void emit_cr_update(translator_t* t, unsigned field, bool is_signed) {
+    emit_t* e = &t->e;
+    unsigned shift = 28 - field * 4;
+
+    emit_setcc(e, is_signed ? CC_L : CC_B, RAX);
+    emit_setcc(e, is_signed ? CC_G : CC_A, RCX);
+    emit_setcc(e, CC_E, RDX);
+    emit_rr0f(e, 0xB6, 0, RAX, RAX);
+    emit_rr0f(e, 0xB6, 0, RCX, RCX);
+    emit_rr0f(e, 0xB6, 0, RDX, RDX);
+    emit_shift_ri(e, SHIFT_SHL, 0, RAX, 3);
+    emit_shift_ri(e, SHIFT_SHL, 0, RCX, 2);
+    emit_shift_ri(e, SHIFT_SHL, 0, RDX, 1);
+    emit_rr(e, 0x09, 0, RAX, RCX);
+    emit_rr(e, 0x09, 0, RAX, RDX);
+    emit_load32(e, RCX, RBX, CPU_OFF(xer));
+    emit_shift_ri(e, SHIFT_SHR, 0, RCX, 31);
+    emit_rr(e, 0x09, 0, RAX, RCX);
+    emit_shift_ri(e, SHIFT_SHL, 0, RAX, (uint8_t)shift);
+    emit_load32(e, RCX, RBX, CPU_OFF(cr));
+    emit_alu_ri(e, ALU_AND, 0, RCX, (int32_t)~(0xFU << shift));
+    emit_rr(e, 0x09, 0, RCX, RAX);
+    emit_store32(e, RBX, CPU_OFF(cr), RCX);
+}
+
+static void emit_set_cr0_pending(translator_t* t, bool pending) {
+    emit_t* e = &t->e;
+    rex(e, 0, 0, 0, RBX);
+    e8(e, 0xC6);
+    modrm_mem(e, 0, RBX, CPU_OFF(lazy.cr0_pending));
+    e8(e, pending);
+}
+
+// Computes a pending CR0 into cr, as cpu_get_cr does
+static void emit_settle_cr0(translator_t* t) {
+    emit_t* e = &t->e;
+    rex(e, 0, 0, 0, RBX);
+    e8(e, 0x80);
+    modrm_mem(e, 7, RBX, CPU_OFF(lazy.cr0_pending));
+    e8(e, 0);
+    uint8_t* settled = emit_jcc(e, CC_E);
+    emit_load64(e, RAX, RBX, CPU_OFF(lazy.cr0_result));
+    emit_rr(e, 0x85, 1, RAX, RAX);
+    emit_cr_update(t, 0, true);
+    emit_set_cr0_pending(t, false);
+    patch_rel32(settled, e->p);
+}
+
+// Stores rax to a GPR and, for record forms, leaves CR0 pending on it
+static void finish_result(translator_t* t, int gpr, bool record) {
+    store_gpr(t, gpr, RAX);
+    if (record) {
+        emit_store64(&t->e, RBX, CPU_OFF(lazy.cr0_result), RAX);
+        emit_set_cr0_pending(t, true);
+    }
+}
+
+// Inlined data TLB lookup, the same tag compare as memory_readN/writeN.
+// Expects the EA in rax (and a store value in r10); a load leaves the
+// zero-extended value in rax. Anything the compare rejects (misses,
+// misaligned accesses, code pages, addresses outside RAM) goes to an
+// out-of-line path calling memory_read_slow/memory_write_slow.
+static void emit_memory_access(translator_t* t, unsigned size, bool is_store) {
+    emit_t* e = &t->e;
+    if (t->n_slow == JIT_MAX_SLOW_PATHS) {
+        t->failed = true;
+        return;
+    }
+    slow_path_t* slow = &t->slow[t->n_slow++];
+    slow->dirty = t->dirty;
+    slow->pc_off = t->pc_off;
+    slow->size = (uint8_t)size;
+    slow->is_store = is_store;
+
+    _Static_assert(sizeof(tlb_entry_t) == 32, "JIT TLB indexing assumes 32-byte entries");
+
+    // rdx = &dtlb.fast[(ea >> 12) & TLB_MASK]
+    emit_mov_rr(e, RDX, RAX);
+    emit_shift_ri(e, SHIFT_SHR, 1, RDX, PAGE_SHIFT);
+    emit_alu_ri(e, ALU_AND, 0, RDX, TLB_MASK);
+    emit_shift_ri(e, SHIFT_SHL, 0, RDX, 5);
+    rex(e, 1, RDX, RDX, RBP);
+    e8(e, 0x8D);
+    modrm_sib(e, RDX, RBP, RDX, 0, MEM_OFF(dtlb.fast));  // lea rdx, [rbp + rdx + dtlb.fast]
+
+    // Page and alignment bits against the tag
+    emit_mov_rr(e, RCX, RAX);
+    emit_alu_ri(e, ALU_AND, 1, RCX, (int32_t)(~PAGE_MASK | (size - 1)));
+    emit_rm(e, 0x3B, 1, RCX, RDX, is_store ? (int32_t)offsetof(tlb_entry_t, addr_write)
+                                           : (int32_t)offsetof(tlb_entry_t, addr_read));
+    slow->site = emit_jcc(e, CC_NE);
+
+    // rcx = host address
+    emit_load64(e, RCX, RDX, (int32_t)offsetof(tlb_entry_t, addend));
+    emit_rr(e, 0x01, 1, RCX, RAX);
+
+    if (is_store) {
+        if (size == 8) {
+            emit_bswap(e, 1, R10);
+        } else if (size == 4) {
+            emit_bswap(e, 0, R10);
+        } else if (size == 2) {
+            emit_bswap(e, 0, R10);
+            emit_shift_ri(e, SHIFT_SHR, 0, R10, 16);
+        }
+        // mov [rcx], r10{b,w,d,}
+        if (size == 2) e8(e, 0x66);
+        rex(e, size == 8, R10, 0, RCX);
+        e8(e, size == 1 ? 0x88 : 0x89);
+        modrm_mem(e, R10, RCX, 0);
+    } else {
+        rex(e, size == 8, RAX, 0, RCX);
+        if (size == 1) {
+            e8(e, 0x0F);
+            e8(e, 0xB6);
+        } else if (size == 2) {
+            e8(e, 0x0F);
+            e8(e, 0xB7);
+        } else {
+            e8(e, 0x8B);
+        }
+        modrm_mem(e, RAX, RCX, 0);
+        if (size == 8) {
+            emit_bswap(e, 1, RAX);
+        } else if (size == 4) {
+            emit_bswap(e, 0, RAX);
+        } else if (size == 2) {
+            emit_bswap(e, 0, RAX);
+            emit_shift_ri(e, SHIFT_SHR, 0, RAX, 16);
+        }
+    }
+    slow->resume = e->p;
+}
+
+static void emit_slow_paths(translator_t* t) {
+    emit_t* e = &t->e;
+
+    for (int i = 0; i < t->n_slow; i++) {
+        slow_path_t* slow = &t->slow[i];
+        patch_rel32(slow->site, e->p);
+        write_back(t, slow->dirty);
+        // The access may fault; cpu->pc still holds the block's PC
+        rex(e, 0, 0, 0, RBX);
+        e8(e, 0xC7);
+        modrm_mem(e, 0, RBX, CPU_OFF(exec_state.mem_pc_off));
+        e32(e, slow->pc_off);
+        emit_mov_rr(e, RSI, RAX);
+        emit_mov_rr(e, RDI, RBP);
+        if (slow->is_store) {
+            emit_mov_rr(e, RDX, R10);
+            emit_mov_ri(e, RCX, slow->size);
+            emit_call(e, (const void*)memory_write_slow);
+        } else {
+            emit_mov_ri(e, RDX, slow->size);
+            emit_call(e, (const void*)memory_read_slow);
+        }
+        reload(t, true);
+        patch_rel32(emit_jmp(e), slow->resume);
+    }
+}
+
+// Leaves the block for a statically known PC through a chainable exit
+static void emit_chainable_exit(translator_t* t, uint64_t target) {
+    emit_t* e = &t->e;
+    write_back(t, t->dirty);
+    emit_mov_ri(e, RAX, target);
+    emit_store64(e, RBX, CPU_OFF(pc), RAX);
+    t->chain_sites[t->n_exits++] = emit_jmp(e);
+}
+
+// Leaves the block for a PC already stored in cpu->pc
+static void emit_dynamic_exit(translator_t* t) {
+    write_back(t, t->dirty);
+    patch_rel32(emit_jmp(&t->e), t->jit->epilogue);
+}
+
+// Runs the interpreter handler for one op, isolated by a return op.
+// Handlers that leave the block set exec_state.retired, so it is primed
+// with a value no handler stores and checked afterwards. Fused handlers
+// would run the next op too, so single ops get their plain handler; a
+// prefixed instruction (n_ops 2) is handed over fused.
+static void emit_fallback(translator_t* t, const ppc_op_t* op, int n_ops) {
+    emit_t* e = &t->e;
+    ppc_op_t* chain = &t->jb->fallback_ops[t->n_fallback_ops];
+    t->n_fallback_ops += n_ops + 1;
+
+    for (int i = 0; i < n_ops; i++) chain[i] = op[i];
+    if (n_ops == 1) chain[0].handler = interp_get_handler(op->inst.id);
+    chain[n_ops].handler = interp_return_handler();
+    chain[n_ops].pc_off = op->pc_off + 4 * n_ops;
+    chain[n_ops].inst = decode_packed(0);
+    chain[n_ops].raw = 0;
+
+    write_back(t, t->dirty);
+    t->dirty = 0;
+    rex(e, 0, 0, 0, RBX);
+    e8(e, 0xC7);
+    modrm_mem(e, 0, RBX, CPU_OFF(exec_state.retired));
+    e32(e, FALLBACK_STAYED);
+    emit_mov_rr(e, RDI, RBX);
+    emit_mov_rr(e, RSI, RBP);
+    emit_mov_ri(e, RDX, (uint64_t)(uintptr_t)chain);
+    emit_call(e, (const void*)chain[0].handler);
+
+    reload(t, false);
+    emit_alu_mi(e, ALU_CMP, 0, RBX, CPU_OFF(exec_state.retired), (int32_t)FALLBACK_STAYED);
+    t->fallback_exit_sites[t->n_fallback_exits++] = emit_jcc(e, CC_NE);
+}
+
+// Conditional branch test: jumps taken to a not-taken label when the
+// branch falls through. Returns the number of sites written.
+static int emit_branch_test(translator_t* t, unsigned bo, unsigned bi, bool use_ctr, uint8_t** sites) {
+    emit_t* e = &t->e;
+    int n = 0;
+    if (use_ctr && !(bo & 0x04)) {
+        emit_alu_mi(e, ALU_SUB, 1, RBX, CPU_OFF(ctr), 1);
+        // Branch when (ctr != 0) != bo[1]
+        sites[n++] = emit_jcc(e, (bo & 0x02) ? CC_NE : CC_E);
+    }
+    if (!(bo & 0x10)) {
+        if (bi < 4) emit_settle_cr0(t);
+        rex(e, 0, 0, 0, RBX);
+        e8(e, 0xF7);
+        modrm_mem(e, 0, RBX, CPU_OFF(cr));
+        e32(e, 1U << (31 - bi));
+        sites[n++] = emit_jcc(e, (bo & 0x08) ? CC_E : CC_NE);
+    }
+    return n;
+}
+
+static void set_lr(translator_t* t, uint64_t value) {
+    emit_mov_ri(&t->e, RAX, value);
+    emit_store64(&t->e, RBX, CPU_OFF(lr), RAX);
+}
+
+static uint64_t branch_target(uint64_t pc, const ppc_packed_inst_t* inst) {
+    int64_t disp = (int32_t)inst->addr;
+    return inst->aa ? (uint64_t)disp : pc + disp;
+}
+
+// Loads and stores. EA goes to rax; update forms keep it in [rsp].
+static void translate_load(translator_t* t, const ppc_packed_inst_t* in, unsigned size,
+                           int sext, bool indexed, bool update) {
+    emit_t* e = &t->e;
+    if (update) load_gpr(t, RAX, in->ra); else load_ra0(t, RAX, in->ra);
+    if (indexed) {
+        alu_gpr(t, 0x01, RAX, in->rb);
+    } else if (in->simm) {
+        emit_alu_ri(e, ALU_ADD, 1, RAX, in->simm);
+    }
+    if (update) emit_store64(e, RSP, 0, RAX);
+    emit_memory_access(t, size, false);
+    if (sext == 2) {
+        emit_rr0f(e, 0xBF, 1, RAX, RAX);
+    } else if (sext == 4) {
+        emit_movsxd(e, RAX);
+    }
+    store_gpr(t, in->rt, RAX);
+    if (update) {
+        emit_load64(e, RAX, RSP, 0);
+        store_gpr(t, in->ra, RAX);
+    }
+}
+
+static void translate_store(translator_t* t, const ppc_packed_inst_t* in, unsigned size,
+                            bool indexed, bool update) {
+    emit_t* e = &t->e;
+    if (update) load_gpr(t, RAX, in->ra); else load_ra0(t, RAX, in->ra);
+    if (indexed) {
+        alu_gpr(t, 0x01, RAX, in->rb);
+    } else if (in->simm) {
+        emit_alu_ri(e, ALU_ADD, 1, RAX, in->simm);
+    }
+    if (update) emit_store64(e, RSP, 0, RAX);
+    load_gpr(t, R10, in->rt);
+    emit_memory_access(t, size, true);
+    if (update) {
+        emit_load64(e, RAX, RSP, 0);
+        store_gpr(t, in->ra, RAX);
+    }
+}
+
+static void translate_compare(translator_t* t, const ppc_packed_inst_t* in, bool is_signed, bool immediate) {
+    emit_t* e = &t->e;
+    bool wide = in->rt & 1;
+    load_gpr(t, RAX, in->ra);
+    if (immediate) {
+        uint64_t imm = is_signed ? (uint64_t)(int64_t)in->simm : in->imm;
+        emit_mov_ri(e, RCX, imm);
+    } else {
+        load_gpr(t, RCX, in->rb);
+    }
+    if (!wide) {
+        if (is_signed) {
+            emit_movsxd(e, RAX);
+            emit_movsxd(e, RCX);
+        } else {
+            emit_rr(e, 0x89, 0, RAX, RAX);
+            emit_rr(e, 0x89, 0, RCX, RCX);
+        }
+    }
+    emit_rr(e, 0x39, 1, RAX, RCX);
+    emit_cr_update(t, in->rt >> 2, is_signed);
+    if (in->rt >> 2 == 0) emit_set_cr0_pending(t, false);
+}
+
+// Translates one op natively; returns false to fall back to its handler
+static bool translate_op(translator_t* t, const ppc_op_t* op) {
+    emit_t* e = &t->e;
+    const ppc_packed_inst_t* in = &op->inst;
+    uint64_t pc = t->pc + op->pc_off;
+    bool rc = in->rc;
+
+    switch (in->id) {
+        case PPC_INST_ADDI:
+        case PPC_INST_ADDIS: {
+            int64_t imm = in->id == PPC_INST_ADDIS ? (int64_t)in->simm * 65536 : in->simm;
+            load_ra0(t, RAX, in->ra);
+            if (imm) emit_alu_ri(e, ALU_ADD, 1, RAX, (int32_t)imm);
+            store_gpr(t, in->rt, RAX);
+            return true;
+        }
+
+        case PPC_INST_ADD:
+        case PPC_INST_SUBF:
+            if (in->oe) return false;
+            load_gpr(t, RAX, in->id == PPC_INST_ADD ? in->ra : in->rb);
+            alu_gpr(t, in->id == PPC_INST_ADD ? 0x01 : 0x29, RAX,
+                    in->id == PPC_INST_ADD ? in->rb : in->ra);
+            finish_result(t, in->rt, rc);
+            return true;
+
+        case PPC_INST_NEG:
+            if (in->oe) return false;
+            load_gpr(t, RAX, in->ra);
+            emit_unary(e, 3, 1, RAX);
+            finish_result(t, in->rt, rc);
+            return true;
+
+        case PPC_INST_MULLD:
+        case PPC_INST_MULLW:
+            if (in->oe) return false;
+            load_gpr(t, RAX, in->ra);
+            load_gpr(t, RCX, in->rb);
+            if (in->id == PPC_INST_MULLW) {
+                emit_movsxd(e, RAX);
+                emit_movsxd(e, RCX);
+            }
+            emit_rr0f(e, 0xAF, 1, RAX, RCX);
+            finish_result(t, in->rt, rc);
+            return true;
+
+        case PPC_INST_AND:
+        case PPC_INST_OR:
+        case PPC_INST_XOR:
+        case PPC_INST_NOR:
+        case PPC_INST_NAND:
+        case PPC_INST_EQV: {
+            uint8_t opc = in->id == PPC_INST_AND || in->id == PPC_INST_NAND ? 0x21 :
+                          in->id == PPC_INST_XOR || in->id == PPC_INST_EQV ? 0x31 : 0x09;
+            load_gpr(t, RAX, in->rt);
+            if (in->rt != in->rb || opc == 0x31) alu_gpr(t, opc, RAX, in->rb);
+            if (in->id == PPC_INST_NOR || in->id == PPC_INST_NAND || in->id == PPC_INST_EQV) {
+                emit_unary(e, 2, 1, RAX);
+            }
+            finish_result(t, in->ra, rc);
+            return true;
+        }
+
+        case PPC_INST_ANDC:
+            load_gpr(t, RCX, in->rb);
+            emit_unary(e, 2, 1, RCX);
+            load_gpr(t, RAX, in->rt);
+            emit_rr(e, 0x21, 1, RAX, RCX);
+            finish_result(t, in->ra, rc);
+            return true;
+
+        case PPC_INST_EXTSB:
+        case PPC_INST_EXTSH:
+        case PPC_INST_EXTSW:
+            load_gpr(t, RAX, in->rt);
+            rex(e, 1, RAX, 0, RAX);
+            if (in->id == PPC_INST_EXTSW) {
+                e8(e, 0x63);
+            } else {
+                e8(e, 0x0F);
+                e8(e, in->id == PPC_INST_EXTSB ? 0xBE : 0xBF);
+            }
+            modrm_rr(e, RAX, RAX);
+            finish_result(t, in->ra, rc);
+            return true;
+
+        case PPC_INST_ORI:
+        case PPC_INST_ORIS:
+        case PPC_INST_XORI:
+        case PPC_INST_XORIS:
+        case PPC_INST_ANDI_DOT:
+        case PPC_INST_ANDIS_DOT: {
+            bool shifted = in->id == PPC_INST_ORIS || in->id == PPC_INST_XORIS ||
+                           in->id == PPC_INST_ANDIS_DOT;
+            uint8_t opc = (in->id == PPC_INST_ORI || in->id == PPC_INST_ORIS) ? 0x09 :
+                          (in->id == PPC_INST_XORI || in->id == PPC_INST_XORIS) ? 0x31 : 0x21;
+            bool record = in->id == PPC_INST_ANDI_DOT || in->id == PPC_INST_ANDIS_DOT;
+            load_gpr(t, RAX, in->rt);
+            emit_mov_ri(e, RCX, shifted ? (uint64_t)in->imm << 16 : in->imm);
+            emit_rr(e, opc, 1, RAX, RCX);
+            finish_result(t, in->ra, record);
+            return true;
+        }
+
+        case PPC_INST_RLWINM:
+            // Wrapping masks use the replicated high word; leave them to C
+            if (in->mask >> 32) return false;
+            load_gpr(t, RAX, in->rt);
+            emit_rr(e, 0x89, 0, RAX, RAX);
+            emit_shift_ri(e, SHIFT_ROL, 0, RAX, in->sh);
+            emit_alu_ri64(e, ALU_AND, RAX, in->mask);
+            finish_result(t, in->ra, rc);
+            return true;
+
+        case PPC_INST_RLDICL:
+        case PPC_INST_RLDICR:
+            load_gpr(t, RAX, in->rt);
+            emit_shift_ri(e, SHIFT_ROL, 1, RAX, in->sh & 63);
+            emit_alu_ri64(e, ALU_AND, RAX, in->mask);
+            finish_result(t, in->ra, rc);
+            return true;
+
+        case PPC_INST_CMP:   translate_compare(t, in, true, false);  return true;
+        case PPC_INST_CMPL:  translate_compare(t, in, false, false); return true;
+        case PPC_INST_CMPI:  translate_compare(t, in, true, true);   return true;
+        case PPC_INST_CMPLI: translate_compare(t, in, false, true);  return true;
+
+        case PPC_INST_LBZ:   translate_load(t, in, 1, 0, false, false); return true;
+        case PPC_INST_LBZU:  translate_load(t, in, 1, 0, false, true);  return true;
+        case PPC_INST_LBZX:  translate_load(t, in, 1, 0, true, false);  return true;
+        case PPC_INST_LHZ:   translate_load(t, in, 2, 0, false, false); return true;
+        case PPC_INST_LHZX:  translate_load(t, in, 2, 0, true, false);  return true;
+        case PPC_INST_LHA:   translate_load(t, in, 2, 2, false, false); return true;
+        case PPC_INST_LWZ:   translate_load(t, in, 4, 0, false, false); return true;
+        case PPC_INST_LWZU:  translate_load(t, in, 4, 0, false, true);  return true;
+        case PPC_INST_LWZX:  translate_load(t, in, 4, 0, true, false);  return true;
+        case PPC_INST_LWA:   translate_load(t, in, 4, 4, false, false); return true;
+        case PPC_INST_LD:    translate_load(t, in, 8, 0, false, false); return true;
+        case PPC_INST_LDU:   translate_load(t, in, 8, 0, false, true);  return true;
+        case PPC_INST_LDX:   translate_load(t, in, 8, 0, true, false);  return true;
+        case PPC_INST_STB:   translate_store(t, in, 1, false, false); return true;
+        case PPC_INST_STBX:  translate_store(t, in, 1, true, false);  return true;
+        case PPC_INST_STH:   translate_store(t, in, 2, false, false); return true;
+        case PPC_INST_STHX:  translate_store(t, in, 2, true, false);  return true;
+        case PPC_INST_STW:   translate_store(t, in, 4, false, false); return true;
+        case PPC_INST_STWU:  translate_store(t, in, 4, false, true);  return true;
+        case PPC_INST_STWX:  translate_store(t, in, 4, true, false);  return true;
+        case PPC_INST_STD:   translate_store(t, in, 8, false, false); return true;
+        case PPC_INST_STDU:  translate_store(t, in, 8, false, true);  return true;
+        case PPC_INST_STDX:  translate_store(t, in, 8, true, false);  return true;
+
+        case PPC_INST_MFSPR:
+        case PPC_INST_MTSPR: {
+            int32_t off = in->spr == SPR_LR ? CPU_OFF(lr) : in->spr == SPR_CTR ? CPU_OFF(ctr) : -1;
+            if (off < 0) return false;
+            if (in->id == PPC_INST_MFSPR) {
+                emit_load64(e, RAX, RBX, off);
+                store_gpr(t, in->rt, RAX);
+            } else {
+                load_gpr(t, RAX, in->rt);
+                emit_store64(e, RBX, off, RAX);
+            }
+            return true;
+        }
+
+        // x86 keeps every order but store-load, so only a full sync
+        // needs a fence; lwsync is free
+        case PPC_INST_SYNC:
+            if (((op->raw >> 21) & 3) != 1) {
+                e8(e, 0x0F); e8(e, 0xAE); e8(e, 0xF0);  // mfence
+            }
+            return true;
+
+        case PPC_INST_B:
+            if (in->lk) set_lr(t, pc + 4);
+            emit_chainable_exit(t, branch_target(pc, in));
+            return true;
+
+        case PPC_INST_BC: {
+            uint8_t* not_taken[2];
+            if (in->lk) set_lr(t, pc + 4);
+            int n = emit_branch_test(t, in->bt, in->ba, true, not_taken);
+            uint32_t dirty = t->dirty;
+            emit_chainable_exit(t, branch_target(pc, in));
+            for (int i = 0; i < n; i++) patch_rel32(not_taken[i], e->p);
+            t->dirty = dirty;
+            if (n) emit_chainable_exit(t, pc + 4);
+            return true;
+        }
+
+        case PPC_INST_BCLR:
+        case PPC_INST_BCCTR: {
+            uint8_t* not_taken[2];
+            bool is_lr = in->id == PPC_INST_BCLR;
+            // Target is read before LK updates LR
+            emit_load64(e, R10, RBX, is_lr ? CPU_OFF(lr) : CPU_OFF(ctr));
+            emit_alu_ri(e, ALU_AND, 1, R10, ~3);
+            if (in->lk) set_lr(t, pc + 4);
+            int n = emit_branch_test(t, in->bt, in->ba, is_lr, not_taken);
+            uint32_t dirty = t->dirty;
+            emit_store64(e, RBX, CPU_OFF(pc), R10);
+            emit_dynamic_exit(t);
+            for (int i = 0; i < n; i++) patch_rel32(not_taken[i], e->p);
+            t->dirty = dirty;
+            if (n) emit_chainable_exit(t, pc + 4);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+static bool is_block_terminator(uint16_t id) {
+    return id == PPC_INST_B || id == PPC_INST_BC ||
+           id == PPC_INST_BCLR || id == PPC_INST_BCCTR;
+}
+
+// Gives host registers to the most used GPRs of the block
+static void allocate_registers(translator_t* t) {
+    unsigned uses[32] = {0};
+    for (uint32_t i = 0; i < t->block->n_insns; i++) {
+        // VSX forms widen the fields to 6 bits; those are not GPRs
+        const ppc_packed_inst_t* in = &t->block->ops[i].inst;
+        uses[in->rt & 31]++;
+        uses[in->ra & 31]++;
+        uses[in->rb & 31]++;
+    }
+    memset(t->host, -1, sizeof(t->host));
+    t->cached = 0;
+    for (int n = 0; n < JIT_CACHED_REGS; n++) {
+        int best = -1;
+        for (int gpr = 0; gpr < 32; gpr++) {
+            if (t->host[gpr] < 0 && uses[gpr] > 1 && (best < 0 || uses[gpr] > uses[best])) {
+                best = gpr;
+            }
+        }
+        if (best < 0) break;
+        t->host[best] = (int8_t)cache_regs[n];
+        t->cached |= 1U << best;
+    }
+}
+
+static void emit_shared_stubs(jit_t* jit) {
+    emit_t e = { jit->code, jit->code + jit->size };
+
+    // void trampoline(cpu, mem, code)
+    jit->trampoline = e.p;
+    emit_push(&e, RBX);
+    emit_push(&e, RBP);
+    emit_push(&e, R12);
+    emit_push(&e, R13);
+    emit_push(&e, R14);
+    emit_push(&e, R15);
+    emit_alu_ri(&e, ALU_SUB, 1, RSP, 8);
+    emit_mov_rr(&e, RBX, RDI);
+    emit_mov_rr(&e, RBP, RSI);
+    e8(&e, 0xFF);
+    modrm_rr(&e, 4, RDX);                           // jmp rdx
+
+    jit->epilogue = e.p;
+    emit_alu_ri(&e, ALU_ADD, 1, RSP, 8);
+    emit_pop(&e, R15);
+    emit_pop(&e, R14);
+    emit_pop(&e, R13);
+    emit_pop(&e, R12);
+    emit_pop(&e, RBP);
+    emit_pop(&e, RBX);
+    e8(&e, 0xC3);
+
+    jit->used = (size_t)(e.p - jit->code + 15) & ~(size_t)15;
+    jit->reset_point = jit->used;
+}
+
+jit_t* jit_create(block_cache_t* cache) {
+    jit_t* jit = calloc(1, sizeof(jit_t));
+    if (!jit) return NULL;
+
+    void* code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+    jit->cache = cache;
+    jit->code = code;
+    jit->size = JIT_CODE_SIZE;
+    emit_shared_stubs(jit);
+
+    // Symbols for perf: one line per translation, named by guest PC
+    if (getenv("PWRXE_PERF_MAP")) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+        jit->perf_map = fopen(path, "w");
+        if (jit->perf_map) {
+            fprintf(jit->perf_map, "%lx %lx pwrxe_stubs\n", (unsigned long)(uintptr_t)jit->code,
+                    (unsigned long)jit->reset_point);
+        }
+    }
+    return jit;
+}
+
+void jit_destroy(jit_t* jit) {
+    if (!jit) return;
+    if (jit->perf_map) fclose(jit->perf_map);
+    munmap(jit->code, jit->size);
+    free(jit);
+}
+
+bool jit_translate(jit_t* jit, ppc_block_t* block, uint64_t pc) {
+    if (block->jit) return true;
+
+    // Out of space: drop every block and start over at a safe point
+    if (jit->size - jit->used < JIT_BLOCK_MAX) {
+        block_cache_flush(jit->cache);
+        jit->used = jit->reset_point;
+        return false;
+    }
+
+    jit_block_t* jb = calloc(1, sizeof(jit_block_t));
+    translator_t* t = calloc(1, sizeof(translator_t));
+    if (jb) jb->fallback_ops = malloc(sizeof(ppc_op_t) * 2 * (block->n_insns + 1));
+    if (!jb || !t || !jb->fallback_ops) {
+        if (jb) free(jb->fallback_ops);
+        free(jb);
+        free(t);
+        return false;
+    }
+
+    t->jit = jit;
+    t->block = block;
+    t->jb = jb;
+    t->pc = pc;
+    t->e.p = jit->code + jit->used;
+    t->e.end = jit->code + jit->size;
+    emit_t* e = &t->e;
+    uint8_t* start = e->p;
+
+    allocate_registers(t);
+
+    // Entry: publish the PC, return to the dispatcher if other vCPUs
+    // left invalidations, charge the budget, load cached GPRs
+    emit_mov_ri(e, RAX, pc);
+    emit_store64(e, RBX, CPU_OFF(pc), RAX);
+    emit_alu_mi(e, ALU_CMP, 0, RBP, MEM_OFF(pending), 0);
+    patch_rel32(emit_jcc(e, CC_NE), jit->epilogue);
+    emit_alu_mi(e, ALU_CMP, 1, RBX, CPU_OFF(exec_state.jit_budget), (int32_t)block->n_insns);
+    patch_rel32(emit_jcc(e, CC_L), jit->epilogue);
+    emit_alu_mi(e, ALU_SUB, 1, RBX, CPU_OFF(exec_state.jit_budget), (int32_t)block->n_insns);
+    rex(e, 0, 0, 0, RBX);
+    e8(e, 0xC7);
+    modrm_mem(e, 0, RBX, CPU_OFF(exec_state.charged));
+    e32(e, block->n_insns);
+#ifdef PWRXE_PROFILE
+    emit_mov_ri(e, RAX, (uint64_t)(uintptr_t)&block->prof_runs);
+    emit_alu_mi(e, ALU_ADD, 1, RAX, 0, 1);
+#endif
+    // Traced views record each block entered (trace.h); nothing is
+    // cached in host registers yet
+    trace_ring_t* ring = jit->cache->mem->trace;
+    if (ring) {
+        emit_mov_ri(e, RDI, (uint64_t)(uintptr_t)ring);
+        emit_mov_ri(e, RSI, (uint64_t)(uintptr_t)block);
+        emit_mov_ri(e, RDX, pc);
+        emit_call(e, (const void*)trace_jit_enter);
+    }
+    reload(t, false);
+
+    bool terminated = false;
+    for (uint32_t i = 0; i < block->n_insns && !t->failed; i++) {
+        const ppc_op_t* op = &block->ops[i];
+        t->pc_off = op->pc_off;
+        if (op->inst.id == PPC_INST_PREFIX && i + 1 < block->n_insns) {
+            emit_fallback(t, op, 2);
+            terminated = false;
+            i++;
+            continue;
+        }
+        if (translate_op(t, op)) {
+            terminated = is_block_terminator(op->inst.id);
+            continue;
+        }
+        emit_fallback(t, op, 1);
+        terminated = false;
+    }
+    if (!terminated) {
+        emit_chainable_exit(t, pc + block->n_insns * 4);
+    }
+
+    // Fallback exits: refund the instructions the block did not retire
+    uint8_t* refund = e->p;
+    emit_mov_ri(e, RAX, block->n_insns);
+    emit_rm(e, 0x2B, 0, RAX, RBX, CPU_OFF(exec_state.retired));
+    emit_rm(e, 0x01, 1, RAX, RBX, CPU_OFF(exec_state.jit_budget));
+    patch_rel32(emit_jmp(e), jit->epilogue);
+
+    // Exit stubs record the exit so the dispatcher can chain it
+    for (int i = 0; i < t->n_exits; i++) {
+        jit_exit_t* exit = &jb->exits[i];
+        exit->stub = e->p;
+        exit->jmp_site = t->chain_sites[i];
+        exit->owner = block;
+        emit_mov_ri(e, RAX, (uint64_t)(uintptr_t)exit);
+        emit_store64(e, RBX, CPU_OFF(exec_state.jit_exit), RAX);
+        patch_rel32(emit_jmp(e), jit->epilogue);
+    }
+
+    emit_slow_paths(t);
+
+    if (t->failed || e->p > e->end) {
+        free(jb->fallback_ops);
+        free(jb);
+        free(t);
+        return false;
+    }
+
+    for (int i = 0; i < t->n_fallback_exits; i++) {
+        patch_rel32(t->fallback_exit_sites[i], refund);
+    }
+    for (int i = 0; i < t->n_exits; i++) {
+        patch_rel32(jb->exits[i].jmp_site, jb->exits[i].stub);
+    }
+
+    jb->pc = pc;
+    jb->code = start;
+    jb->code_size = (uint32_t)(e->p - start);
+    jit->used = (size_t)(e->p - jit->code + 15) & ~(size_t)15;
+    block->jit = jb;
+    free(t);
+
+    // Addresses are reused after a flush; perf takes the latest line
+    if (jit->perf_map) {
+        fprintf(jit->perf_map, "%lx %x pwrxe:0x%llx\n", (unsigned long)(uintptr_t)start,
+                jb->code_size, (unsigned long long)pc);
+        fflush(jit->perf_map);
+    }
+    return true;
+}
+
+void jit_execute(jit_t* jit, ppc_cpu_state_t* cpu, memory_system_t* mem, ppc_block_t* block) {
+    void (*enter)(ppc_cpu_state_t*, memory_system_t*, void*) =
+        (void (*)(ppc_cpu_state_t*, memory_system_t*, void*))(void*)jit->trampoline;
+    cpu->exec_state.jit_exit = NULL;
+    enter(cpu, mem, block->jit->code);
+}
+
+void jit_chain(jit_exit_t* exit, ppc_block_t* target) {
+    if (exit->target || !target->jit) return;
+    patch_rel32(exit->jmp_site, target->jit->code);
+    exit->target = target;
+    exit->next_incoming = target->jit->incoming;
+    target->jit->incoming = exit;
+}
+
+static void unchain_exit(jit_exit_t* exit) {
+    patch_rel32(exit->jmp_site, exit->stub);
+    exit->target = NULL;
+    exit->next_incoming = NULL;
+}
+
+void jit_block_unlink(ppc_block_t* block) {
+    jit_block_t* jb = block->jit;
+    if (!jb) return;
+
+    // Nobody may jump into this block any more
+    for (jit_exit_t* in = jb->incoming; in; ) {
+        jit_exit_t* next = in->next_incoming;
+        unchain_exit(in);
+        in = next;
+    }
+    jb->incoming = NULL;
+
+    // And its own exits leave the targets' incoming lists
+    for (int i = 0; i < 2; i++) {
+        jit_exit_t* exit = &jb->exits[i];
+        if (!exit->target) continue;
+        jit_exit_t** link = &exit->target->jit->incoming;
+        while (*link && *link != exit) link = &(*link)->next_incoming;
+        if (*link) *link = exit->next_incoming;
+        unchain_exit(exit);
+    }
+}
+
+void jit_block_free(ppc_block_t* block) {
+    if (!block->jit) return;
+    free(block->jit->fallback_ops);
+    free(block->jit);
+    block->jit = NULL;
+}
+
+void jit_unchain_all(block_cache_t* cache) {
+    for (int i = 0; i < BLOCK_HASH_SIZE; i++) {
+        for (ppc_block_t* block = cache->hash[i]; block; block = block->hash_next) {
+            jit_block_unlink(block);
+        }
+    }
+}
+
+#else
+
+// Translation is only implemented for x86-64 hosts
+jit_t* jit_create(block_cache_t* cache) { (void)cache; return NULL; }
+void jit_destroy(jit_t* jit) { (void)jit; }
+bool jit_translate(jit_t* jit, ppc_block_t* block, uint64_t pc) {
+    (void)jit; (void)block; (void)pc;
+    return false;
+}
+void jit_execute(jit_t* jit, ppc_cpu_state_t* cpu, memory_system_t* mem, ppc_block_t* block) {
+    (void)jit; (void)cpu; (void)mem; (void)block;
+}
+void jit_chain(jit_exit_t* exit, ppc_block_t* target) { (void)exit; (void)target; }
+void jit_block_unlink(ppc_block_t* block) { (void)block; }
+void jit_block_free(ppc_block_t* block) { (void)block; }
+void jit_unchain_all(block_cache_t* cache) { (void)cache; }
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "block.h"
+
+// Blocks interpreted this many times are translated to native code
+#define JIT_THRESHOLD   50
+
+#define JIT_CODE_SIZE   (64 * 1024 * 1024)
+#define JIT_BLOCK_MAX   (64 * 1024)     // Worst-case code for one block
+
+// Patchable direct-branch exit of a translated block. Until it is chained
+// the jump goes to a stub that returns to the dispatcher.
+typedef struct jit_exit {
+    uint8_t* jmp_site;              // rel32 field of the exit jump
+    uint8_t* stub;                  // Unchained target
+    struct ppc_block* owner;
+    struct ppc_block* target;       // Chained block, or NULL
+    struct jit_exit* next_incoming; // Next exit chained to the same target
+} jit_exit_t;
+
+typedef struct jit_block {
+    uint64_t pc;                    // Guest PC the code was translated for
+    uint8_t* code;                  // Entry point (after the host prologue)
+    uint32_t code_size;
+    jit_exit_t exits[2];
+    jit_exit_t* incoming;           // Exits of other blocks chained here
+    ppc_op_t* fallback_ops;         // Interpreter ops called from the code
+} jit_block_t;
+
+typedef struct jit jit_t;
+
+jit_t* jit_create(block_cache_t* cache);
+void jit_destroy(jit_t* jit);
+
+// Translates an interpreted block; returns false if it could not
+bool jit_translate(jit_t* jit, ppc_block_t* block, uint64_t pc);
+
+// Runs translated code until it leaves the chain of translated blocks.
+// Instructions are charged against cpu->exec_state.jit_budget.
+void jit_execute(jit_t* jit, ppc_cpu_state_t* cpu, memory_system_t* mem, ppc_block_t* block);
+
+// Patches a chainable exit to jump straight into target's code
+void jit_chain(jit_exit_t* exit, ppc_block_t* target);
+
+// Chain maintenance for the block cache
+void jit_block_unlink(ppc_block_t* block);
+void jit_block_free(ppc_block_t* block);
+void jit_unchain_all(block_cache_t* cache);
+
+#endif
@@ -0,0 +1,395 @@
+#define _GNU_SOURCE        // O_DIRECT, fstatat, preadv
+#include "linux_user.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+// ppc64 system call numbers
+enum {
+    PPC_NR_exit = 1, PPC_NR_read = 3, PPC_NR_write = 4, PPC_NR_open = 5, PPC_NR_close = 6,
+    PPC_NR_lseek = 19, PPC_NR_getpid = 20, PPC_NR_getuid = 24, PPC_NR_brk = 45,
+    PPC_NR_getgid = 47, PPC_NR_geteuid = 49, PPC_NR_getegid = 50, PPC_NR_ioctl = 54,
+    PPC_NR_gettimeofday = 78, PPC_NR_mmap = 90, PPC_NR_munmap = 91, PPC_NR_fstat = 108,
+    PPC_NR_uname = 122, PPC_NR_mprotect = 125, PPC_NR_readv = 145, PPC_NR_writev = 146,
+    PPC_NR_sched_yield = 158, PPC_NR_rt_sigaction = 173, PPC_NR_rt_sigprocmask = 174,
+    PPC_NR_pread64 = 179, PPC_NR_pwrite64 = 180, PPC_NR_sigaltstack = 185,
+    PPC_NR_madvise = 205, PPC_NR_gettid = 207, PPC_NR_futex = 221,
+    PPC_NR_set_tid_address = 232, PPC_NR_exit_group = 234, PPC_NR_clock_gettime = 246,
+    PPC_NR_openat = 286, PPC_NR_newfstatat = 291, PPC_NR_set_robust_list = 300,
+    PPC_NR_getrandom = 359,
+};
+
+// open() flags that differ from the generic values
+#define PPC_O_DIRECTORY     040000
+#define PPC_O_NOFOLLOW      0100000
+#define PPC_O_LARGEFILE     0200000
+#define PPC_O_DIRECT        0400000
+
+#define PPC_PROT_WRITE      0x2
+
+#define PPC_MAP_SHARED      0x01
+#define PPC_MAP_FIXED       0x10
+#define PPC_MAP_ANONYMOUS   0x20
+
+// Host iovecs per call; longer buffers make short transfers
+#define GUEST_IOV_MAX       256
+
+#define PAGE_ROUND_UP(x)    (((x) + PAGE_MASK) & ~(uint64_t)PAGE_MASK)
+
+void linux_process_init(linux_process_t* proc, const memory_system_t* mem, const elf_image_t* image) {
+    proc->brk_start = proc->brk = proc->brk_max = image->brk;
+    proc->mmap_top = mem->ram_size - LINUX_STACK_SIZE;
+    proc->exit_status = 0;
+    proc->exited = false;
+}
+
+static inline int64_t host_result(int64_t ret) {
+    return ret < 0 ? -errno : ret;
+}
+
+// Appends iovecs for len bytes of guest memory at addr, merging pages
+// that are contiguous on the host. Returns how many bytes they cover,
+// which falls short of len at an inaccessible page or when iov is full.
+static uint64_t guest_iov(memory_system_t* mem, uint64_t addr, uint64_t len, uint32_t access,
+                          struct iovec* iov, int* n) {
+    uint64_t covered = 0;
+    while (covered < len) {
+        uint8_t* host = memory_host_page(mem, addr, access);
+        if (!host) break;
+        size_t chunk = PAGE_SIZE - (addr & PAGE_MASK);
+        if (chunk > len - covered) chunk = len - covered;
+        struct iovec* last = *n ? &iov[*n - 1] : NULL;
+        if (last && (uint8_t*)last->iov_base + last->iov_len == host) {
+            last->iov_len += chunk;
+        } else if (*n < GUEST_IOV_MAX) {
+            iov[*n].iov_base = host;
+            iov[*n].iov_len = chunk;
+            (*n)++;
+        } else {
+            break;
+        }
+        addr += chunk;
+        covered += chunk;
+    }
+    return covered;
+}
+
+// The same for a guest struct iovec array
+static bool guest_iov_array(memory_system_t* mem, uint64_t vec, uint64_t count, uint32_t access,
+                            struct iovec* iov, int* n) {
+    if (count > 1024) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t entry[2];
+        if (!memory_host_page(mem, vec + i * 16, MEM_READ) ||
+            memory_read_be64(mem, vec + i * 16, entry, 2) < 2) {
+            return false;
+        }
+        if (guest_iov(mem, entry[0], entry[1], access, iov, n) < entry[1]) return *n > 0;
+    }
+    return true;
+}
+
+// Copies a NUL-terminated guest string (paths) into buf
+static bool guest_string(memory_system_t* mem, uint64_t addr, char* buf, size_t size) {
+    for (size_t i = 0; i < size; i++, addr++) {
+        if ((i == 0 || !(addr & PAGE_MASK)) && !memory_host_page(mem, addr, MEM_READ)) return false;
+        buf[i] = (char)memory_read8(mem, addr);
+        if (!buf[i]) return true;
+    }
+    return false;
+}
+
+static bool guest_writable(memory_system_t* mem, uint64_t addr, uint64_t len) {
+    return memory_host_page(mem, addr, MEM_WRITE) &&
+           memory_host_page(mem, addr + len - 1, MEM_WRITE);
+}
+
+static int64_t put_timespec(memory_system_t* mem, uint64_t addr, int64_t sec, int64_t frac) {
+    const uint64_t words[2] = { (uint64_t)sec, (uint64_t)frac };
+    if (!guest_writable(mem, addr, 16)) return -EFAULT;
+    memory_write_be64(mem, addr, words, 2);
+    return 0;
+}
+
+static int open_flags(uint64_t flags) {
+    int host = (int)(flags & ~(uint64_t)(PPC_O_DIRECTORY | PPC_O_NOFOLLOW | PPC_O_LARGEFILE |
+                                         PPC_O_DIRECT));
+    if (flags & PPC_O_DIRECTORY) host |= O_DIRECTORY;
+    if (flags & PPC_O_NOFOLLOW) host |= O_NOFOLLOW;
+    if (flags & PPC_O_DIRECT) host |= O_DIRECT;
+    return host;
+}
+
+// struct stat as the ppc64 kernel lays it out
+static int64_t put_stat(memory_system_t* mem, uint64_t addr, const struct stat* st) {
+    const uint64_t words[18] = {
+        st->st_dev, st->st_ino, st->st_nlink,
+        (uint64_t)st->st_mode << 32 | st->st_uid,     // Two 32-bit fields each
+        (uint64_t)st->st_gid << 32,
+        st->st_rdev, (uint64_t)st->st_size, (uint64_t)st->st_blksize, (uint64_t)st->st_blocks,
+        (uint64_t)st->st_atim.tv_sec, (uint64_t)st->st_atim.tv_nsec,
+        (uint64_t)st->st_mtim.tv_sec, (uint64_t)st->st_mtim.tv_nsec,
+        (uint64_t)st->st_ctim.tv_sec, (uint64_t)st->st_ctim.tv_nsec,
+        0, 0, 0,
+    };
+    if (!guest_writable(mem, addr, sizeof(words))) return -EFAULT;
+    memory_write_be64(mem, addr, words, 18);
+    return 0;
+}
+
+static int64_t sys_uname(memory_system_t* mem, uint64_t addr) {
+    static const char* const fields[] = {"Linux", "pwrxe", "6.1.0", "#1", "ppc64", "(none)"};
+    char buf[6 * 65] = {0};
+    if (!guest_writable(mem, addr, sizeof(buf))) return -EFAULT;
+    for (unsigned f = 0; f < 6; f++) {
+        strcpy(buf + f * 65, fields[f]);
+    }
+    memory_write_block(mem, addr, buf, sizeof(buf));
+    return 0;
+}
+
+// Buffer I/O straight from and to guest RAM
+static int64_t sys_rw(memory_system_t* mem, int nr, int fd, uint64_t buf, uint64_t len, int64_t off) {
+    struct iovec iov[GUEST_IOV_MAX];
+    int n = 0;
+    bool reading = nr == PPC_NR_read || nr == PPC_NR_pread64;
+    if (len && !guest_iov(mem, buf, len, reading ? MEM_WRITE : MEM_READ, iov, &n)) return -EFAULT;
+    switch (nr) {
+        case PPC_NR_read:    return host_result(readv(fd, iov, n));
+        case PPC_NR_write:   return host_result(writev(fd, iov, n));
+        case PPC_NR_pread64: return host_result(preadv(fd, iov, n, off));
+        default:             return host_result(pwritev(fd, iov, n, off));
+    }
+}
+
+static int64_t sys_rwv(memory_system_t* mem, bool reading, int fd, uint64_t vec, uint64_t count) {
+    struct iovec iov[GUEST_IOV_MAX];
+    int n = 0;
+    if (!guest_iov_array(mem, vec, count, reading ? MEM_WRITE : MEM_READ, iov, &n)) return -EFAULT;
+    return host_result(reading ? readv(fd, iov, n) : writev(fd, iov, n));
+}
+
+static int64_t sys_brk(linux_process_t* proc, memory_system_t* mem, uint64_t addr) {
+    if (addr < proc->brk_start || addr > proc->mmap_top) return (int64_t)proc->brk;
+
+    // Pages given back are cleared, as a later break must see zeros
+    uint64_t old_end = PAGE_ROUND_UP(proc->brk);
+    uint64_t new_end = PAGE_ROUND_UP(addr);
+    if (new_end < old_end && !memory_map_zero(mem, new_end, old_end - new_end)) {
+        return (int64_t)proc->brk;
+    }
+    proc->brk = addr;
+    if (addr > proc->brk_max) proc->brk_max = addr;
+    return (int64_t)addr;
+}
+
+// Guest mappings are guest RAM replaced by a host mapping, at equal guest
+// physical addresses (user-mode code runs untranslated). Protection is not
+// enforced, except that shared mappings without PROT_WRITE are read-only,
+// as their file may be open for reading only.
+static int64_t sys_mmap(linux_process_t* proc, memory_system_t* mem, uint64_t addr, uint64_t len,
+                        uint64_t prot, uint64_t flags, int fd, uint64_t offset) {
+    if (!len || (offset & PAGE_MASK)) return -EINVAL;
+    len = PAGE_ROUND_UP(len);
+    if (flags & PPC_MAP_FIXED) {
+        if ((addr & PAGE_MASK) || addr >= mem->ram_size || len > mem->ram_size - addr) return -EINVAL;
+    } else {
+        if (len > proc->mmap_top - PAGE_ROUND_UP(proc->brk_max)) return -ENOMEM;
+        addr = proc->mmap_top - len;
+    }
+
+    bool ok = (flags & PPC_MAP_ANONYMOUS) ?
+        memory_map_zero(mem, addr, len) :
+        memory_map_file(mem, addr, len, fd, offset, flags & PPC_MAP_SHARED, prot & PPC_PROT_WRITE);
+    if (!ok) return -errno;
+    if (!(flags & PPC_MAP_FIXED)) proc->mmap_top = addr;
+    return (int64_t)addr;
+}
+
+static int64_t sys_munmap(linux_process_t* proc, memory_system_t* mem, uint64_t addr, uint64_t len) {
+    len = PAGE_ROUND_UP(len);
+    if ((addr & PAGE_MASK) || !len) return -EINVAL;
+    if (!memory_map_zero(mem, addr, len)) return -EINVAL;
+    if (addr == proc->mmap_top) proc->mmap_top += len;
+    return 0;
+}
+
+// Futex words are waited on in place. The guest compares big-endian
+// values, so the expected value is swapped to match memory.
+static int64_t sys_futex(memory_system_t* mem, uint64_t uaddr, int op, uint32_t val,
+                         uint64_t timeout, uint32_t val3) {
+    if (uaddr & 3) return -EINVAL;
+    uint32_t* word = memory_host_page(mem, uaddr, MEM_READ);
+    if (!word) return -EFAULT;
+
+    struct timespec ts, *tsp = NULL;
+    switch (op & FUTEX_CMD_MASK) {
+        case FUTEX_WAIT:
+        case FUTEX_WAIT_BITSET:
+            if (timeout) {
+                uint64_t words[2];
+                if (!memory_host_page(mem, timeout, MEM_READ) ||
+                    memory_read_be64(mem, timeout, words, 2) < 2) {
+                    return -EFAULT;
+                }
+                ts.tv_sec = (time_t)words[0];
+                ts.tv_nsec = (long)words[1];
+                tsp = &ts;
+            }
+            return host_result(syscall(SYS_futex, word, op, __builtin_bswap32(val), tsp, NULL, val3));
+        case FUTEX_WAKE:
+        case FUTEX_WAKE_BITSET:
+            return host_result(syscall(SYS_futex, word, op, val, NULL, NULL, val3));
+        default:
+            return -ENOSYS;
+    }
+}
+
+static int64_t sys_getrandom(memory_system_t* mem, uint64_t buf, uint64_t len, unsigned flags) {
+    struct iovec iov[GUEST_IOV_MAX];
+    int n = 0;
+    if (len && !guest_iov(mem, buf, len, MEM_WRITE, iov, &n)) return -EFAULT;
+    int64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        ssize_t got = getrandom(iov[i].iov_base, iov[i].iov_len, flags);
+        if (got < 0) return total ? total : -errno;
+        total += got;
+        if ((size_t)got < iov[i].iov_len) break;
+    }
+    return total;
+}
+
+bool linux_syscall(linux_process_t* proc, ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    uint64_t* r = cpu->gpr;
+    uint64_t a0 = r[3], a1 = r[4], a2 = r[5], a3 = r[6], a4 = r[7], a5 = r[8];
+    char path[4096];
+    struct stat st;
+    struct timespec ts;
+    int64_t ret;
+
+    switch ((int)r[0]) {
+        case PPC_NR_exit:
+        case PPC_NR_exit_group:
+            proc->exit_status = (int)(a0 & 0xFF);
+            proc->exited = true;
+            return false;
+
+        case PPC_NR_read:
+        case PPC_NR_write:
+            ret = sys_rw(mem, (int)r[0], (int)a0, a1, a2, 0);
+            break;
+        case PPC_NR_pread64:
+        case PPC_NR_pwrite64:
+            ret = sys_rw(mem, (int)r[0], (int)a0, a1, a2, (int64_t)a3);
+            break;
+        case PPC_NR_readv:
+            ret = sys_rwv(mem, true, (int)a0, a1, a2);
+            break;
+        case PPC_NR_writev:
+            ret = sys_rwv(mem, false, (int)a0, a1, a2);
+            break;
+
+        case PPC_NR_open:
+            ret = guest_string(mem, a0, path, sizeof(path)) ?
+                host_result(open(path, open_flags(a1), (mode_t)a2)) : -EFAULT;
+            break;
+        case PPC_NR_openat:
+            ret = guest_string(mem, a1, path, sizeof(path)) ?
+                host_result(openat((int)a0, path, open_flags(a2), (mode_t)a3)) : -EFAULT;
+            break;
+        case PPC_NR_close:
+            ret = host_result(close((int)a0));
+            break;
+        case PPC_NR_lseek:
+            ret = host_result(lseek((int)a0, (off_t)a1, (int)a2));
+            break;
+        case PPC_NR_fstat:
+            ret = host_result(fstat((int)a0, &st));
+            if (ret == 0) ret = put_stat(mem, a1, &st);
+            break;
+        case PPC_NR_newfstatat:
+            if (!guest_string(mem, a1, path, sizeof(path))) {
+                ret = -EFAULT;
+                break;
+            }
+            ret = host_result(fstatat((int)a0, path, &st, (int)a3));
+            if (ret == 0) ret = put_stat(mem, a2, &st);
+            break;
+        case PPC_NR_ioctl:
+            ret = -ENOTTY;
+            break;
+
+        case PPC_NR_brk:
+            ret = sys_brk(proc, mem, a0);
+            break;
+        case PPC_NR_mmap:
+            ret = sys_mmap(proc, mem, a0, a1, a2, a3, (int)a4, a5);
+            break;
+        case PPC_NR_munmap:
+            ret = sys_munmap(proc, mem, a0, a1);
+            break;
+        case PPC_NR_mprotect:
+        case PPC_NR_madvise:
+            ret = 0;
+            break;
+
+        case PPC_NR_futex:
+            ret = sys_futex(mem, a0, (int)a1, (uint32_t)a2, a3, (uint32_t)a5);
+            break;
+        case PPC_NR_clock_gettime:
+            ret = host_result(clock_gettime((clockid_t)a0, &ts));
+            if (ret == 0) ret = put_timespec(mem, a1, ts.tv_sec, ts.tv_nsec);
+            break;
+        case PPC_NR_gettimeofday:
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ret = a0 ? put_timespec(mem, a0, ts.tv_sec, ts.tv_nsec / 1000) : 0;
+            break;
+        case PPC_NR_getrandom:
+            ret = sys_getrandom(mem, a0, a1, (unsigned)a2);
+            break;
+        case PPC_NR_uname:
+            ret = sys_uname(mem, a0);
+            break;
+
+        case PPC_NR_getpid:          ret = getpid(); break;
+        case PPC_NR_gettid:          ret = getpid(); break;
+        case PPC_NR_set_tid_address: ret = getpid(); break;
+        case PPC_NR_getuid:          ret = getuid(); break;
+        case PPC_NR_geteuid:         ret = geteuid(); break;
+        case PPC_NR_getgid:          ret = getgid(); break;
+        case PPC_NR_getegid:         ret = getegid(); break;
+        case PPC_NR_sched_yield:     ret = host_result(sched_yield()); break;
+
+        // Signals are never delivered, so their setup only has to succeed
+        case PPC_NR_rt_sigaction:
+        case PPC_NR_rt_sigprocmask:
+        case PPC_NR_sigaltstack:
+        case PPC_NR_set_robust_list:
+            ret = 0;
+            break;
+
+        default:
+            ret = -ENOSYS;
+            break;
+    }
+
+    // Errors come back as a positive errno with CR0[SO] set
+    uint32_t cr = cpu_get_cr(cpu) & ~(1U << 28);
+    if (ret < 0 && ret >= -4095) {
+        r[3] = (uint64_t)-ret;
+        cr |= 1U << 28;
+    } else {
+        r[3] = (uint64_t)ret;
+    }
+    cpu_set_cr(cpu, cr);
+    return true;
+}
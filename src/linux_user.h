@@ -0,0 +1,37 @@
+#ifndef LINUX_USER_H
+#define LINUX_USER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+#include "loader.h"
+
+// User-mode ppc64 Linux system calls. sc stops cpu_run with
+// CPU_EXIT_SYSCALL; linux_syscall then carries out the call in r0 with
+// the arguments in r3-r8 and returns the result the way the kernel does
+// (r3, and CR0[SO] with a positive errno on failure).
+//
+// Buffers are handed to the host as guest RAM pointers (one iovec per run
+// of contiguous pages), so I/O copies nothing. Guest mmap of a file
+// becomes a host mmap over guest RAM. Addresses are guest effective
+// addresses, translated like the guest's own loads and stores.
+
+// Room kept below the initial stack before mmap allocations start
+#define LINUX_STACK_SIZE    (8ULL << 20)
+
+typedef struct {
+    uint64_t brk_start;     // Initial program break (end of the image)
+    uint64_t brk;           // Current program break
+    uint64_t brk_max;       // Highest break so far
+    uint64_t mmap_top;      // mmap allocates downwards from here
+    int exit_status;
+    bool exited;
+} linux_process_t;
+
+void linux_process_init(linux_process_t* proc, const memory_system_t* mem, const elf_image_t* image);
+
+// Handles the system call cpu stopped at. Returns false once the process
+// has exited (exit_status is set).
+bool linux_syscall(linux_process_t* proc, ppc_cpu_state_t* cpu, memory_system_t* mem);
+
+#endif
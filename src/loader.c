@@ -0,0 +1,260 @@
+#include "loader.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PAGE_ROUND_UP(x)    (((x) + PAGE_MASK) & ~(uint64_t)PAGE_MASK)
+#define PAGE_ROUND_DOWN(x)  ((x) & ~(uint64_t)PAGE_MASK)
+
+// Header fields are big-endian, and so is everything the loader puts in
+// guest memory
+static inline uint16_t be16(uint16_t v) {
+    return __builtin_bswap16(v);
+}
+
+static inline uint32_t be32(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static inline uint64_t be64(uint64_t v) {
+    return __builtin_bswap64(v);
+}
+
+static inline void put64(memory_system_t* mem, uint64_t paddr, uint64_t value) {
+    value = be64(value);
+    memcpy(mem->ram + paddr, &value, sizeof(value));
+}
+
+static inline uint64_t get64(memory_system_t* mem, uint64_t paddr) {
+    uint64_t value;
+    memcpy(&value, mem->ram + paddr, sizeof(value));
+    return be64(value);
+}
+
+static bool fail(const char** error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+static bool read_exact(int fd, void* buf, size_t len, uint64_t offset) {
+    uint8_t* p = buf;
+    while (len) {
+        ssize_t n = pread(fd, p, len, (off_t)offset);
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+// Puts one PT_LOAD segment at vaddr. mapped_end is the end of the last
+// page mapped so far: a segment sharing a page with the previous one is
+// read instead, so that the mapping does not hide the other's bytes.
+static bool load_segment(memory_system_t* mem, int fd, uint64_t vaddr, uint64_t offset,
+                         uint64_t filesz, uint64_t memsz, uint64_t* mapped_end) {
+    uint64_t file_end = vaddr + filesz;
+    uint64_t page = PAGE_ROUND_DOWN(vaddr);
+
+    if (filesz) {
+        bool mappable = (offset & PAGE_MASK) == (vaddr & PAGE_MASK) && page >= *mapped_end;
+        if (mappable) {
+            uint64_t len = PAGE_ROUND_UP(file_end) - page;
+            if (!memory_map_file(mem, page, len, fd, offset - (vaddr - page), false, true)) return false;
+        } else if (!read_exact(fd, mem->ram + vaddr, filesz, offset)) {
+            return false;
+        }
+    }
+
+    // BSS: the rest of the page holding the end of the file contents is
+    // cleared, whole pages after it are fresh zero-fill
+    uint64_t mem_end = vaddr + memsz;
+    uint64_t bss_page = PAGE_ROUND_UP(file_end);
+    if (mem_end > file_end) {
+        memset(mem->ram + file_end, 0, (mem_end < bss_page ? mem_end : bss_page) - file_end);
+    }
+    uint64_t end = PAGE_ROUND_UP(mem_end);
+    if (end > bss_page && !memory_map_zero(mem, bss_page, end - bss_page)) return false;
+    if (end > *mapped_end) *mapped_end = end;
+    return true;
+}
+
+bool elf_load(memory_system_t* mem, const char* path, elf_image_t* image, const char** error) {
+    memset(image, 0, sizeof(*image));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return fail(error, "cannot open file");
+
+    // Segment contents are mapped, not read: pages past the end of the
+    // file would fault on first touch
+    const char* message = NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        message = "cannot open file";
+        goto out;
+    }
+    uint64_t file_size = (uint64_t)st.st_size;
+
+    Elf64_Ehdr eh;
+    if (!read_exact(fd, &eh, sizeof(eh), 0) || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0) {
+        message = "not an ELF file";
+        goto out;
+    }
+    // The core runs guests big-endian whatever MSR[LE] says
+    if (eh.e_ident[EI_DATA] == ELFDATA2LSB) {
+        message = "little-endian executables are not supported";
+        goto out;
+    }
+    uint16_t type = be16(eh.e_type);
+    if (eh.e_ident[EI_CLASS] != ELFCLASS64 || eh.e_ident[EI_DATA] != ELFDATA2MSB ||
+        be16(eh.e_machine) != EM_PPC64 || (type != ET_EXEC && type != ET_DYN)) {
+        message = "not a 64-bit PowerPC executable";
+        goto out;
+    }
+
+    uint32_t phnum = be16(eh.e_phnum);
+    uint32_t phent = be16(eh.e_phentsize);
+    uint64_t phoff = be64(eh.e_phoff);
+    if (phent != sizeof(Elf64_Phdr) || phnum == 0 || phnum > 256) {
+        message = "bad program headers";
+        goto out;
+    }
+    Elf64_Phdr ph[256];
+    if (!read_exact(fd, ph, phnum * sizeof(Elf64_Phdr), phoff)) {
+        message = "truncated program headers";
+        goto out;
+    }
+
+    image->load_bias = type == ET_DYN ? ELF_DYN_BASE : 0;
+    image->phnum = phnum;
+    image->phent = phent;
+    image->abi = (be32(eh.e_flags) & 3) ? (be32(eh.e_flags) & 3) : 1;
+
+    uint64_t mapped_end = 0;
+    for (uint32_t i = 0; i < phnum; i++) {
+        uint32_t ptype = be32(ph[i].p_type);
+        uint64_t vaddr = be64(ph[i].p_vaddr) + image->load_bias;
+        uint64_t offset = be64(ph[i].p_offset);
+        uint64_t filesz = be64(ph[i].p_filesz);
+        uint64_t memsz = be64(ph[i].p_memsz);
+
+        if (ptype == PT_INTERP) {
+            message = "dynamically linked executables are not supported";
+            goto out;
+        }
+        if (ptype == PT_PHDR) image->phdr = vaddr;
+        if (ptype != PT_LOAD || memsz == 0) continue;
+
+        if (filesz > memsz || vaddr >= mem->ram_size || memsz > mem->ram_size - vaddr) {
+            message = "segment does not fit in guest RAM";
+            goto out;
+        }
+        if (offset > file_size || filesz > file_size - offset) {
+            message = "segment outside the file";
+            goto out;
+        }
+        if (!load_segment(mem, fd, vaddr, offset, filesz, memsz, &mapped_end)) {
+            message = "cannot map segment";
+            goto out;
+        }
+        if (!image->phdr && offset <= phoff && phoff < offset + filesz) {
+            image->phdr = vaddr + (phoff - offset);
+        }
+        if (vaddr + memsz > image->brk) image->brk = PAGE_ROUND_UP(vaddr + memsz);
+    }
+    if (!image->brk) message = "no loadable segments";
+
+out:
+    close(fd);     // The mappings keep the file
+    if (message) return fail(error, message);
+
+    // ELFv1 entry points are function descriptors: entry, then TOC
+    image->entry = be64(eh.e_entry) + image->load_bias;
+    if (image->abi == 1) {
+        if (image->entry + 16 > mem->ram_size) return fail(error, "entry point outside RAM");
+        uint64_t desc = image->entry;
+        image->entry = get64(mem, desc);
+        image->toc = get64(mem, desc + 8);
+    }
+    return true;
+}
+
+// Pushes a string below *sp and returns its address
+static uint64_t push_string(memory_system_t* mem, uint64_t* sp, const char* s) {
+    size_t len = strlen(s) + 1;
+    *sp -= len;
+    memcpy(mem->ram + *sp, s, len);
+    return *sp;
+}
+
+bool elf_setup_process(ppc_cpu_state_t* cpu, memory_system_t* mem, const elf_image_t* image,
+                       int argc, char* const* argv, char* const* envp) {
+    int envc = 0;
+    while (envp && envp[envc]) envc++;
+
+    // Size everything first, so nothing is written past RAM
+    size_t strings = 16 + sizeof("ppc64");
+    for (int i = 0; i < argc; i++) strings += strlen(argv[i]) + 1;
+    for (int i = 0; i < envc; i++) strings += strlen(envp[i]) + 1;
+    size_t vectors = 1 + (argc + 1) + (envc + 1) + 2 * 10;
+    uint64_t need = PAGE_ROUND_UP(strings + vectors * 8 + 64);
+    if (need + image->brk > mem->ram_size) return false;
+
+    // Strings at the very top, then the 16 bytes AT_RANDOM points to
+    uint64_t sp = mem->ram_size;
+    uint64_t arg_ptrs[argc > 0 ? argc : 1];
+    uint64_t env_ptrs[envc > 0 ? envc : 1];
+    for (int i = 0; i < argc; i++) arg_ptrs[i] = push_string(mem, &sp, argv[i]);
+    for (int i = 0; i < envc; i++) env_ptrs[i] = push_string(mem, &sp, envp[i]);
+    uint64_t platform = push_string(mem, &sp, "ppc64");
+    sp = (sp - 16) & ~15ULL;
+    uint64_t random = sp;
+    for (int i = 0; i < 16; i++) mem->ram[random + i] = (uint8_t)(0x5A ^ (i * 37));
+
+    // argc, argv[], NULL, envp[], NULL, auxv[], AT_NULL, 16-byte aligned
+    uint64_t auxv[][2] = {
+        {AT_PHDR, image->phdr},
+        {AT_PHENT, image->phent},
+        {AT_PHNUM, image->phnum},
+        {AT_PAGESZ, PAGE_SIZE},
+        {AT_BASE, 0},
+        {AT_ENTRY, image->entry},
+        {AT_RANDOM, random},
+        {AT_PLATFORM, platform},
+        {AT_SECURE, 0},
+        {AT_NULL, 0},
+    };
+    size_t n_aux = sizeof(auxv) / sizeof(auxv[0]);
+    sp -= (1 + (argc + 1) + (envc + 1) + 2 * n_aux) * 8;
+    sp &= ~15ULL;
+
+    uint64_t p = sp;
+    put64(mem, p, (uint64_t)argc);
+    p += 8;
+    uint64_t argv_addr = p;
+    for (int i = 0; i < argc; i++, p += 8) put64(mem, p, arg_ptrs[i]);
+    put64(mem, p, 0);
+    p += 8;
+    uint64_t envp_addr = p;
+    for (int i = 0; i < envc; i++, p += 8) put64(mem, p, env_ptrs[i]);
+    put64(mem, p, 0);
+    p += 8;
+    uint64_t auxv_addr = p;
+    for (size_t i = 0; i < n_aux; i++, p += 16) {
+        put64(mem, p, auxv[i][0]);
+        put64(mem, p + 8, auxv[i][1]);
+    }
+
+    // r1 points at argc; ELFv2 code finds its TOC from r12
+    cpu->pc = image->entry;
+    cpu->gpr[1] = sp;
+    cpu->gpr[2] = image->toc;
+    cpu->gpr[3] = (uint64_t)argc;
+    cpu->gpr[4] = argv_addr;
+    cpu->gpr[5] = envp_addr;
+    cpu->gpr[6] = auxv_addr;
+    cpu->gpr[12] = image->entry;
+    cpu->msr = MSR_SF;
+    return true;
+}
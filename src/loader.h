@@ -0,0 +1,45 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+// Static ELF64 PowerPC executables for user-mode runs in real mode: each
+// segment goes to the guest physical address equal to its virtual
+// address. File-backed parts of segments are mapped straight from the
+// file over guest RAM (memory_map_file), and BSS is left to the kernel's
+// lazy zero fill, so loading reads nothing but the headers. The stack is
+// built at the top of RAM. Only big-endian executables load, as the core
+// does not honour MSR[LE] yet.
+
+// Position-independent executables are loaded here
+#define ELF_DYN_BASE    0x10000000ULL
+
+// RAM for user-mode runs; most executables are linked above 256MB.
+// Reserved lazily, like any guest RAM.
+#define ELF_MEMORY_SIZE (4ULL << 30)
+
+typedef struct {
+    uint64_t entry;         // First instruction
+    uint64_t toc;           // ELFv1: r2 from the entry's function descriptor
+    uint64_t load_bias;     // Added to every virtual address in the file
+    uint64_t phdr;          // Program headers in guest memory, for AT_PHDR
+    uint32_t phnum;
+    uint32_t phent;
+    uint64_t brk;           // Page after the highest segment
+    unsigned abi;           // 1 or 2 (ELFv1 function descriptors, or ELFv2)
+} elf_image_t;
+
+// Maps the executable at path into mem. Returns false, with a message in
+// error (if given), when the file is not a loadable static executable or
+// does not fit in RAM.
+bool elf_load(memory_system_t* mem, const char* path, elf_image_t* image, const char** error);
+
+// Builds the initial process stack (argc, argv, envp, auxv) below the top
+// of RAM and points cpu at the entry with the registers the Linux ABI
+// gives a new process
+bool elf_setup_process(ppc_cpu_state_t* cpu, memory_system_t* mem, const elf_image_t* image,
+                       int argc, char* const* argv, char* const* envp);
+
+#endif
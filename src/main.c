@@ -1,7 +1,83 @@
 #include "instruction.h"
+#include "block.h"
+#include "cpu.h"
+#include "linux_user.h"
+#include "profile.h"
+#include "trace.h"
 #include <stdio.h>
+#include <stdlib.h>
+
+extern char** environ;
+
+// pwrxe program [args...]: runs a static PowerPC executable in user mode
+static int run_program(int argc, char** argv) {
+    memory_system_t* mem = malloc(sizeof(memory_system_t));
+    block_cache_t* blocks = malloc(sizeof(block_cache_t));
+    ppc_cpu_state_t cpu;
+    if (!mem || !blocks || !memory_init(mem, ELF_MEMORY_SIZE)) {
+        fprintf(stderr, "failed to allocate guest memory\n");
+        free(blocks);
+        free(mem);
+        return 1;
+    }
+    block_cache_init(blocks, mem);
+
+    // Failures from here on go through the cleanup at the end
+    int status = 1;
+    elf_image_t image;
+    const char* error = NULL;
+    cpu_reset(&cpu);
+    if (!elf_load(mem, argv[0], &image, &error)) {
+        fprintf(stderr, "%s: %s\n", argv[0], error);
+        goto out;
+    }
+    if (!elf_setup_process(&cpu, mem, &image, argc, argv, environ)) {
+        fprintf(stderr, "%s: no room for the stack\n", argv[0]);
+        goto out;
+    }
+
+    // PWRXE_TRACE=file records the run, with data accesses if
+    // PWRXE_TRACE_MEMORY is set too (trace.h)
+    trace_t* trace = NULL;
+    const char* trace_path = getenv("PWRXE_TRACE");
+    if (trace_path) {
+        trace = trace_open(trace_path, getenv("PWRXE_TRACE_MEMORY") ? TRACE_MEMORY : 0);
+        if (!trace || !trace_attach(trace, &cpu, mem)) {
+            fprintf(stderr, "%s: cannot trace to %s\n", argv[0], trace_path);
+            if (trace) trace_close(trace);
+            goto out;
+        }
+    }
+
+    linux_process_t proc;
+    linux_process_init(&proc, mem, &image);
+    cpu_exit_t reason;
+    do {
+        reason = cpu_run(&cpu, mem, UINT64_MAX);
+    } while (reason == CPU_EXIT_BUDGET ||
+             (reason == CPU_EXIT_SYSCALL && linux_syscall(&proc, &cpu, mem)));
+    if (!proc.exited) {
+        fprintf(stderr, "%s: stopped, exit=%d\n", argv[0], reason);
+        cpu_dump_state(&cpu);
+    }
+    profile_dump(mem, stderr);
+    if (trace) {
+        trace_detach(mem);
+        if (!trace_close(trace)) fprintf(stderr, "%s: writing the trace failed\n", trace_path);
+    }
+    status = proc.exited ? proc.exit_status : 128;
+
+out:
+    block_cache_destroy(blocks);
+    memory_destroy(mem);
+    free(blocks);
+    free(mem);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) return run_program(argc - 1, argv + 1);
 
-int main() {
     uint32_t test_instructions[] = {
         0x38600005,  // addi r3, r0, 5
         0x7C601A14,  // add r3, r0, r3
@@ -15,6 +91,28 @@ int main() {
                get_instruction_name(&inst), 
                inst.fmt);
     }
-    
+
+    // Run the same words from guest RAM
+    memory_system_t* mem = malloc(sizeof(memory_system_t));
+    block_cache_t* blocks = malloc(sizeof(block_cache_t));
+    ppc_cpu_state_t cpu;
+    if (!mem || !blocks || !memory_init(mem, MEMORY_SIZE)) {
+        fprintf(stderr, "failed to allocate guest memory\n");
+        return 1;
+    }
+    block_cache_init(blocks, mem);
+    for (int i = 0; i < 3; i++) {
+        memory_write32(mem, i * 4, test_instructions[i]);
+    }
+
+    cpu_reset(&cpu);
+    cpu_exit_t reason = cpu_run(&cpu, mem, 16);
+    printf("exit=%d\n", reason);
+    cpu_dump_state(&cpu);
+
+    block_cache_destroy(blocks);
+    memory_destroy(mem);
+    free(blocks);
+    free(mem);
     return 0;
-}
\ No newline at end of file
+}
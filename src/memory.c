@@ -1,129 +1,1187 @@
 #include "memory.h"
+#include "block.h"
+#include "fault.h"
+#include "profile.h"
+#include "trace.h"
+#include <errno.h>
+#include <immintrin.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
-bool memory_init(memory_system_t* mem, size_t size) {
-    mem->ram = aligned_alloc(4096, size);
-    if (!mem->ram) return false;
-    
-    mem->ram_size = size;
-    memset(mem->ram, 0, size);
+// Copy-on-write tracking. While it is active RAM is read-only, and the
+// first write to a page, from the guest or the host, saves the page and
+// opens it up again; reverting copies back only the pages saved.
+typedef struct memory_cow {
+    uint8_t* saved;         // Page contents at begin, at their RAM offsets
+    uint64_t* dirty;        // Bit per page written since begin
+    uint32_t* dirty_list;   // The same pages, in the order first written
+    size_t n_dirty;
+} memory_cow_t;
+
+// Self-modifying code. Host pages holding decoded code are mapped
+// read-only (code_protected), so that stores need no check of their own:
+// the first one to such a page, from translated code, the interpreter or
+// the host, faults, and the handler marks the page for every view that
+// has code on it and opens the page up again. Views drop the blocks
+// before their next one, as they do for any write to their code from
+// another view. Pages whose code goes away otherwise stay protected
+// until the next store, which then costs one fault and nothing else.
+// Guest pages and host pages are assumed to be the same size.
+
+static inline void code_lock(memory_shared_t* shared) {
+    while (__atomic_test_and_set(&shared->code_lock, __ATOMIC_ACQUIRE)) {
+        _mm_pause();
+    }
+}
+
+static inline void code_unlock(memory_shared_t* shared) {
+    __atomic_clear(&shared->code_lock, __ATOMIC_RELEASE);
+}
+
+static inline bool code_protected(const memory_shared_t* shared, uint64_t page) {
+    return (__atomic_load_n(&shared->code_protected[page >> 6], __ATOMIC_SEQ_CST) >> (page & 63)) & 1;
+}
+
+static inline bool page_bit(const uint64_t* bitmap, uint64_t page) {
+    return (__atomic_load_n(&bitmap[page >> 6], __ATOMIC_ACQUIRE) >> (page & 63)) & 1;
+}
+
+static inline void set_page_bit(uint64_t* bitmap, uint64_t page, bool set) {
+    uint64_t bit = 1ULL << (page & 63);
+    if (set) __atomic_fetch_or(&bitmap[page >> 6], bit, __ATOMIC_RELEASE);
+    else __atomic_fetch_and(&bitmap[page >> 6], ~bit, __ATOMIC_RELEASE);
+}
+
+static inline bool page_read_only(const memory_shared_t* shared, uint64_t page) {
+    return page_bit(shared->read_only, page);
+}
+
+// Copy-on-write still has to see a write to the page
+static inline bool cow_clean(const memory_shared_t* shared, uint64_t page) {
+    const memory_cow_t* cow = shared->cow;
+    return cow && !((cow->dirty[page >> 6] >> (page & 63)) & 1);
+}
+
+static void post_invalidation(memory_system_t* view, uint64_t page);
+
+// Takes the code protection off a page: every view with code on it drops
+// it before its next block (own_view, if given, at once), and the page
+// is left as copy-on-write and its mapping want it. Called with code_lock
+// held.
+static void code_unprotect(memory_shared_t* shared, uint64_t page, memory_system_t* own_view) {
+    __atomic_fetch_and(&shared->code_protected[page >> 6], ~(1ULL << (page & 63)), __ATOMIC_SEQ_CST);
+    shared->opened++;
+    uint64_t owners = __atomic_load_n(&shared->code_owners[page], __ATOMIC_SEQ_CST);
+    if (own_view && (owners & own_view->view_bit)) {
+        block_cache_invalidate_page(own_view->blocks, page);
+        owners &= ~own_view->view_bit;
+    }
+    for (; owners; owners &= owners - 1) {
+        memory_system_t* view = shared->views[__builtin_ctzll(owners)];
+        if (view) post_invalidation(view, page);
+    }
+    mprotect(shared->ram + (page << PAGE_SHIFT), PAGE_SIZE,
+             page_read_only(shared, page) || cow_clean(shared, page) ? PROT_READ : PROT_READ | PROT_WRITE);
+}
+
+// The first write to a page under copy-on-write saves it
+static void cow_save(memory_shared_t* shared, memory_cow_t* cow, uint64_t page) {
+    cow->dirty[page >> 6] |= 1ULL << (page & 63);
+    memcpy(cow->saved + (page << PAGE_SHIFT), shared->ram + (page << PAGE_SHIFT), PAGE_SIZE);
+    cow->dirty_list[cow->n_dirty++] = (uint32_t)page;
+}
+
+// A fault that finds nothing to fix lost a race with another thread
+// opening the page, unless the same thread faults on the same page again
+// with nothing opened since: then the access cannot succeed (a file page
+// past the end of its file, say) and retrying would spin forever
+static _Thread_local struct {
+    uint64_t page;
+    uint64_t opened;
+    bool valid;
+} blind_retry;
+
+// Writes to read-only RAM save the page for copy-on-write and drop the
+// code on it; accesses to the guard, stores to read-only mappings and
+// faults that cannot be fixed fail the guest, not the host. Other threads
+// faulting on the same page wait for the lock, then retry.
+static fault_action_t guard_fault(void* ctx, void* addr) {
+    memory_shared_t* shared = ctx;
+    uint8_t* host = addr;
+    if (host >= shared->ram + shared->ram_size) {
+        shared->fault_paddr = (uint64_t)(host - shared->ram);
+        return FAULT_RECOVER;
+    }
+
+    uint64_t page = (uint64_t)(host - shared->ram) >> PAGE_SHIFT;
+    if (page_read_only(shared, page)) {
+        shared->fault_paddr = (uint64_t)(host - shared->ram);
+        return FAULT_RECOVER;
+    }
+    code_lock(shared);
+    memory_cow_t* cow = __atomic_load_n(&shared->cow, __ATOMIC_ACQUIRE);
+    fault_action_t action = FAULT_RETRY;
+    if (cow_clean(shared, page)) {
+        cow_save(shared, cow, page);
+        if (code_protected(shared, page)) {
+            code_unprotect(shared, page, NULL);
+        } else if (mprotect(shared->ram + (page << PAGE_SHIFT), PAGE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+            action = FAULT_UNHANDLED;
+        } else {
+            shared->opened++;
+        }
+    } else if (code_protected(shared, page)) {
+        code_unprotect(shared, page, NULL);
+    } else if (blind_retry.valid && blind_retry.page == page && blind_retry.opened == shared->opened) {
+        shared->fault_paddr = (uint64_t)(host - shared->ram);
+        action = FAULT_RECOVER;
+    } else {
+        blind_retry.page = page;
+        blind_retry.opened = shared->opened;
+        blind_retry.valid = true;
+        code_unlock(shared);
+        return FAULT_RETRY;
+    }
+    blind_retry.valid = false;
+    code_unlock(shared);
+    return action;
+}
+
+static void cow_free(memory_shared_t* shared, memory_cow_t* cow) {
+    munmap(cow->saved, shared->ram_size);
+    free(cow->dirty);
+    free(cow->dirty_list);
+    free(cow);
+}
+
+static memory_shared_t* shared_create(size_t size) {
+    size = (size + PAGE_MASK) & ~(size_t)PAGE_MASK;
+    if (size == 0 || size > SIZE_MAX - MEMORY_GUARD_SIZE) return NULL;
+
+    memory_shared_t* shared = calloc(1, sizeof(memory_shared_t));
+    if (!shared) return NULL;
+
+    // Reserve RAM plus guard, then open up the RAM part. Anonymous pages
+    // are zero-filled by the kernel when first touched.
+    void* ram = mmap(NULL, size + MEMORY_GUARD_SIZE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ram == MAP_FAILED) {
+        free(shared);
+        return NULL;
+    }
+    shared->ram = ram;
+    shared->ram_size = size;
+    shared->code_owners = calloc(size >> PAGE_SHIFT, sizeof(uint64_t));
+    shared->code_protected = calloc(((size >> PAGE_SHIFT) + 63) / 64, sizeof(uint64_t));
+    shared->file_shared = calloc(((size >> PAGE_SHIFT) + 63) / 64, sizeof(uint64_t));
+    shared->read_only = calloc(((size >> PAGE_SHIFT) + 63) / 64, sizeof(uint64_t));
+    if (mprotect(ram, size, PROT_READ | PROT_WRITE) != 0 || !shared->code_owners ||
+        !shared->code_protected || !shared->file_shared || !shared->read_only ||
+        !fault_register(ram, size + MEMORY_GUARD_SIZE, guard_fault, shared)) {
+        free(shared->code_owners);
+        free(shared->code_protected);
+        free(shared->file_shared);
+        free(shared->read_only);
+        munmap(ram, size + MEMORY_GUARD_SIZE);
+        free(shared);
+        return NULL;
+    }
+    pthread_mutex_init(&shared->lock, NULL);
+    return shared;
+}
+
+static void shared_destroy(memory_shared_t* shared) {
+    fault_unregister(shared->ram);
+    if (shared->cow) cow_free(shared, shared->cow);
+    munmap(shared->ram, shared->ram_size + MEMORY_GUARD_SIZE);
+    free(shared->code_owners);
+    free(shared->code_protected);
+    free(shared->file_shared);
+    free(shared->read_only);
+    pthread_mutex_destroy(&shared->lock);
+    free(shared);
+}
+
+// Takes a free view slot and resets the per-view state
+static bool view_init(memory_system_t* mem, memory_shared_t* shared) {
+    if (!profile_init(mem)) return false;
+    size_t inval_words = ((shared->ram_size >> PAGE_SHIFT) + 63) / 64;
+    mem->inval_pages = calloc(inval_words, sizeof(uint64_t));
+    mem->inval_words = calloc((inval_words + 63) / 64, sizeof(uint64_t));
+    unsigned view = MEMORY_MAX_VIEWS;
+    if (mem->inval_pages && mem->inval_words) {
+        pthread_mutex_lock(&shared->lock);
+        view = 0;
+        while (view < MEMORY_MAX_VIEWS && shared->views[view]) view++;
+        if (view < MEMORY_MAX_VIEWS) shared->views[view] = mem;
+        pthread_mutex_unlock(&shared->lock);
+    }
+    if (view == MEMORY_MAX_VIEWS) {
+        free(mem->inval_pages);
+        free(mem->inval_words);
+        profile_destroy(mem);
+        return false;
+    }
+
+    mem->ram = shared->ram;
+    mem->ram_size = shared->ram_size;
+    mem->code_owners = shared->code_owners;
+    mem->shared = shared;
+    mem->view = view;
+    mem->view_bit = 1ULL << view;
+    mem->blocks = NULL;
+    mem->trace = NULL;
+    mem->events = NULL;
+    mem->fault_vaddr = 0;
+    mem->fault_access = 0;
+    mem->fault_status = 0;
+    mem->pending = 0;
     
     // Initialize TLBs
-    memset(mem->itlb, 0, sizeof(mem->itlb));
-    memset(mem->dtlb, 0, sizeof(mem->dtlb));
+    mem->lpid = 0;
+    mem->pid = 0;
+    mem->problem_state = false;
+    mem->itlb.relocate = false;
+    mem->dtlb.relocate = false;
+    memset(&mem->mmu, 0, sizeof(mem->mmu));
+    tlb_flush(mem);
     
     // Set up identity mapping for initial pages
     for (int i = 0; i < 16; i++) {
         uint64_t addr = i * PAGE_SIZE;
-        tlb_insert(mem->itlb, addr, addr, MEM_READ | MEM_EXEC);
-        tlb_insert(mem->dtlb, addr, addr, MEM_READ | MEM_WRITE);
+        tlb_insert(mem, &mem->itlb, addr, addr, MEM_READ | MEM_EXEC);
+        tlb_insert(mem, &mem->dtlb, addr, addr, MEM_READ | MEM_WRITE);
     }
     
-    mem->tlb_hits = 0;
     mem->tlb_misses = 0;
     return true;
 }
 
+bool memory_init(memory_system_t* mem, size_t size) {
+    mem->shared = NULL;
+    memory_shared_t* shared = shared_create(size);
+    if (!shared) return false;
+    if (!view_init(mem, shared)) {
+        shared_destroy(shared);
+        return false;
+    }
+    return true;
+}
+
+bool memory_attach(memory_system_t* mem, memory_system_t* other) {
+    return view_init(mem, other->shared);
+}
+
 void memory_destroy(memory_system_t* mem) {
-    if (mem->ram) {
-        free(mem->ram);
-        mem->ram = NULL;
+    memory_shared_t* shared = mem->shared;
+    if (!shared) return;
+
+    pthread_mutex_lock(&shared->lock);
+    shared->views[mem->view] = NULL;
+    bool last = true;
+    for (unsigned i = 0; i < MEMORY_MAX_VIEWS; i++) {
+        if (shared->views[i]) last = false;
     }
+    pthread_mutex_unlock(&shared->lock);
+
+    // Code this view decoded no longer needs protecting
+    if (!last) {
+        for (size_t page = 0; page < shared->ram_size >> PAGE_SHIFT; page++) {
+            if (shared->code_owners[page] & mem->view_bit) memory_clear_code_page(mem, page);
+        }
+    }
+    free(mem->inval_pages);
+    free(mem->inval_words);
+    profile_destroy(mem);
+    if (last) shared_destroy(shared);
+    mem->shared = NULL;
+    mem->ram = NULL;
 }
 
-bool tlb_lookup(tlb_entry_t* tlb, uint64_t vaddr, uint64_t* paddr) {
-    uint64_t index = vaddr_to_tlb_index(vaddr);
-    tlb_entry_t* entry = &tlb[index];
-    
-    if (entry->valid && (entry->vaddr & ~PAGE_MASK) == (vaddr & ~PAGE_MASK)) {
-        *paddr = entry->paddr | (vaddr & PAGE_MASK);
-        return true;
+static inline bool tlb_entry_matches(const tlb_entry_t* entry, uint64_t vaddr) {
+    return (entry->addr_read & (~(uint64_t)PAGE_MASK | TLB_INVALID)) == (vaddr & ~(uint64_t)PAGE_MASK);
+}
+
+// Quadrant 3 (the top of the address space) belongs to the OS and is
+// shared by every process of a partition. Real mode is per partition.
+static inline uint32_t tlb_context_pid(const memory_system_t* mem, const tlb_t* tlb, uint64_t vaddr) {
+    return !tlb->relocate || (vaddr >> 62) == 3 ? 0 : mem->pid;
+}
+
+static inline uint32_t tlb_context_mode(const tlb_t* tlb) {
+    return tlb->relocate ? 0 : TLB_WAY_REAL;
+}
+
+static inline bool tlb_way_in_context(const memory_system_t* mem, const tlb_t* tlb, const tlb_way_t* way) {
+    return way->flags && (way->flags & TLB_WAY_REAL) == tlb_context_mode(tlb) &&
+           way->lpid == mem->lpid && way->pid == tlb_context_pid(mem, tlb, way->vaddr);
+}
+
+// Rebuilds the fast entry of a set from its most recently used way
+static void tlb_refresh(memory_system_t* mem, tlb_t* tlb, uint64_t set) {
+    tlb_entry_t* entry = &tlb->fast[set];
+    const tlb_way_t* way = &tlb->ways[set][0];
+    if (!tlb_way_in_context(mem, tlb, way)) {
+        entry->addr_read = entry->addr_write = TLB_INVALID;
+        return;
     }
-    return false;
+
+    uint64_t tag = way->vaddr;
+    uint64_t page = way->paddr;
+    entry->paddr = page;
+    if (memory_is_ram(mem, page)) {
+        entry->addend = (uintptr_t)(mem->ram + page) - (uintptr_t)tag;
+    } else {
+        entry->addend = 0;
+        tag |= TLB_MMIO;
+    }
+
+    // Fetches go through the ITLB's read tag
+    uint32_t flags = way->flags;
+    if (mem->problem_state && (flags & TLB_WAY_PRIV)) flags = 0;
+    bool can_read = flags & (tlb == &mem->itlb ? MEM_EXEC : MEM_READ);
+    if (tlb == &mem->dtlb && mem->trace && mem->trace->memory) tag |= TLB_TRACE;
+    entry->addr_read = can_read ? tag : tag | TLB_FORBIDDEN;
+    entry->addr_write = (flags & MEM_WRITE) ? tag : tag | TLB_FORBIDDEN;
 }
 
-void tlb_insert(tlb_entry_t* tlb, uint64_t vaddr, uint64_t paddr, uint32_t flags) {
-    uint64_t index = vaddr_to_tlb_index(vaddr);
-    tlb_entry_t* entry = &tlb[index];
-    
-    entry->vaddr = vaddr & ~PAGE_MASK;
-    entry->paddr = paddr & ~PAGE_MASK;
-    entry->flags = flags;
-    entry->valid = true;
+// Moves way i of a set to the front, making it the most recently used
+static void tlb_touch(memory_system_t* mem, tlb_t* tlb, uint64_t set, int i) {
+    tlb_way_t* ways = tlb->ways[set];
+    if (i == 0) return;
+    tlb_way_t way = ways[i];
+    memmove(&ways[1], &ways[0], i * sizeof(tlb_way_t));
+    ways[0] = way;
+    tlb_refresh(mem, tlb, set);
+}
+
+// Returns the way index of vaddr in the current context, or -1
+static int tlb_find(const memory_system_t* mem, const tlb_t* tlb, uint64_t vaddr) {
+    const tlb_way_t* ways = tlb->ways[vaddr_to_tlb_index(vaddr)];
+    uint64_t page = vaddr & ~(uint64_t)PAGE_MASK;
+    for (int i = 0; i < TLB_WAYS; i++) {
+        if (ways[i].flags && ways[i].vaddr == page && tlb_way_in_context(mem, tlb, &ways[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool tlb_lookup(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint64_t* paddr) {
+    int i = tlb_find(mem, tlb, vaddr);
+    if (i < 0) return false;
+    *paddr = tlb->ways[vaddr_to_tlb_index(vaddr)][i].paddr | (vaddr & PAGE_MASK);
+    return true;
+}
+
+static void tlb_insert_sized(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint64_t paddr,
+                             uint32_t flags, unsigned page_shift) {
+    uint64_t set = vaddr_to_tlb_index(vaddr);
+    int i = tlb_find(mem, tlb, vaddr);
+
+    // Replace an existing translation in place, otherwise evict the least
+    // recently used way
+    tlb_touch(mem, tlb, set, i < 0 ? TLB_WAYS - 1 : i);
+    tlb_way_t* way = &tlb->ways[set][0];
+    way->vaddr = vaddr & ~(uint64_t)PAGE_MASK;
+    way->paddr = paddr & ~(uint64_t)PAGE_MASK;
+    way->lpid = mem->lpid;
+    way->pid = tlb_context_pid(mem, tlb, vaddr);
+    way->flags = (flags & (MEM_READ | MEM_WRITE | MEM_EXEC | TLB_WAY_PRIV)) | tlb_context_mode(tlb);
+    way->page_shift = (uint8_t)page_shift;
+    tlb_refresh(mem, tlb, set);
+}
+
+void tlb_insert(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint64_t paddr, uint32_t flags) {
+    tlb_insert_sized(mem, tlb, vaddr, paddr, flags, PAGE_SHIFT);
+}
+
+static void tlb_refresh_all(memory_system_t* mem) {
+    for (uint64_t set = 0; set < TLB_SETS; set++) {
+        tlb_refresh(mem, &mem->itlb, set);
+        tlb_refresh(mem, &mem->dtlb, set);
+    }
+}
+
+void memory_set_trace(memory_system_t* mem, struct trace_ring* ring) {
+    mem->trace = ring;
+    tlb_refresh_all(mem);
+}
+
+void memory_set_context(memory_system_t* mem, uint32_t lpid, uint32_t pid) {
+    if (lpid == mem->lpid && pid == mem->pid) return;
+    mem->lpid = lpid;
+    mem->pid = pid;
+    tlb_refresh_all(mem);
+    // The jump cache is indexed by virtual PC, so it goes with the mappings
+    if (mem->blocks) block_cache_flush_jump_cache(mem->blocks);
+}
+
+void memory_set_translation(memory_system_t* mem, bool inst, bool data, bool problem) {
+    if (inst == mem->itlb.relocate && data == mem->dtlb.relocate && problem == mem->problem_state) return;
+    bool fetch_changed = inst != mem->itlb.relocate || problem != mem->problem_state;
+    mem->itlb.relocate = inst;
+    mem->dtlb.relocate = data;
+    mem->problem_state = problem;
+    tlb_refresh_all(mem);
+    if (fetch_changed && mem->blocks) block_cache_flush_jump_cache(mem->blocks);
+}
+
+void memory_set_ptcr(memory_system_t* mem, uint64_t ptcr) {
+    mem->mmu.ptcr = ptcr;
+    tlb_flush(mem);
+}
+
+// Selects the ways an invalidation drops
+typedef struct {
+    uint64_t page;
+    uint32_t lpid;
+    uint32_t pid;
+    unsigned page_shift;
+    enum { TLBI_PAGE, TLBI_PID, TLBI_LPID, TLBI_ALL } scope;
+} tlb_match_t;
+
+static inline bool tlb_way_selected(const tlb_way_t* way, const tlb_match_t* m) {
+    unsigned shift = way->page_shift > m->page_shift ? way->page_shift : m->page_shift;
+    switch (m->scope) {
+    case TLBI_PAGE: return ((way->vaddr ^ m->page) >> shift) == 0 && way->lpid == m->lpid &&
+                           way->pid == m->pid && !(way->flags & TLB_WAY_REAL);
+    case TLBI_PID:  return way->lpid == m->lpid && way->pid == m->pid;
+    case TLBI_LPID: return way->lpid == m->lpid;
+    default:        return true;
+    }
+}
+
+// Drops the selected ways of one set; returns true if any were dropped
+static bool tlb_invalidate_set(memory_system_t* mem, tlb_t* tlb, uint64_t set, const tlb_match_t* m) {
+    tlb_way_t* ways = tlb->ways[set];
+    int kept = 0;
+    // Compact the survivors so their LRU order is preserved
+    for (int i = 0; i < TLB_WAYS; i++) {
+        if (ways[i].flags && !tlb_way_selected(&ways[i], m)) {
+            ways[kept++] = ways[i];
+        }
+    }
+    bool dropped = false;
+    for (int i = kept; i < TLB_WAYS; i++) {
+        dropped |= ways[i].flags != 0;
+        ways[i].flags = 0;
+    }
+    if (dropped) tlb_refresh(mem, tlb, set);
+    return dropped;
+}
+
+static void tlb_invalidate(memory_system_t* mem, const tlb_match_t* m) {
+    // A 4K page lives in one set; larger pages are spread over all of them
+    uint64_t first = 0, last = TLB_MASK;
+    if (m->scope == TLBI_PAGE && m->page_shift == PAGE_SHIFT) first = last = vaddr_to_tlb_index(m->page);
+
+    bool dropped_fetch = false;
+    for (uint64_t set = first; set <= last; set++) {
+        dropped_fetch |= tlb_invalidate_set(mem, &mem->itlb, set, m);
+        tlb_invalidate_set(mem, &mem->dtlb, set, m);
+    }
+    // The jump cache is indexed by virtual PC, so it goes with the mappings
+    if (dropped_fetch && mem->blocks) block_cache_flush_jump_cache(mem->blocks);
+    mmu_flush(&mem->mmu);
+}
+
+void tlb_invalidate_page(memory_system_t* mem, uint64_t vaddr, uint32_t lpid, uint32_t pid,
+                         unsigned page_shift) {
+    if (page_shift < PAGE_SHIFT) page_shift = PAGE_SHIFT;
+    uint64_t page = vaddr & ~((1ULL << page_shift) - 1);
+    if ((vaddr >> 62) == 3) pid = 0;
+    tlb_invalidate(mem, &(tlb_match_t){ page, lpid, pid, page_shift, TLBI_PAGE });
+}
+
+void tlb_invalidate_pid(memory_system_t* mem, uint32_t lpid, uint32_t pid) {
+    tlb_invalidate(mem, &(tlb_match_t){ 0, lpid, pid, PAGE_SHIFT, TLBI_PID });
+}
+
+void tlb_invalidate_lpid(memory_system_t* mem, uint32_t lpid) {
+    tlb_invalidate(mem, &(tlb_match_t){ 0, lpid, 0, PAGE_SHIFT, TLBI_LPID });
 }
 
 void tlb_flush(memory_system_t* mem) {
-    for (int i = 0; i < TLB_SIZE; i++) {
-        mem->itlb[i].valid = false;
-        mem->dtlb[i].valid = false;
+    memset(mem->itlb.ways, 0, sizeof(mem->itlb.ways));
+    memset(mem->dtlb.ways, 0, sizeof(mem->dtlb.ways));
+    tlb_refresh_all(mem);
+    if (mem->blocks) block_cache_flush_jump_cache(mem->blocks);
+    mmu_flush(&mem->mmu);
+}
+
+// The owner bit goes in before the protection is checked, and the fault
+// handler clears the protection before it reads the owners, so a view
+// adding code to a page being unprotected either protects it again or
+// gets the invalidation
+void memory_set_code_page(memory_system_t* mem, uint64_t page) {
+    memory_shared_t* shared = mem->shared;
+    __atomic_fetch_or(&mem->code_owners[page], mem->view_bit, __ATOMIC_SEQ_CST);
+    if (code_protected(shared, page)) return;
+
+    code_lock(shared);
+    if (!code_protected(shared, page)) {
+        mprotect(shared->ram + (page << PAGE_SHIFT), PAGE_SIZE, PROT_READ);
+        __atomic_fetch_or(&shared->code_protected[page >> 6], 1ULL << (page & 63), __ATOMIC_SEQ_CST);
     }
+    code_unlock(shared);
 }
 
-static inline uint64_t translate_address(memory_system_t* mem, uint64_t vaddr, bool is_instruction) {
-    uint64_t paddr;
-    tlb_entry_t* tlb = is_instruction ? mem->itlb : mem->dtlb;
-    
-    if (tlb_lookup(tlb, vaddr, &paddr)) {
-        mem->tlb_hits++;
-        return paddr;
+// Records an access translation refused and unwinds to the guest's
+// recovery point. Host-side accesses made with none armed go ahead.
+static void memory_fault(memory_system_t* mem, uint64_t vaddr, uint32_t access, uint32_t status) {
+    mem->fault_vaddr = vaddr;
+    mem->fault_access = access;
+    mem->fault_status = status;
+    fault_unwind(FAULT_UNWIND_GUEST);
+}
+
+// Real mode ignores the top four address bits
+#define REAL_ADDR_MASK 0x0FFFFFFFFFFFFFFFULL
+
+// Fills a TLB way for vaddr; false if translation refused the access
+static bool tlb_map(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint32_t access) {
+    uint64_t start = profile_start();
+    if (!tlb->relocate) {
+        tlb_insert(mem, tlb, vaddr, vaddr & REAL_ADDR_MASK, MEM_READ | MEM_WRITE | MEM_EXEC);
+        profile_end(mem, PROFILE_PATH_TLB_FILL, start);
+        return true;
     }
-    
-    mem->tlb_misses++;
-    // Simple identity mapping fallback
-    paddr = vaddr;
-    tlb_insert(tlb, vaddr, paddr, MEM_READ | MEM_WRITE | MEM_EXEC);
-    return paddr;
+    mmu_result_t result;
+    uint32_t status;
+    if (!mmu_translate(mem, vaddr, access, &result, &status)) {
+        profile_tlb(mem, tlb == &mem->itlb, PROFILE_TLB_FAULT);
+        memory_fault(mem, vaddr, access, status);
+        return false;
+    }
+    tlb_insert_sized(mem, tlb, vaddr, result.paddr, result.flags, result.page_shift);
+    profile_end(mem, PROFILE_PATH_TLB_FILL, start);
+    return true;
+}
+
+static inline bool tlb_denies(const tlb_entry_t* entry, uint32_t access) {
+    return (access == MEM_WRITE ? entry->addr_write : entry->addr_read) & TLB_FORBIDDEN;
 }
 
-uint8_t memory_read8(memory_system_t* mem, uint64_t addr) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr >= mem->ram_size) return 0;
-    return mem->ram[paddr];
+// Returns the fast entry for an access to vaddr, filling it on a miss, or
+// NULL if the access is refused. A way that refuses it may predate a PTE
+// update (or a clear C bit), so the tables are walked again first.
+static tlb_entry_t* tlb_fill(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint32_t access) {
+    uint64_t set = vaddr_to_tlb_index(vaddr);
+    tlb_entry_t* entry = &tlb->fast[set];
+    bool fetch = tlb == &mem->itlb;
+    if (!tlb_entry_matches(entry, vaddr)) {
+        int i = tlb_find(mem, tlb, vaddr);
+        if (i >= 0) {
+            profile_tlb(mem, fetch, PROFILE_TLB_WAY);
+            tlb_touch(mem, tlb, set, i);
+        } else {
+            mem->tlb_misses++;
+            profile_tlb(mem, fetch, tlb->relocate ? PROFILE_TLB_WALK : PROFILE_TLB_REAL);
+            if (!tlb_map(mem, tlb, vaddr, access)) return NULL;
+        }
+    } else if (!tlb_denies(entry, access)) {
+        profile_tlb(mem, fetch, PROFILE_TLB_OTHER);
+    }
+    if (__builtin_expect(tlb_denies(entry, access), 0)) {
+        profile_tlb(mem, fetch, PROFILE_TLB_RECHECK);
+        if (tlb->relocate && !tlb_map(mem, tlb, vaddr, access)) return NULL;
+        if (tlb_denies(entry, access)) {
+            profile_tlb(mem, fetch, PROFILE_TLB_FAULT);
+            memory_fault(mem, vaddr, access, DSISR_PROTFAULT | (access == MEM_WRITE ? DSISR_ISSTORE : 0));
+            return NULL;
+        }
+    }
+    return entry;
+}
+
+// Marks a written code page for another view and makes it stop at its
+// next block boundary. Lock-free, as the fault handler calls it: the page
+// bit goes in first, then its word's bit, then the pending bit that sends
+// the view looking for them.
+static void post_invalidation(memory_system_t* view, uint64_t page) {
+    uint64_t word = page >> 6;
+    __atomic_fetch_or(&view->inval_pages[word], 1ULL << (page & 63), __ATOMIC_RELEASE);
+    __atomic_fetch_or(&view->inval_words[word >> 6], 1ULL << (word & 63), __ATOMIC_RELEASE);
+    __atomic_fetch_or(&view->pending, MEMORY_PENDING_INVAL, __ATOMIC_RELEASE);
+}
+
+// Drops the decoded blocks of every view on a page the host rewrote
+// without storing to it (mappings, copy-on-write reverts). Other views do
+// it before their next block, which is as soon as the architecture needs
+// them to see the new code (after their next context sync).
+static void code_written(memory_system_t* mem, uint64_t page) {
+    uint64_t start = profile_start();
+    memory_shared_t* shared = mem->shared;
+    code_lock(shared);
+    code_unprotect(shared, page, mem);
+    code_unlock(shared);
+    profile_end(mem, PROFILE_PATH_CODE_WRITE, start);
+}
+
+// Drops the code pages other views marked. Bits are taken with an
+// exchange, so a page posted meanwhile is either seen now or left for the
+// next pass its pending bit asks for.
+static void service_invalidations(memory_system_t* mem) {
+    size_t n_words = ((mem->ram_size >> PAGE_SHIFT) + 63) / 64;
+    for (size_t i = 0; i < (n_words + 63) / 64; i++) {
+        if (!__atomic_load_n(&mem->inval_words[i], __ATOMIC_RELAXED)) continue;
+        uint64_t words = __atomic_exchange_n(&mem->inval_words[i], 0, __ATOMIC_ACQ_REL);
+        for (; words; words &= words - 1) {
+            uint64_t word = i * 64 + (uint64_t)__builtin_ctzll(words);
+            uint64_t pages = __atomic_exchange_n(&mem->inval_pages[word], 0, __ATOMIC_ACQ_REL);
+            for (; pages; pages &= pages - 1) {
+                block_cache_invalidate_page(mem->blocks, word * 64 + (uint64_t)__builtin_ctzll(pages));
+            }
+        }
+    }
+}
+
+uint32_t memory_service(memory_system_t* mem) {
+    uint64_t start = profile_start();
+    uint32_t pending = __atomic_exchange_n(&mem->pending, 0, __ATOMIC_ACQUIRE);
+    if (pending & MEMORY_PENDING_TLB) tlb_flush(mem);
+    if (pending & MEMORY_PENDING_INVAL) service_invalidations(mem);
+    profile_end(mem, PROFILE_PATH_SERVICE, start);
+    return pending;
+}
+
+void tlb_broadcast_flush(memory_system_t* mem) {
+    for (unsigned v = 0; v < MEMORY_MAX_VIEWS; v++) {
+        memory_system_t* view = mem->shared->views[v];
+        if (view && view != mem) __atomic_fetch_or(&view->pending, MEMORY_PENDING_TLB, __ATOMIC_RELEASE);
+    }
 }
 
-uint16_t memory_read16(memory_system_t* mem, uint64_t addr) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr + 1 >= mem->ram_size) return 0;
-    return __builtin_bswap16(*(uint16_t*)&mem->ram[paddr]);
+uint64_t memory_translate_fetch(memory_system_t* mem, uint64_t addr) {
+    tlb_entry_t* entry = tlb_fill(mem, &mem->itlb, addr, MEM_EXEC);
+    // Refused fetches read outside RAM, as invalid instructions
+    if (!entry) return UINT64_MAX & ~(uint64_t)PAGE_MASK;
+    return entry->paddr | (addr & PAGE_MASK);
 }
 
-uint32_t memory_read32(memory_system_t* mem, uint64_t addr) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr + 3 >= mem->ram_size) return 0;
+uint32_t memory_fetch_phys32(memory_system_t* mem, uint64_t paddr) {
+    if (!memory_is_ram(mem, paddr)) return 0;
     return __builtin_bswap32(*(uint32_t*)&mem->ram[paddr]);
 }
 
-uint64_t memory_read64(memory_system_t* mem, uint64_t addr) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr + 7 >= mem->ram_size) return 0;
-    return __builtin_bswap64(*(uint64_t*)&mem->ram[paddr]);
+static inline uint64_t load_be(const uint8_t* p, unsigned size) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < size; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static inline void store_be(uint8_t* p, uint64_t value, unsigned size) {
+    for (unsigned i = size; i-- > 0; value >>= 8) {
+        p[i] = (uint8_t)value;
+    }
+}
+
+static uint64_t read_slow(memory_system_t* mem, uint64_t addr, unsigned size) {
+    // Accesses crossing a page are split into bytes, each translated
+    if ((addr & PAGE_MASK) + size > PAGE_SIZE) {
+        uint64_t value = 0;
+        for (unsigned i = 0; i < size; i++) {
+            value = (value << 8) | read_slow(mem, addr + i, 1);
+        }
+        return value;
+    }
+
+    // Pages outside RAM (and refused host-side reads) read as zero
+    tlb_entry_t* entry = tlb_fill(mem, &mem->dtlb, addr, MEM_READ);
+    if (!entry || (entry->addr_read & TLB_MMIO)) return 0;
+    return load_be((const uint8_t*)(uintptr_t)(addr + entry->addend), size);
+}
+
+static void write_slow(memory_system_t* mem, uint64_t addr, uint64_t value, unsigned size) {
+    if ((addr & PAGE_MASK) + size > PAGE_SIZE) {
+        for (unsigned i = size; i-- > 0; value >>= 8) {
+            write_slow(mem, addr + i, value & 0xFF, 1);
+        }
+        return;
+    }
+
+    // Stores outside RAM (and refused host-side stores) are dropped
+    tlb_entry_t* entry = tlb_fill(mem, &mem->dtlb, addr, MEM_WRITE);
+    if (!entry || (entry->addr_write & TLB_MMIO)) return;
+
+    store_be((uint8_t*)(uintptr_t)(addr + entry->addend), value, size);
+}
+
+// Accesses that fault unwind before they are recorded
+uint64_t memory_read_slow(memory_system_t* mem, uint64_t addr, unsigned size) {
+    uint64_t value = read_slow(mem, addr, size);
+    if (__builtin_expect(mem->trace != NULL, 0)) trace_access(mem->trace, TRACE_REC_LOAD, addr, value, size);
+    return value;
+}
+
+void memory_write_slow(memory_system_t* mem, uint64_t addr, uint64_t value, unsigned size) {
+    write_slow(mem, addr, value, size);
+    if (__builtin_expect(mem->trace != NULL, 0)) trace_access(mem->trace, TRACE_REC_STORE, addr, value, size);
 }
 
-void memory_write8(memory_system_t* mem, uint64_t addr, uint8_t value) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr < mem->ram_size) {
-        mem->ram[paddr] = value;
+void* memory_atomic_ptr(memory_system_t* mem, uint64_t addr, unsigned size, uint32_t access) {
+    if (addr & (size - 1)) return NULL;
+    tlb_entry_t* entry = tlb_fill(mem, &mem->dtlb, addr, access);
+    if (!entry || (entry->addr_read & TLB_MMIO)) return NULL;
+    return (void*)(uintptr_t)(addr + entry->addend);
+}
+
+// Host-side writes to read-only mappings are refused, not faulted on
+static inline bool host_read_only(const memory_system_t* mem, const uint8_t* host) {
+    return page_read_only(mem->shared, (uint64_t)(host - mem->ram) >> PAGE_SHIFT);
+}
+
+void* memory_host_page(memory_system_t* mem, uint64_t vaddr, uint32_t access) {
+    tlb_entry_t* entry = tlb_fill(mem, &mem->dtlb, vaddr, access);
+    if (!entry || (entry->addr_read & TLB_MMIO)) return NULL;
+    uint8_t* host = (uint8_t*)(uintptr_t)(vaddr + entry->addend);
+    // The kernel fails writes to protected pages instead of faulting, so
+    // let copy-on-write and code protection see one from here
+    if (access == MEM_WRITE) {
+        if (host_read_only(mem, host)) return NULL;
+        __atomic_fetch_or(host, 0, __ATOMIC_RELAXED);
+    }
+    return host;
+}
+
+// Bulk access
+
+// Translates the part of [addr, addr + len) on addr's page, sizing it in
+// *chunk. False if the access is refused; *host is NULL outside RAM.
+static bool block_page(memory_system_t* mem, uint64_t addr, size_t len, uint32_t access,
+                       uint8_t** host, size_t* chunk) {
+    size_t room = PAGE_SIZE - (addr & PAGE_MASK);
+    *chunk = len < room ? len : room;
+    tlb_entry_t* entry = tlb_fill(mem, &mem->dtlb, addr, access);
+    if (!entry) return false;
+    if (entry->addr_read & TLB_MMIO) {
+        *host = NULL;
+        return true;
+    }
+    *host = (uint8_t*)(uintptr_t)(addr + entry->addend);
+    return access != MEM_WRITE || !host_read_only(mem, *host);
+}
+
+// Recorded data accesses have to go through the slow path one by one
+static inline bool block_traced(const memory_system_t* mem) {
+    return __builtin_expect(mem->trace != NULL, 0) && mem->trace->memory;
+}
+
+size_t memory_read_block(memory_system_t* mem, uint64_t addr, void* buf, size_t len) {
+    uint8_t* out = buf;
+    size_t done = 0;
+    if (block_traced(mem)) {
+        for (; done < len; done++) out[done] = (uint8_t)memory_read_slow(mem, addr + done, 1);
+        return done;
     }
+    while (done < len) {
+        uint8_t* host;
+        size_t chunk;
+        if (!block_page(mem, addr + done, len - done, MEM_READ, &host, &chunk)) break;
+        if (host) {
+            memcpy(out + done, host, chunk);
+        } else {
+            memset(out + done, 0, chunk);
+        }
+        done += chunk;
+    }
+    return done;
 }
 
-void memory_write16(memory_system_t* mem, uint64_t addr, uint16_t value) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr + 1 < mem->ram_size) {
-        *(uint16_t*)&mem->ram[paddr] = __builtin_bswap16(value);
+size_t memory_write_block(memory_system_t* mem, uint64_t addr, const void* buf, size_t len) {
+    const uint8_t* in = buf;
+    size_t done = 0;
+    if (block_traced(mem)) {
+        for (; done < len; done++) memory_write_slow(mem, addr + done, in[done], 1);
+        return done;
+    }
+    while (done < len) {
+        uint8_t* host;
+        size_t chunk;
+        if (!block_page(mem, addr + done, len - done, MEM_WRITE, &host, &chunk)) break;
+        if (host) memcpy(host, in + done, chunk);
+        done += chunk;
     }
+    return done;
 }
 
-void memory_write32(memory_system_t* mem, uint64_t addr, uint32_t value) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr + 3 < mem->ram_size) {
-        *(uint32_t*)&mem->ram[paddr] = __builtin_bswap32(value);
+size_t memory_fill(memory_system_t* mem, uint64_t addr, uint8_t value, size_t len) {
+    size_t done = 0;
+    if (block_traced(mem)) {
+        for (; done < len; done++) memory_write_slow(mem, addr + done, value, 1);
+        return done;
+    }
+    while (done < len) {
+        uint8_t* host;
+        size_t chunk;
+        if (!block_page(mem, addr + done, len - done, MEM_WRITE, &host, &chunk)) break;
+        if (host) memset(host, value, chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+size_t memory_copy(memory_system_t* mem, uint64_t dst, uint64_t src, size_t len) {
+    size_t done = 0;
+    if (block_traced(mem)) {
+        for (; done < len; done++) {
+            memory_write_slow(mem, dst + done, memory_read_slow(mem, src + done, 1), 1);
+        }
+        return done;
+    }
+    while (done < len) {
+        uint8_t *from, *to;
+        size_t from_chunk, to_chunk;
+        if (!block_page(mem, src + done, len - done, MEM_READ, &from, &from_chunk) ||
+            !block_page(mem, dst + done, from_chunk, MEM_WRITE, &to, &to_chunk)) {
+            break;
+        }
+        if (to) {
+            if (from) {
+                memmove(to, from, to_chunk);
+            } else {
+                memset(to, 0, to_chunk);
+            }
+        }
+        done += to_chunk;
+    }
+    return done;
+}
+
+// Byte-reverses n 32-bit or 64-bit words from src into dst, either of
+// them unaligned, 32 or 16 bytes at a time
+static void swap_words32(void* dst, const void* src, size_t n) {
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i rev256 = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i * 4));
+        _mm256_storeu_si256((__m256i*)(d + i * 4), _mm256_shuffle_epi8(v, rev256));
+    }
+#endif
+    const __m128i rev = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i * 4));
+        _mm_storeu_si128((__m128i*)(d + i * 4), _mm_shuffle_epi8(v, rev));
+    }
+    for (; i < n; i++) {
+        uint32_t w;
+        memcpy(&w, s + i * 4, 4);
+        w = __builtin_bswap32(w);
+        memcpy(d + i * 4, &w, 4);
+    }
+}
+
+static void swap_words64(void* dst, const void* src, size_t n) {
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i rev256 = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i * 8));
+        _mm256_storeu_si256((__m256i*)(d + i * 8), _mm256_shuffle_epi8(v, rev256));
+    }
+#endif
+    const __m128i rev = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i * 8));
+        _mm_storeu_si128((__m128i*)(d + i * 8), _mm_shuffle_epi8(v, rev));
+    }
+    for (; i < n; i++) {
+        uint64_t w;
+        memcpy(&w, s + i * 8, 8);
+        w = __builtin_bswap64(w);
+        memcpy(d + i * 8, &w, 8);
     }
 }
 
-void memory_write64(memory_system_t* mem, uint64_t addr, uint64_t value) {
-    uint64_t paddr = translate_address(mem, addr, false);
-    if (paddr + 7 < mem->ram_size) {
-        *(uint64_t*)&mem->ram[paddr] = __builtin_bswap64(value);
+static inline void swap_words(void* dst, const void* src, size_t n, unsigned size) {
+    if (size == 4) {
+        swap_words32(dst, src, n);
+    } else {
+        swap_words64(dst, src, n);
     }
-}
\ No newline at end of file
+}
+
+// Whole words a page at a time; a word crossing into the next page goes
+// through a bounce buffer
+static size_t read_words(memory_system_t* mem, uint64_t addr, void* words, size_t n, unsigned size) {
+    uint8_t* out = words;
+    size_t done = 0;
+    if (block_traced(mem)) {
+        for (; done < n; done++) {
+            uint64_t w = memory_read_slow(mem, addr + done * size, size);
+            if (size == 4) {
+                ((uint32_t*)words)[done] = (uint32_t)w;
+            } else {
+                ((uint64_t*)words)[done] = w;
+            }
+        }
+        return done;
+    }
+    while (done < n) {
+        uint64_t a = addr + done * size;
+        uint8_t* host;
+        size_t chunk;
+        if (PAGE_SIZE - (a & PAGE_MASK) < size) {
+            uint8_t bounce[8];
+            if (memory_read_block(mem, a, bounce, size) < size) break;
+            swap_words(out + done * size, bounce, 1, size);
+            done++;
+            continue;
+        }
+        if (!block_page(mem, a, (n - done) * size, MEM_READ, &host, &chunk)) break;
+        size_t count = chunk / size;
+        if (host) {
+            swap_words(out + done * size, host, count, size);
+        } else {
+            memset(out + done * size, 0, count * size);
+        }
+        done += count;
+    }
+    return done;
+}
+
+static size_t write_words(memory_system_t* mem, uint64_t addr, const void* words, size_t n,
+                          unsigned size) {
+    const uint8_t* in = words;
+    size_t done = 0;
+    if (block_traced(mem)) {
+        for (; done < n; done++) {
+            uint64_t w = size == 4 ? ((const uint32_t*)words)[done] : ((const uint64_t*)words)[done];
+            memory_write_slow(mem, addr + done * size, w, size);
+        }
+        return done;
+    }
+    while (done < n) {
+        uint64_t a = addr + done * size;
+        uint8_t* host;
+        size_t chunk;
+        if (PAGE_SIZE - (a & PAGE_MASK) < size) {
+            uint8_t bounce[8];
+            swap_words(bounce, in + done * size, 1, size);
+            if (memory_write_block(mem, a, bounce, size) < size) break;
+            done++;
+            continue;
+        }
+        if (!block_page(mem, a, (n - done) * size, MEM_WRITE, &host, &chunk)) break;
+        size_t count = chunk / size;
+        if (host) swap_words(host, in + done * size, count, size);
+        done += count;
+    }
+    return done;
+}
+
+size_t memory_read_be32(memory_system_t* mem, uint64_t addr, uint32_t* words, size_t n) {
+    return read_words(mem, addr, words, n, 4);
+}
+
+size_t memory_write_be32(memory_system_t* mem, uint64_t addr, const uint32_t* words, size_t n) {
+    return write_words(mem, addr, words, n, 4);
+}
+
+size_t memory_read_be64(memory_system_t* mem, uint64_t addr, uint64_t* words, size_t n) {
+    return read_words(mem, addr, words, n, 8);
+}
+
+size_t memory_write_be64(memory_system_t* mem, uint64_t addr, const uint64_t* words, size_t n) {
+    return write_words(mem, addr, words, n, 8);
+}
+
+// Pages the guest wrote may hold decoded code, in any view
+static void cow_page_restored(memory_system_t* mem, uint64_t page) {
+    if (memory_is_code_page(mem, page)) code_written(mem, page);
+}
+
+bool memory_cow_begin(memory_system_t* mem) {
+    memory_shared_t* shared = mem->shared;
+    memory_cow_t* cow = shared->cow;
+    size_t pages = shared->ram_size >> PAGE_SHIFT;
+
+    // Already tracking: the current contents become the new baseline
+    if (cow) {
+        for (size_t i = 0; i < cow->n_dirty; i++) {
+            uint64_t page = cow->dirty_list[i];
+            mprotect(shared->ram + (page << PAGE_SHIFT), PAGE_SIZE, PROT_READ);
+            cow->dirty[page >> 6] = 0;
+        }
+        cow->n_dirty = 0;
+        return true;
+    }
+
+    cow = calloc(1, sizeof(memory_cow_t));
+    if (!cow) return false;
+    cow->saved = mmap(NULL, shared->ram_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    cow->dirty = calloc((pages + 63) / 64, sizeof(uint64_t));
+    cow->dirty_list = malloc(pages * sizeof(uint32_t));
+    if (cow->saved == MAP_FAILED || !cow->dirty || !cow->dirty_list) {
+        if (cow->saved != MAP_FAILED) munmap(cow->saved, shared->ram_size);
+        free(cow->dirty);
+        free(cow->dirty_list);
+        free(cow);
+        return false;
+    }
+    __atomic_store_n(&shared->cow, cow, __ATOMIC_RELEASE);
+    if (mprotect(shared->ram, shared->ram_size, PROT_READ) != 0) {
+        memory_cow_end(mem);
+        return false;
+    }
+    return true;
+}
+
+// A page stays dirty until its copy is back: the copy may fault on code
+// protection, and the fault must not take the page for a clean one and
+// save it again over the baseline
+bool memory_cow_revert(memory_system_t* mem) {
+    memory_shared_t* shared = mem->shared;
+    memory_cow_t* cow = shared->cow;
+    if (!cow) return true;
+
+    for (size_t i = 0; i < cow->n_dirty; i++) {
+        uint64_t page = cow->dirty_list[i];
+        uint8_t* ram_page = shared->ram + (page << PAGE_SHIFT);
+
+        // Copying into a shared file page would write the snapshot to the
+        // file; the page goes back to being anonymous RAM first. Pages not
+        // restored yet stay on the list.
+        if (page_bit(shared->file_shared, page)) {
+            if (mmap(ram_page, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+                cow->n_dirty -= i;
+                memmove(cow->dirty_list, cow->dirty_list + i, cow->n_dirty * sizeof(uint32_t));
+                return false;
+            }
+            set_page_bit(shared->file_shared, page, false);
+            set_page_bit(shared->read_only, page, false);
+        }
+        memcpy(ram_page, cow->saved + (page << PAGE_SHIFT), PAGE_SIZE);
+        mprotect(ram_page, PAGE_SIZE, PROT_READ);
+        cow->dirty[page >> 6] &= ~(1ULL << (page & 63));
+        cow_page_restored(mem, page);
+    }
+    cow->n_dirty = 0;
+    return true;
+}
+
+void memory_cow_end(memory_system_t* mem) {
+    memory_shared_t* shared = mem->shared;
+    memory_cow_t* cow = shared->cow;
+    if (!cow) return;
+
+    // Pages with code on them and read-only mappings stay read-only; the
+    // kernel refuses write access to the latter, so only the runs between
+    // them are opened up
+    code_lock(shared);
+    uint64_t pages = shared->ram_size >> PAGE_SHIFT;
+    for (uint64_t page = 0; page < pages; page++) {
+        uint64_t end = page;
+        while (end < pages && !code_protected(shared, end) && !page_read_only(shared, end)) end++;
+        if (end > page) {
+            mprotect(shared->ram + (page << PAGE_SHIFT), (end - page) << PAGE_SHIFT, PROT_READ | PROT_WRITE);
+        }
+        page = end;
+    }
+    __atomic_store_n(&shared->cow, NULL, __ATOMIC_RELEASE);
+    code_unlock(shared);
+    cow_free(shared, cow);
+}
+
+size_t memory_cow_dirty_pages(const memory_system_t* mem) {
+    const memory_cow_t* cow = mem->shared->cow;
+    return cow ? cow->n_dirty : 0;
+}
+
+void memory_save_translation(const memory_system_t* mem, memory_translation_t* state) {
+    state->itlb = mem->itlb;
+    state->dtlb = mem->dtlb;
+    state->lpid = mem->lpid;
+    state->pid = mem->pid;
+    state->problem_state = mem->problem_state;
+    state->ptcr = mem->mmu.ptcr;
+}
+
+void memory_restore_translation(memory_system_t* mem, const memory_translation_t* state) {
+    mem->itlb = state->itlb;
+    mem->dtlb = state->dtlb;
+    mem->lpid = state->lpid;
+    mem->pid = state->pid;
+    mem->problem_state = state->problem_state;
+    mem->mmu.ptcr = state->ptcr;
+
+    // Page tables may have been restored under the walk caches, and code
+    // pages may have changed since the fast entries were built
+    mmu_flush(&mem->mmu);
+    tlb_refresh_all(mem);
+    if (mem->blocks) block_cache_flush_jump_cache(mem->blocks);
+}
+
+// Replacing RAM pages: copy-on-write has to save what the mapping is about
+// to hide, and code decoded from the old contents has to go
+static bool ram_range_ok(const memory_system_t* mem, uint64_t paddr, size_t len) {
+    return !(paddr & PAGE_MASK) && !(len & PAGE_MASK) && len && paddr < mem->ram_size &&
+           len <= mem->ram_size - paddr;
+}
+
+static void ram_replacing(memory_system_t* mem, uint64_t paddr, size_t len) {
+    memory_shared_t* shared = mem->shared;
+    memory_cow_t* cow = shared->cow;
+    if (!cow) return;
+    code_lock(shared);
+    for (uint64_t page = paddr >> PAGE_SHIFT; page < (paddr + len) >> PAGE_SHIFT; page++) {
+        if (cow_clean(shared, page)) cow_save(shared, cow, page);
+    }
+    code_unlock(shared);
+}
+
+// The new pages come in writable unless read_only, so protection left
+// over from code already dropped (block_cache_flush keeps it) has to go
+// with the rest
+static void ram_replaced(memory_system_t* mem, uint64_t paddr, size_t len, bool file_shared,
+                         bool read_only) {
+    memory_shared_t* shared = mem->shared;
+    for (uint64_t page = paddr >> PAGE_SHIFT; page < (paddr + len) >> PAGE_SHIFT; page++) {
+        set_page_bit(shared->file_shared, page, file_shared);
+        set_page_bit(shared->read_only, page, read_only);
+        if (memory_is_code_page(mem, page) || code_protected(mem->shared, page)) {
+            code_written(mem, page);
+        }
+    }
+}
+
+bool memory_map_file(memory_system_t* mem, uint64_t paddr, size_t len, int fd, uint64_t offset,
+                     bool shared, bool writable) {
+    if (!ram_range_ok(mem, paddr, len) || (offset & PAGE_MASK)) {
+        errno = EINVAL;
+        return false;
+    }
+    bool read_only = shared && !writable;
+    ram_replacing(mem, paddr, len);
+    void* host = mmap(mem->ram + paddr, len, read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+                      (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fd, (off_t)offset);
+    if (host == MAP_FAILED) return false;
+    ram_replaced(mem, paddr, len, shared, read_only);
+    return true;
+}
+
+bool memory_map_zero(memory_system_t* mem, uint64_t paddr, size_t len) {
+    if (!ram_range_ok(mem, paddr, len)) {
+        errno = EINVAL;
+        return false;
+    }
+    ram_replacing(mem, paddr, len);
+    void* host = mmap(mem->ram + paddr, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    if (host == MAP_FAILED) return false;
+    ram_replaced(mem, paddr, len, false, false);
+    return true;
+}
@@ -4,37 +4,159 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <pthread.h>
+#include "mmu.h"
 
 #define MEMORY_SIZE (256 * 1024 * 1024)  // 256MB default
+
+// Inaccessible host mapping after guest RAM. Host code that overruns the
+// end of RAM faults there instead of touching unrelated memory.
+#define MEMORY_GUARD_SIZE (64 * 1024)
+
 #define PAGE_SIZE 4096
 #define PAGE_MASK (PAGE_SIZE - 1)
 #define PAGE_SHIFT 12
 
-// TLB Entry for fast address translation
+// Fast-path TLB entry. The tags hold the virtual page
+// plus TLB_* bits; an access hits the fast path when its address, masked
+// to the page and its alignment bits, equals the tag. Any TLB_* bit (or
+// a misaligned address) makes the compare fail and sends the access to
+// the out-of-line slow path.
 typedef struct {
-    uint64_t vaddr;     // Virtual address tag
-    uint64_t paddr;     // Physical address
-    uint32_t flags;     // Protection flags
-    bool valid;
+    uint64_t addr_read;     // Tag for loads (and fetches, in the ITLB)
+    uint64_t addr_write;    // Tag for stores
+    uintptr_t addend;       // Host address = guest address + addend
+    uint64_t paddr;         // Guest physical page
 } tlb_entry_t;
 
-#define TLB_SIZE 64
-#define TLB_MASK (TLB_SIZE - 1)
+// TLB geometry; override at build time (TLB_SETS must be a power of two)
+#ifndef TLB_SETS
+#define TLB_SETS 64
+#endif
+#ifndef TLB_WAYS
+#define TLB_WAYS 4
+#endif
+#define TLB_MASK (TLB_SETS - 1)
+
+// One translation, tagged with the context it belongs to
+typedef struct {
+    uint64_t vaddr;         // Virtual page
+    uint64_t paddr;         // Physical page
+    uint32_t lpid;          // Partition
+    uint32_t pid;           // Process (address space) within the partition
+    uint32_t flags;         // MEM_* and TLB_WAY_* bits; 0 marks an empty way
+    uint8_t page_shift;     // Size of the mapping this page belongs to
+} tlb_way_t;
+
+// Way attributes besides the MEM_* permissions
+#define TLB_WAY_PRIV    (1 << 3)    // No access in problem state
+#define TLB_WAY_REAL    (1 << 4)    // Real-mode (untranslated) entry
 
-// Memory subsystem
+// N-way set-associative TLB. Ways are kept in LRU order, and the fast
+// entry of a set mirrors its way 0 when that belongs to the current
+// context; everything else is found by the out-of-line slow path.
 typedef struct {
-    uint8_t* ram;
+    tlb_entry_t fast[TLB_SETS];
+    tlb_way_t ways[TLB_SETS][TLB_WAYS];
+    bool relocate;          // MSR[IR] or MSR[DR]: misses walk the page tables
+} tlb_t;
+
+// Slow-path bits in TLB tags. They sit above the alignment bits that
+// take part in the fast-path compare.
+#define TLB_TRACE       (1ULL << 7)     // Accesses are being recorded
+#define TLB_FORBIDDEN   (1ULL << 8)     // Access not permitted
+#define TLB_MMIO        (1ULL << 10)    // Not backed by guest RAM
+#define TLB_INVALID     (1ULL << 11)    // Empty entry
+
+struct block_cache;
+struct memory_system;
+
+#define MEMORY_MAX_VIEWS    64  // vCPUs that can share one guest RAM
+
+// Guest RAM and what every view of it shares. Views attach and detach
+// only while no vCPU is running.
+typedef struct memory_shared {
+    uint8_t* ram;           // Lazily committed; whole pages only
+    size_t ram_size;
+
+    // Per guest physical page, bit i is set while view i has decoded
+    // code on it
+    uint64_t* code_owners;
+
+    // Bit per page whose host page is write-protected for the code on it,
+    // and the lock its changes (and their mprotect calls) are made under
+    uint64_t* code_protected;
+    bool code_lock;
+    uint64_t opened;        // Pages unprotected so far, under code_lock
+
+    // Bit per page of a shared file mapping, and per page of one without
+    // write access
+    uint64_t* file_shared;
+    uint64_t* read_only;
+
+    struct memory_system* views[MEMORY_MAX_VIEWS];
+    pthread_mutex_t lock;   // Attach/detach
+
+    // Guest physical address of the last host fault nothing could fix: an
+    // access to the guard, a store to a read-only page, or an access the
+    // backing file cannot satisfy
+    uint64_t fault_paddr;
+
+    struct memory_cow* cow; // Copy-on-write tracking, while active
+} memory_shared_t;
+
+// Work other views ask of a view, done between blocks (memory_service)
+#define MEMORY_PENDING_INVAL    (1U << 0)   // Queued code pages were written
+#define MEMORY_PENDING_TLB      (1U << 1)   // A tlbie was broadcast
+#define MEMORY_PENDING_EVENTS   (1U << 2)   // For the event queue (events.h)
+
+// One vCPU's view of guest memory: its TLBs, MMU caches and decoded code
+typedef struct memory_system {
+    uint8_t* ram;           // Copies of shared->ram/ram_size
     size_t ram_size;
+    uint64_t* code_owners;  // shared->code_owners
+    memory_shared_t* shared;
+    unsigned view;          // Index in shared->views
+    uint64_t view_bit;      // 1 << view
+
+    struct block_cache* blocks;
     
-    // Simple TLB for address translation
-    tlb_entry_t itlb[TLB_SIZE];  // Instruction TLB
-    tlb_entry_t dtlb[TLB_SIZE];  // Data TLB
+    // TLBs for address translation
+    tlb_t itlb;             // Instruction TLB
+    tlb_t dtlb;             // Data TLB
+
+    // Current translation context
+    uint32_t lpid;
+    uint32_t pid;
+    bool problem_state;     // MSR[PR]
+    mmu_t mmu;
     
-    // Stats for optimization
-    uint64_t tlb_hits;
+    // Stats for optimization (fast-path hits are not counted)
     uint64_t tlb_misses;
+#ifdef PWRXE_PROFILE
+    struct profile* profile;    // See profile.h
+#endif
+    struct trace_ring* trace;   // Execution trace being recorded (trace.h)
+    struct event_queue* events; // Timers and interrupts (events.h)
+
+    // Requests from other views: MEMORY_PENDING_* bits, and a bit per
+    // code page to invalidate, with a bit per word of those that has any
+    // set. All are posted with atomic ORs, as the fault handler posts them.
+    uint32_t pending;
+    uint64_t* inval_pages;
+    uint64_t* inval_words;
+
+    // Last access translation refused
+    uint64_t fault_vaddr;
+    uint32_t fault_access;  // MEM_* of the access
+    uint32_t fault_status;  // DSISR_* bits
 } memory_system_t;
 
+// Translation fault causes, as reported in DSISR (and SRR1 for fetches)
+#define DSISR_NOPTE     (1U << 30)  // No translation
+#define DSISR_PROTFAULT (1U << 27)  // Access not permitted
+#define DSISR_ISSTORE   (1U << 25)  // The access was a store
+
 // Memory access flags
 #define MEM_READ    (1 << 0)
 #define MEM_WRITE   (1 << 1)
@@ -45,24 +167,222 @@ static inline uint64_t vaddr_to_tlb_index(uint64_t vaddr) {
     return (vaddr >> PAGE_SHIFT) & TLB_MASK;
 }
 
-// Function prototypes
+static inline bool memory_is_ram(const memory_system_t* mem, uint64_t paddr) {
+    return paddr < mem->ram_size;
+}
+
+// True if any view has decoded code on the page
+static inline bool memory_is_code_page(const memory_system_t* mem, uint64_t page) {
+    return __atomic_load_n(&mem->code_owners[page], __ATOMIC_SEQ_CST) != 0;
+}
+
+// This view no longer has decoded code on the page
+static inline void memory_clear_code_page(memory_system_t* mem, uint64_t page) {
+    if (page < mem->ram_size >> PAGE_SHIFT) {
+        __atomic_fetch_and(&mem->code_owners[page], ~mem->view_bit, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Marks a page as holding decoded code for this view. Its host page is
+// write-protected, and the first store to it, by any view or the host,
+// drops the code decoded from it in every view.
+void memory_set_code_page(memory_system_t* mem, uint64_t page);
+
+// Function prototypes. Sizes are rounded up to whole pages.
 bool memory_init(memory_system_t* mem, size_t size);
+
+// Sets up another view of the RAM other belongs to, e.g. for a new vCPU
+bool memory_attach(memory_system_t* mem, memory_system_t* other);
+
+// Detaches the view; the RAM goes with the last one
 void memory_destroy(memory_system_t* mem);
 
-// Fast memory access functions
-uint8_t memory_read8(memory_system_t* mem, uint64_t addr);
-uint16_t memory_read16(memory_system_t* mem, uint64_t addr);
-uint32_t memory_read32(memory_system_t* mem, uint64_t addr);
-uint64_t memory_read64(memory_system_t* mem, uint64_t addr);
+// Handles requests other views left in mem->pending. Must be called by
+// the view's own thread, between blocks. Returns the bits it took, so the
+// caller can act on MEMORY_PENDING_EVENTS.
+uint32_t memory_service(memory_system_t* mem);
+
+// Host address of an aligned access for atomics (lwarx/stwcx.), or NULL
+// if it is not in RAM
+void* memory_atomic_ptr(memory_system_t* mem, uint64_t addr, unsigned size, uint32_t access);
+
+// Host address of guest data at vaddr, translated like a data access of
+// the given kind, for the host to access the rest of the page directly
+// (system calls, DMA). For writes, code decoded from the page is dropped
+// and copy-on-write tracking saves it first. NULL if the page is not RAM
+// or the access is refused.
+void* memory_host_page(memory_system_t* mem, uint64_t vaddr, uint32_t access);
+
+// Bulk access, translated once per page. Inside cpu_run a page the
+// access is refused on faults like any guest access, with the pages
+// before it done; elsewhere the call stops there. Each returns the bytes
+// done. As with single accesses, addresses outside RAM read as zeros and
+// drop stores.
+size_t memory_read_block(memory_system_t* mem, uint64_t addr, void* buf, size_t len);
+size_t memory_write_block(memory_system_t* mem, uint64_t addr, const void* buf, size_t len);
+size_t memory_fill(memory_system_t* mem, uint64_t addr, uint8_t value, size_t len);
 
-void memory_write8(memory_system_t* mem, uint64_t addr, uint8_t value);
-void memory_write16(memory_system_t* mem, uint64_t addr, uint16_t value);
-void memory_write32(memory_system_t* mem, uint64_t addr, uint32_t value);
-void memory_write64(memory_system_t* mem, uint64_t addr, uint64_t value);
+// Guest to guest, page by page; the ranges must not overlap
+size_t memory_copy(memory_system_t* mem, uint64_t dst, uint64_t src, size_t len);
 
-// TLB management
+// Arrays of big-endian words in guest memory, from and to host order;
+// these return the words done
+size_t memory_read_be32(memory_system_t* mem, uint64_t addr, uint32_t* words, size_t n);
+size_t memory_write_be32(memory_system_t* mem, uint64_t addr, const uint32_t* words, size_t n);
+size_t memory_read_be64(memory_system_t* mem, uint64_t addr, uint64_t* words, size_t n);
+size_t memory_write_be64(memory_system_t* mem, uint64_t addr, const uint64_t* words, size_t n);
+
+// Out-of-line halves of the accessors below: TLB misses, misaligned and
+// page-crossing accesses and addresses outside RAM
+uint64_t memory_read_slow(memory_system_t* mem, uint64_t addr, unsigned size);
+void memory_write_slow(memory_system_t* mem, uint64_t addr, uint64_t value, unsigned size);
+
+// Fast memory access functions: a tag compare and one host access
+static inline uint64_t tlb_compare_addr(uint64_t addr, unsigned size) {
+    return addr & (~(uint64_t)PAGE_MASK | (size - 1));
+}
+
+static inline tlb_entry_t* dtlb_entry(memory_system_t* mem, uint64_t addr) {
+    return &mem->dtlb.fast[vaddr_to_tlb_index(addr)];
+}
+
+static inline uint8_t memory_read8(memory_system_t* mem, uint64_t addr) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 1) == entry->addr_read, 1)) {
+        return *(uint8_t*)(uintptr_t)(addr + entry->addend);
+    }
+    return (uint8_t)memory_read_slow(mem, addr, 1);
+}
+
+static inline uint16_t memory_read16(memory_system_t* mem, uint64_t addr) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 2) == entry->addr_read, 1)) {
+        return __builtin_bswap16(*(uint16_t*)(uintptr_t)(addr + entry->addend));
+    }
+    return (uint16_t)memory_read_slow(mem, addr, 2);
+}
+
+static inline uint32_t memory_read32(memory_system_t* mem, uint64_t addr) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 4) == entry->addr_read, 1)) {
+        return __builtin_bswap32(*(uint32_t*)(uintptr_t)(addr + entry->addend));
+    }
+    return (uint32_t)memory_read_slow(mem, addr, 4);
+}
+
+static inline uint64_t memory_read64(memory_system_t* mem, uint64_t addr) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 8) == entry->addr_read, 1)) {
+        return __builtin_bswap64(*(uint64_t*)(uintptr_t)(addr + entry->addend));
+    }
+    return memory_read_slow(mem, addr, 8);
+}
+
+static inline void memory_write8(memory_system_t* mem, uint64_t addr, uint8_t value) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 1) == entry->addr_write, 1)) {
+        *(uint8_t*)(uintptr_t)(addr + entry->addend) = value;
+        return;
+    }
+    memory_write_slow(mem, addr, value, 1);
+}
+
+static inline void memory_write16(memory_system_t* mem, uint64_t addr, uint16_t value) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 2) == entry->addr_write, 1)) {
+        *(uint16_t*)(uintptr_t)(addr + entry->addend) = __builtin_bswap16(value);
+        return;
+    }
+    memory_write_slow(mem, addr, value, 2);
+}
+
+static inline void memory_write32(memory_system_t* mem, uint64_t addr, uint32_t value) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 4) == entry->addr_write, 1)) {
+        *(uint32_t*)(uintptr_t)(addr + entry->addend) = __builtin_bswap32(value);
+        return;
+    }
+    memory_write_slow(mem, addr, value, 4);
+}
+
+static inline void memory_write64(memory_system_t* mem, uint64_t addr, uint64_t value) {
+    tlb_entry_t* entry = dtlb_entry(mem, addr);
+    if (__builtin_expect(tlb_compare_addr(addr, 8) == entry->addr_write, 1)) {
+        *(uint64_t*)(uintptr_t)(addr + entry->addend) = __builtin_bswap64(value);
+        return;
+    }
+    memory_write_slow(mem, addr, value, 8);
+}
+
+// Starts (or, with NULL, stops) recording the view into a trace ring.
+// Recording data accesses sends all of them to the slow path.
+void memory_set_trace(memory_system_t* mem, struct trace_ring* ring);
+
+// Instruction fetch
+uint64_t memory_translate_fetch(memory_system_t* mem, uint64_t addr);
+uint32_t memory_fetch_phys32(memory_system_t* mem, uint64_t paddr);
+
+// TLB management. Lookups and inserts are for the current context.
+bool tlb_lookup(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint64_t* paddr);
+void tlb_insert(memory_system_t* mem, tlb_t* tlb, uint64_t vaddr, uint64_t paddr, uint32_t flags);
+
+// Switches the translation context without dropping any translations
+void memory_set_context(memory_system_t* mem, uint32_t lpid, uint32_t pid);
+
+// Follows MSR[IR], MSR[DR] and MSR[PR]
+void memory_set_translation(memory_system_t* mem, bool inst, bool data, bool problem);
+
+// Points the MMU at a new partition table, dropping every translation
+void memory_set_ptcr(memory_system_t* mem, uint64_t ptcr);
+
+// Invalidation, from one page (of 1 << page_shift bytes) in one context
+// up to everything. Page table caches go with the TLB entries.
+void tlb_invalidate_page(memory_system_t* mem, uint64_t vaddr, uint32_t lpid, uint32_t pid,
+                         unsigned page_shift);
+void tlb_invalidate_pid(memory_system_t* mem, uint32_t lpid, uint32_t pid);
+void tlb_invalidate_lpid(memory_system_t* mem, uint32_t lpid);
 void tlb_flush(memory_system_t* mem);
-bool tlb_lookup(tlb_entry_t* tlb, uint64_t vaddr, uint64_t* paddr);
-void tlb_insert(tlb_entry_t* tlb, uint64_t vaddr, uint64_t paddr, uint32_t flags);
+
+// Makes every other view flush its TLBs before its next block (tlbie)
+void tlb_broadcast_flush(memory_system_t* mem);
+
+// Copy-on-write tracking of guest RAM, for snapshots. Once begun, the
+// first write to each page saves its contents; revert puts back the
+// pages written since, in time proportional to their number; pages of
+// shared file mappings come back as anonymous memory, leaving the file as
+// the guest wrote it. Revert fails only if such a page cannot be
+// remapped; the pages not put back stay tracked. Beginning again makes
+// the current contents the baseline. None of these may run
+// while a vCPU sharing the RAM is running.
+bool memory_cow_begin(memory_system_t* mem);
+bool memory_cow_revert(memory_system_t* mem);
+void memory_cow_end(memory_system_t* mem);
+size_t memory_cow_dirty_pages(const memory_system_t* mem);
+
+// Replaces whole pages of guest RAM, starting at paddr, with a mapping of
+// a file, or with fresh zero-filled pages. Nothing is read until the
+// guest touches it. Writes go to the file only for a shared mapping, and
+// to anonymous copies otherwise. A shared mapping that is not writable is
+// mapped read-only (as the file may only be open for reading): guest
+// stores to it fail like accesses outside RAM, and host-side writes are
+// refused. Code decoded from the old contents is dropped, and
+// copy-on-write tracking sees the mapping as a write. False, with errno
+// set, on failure.
+bool memory_map_file(memory_system_t* mem, uint64_t paddr, size_t len, int fd, uint64_t offset,
+                     bool shared, bool writable);
+bool memory_map_zero(memory_system_t* mem, uint64_t paddr, size_t len);
+
+// Translation state of a view: TLB contents and context
+typedef struct {
+    tlb_t itlb;
+    tlb_t dtlb;
+    uint32_t lpid;
+    uint32_t pid;
+    bool problem_state;
+    uint64_t ptcr;
+} memory_translation_t;
+
+void memory_save_translation(const memory_system_t* mem, memory_translation_t* state);
+void memory_restore_translation(memory_system_t* mem, const memory_translation_t* state);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "mmu.h"
+#include "memory.h"
+#include <string.h>
+
+// Page table entries are big-endian doublewords in guest RAM. Entries
+// outside RAM read as invalid.
+static inline uint64_t* table_entry(memory_system_t* mem, uint64_t paddr) {
+    if (paddr & 7 || !memory_is_ram(mem, paddr)) return NULL;
+    return (uint64_t*)(mem->ram + paddr);
+}
+
+static inline uint64_t read_entry(memory_system_t* mem, uint64_t paddr) {
+    uint64_t* p = table_entry(mem, paddr);
+    return p ? __builtin_bswap64(__atomic_load_n(p, __ATOMIC_ACQUIRE)) : 0;
+}
+
+// Finds the tree for the current context through the partition and
+// process tables, which costs two reads the first time
+static mmu_root_t* find_root(memory_system_t* mem, uint32_t pid) {
+    mmu_t* mmu = &mem->mmu;
+    mmu_root_t* root = &mmu->roots[pid & (MMU_ROOTS - 1)];
+    if (root->valid && root->lpid == mem->lpid && root->pid == pid) return root;
+
+    uint64_t patb = mmu->ptcr & RADIX_TABLE_MASK;
+    if (!patb || mem->lpid >= (1ULL << (RADIX_TABLE_SIZE(mmu->ptcr) + 12 - 4))) return NULL;
+    uint64_t pate0 = read_entry(mem, patb + mem->lpid * 16ULL);
+    uint64_t pate1 = read_entry(mem, patb + mem->lpid * 16ULL + 8);
+    if (!(pate0 & RADIX_HR)) return NULL;   // Hashed page tables are not supported
+
+    uint64_t prtb = pate1 & RADIX_TABLE_MASK;
+    if (!prtb || pid >= (1ULL << (RADIX_TABLE_SIZE(pate1) + 12 - 4))) return NULL;
+    uint64_t prte = read_entry(mem, prtb + pid * 16ULL);
+    unsigned top = ((RADIX_RTS1(prte) << 3) | RADIX_RTS2(prte)) + 31;
+    unsigned nls = RADIX_RPDS(prte);
+    if (!(prte & RADIX_RPDB_MASK) || nls < 5 || top > 62 || nls > top - PAGE_SHIFT) return NULL;
+
+    memset(root, 0, sizeof(*root));
+    root->base = prte & RADIX_RPDB_MASK;
+    root->lpid = mem->lpid;
+    root->pid = pid;
+    root->top = (uint8_t)top;
+    root->nls = (uint8_t)nls;
+    root->valid = true;
+    return root;
+}
+
+static inline pwc_entry_t* pwc_slot(mmu_t* mmu, unsigned depth, uint64_t prefix, uint32_t pid) {
+    return &mmu->pwc[depth - 1][(prefix ^ (prefix >> 9) ^ pid) & (PWC_SIZE - 1)];
+}
+
+// Sets R, and C for stores, the way the hardware would
+static void update_rc(memory_system_t* mem, uint64_t pte_addr, uint64_t pte, uint32_t access) {
+    uint64_t bits = RADIX_R | (access == MEM_WRITE ? RADIX_C : 0);
+    if ((pte & bits) == bits) return;
+    __atomic_fetch_or(table_entry(mem, pte_addr), __builtin_bswap64(bits), __ATOMIC_RELEASE);
+}
+
+bool mmu_translate(memory_system_t* mem, uint64_t vaddr, uint32_t access,
+                   mmu_result_t* result, uint32_t* status) {
+    mmu_t* mmu = &mem->mmu;
+    uint32_t store = access == MEM_WRITE ? DSISR_ISSTORE : 0;
+    *status = DSISR_NOPTE | store;
+    mmu->walks++;
+
+    // Quadrant 0 is the process's, 3 the OS's; 1 and 2 are hypervisor-only
+    unsigned quadrant = vaddr >> 62;
+    if (quadrant == 1 || quadrant == 2) return false;
+    mmu_root_t* root = find_root(mem, quadrant == 3 ? 0 : mem->pid);
+    if (!root) return false;
+
+    uint64_t ea = vaddr & ((1ULL << 62) - 1);
+    if (ea >> root->top) return false;
+
+    // Resume from the deepest table the PWC knows for this EA
+    uint64_t base = root->base;
+    unsigned nls = root->nls, shift = root->top, depth = 0;
+    for (unsigned d = PWC_LEVELS; d >= 1; d--) {
+        unsigned s = root->shift[d];
+        if (!s) continue;
+        pwc_entry_t* pwc = pwc_slot(mmu, d, ea >> s, root->pid);
+        if (pwc->valid && pwc->shift == s && pwc->prefix == ea >> s &&
+            pwc->lpid == root->lpid && pwc->pid == root->pid) {
+            base = pwc->base;
+            nls = pwc->nls;
+            shift = s;
+            depth = d;
+            mmu->pwc_hits++;
+            break;
+        }
+    }
+
+    for (;;) {
+        if (nls == 0 || nls > shift - PAGE_SHIFT) return false;
+        shift -= nls;
+        uint64_t entry_addr = base + ((ea >> shift) & ((1ULL << nls) - 1)) * 8;
+        uint64_t entry = read_entry(mem, entry_addr);
+        if (!(entry & RADIX_V)) return false;
+
+        if (entry & RADIX_L) {
+            uint64_t size = 1ULL << shift;
+            uint32_t flags = 0;
+            if (entry & (RADIX_READ | RADIX_RW)) flags |= MEM_READ;
+            if (entry & RADIX_RW) flags |= MEM_WRITE;
+            if (entry & RADIX_EXEC) flags |= MEM_EXEC;
+            if (entry & RADIX_PRIV) flags |= TLB_WAY_PRIV;
+
+            bool denied = !(flags & access) || (mem->problem_state && (flags & TLB_WAY_PRIV));
+            if (denied) {
+                *status = DSISR_PROTFAULT | store;
+                return false;
+            }
+            update_rc(mem, entry_addr, entry, access);
+
+            // Until C is set, stores have to come back here to set it
+            if (access != MEM_WRITE && !(entry & RADIX_C)) flags &= ~MEM_WRITE;
+
+            result->paddr = ((entry & RADIX_RPN_MASK & ~(size - 1)) | (ea & (size - 1))) &
+                            ~(uint64_t)PAGE_MASK;
+            result->flags = flags;
+            result->page_shift = (uint8_t)shift;
+            return true;
+        }
+
+        if (++depth >= RADIX_MAX_DEPTH) return false;
+        base = entry & RADIX_NLB_MASK;
+        nls = RADIX_NLS(entry);
+        if (depth <= PWC_LEVELS) {
+            pwc_entry_t* pwc = pwc_slot(mmu, depth, ea >> shift, root->pid);
+            pwc->prefix = ea >> shift;
+            pwc->base = base;
+            pwc->lpid = root->lpid;
+            pwc->pid = root->pid;
+            pwc->shift = (uint8_t)shift;
+            pwc->nls = (uint8_t)nls;
+            pwc->valid = true;
+            root->shift[depth] = (uint8_t)shift;
+        }
+    }
+}
+
+void mmu_flush(mmu_t* mmu) {
+    memset(mmu->roots, 0, sizeof(mmu->roots));
+    memset(mmu->pwc, 0, sizeof(mmu->pwc));
+}
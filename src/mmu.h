@@ -0,0 +1,91 @@
+#ifndef MMU_H
+#define MMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Radix page-table walker (PowerISA v3.x). PTCR points at the partition
+// table, whose entry for the current LPID points at the process table;
+// the process table entry for the PID (or 0, for quadrant 3) holds the
+// root of the radix tree. Partition-scoped translation is not modelled:
+// guest real addresses are guest RAM offsets.
+
+// Partition/process table entries (first doubleword) and PTCR
+#define RADIX_HR            (1ULL << 63)            // Host radix
+#define RADIX_RTS1(x)       (((x) >> 61) & 3)
+#define RADIX_RTS2(x)       (((x) >> 5) & 7)
+#define RADIX_RPDB_MASK     0x0FFFFFFFFFFFFF00ULL
+#define RADIX_RPDS(x)       ((x) & 0x1F)
+#define RADIX_TABLE_MASK    0x0FFFFFFFFFFFF000ULL   // PATB, PRTB
+#define RADIX_TABLE_SIZE(x) ((x) & 0x1F)            // PATS, PRTS
+
+// Page directory and page table entries
+#define RADIX_V             (1ULL << 63)            // Valid
+#define RADIX_L             (1ULL << 62)            // Leaf
+#define RADIX_NLB_MASK      0x0FFFFFFFFFFFFF00ULL
+#define RADIX_NLS(x)        ((x) & 0x1F)
+#define RADIX_RPN_MASK      0x01FFFFFFFFFFF000ULL
+#define RADIX_R             (1ULL << 8)             // Referenced
+#define RADIX_C             (1ULL << 7)             // Changed
+#define RADIX_PRIV          (1ULL << 3)             // Privileged only
+#define RADIX_READ          (1ULL << 2)
+#define RADIX_RW            (1ULL << 1)
+#define RADIX_EXEC          (1ULL << 0)
+
+#define RADIX_MAX_DEPTH     8   // Tables on the deepest path walked
+#define PWC_LEVELS          4   // Directory depths kept in the PWC
+#define PWC_SIZE            64  // Direct-mapped entries per depth
+#define MMU_ROOTS           16  // Cached process table lookups
+
+// Page-walk cache entry: the table at some depth that covers every EA
+// with the given prefix, so a walk can resume there
+typedef struct {
+    uint64_t prefix;        // EA >> shift
+    uint64_t base;          // Table address
+    uint32_t lpid;
+    uint32_t pid;
+    uint8_t shift;          // Bits below the table's index
+    uint8_t nls;            // log2 of the table's entry count
+    bool valid;
+} pwc_entry_t;
+
+// Root of one context's tree, from the partition and process tables
+typedef struct {
+    uint64_t base;
+    uint32_t lpid;
+    uint32_t pid;
+    uint8_t top;            // Bits the tree translates (RTS + 31)
+    uint8_t nls;
+    uint8_t shift[PWC_LEVELS + 1];  // Last shift seen per depth, for PWC probes
+    bool valid;
+} mmu_root_t;
+
+typedef struct {
+    uint64_t ptcr;
+    mmu_root_t roots[MMU_ROOTS];
+    pwc_entry_t pwc[PWC_LEVELS][PWC_SIZE];
+
+    // Stats
+    uint64_t walks;
+    uint64_t pwc_hits;
+} mmu_t;
+
+struct memory_system;
+
+// Result of a successful walk, cut down to the 4K page holding the EA
+typedef struct {
+    uint64_t paddr;         // Physical page
+    uint32_t flags;         // MEM_* permissions plus TLB_WAY_PRIV
+    uint8_t page_shift;     // Size of the leaf that mapped it
+} mmu_result_t;
+
+// Translates vaddr for an access (one MEM_* bit) in the current context,
+// setting R and C in the PTE. On failure returns false and sets *status
+// to the DSISR bits describing the fault.
+bool mmu_translate(struct memory_system* mem, uint64_t vaddr, uint32_t access,
+                   mmu_result_t* result, uint32_t* status);
+
+// Drops cached table entries; needed whenever page tables change
+void mmu_flush(mmu_t* mmu);
+
+#endif
@@ -0,0 +1,56 @@
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// pwrxe-objdump [-j threads] [-c] [-b] [-o output] file: disassembles the
+// executable sections of a PowerPC ELF64 file and prints its basic blocks
+// and control flow graph (disasm.h)
+static int usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-j threads] [-c] [-b] [-o output] file\n"
+            "  -j  worker threads (default: one per CPU)\n"
+            "  -c  control flow graph only, without the instructions\n"
+            "  -b  compact binary output instead of text\n"
+            "  -o  write to output instead of stdout\n",
+            name);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = 0;
+    bool cfg_only = false, binary = false;
+    const char* output = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:cbo:")) != -1) {
+        switch (opt) {
+            case 'j': threads = (unsigned)strtoul(optarg, NULL, 0); break;
+            case 'c': cfg_only = true; break;
+            case 'b': binary = true; break;
+            case 'o': output = optarg; break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) return usage(argv[0]);
+    const char* path = argv[optind];
+
+    const char* error = NULL;
+    disasm_t* dis = disasm_open(path, threads, &error);
+    if (!dis) {
+        fprintf(stderr, "%s: %s\n", path, error);
+        return 1;
+    }
+
+    FILE* out = output ? fopen(output, binary ? "wb" : "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "%s: cannot create\n", output);
+        disasm_close(dis);
+        return 1;
+    }
+    bool ok = binary ? disasm_write_binary(dis, out, cfg_only) : disasm_write_text(dis, out, cfg_only);
+    if (fflush(out) || (output && fclose(out))) ok = false;
+    if (!ok) fprintf(stderr, "%s: write failed\n", output ? output : "stdout");
+
+    disasm_close(dis);
+    return ok ? 0 : 1;
+}
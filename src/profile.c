@@ -0,0 +1,174 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PWRXE_PROFILE
+
+static const char* const tlb_cause_names[PROFILE_TLB_CAUSES] = {
+    "way", "real", "walk", "recheck", "fault", "other",
+};
+
+static const char* const path_names[PROFILE_PATHS] = {
+    "tlb_fill", "code_write", "decode", "jit", "service",
+};
+
+bool profile_init(memory_system_t* mem) {
+    mem->profile = calloc(1, sizeof(profile_t));
+    return mem->profile != NULL;
+}
+
+void profile_destroy(memory_system_t* mem) {
+    free(mem->profile);
+    mem->profile = NULL;
+}
+
+static profile_block_t* histogram_slot(profile_t* prof, uint64_t paddr) {
+    uint64_t h = paddr_to_block_hash(paddr);
+    for (unsigned probe = 0; probe < PROFILE_BLOCKS; probe++) {
+        profile_block_t* slot = &prof->blocks[(h + probe) & (PROFILE_BLOCKS - 1)];
+        if (slot->runs == 0 || slot->paddr == paddr) return slot;
+    }
+    return NULL;
+}
+
+void profile_fold_block(memory_system_t* mem, ppc_block_t* block) {
+    uint64_t runs = block->prof_runs;
+    if (!runs || !mem->profile) return;
+    profile_t* prof = mem->profile;
+    block->prof_runs = 0;
+
+    for (uint32_t i = 0; i < block->n_insns; i++) {
+        uint16_t id = block->ops[i].inst.id;
+        prof->insn_counts[id] += runs;
+        if (id == PPC_INST_PREFIX) i++;     // Counted once, as "prefix"
+    }
+    profile_block_t* slot = histogram_slot(prof, block->paddr);
+    if (!slot) {
+        prof->lost_insns += runs * block->n_insns;
+        return;
+    }
+    slot->paddr = block->paddr;
+    slot->runs += runs;
+    slot->insns += runs * block->n_insns;
+}
+
+const profile_t* profile_read(memory_system_t* mem) {
+    block_cache_t* cache = mem->blocks;
+    if (cache) {
+        for (int i = 0; i < BLOCK_HASH_SIZE; i++) {
+            for (ppc_block_t* block = cache->hash[i]; block; block = block->hash_next) {
+                profile_fold_block(mem, block);
+            }
+        }
+    }
+    return mem->profile;
+}
+
+void profile_reset(memory_system_t* mem) {
+    profile_read(mem);      // Clears the live blocks
+    memset(mem->profile, 0, sizeof(profile_t));
+}
+
+static int hotter(const void* a, const void* b) {
+    uint64_t x = ((const profile_block_t*)a)->insns, y = ((const profile_block_t*)b)->insns;
+    return (x < y) - (x > y);
+}
+
+size_t profile_hot_blocks(memory_system_t* mem, profile_block_t* out, size_t max) {
+    const profile_t* prof = profile_read(mem);
+    profile_block_t* all = malloc(sizeof(prof->blocks));
+    if (!all) return 0;
+    size_t n = 0;
+    for (int i = 0; i < PROFILE_BLOCKS; i++) {
+        if (prof->blocks[i].runs) all[n++] = prof->blocks[i];
+    }
+    qsort(all, n, sizeof(all[0]), hotter);
+    if (n > max) n = max;
+    memcpy(out, all, n * sizeof(all[0]));
+    free(all);
+    return n;
+}
+
+#define DUMP_HOT_BLOCKS 32
+
+void profile_dump(memory_system_t* mem, FILE* out) {
+    const profile_t* prof = profile_read(mem);
+    if (!prof) return;
+
+    fprintf(out, "{\n  \"insn_counts\": {");
+    bool first = true;
+    for (int id = 0; id < PPC_INST_COUNT; id++) {
+        if (!prof->insn_counts[id]) continue;
+        const char* name = get_instruction_name_by_id((uint16_t)id);
+        fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", name ? name : "invalid",
+                (unsigned long long)prof->insn_counts[id]);
+        first = false;
+    }
+
+    fprintf(out, "\n  },\n  \"hot_blocks\": [");
+    profile_block_t hot[DUMP_HOT_BLOCKS];
+    size_t n = profile_hot_blocks(mem, hot, DUMP_HOT_BLOCKS);
+    for (size_t i = 0; i < n; i++) {
+        fprintf(out, "%s\n    {\"paddr\": \"0x%llx\", \"runs\": %llu, \"insns\": %llu}",
+                i ? "," : "", (unsigned long long)hot[i].paddr,
+                (unsigned long long)hot[i].runs, (unsigned long long)hot[i].insns);
+    }
+    fprintf(out, "\n  ],\n  \"lost_insns\": %llu,\n", (unsigned long long)prof->lost_insns);
+
+    static const char* const tlb_names[2] = { "dtlb", "itlb" };
+    for (int t = 0; t < 2; t++) {
+        fprintf(out, "  \"%s\": {", tlb_names[t]);
+        for (int c = 0; c < PROFILE_TLB_CAUSES; c++) {
+            fprintf(out, "%s\"%s\": %llu", c ? ", " : "", tlb_cause_names[c],
+                    (unsigned long long)prof->tlb[t][c]);
+        }
+        fprintf(out, "},\n");
+    }
+
+    fprintf(out, "  \"slow_paths\": {");
+    for (int p = 0; p < PROFILE_PATHS; p++) {
+        fprintf(out, "%s\n    \"%s\": {\"calls\": %llu, \"cycles\": %llu}", p ? "," : "",
+                path_names[p], (unsigned long long)prof->path_calls[p],
+                (unsigned long long)prof->path_cycles[p]);
+    }
+    fprintf(out, "\n  }\n}\n");
+}
+
+#else
+
+bool profile_init(memory_system_t* mem) {
+    (void)mem;
+    return true;
+}
+
+void profile_destroy(memory_system_t* mem) {
+    (void)mem;
+}
+
+void profile_fold_block(memory_system_t* mem, ppc_block_t* block) {
+    (void)mem;
+    (void)block;
+}
+
+const profile_t* profile_read(memory_system_t* mem) {
+    (void)mem;
+    return NULL;
+}
+
+void profile_reset(memory_system_t* mem) {
+    (void)mem;
+}
+
+size_t profile_hot_blocks(memory_system_t* mem, profile_block_t* out, size_t max) {
+    (void)mem;
+    (void)out;
+    (void)max;
+    return 0;
+}
+
+void profile_dump(memory_system_t* mem, FILE* out) {
+    (void)mem;
+    (void)out;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <x86intrin.h>
+#include "instruction.h"
+#include "block.h"
+
+// Optional instrumentation, built with -DPWRXE_PROFILE (the PWRXE_PROFILE
+// CMake option). Each memory view then carries a profile_t: instruction
+// counts by ID, executions per block, why accesses left the fast path,
+// and host cycles spent in the emulator's slow paths. Without it the
+// hooks below are empty and the fields they touch do not exist.
+//
+// Instruction counts come from whole blocks: a block counts each time it
+// is entered, interpreted or translated, and its instructions are added
+// up when it is freed or the profile is read. Blocks left early (faults,
+// traps) count as if they had run to the end.
+
+// Why an access took the slow path, per TLB
+typedef enum {
+    PROFILE_TLB_WAY,        // Fast entry missed, a way held the translation
+    PROFILE_TLB_REAL,       // Full miss, filled in real mode
+    PROFILE_TLB_WALK,       // Full miss, filled by a page table walk
+    PROFILE_TLB_RECHECK,    // Entry refused the access; tables walked again
+    PROFILE_TLB_FAULT,      // Refused, after a walk or recheck counted above
+    PROFILE_TLB_OTHER,      // Entry was fine: misaligned, MMIO or traced
+    PROFILE_TLB_CAUSES
+} profile_tlb_cause_t;
+
+// Slow paths timed in host cycles (TSC)
+typedef enum {
+    PROFILE_PATH_TLB_FILL,      // Translations missing from the TLB
+    PROFILE_PATH_CODE_WRITE,    // Stores to pages holding decoded code
+    PROFILE_PATH_DECODE,        // Block decoding
+    PROFILE_PATH_JIT,           // Native translation
+    PROFILE_PATH_SERVICE,       // Requests from other views
+    PROFILE_PATHS
+} profile_path_t;
+
+// Hot block histogram entry; insns is runs times the block's length
+typedef struct {
+    uint64_t paddr;
+    uint64_t runs;
+    uint64_t insns;
+} profile_block_t;
+
+#define PROFILE_BLOCKS  4096    // Histogram slots (power of two)
+
+typedef struct profile {
+    uint64_t insn_counts[PPC_INST_COUNT];
+    uint64_t tlb[2][PROFILE_TLB_CAUSES];    // [0] data, [1] instruction
+    uint64_t path_cycles[PROFILE_PATHS];
+    uint64_t path_calls[PROFILE_PATHS];
+    profile_block_t blocks[PROFILE_BLOCKS]; // Open addressing on paddr
+    uint64_t lost_insns;        // From blocks that found the histogram full
+} profile_t;
+
+#ifdef PWRXE_PROFILE
+#define PROFILE_ENABLED 1
+#else
+#define PROFILE_ENABLED 0
+#endif
+
+// Hooks
+static inline void profile_tlb(memory_system_t* mem, bool fetch, profile_tlb_cause_t cause) {
+#ifdef PWRXE_PROFILE
+    mem->profile->tlb[fetch][cause]++;
+#else
+    (void)mem;
+    (void)fetch;
+    (void)cause;
+#endif
+}
+
+static inline uint64_t profile_start(void) {
+    return PROFILE_ENABLED ? __rdtsc() : 0;
+}
+
+static inline void profile_end(memory_system_t* mem, profile_path_t path, uint64_t start) {
+#ifdef PWRXE_PROFILE
+    mem->profile->path_cycles[path] += __rdtsc() - start;
+    mem->profile->path_calls[path]++;
+#else
+    (void)mem;
+    (void)path;
+    (void)start;
+#endif
+}
+
+static inline void profile_block_run(ppc_block_t* block) {
+#ifdef PWRXE_PROFILE
+    block->prof_runs++;
+#else
+    (void)block;
+#endif
+}
+
+// Single instructions stepped outside any block
+static inline void profile_insn(memory_system_t* mem, uint16_t id) {
+#ifdef PWRXE_PROFILE
+    mem->profile->insn_counts[id]++;
+#else
+    (void)mem;
+    (void)id;
+#endif
+}
+
+// Setup, for memory_init/memory_attach and memory_destroy
+bool profile_init(memory_system_t* mem);
+void profile_destroy(memory_system_t* mem);
+
+// Adds a block's runs to the counters and clears them; called before a
+// block is freed
+void profile_fold_block(memory_system_t* mem, ppc_block_t* block);
+
+// The view's counters with its live blocks folded in; NULL when built
+// without PWRXE_PROFILE
+const profile_t* profile_read(memory_system_t* mem);
+void profile_reset(memory_system_t* mem);
+
+// Up to max hottest blocks by instructions executed, hottest first;
+// returns how many were written
+size_t profile_hot_blocks(memory_system_t* mem, profile_block_t* out, size_t max);
+
+// Writes everything as JSON; nothing when built without PWRXE_PROFILE
+void profile_dump(memory_system_t* mem, FILE* out);
+
+#endif
@@ -0,0 +1,71 @@
+#include "smp.h"
+#include <stdlib.h>
+#include <string.h>
+
+static vcpu_t* vcpu_create(unsigned index, vcpu_t* first, size_t ram_size) {
+    vcpu_t* vcpu;
+    if (posix_memalign((void**)&vcpu, 64, sizeof(vcpu_t))) return NULL;
+    memset(vcpu, 0, sizeof(*vcpu));
+
+    bool ok = first ? memory_attach(&vcpu->mem, &first->mem) : memory_init(&vcpu->mem, ram_size);
+    if (!ok) {
+        free(vcpu);
+        return NULL;
+    }
+    block_cache_init(&vcpu->blocks, &vcpu->mem);
+    events_init(&vcpu->events, &vcpu->mem);
+    cpu_reset(&vcpu->cpu);
+    vcpu->cpu.pir = index;
+    vcpu->index = index;
+    return vcpu;
+}
+
+static void vcpu_destroy(vcpu_t* vcpu) {
+    events_destroy(&vcpu->events);
+    block_cache_destroy(&vcpu->blocks);
+    memory_destroy(&vcpu->mem);
+    free(vcpu);
+}
+
+bool smp_init(smp_t* smp, unsigned n_cpus, size_t ram_size) {
+    memset(smp, 0, sizeof(*smp));
+    if (n_cpus == 0 || n_cpus > MEMORY_MAX_VIEWS) return false;
+
+    for (unsigned i = 0; i < n_cpus; i++) {
+        smp->cpus[i] = vcpu_create(i, i ? smp->cpus[0] : NULL, ram_size);
+        if (!smp->cpus[i]) {
+            smp_destroy(smp);
+            return false;
+        }
+        smp->n_cpus = i + 1;
+    }
+    return true;
+}
+
+void smp_destroy(smp_t* smp) {
+    // The first vCPU's view goes last, taking the RAM with it
+    for (unsigned i = smp->n_cpus; i-- > 0;) {
+        vcpu_destroy(smp->cpus[i]);
+        smp->cpus[i] = NULL;
+    }
+    smp->n_cpus = 0;
+}
+
+static void* vcpu_thread(void* arg) {
+    vcpu_t* vcpu = arg;
+    vcpu->exit = cpu_run(&vcpu->cpu, &vcpu->mem, vcpu->budget);
+    return NULL;
+}
+
+bool smp_run(smp_t* smp, uint64_t max_insns) {
+    unsigned started = 0;
+    for (; started < smp->n_cpus; started++) {
+        vcpu_t* vcpu = smp->cpus[started];
+        vcpu->budget = max_insns;
+        if (pthread_create(&vcpu->thread, NULL, vcpu_thread, vcpu)) break;
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(smp->cpus[i]->thread, NULL);
+    }
+    return started == smp->n_cpus;
+}
@@ -0,0 +1,41 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "block.h"
+#include "events.h"
+
+// Symmetric multiprocessing: one host thread per vCPU. Each vCPU has its
+// own registers, memory view (TLBs, MMU caches, stats) and block cache;
+// guest RAM is shared. vCPUs coordinate only through guest memory, host
+// atomics (lwarx/stwcx., sync) and the requests memory views leave each
+// other (code invalidation, tlbie). Each vCPU keeps its own time; other
+// threads interrupt it or stop it early through its event queue.
+typedef struct {
+    ppc_cpu_state_t cpu;        // First, for its alignment
+    memory_system_t mem;
+    block_cache_t blocks;
+    event_queue_t events;
+    unsigned index;             // Also the PIR
+    pthread_t thread;
+    uint64_t budget;            // Instructions smp_run lets it execute
+    cpu_exit_t exit;            // Why its last cpu_run returned
+} vcpu_t;
+
+typedef struct {
+    vcpu_t* cpus[MEMORY_MAX_VIEWS];
+    unsigned n_cpus;
+} smp_t;
+
+// Creates n_cpus vCPUs sharing ram_size bytes of guest RAM, all reset
+bool smp_init(smp_t* smp, unsigned n_cpus, size_t ram_size);
+void smp_destroy(smp_t* smp);
+
+// Runs every vCPU on its own thread for up to max_insns instructions, or
+// until it exits, and waits for all of them. Each vCPU's exit reason is
+// left in its exit field.
+bool smp_run(smp_t* smp, uint64_t max_insns);
+
+#endif
@@ -0,0 +1,19 @@
+#include "snapshot.h"
+
+bool snapshot_take(snapshot_t* snap, const ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    if (!memory_cow_begin(mem)) return false;
+    snap->cpu = *cpu;
+    memory_save_translation(mem, &snap->translation);
+    return true;
+}
+
+bool snapshot_restore(const snapshot_t* snap, ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    if (!memory_cow_revert(mem)) return false;
+    *cpu = snap->cpu;
+    memory_restore_translation(mem, &snap->translation);
+    return true;
+}
+
+void snapshot_release(memory_system_t* mem) {
+    memory_cow_end(mem);
+}
@@ -0,0 +1,29 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include "cpu.h"
+
+// Machine snapshots for resetting a guest many times: registers, the
+// view's translation state and guest RAM. RAM is tracked copy-on-write
+// (see memory_cow_begin), so taking a snapshot and restoring it cost time
+// proportional to the pages written in between, not to the RAM size.
+//
+// RAM tracking is shared by every view of the RAM and holds one baseline:
+// taking a snapshot replaces the RAM contents of any earlier one. With
+// several vCPUs, take (and restore) one snapshot per vCPU while none of
+// them is running.
+typedef struct {
+    ppc_cpu_state_t cpu;
+    memory_translation_t translation;
+} snapshot_t;
+
+bool snapshot_take(snapshot_t* snap, const ppc_cpu_state_t* cpu, memory_system_t* mem);
+// False, with the registers left alone, if RAM could not be put back
+// (memory_cow_revert); restoring may be tried again
+bool snapshot_restore(const snapshot_t* snap, ppc_cpu_state_t* cpu, memory_system_t* mem);
+
+// Stops tracking RAM; snapshots taken so far can no longer be restored
+void snapshot_release(memory_system_t* mem);
+
+#endif
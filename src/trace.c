@@ -0,0 +1,537 @@
+#define _DEFAULT_SOURCE    // usleep
+#include "trace.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// File format: an 8-byte magic, then chunks, each a little-endian u32
+// thread number and u32 length followed by that thread's records. Within
+// a thread, records are a tag byte (TRACE_REC_* kind, log2 of the access
+// size above it) and LEB128 fields, delta-coded against the same
+// thread's previous record:
+//   BLOCK   zigzag((pc - end of previous block) / 4), instructions
+//   CODE    zigzag((pc - end of previous block) / 4), words, 4 bytes each
+//   LOAD    word offset in the block, zigzag(addr - end of previous
+//   STORE   access), value
+// A block that falls through to the next costs three bytes.
+static const char trace_magic[8] = { 'P', 'W', 'R', 'X', 'T', 'R', 'C', '1' };
+
+#define CHUNK_RECORDS   4096
+#define CHUNK_MAX       ((CHUNK_RECORDS + 32) * 32)     // Encoded size bound
+#define WRITER_IDLE_US  200
+
+// Encoder state per thread
+typedef struct {
+    uint64_t block_end;
+    uint64_t access_end;
+} delta_t;
+
+struct trace {
+    FILE* file;
+    uint32_t flags;
+    pthread_t writer;
+    pthread_mutex_t lock;       // Attach
+    trace_ring_t* rings[MEMORY_MAX_VIEWS];
+    unsigned n_rings;
+    bool stop;
+    bool failed;                // Write error
+    delta_t delta[MEMORY_MAX_VIEWS];
+    uint8_t chunk[8 + CHUNK_MAX];
+};
+
+static uint8_t* put_uleb(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static uint8_t* put_sleb(uint8_t* p, int64_t v) {
+    return put_uleb(p, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static unsigned log2_size(unsigned size) {
+    return (unsigned)__builtin_ctz(size);
+}
+
+// Encodes up to CHUNK_RECORDS records of one ring (more to finish a code
+// record) and writes them as a chunk; returns how many were taken
+static size_t drain_ring(trace_t* trace, trace_ring_t* ring) {
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->published, __ATOMIC_ACQUIRE);
+    if (head == tail) return 0;
+
+    delta_t* d = &trace->delta[ring->index];
+    uint8_t* start = trace->chunk + 8;
+    uint8_t* p = start;
+    uint64_t pos = tail;
+    while (pos != head && pos - tail < CHUNK_RECORDS) {
+        const trace_record_t* rec = &ring->records[pos++ & (TRACE_RING_SIZE - 1)];
+        uint32_t kind = TRACE_REC_KIND(rec->kind);
+        switch (kind) {
+            case TRACE_REC_BLOCK:
+                *p++ = TRACE_REC_BLOCK;
+                p = put_sleb(p, (int64_t)(rec->pc - d->block_end) >> 2);
+                p = put_uleb(p, rec->n);
+                d->block_end = rec->pc + (uint64_t)rec->n * 4;
+                break;
+            case TRACE_REC_CODE:
+                // Published together with its words (trace_code)
+                *p++ = TRACE_REC_CODE;
+                p = put_sleb(p, (int64_t)(rec->pc - d->block_end) >> 2);
+                p = put_uleb(p, rec->n);
+                for (uint32_t i = 0; i < rec->n; i += 4) {
+                    const trace_record_t* words = &ring->records[pos++ & (TRACE_RING_SIZE - 1)];
+                    const uint32_t w[4] = { (uint32_t)words->pc, (uint32_t)(words->pc >> 32),
+                                            (uint32_t)words->value, (uint32_t)(words->value >> 32) };
+                    for (uint32_t j = 0; j < 4 && i + j < rec->n; j++) {
+                        for (int b = 3; b >= 0; b--) *p++ = (uint8_t)(w[j] >> (b * 8));
+                    }
+                }
+                break;
+            default: {
+                unsigned size = TRACE_REC_SIZE(rec->kind);
+                *p++ = (uint8_t)(kind | log2_size(size) << 3);
+                p = put_uleb(p, rec->n >> 2);
+                p = put_sleb(p, (int64_t)(rec->pc - d->access_end));
+                p = put_uleb(p, rec->value);
+                d->access_end = rec->pc + size;
+                break;
+            }
+        }
+    }
+    __atomic_store_n(&ring->tail, pos, __ATOMIC_RELEASE);
+
+    size_t len = (size_t)(p - start);
+    put_le32(trace->chunk, ring->index);
+    put_le32(trace->chunk + 4, (uint32_t)len);
+    if (fwrite(trace->chunk, 1, 8 + len, trace->file) != 8 + len) trace->failed = true;
+    return (size_t)(pos - tail);
+}
+
+static void* writer_thread(void* arg) {
+    trace_t* trace = arg;
+    for (;;) {
+        // Whatever was pushed before stop was set is drained below
+        bool stop = __atomic_load_n(&trace->stop, __ATOMIC_ACQUIRE);
+        unsigned n_rings = __atomic_load_n(&trace->n_rings, __ATOMIC_ACQUIRE);
+        size_t drained = 0;
+        for (unsigned i = 0; i < n_rings; i++) {
+            drained += drain_ring(trace, trace->rings[i]);
+        }
+        if (!drained) {
+            if (stop) break;
+            usleep(WRITER_IDLE_US);
+        }
+    }
+    return NULL;
+}
+
+trace_t* trace_open(const char* path, uint32_t flags) {
+    trace_t* trace = calloc(1, sizeof(trace_t));
+    if (!trace) return NULL;
+    trace->file = fopen(path, "wb");
+    if (!trace->file) {
+        free(trace);
+        return NULL;
+    }
+    trace->flags = flags;
+    pthread_mutex_init(&trace->lock, NULL);
+    if (fwrite(trace_magic, 1, sizeof(trace_magic), trace->file) != sizeof(trace_magic) ||
+        pthread_create(&trace->writer, NULL, writer_thread, trace)) {
+        fclose(trace->file);
+        pthread_mutex_destroy(&trace->lock);
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+bool trace_close(trace_t* trace) {
+    __atomic_store_n(&trace->stop, true, __ATOMIC_RELEASE);
+    pthread_join(trace->writer, NULL);
+    bool ok = !trace->failed;
+    if (fclose(trace->file)) ok = false;
+    for (unsigned i = 0; i < trace->n_rings; i++) {
+        free(trace->rings[i]->records);
+        free(trace->rings[i]);
+    }
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+    return ok;
+}
+
+bool trace_attach(trace_t* trace, const ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    trace_ring_t* ring = aligned_alloc(64, sizeof(trace_ring_t));
+    if (!ring) return false;
+    memset(ring, 0, sizeof(*ring));
+    // Touched now, so that recording does not take the page faults
+    ring->records = malloc(sizeof(trace_record_t) * TRACE_RING_SIZE);
+    if (!ring->records) {
+        free(ring);
+        return false;
+    }
+    memset(ring->records, 0, sizeof(trace_record_t) * TRACE_RING_SIZE);
+    ring->block_pc = TRACE_NO_BLOCK;
+    ring->memory = trace->flags & TRACE_MEMORY;
+    ring->cpu = cpu;
+
+    pthread_mutex_lock(&trace->lock);
+    unsigned n = trace->n_rings;
+    if (n == MEMORY_MAX_VIEWS) {
+        pthread_mutex_unlock(&trace->lock);
+        free(ring->records);
+        free(ring);
+        return false;
+    }
+    ring->index = n;
+    trace->rings[n] = ring;
+    __atomic_store_n(&trace->n_rings, n + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace->lock);
+
+    memory_set_trace(mem, ring);
+    if (mem->blocks) block_cache_flush(mem->blocks);
+    return true;
+}
+
+// The ring stays with the trace until trace_close drains it. Translated
+// blocks that record into it go too.
+void trace_detach(memory_system_t* mem) {
+    trace_ring_t* ring = mem->trace;
+    if (ring) __atomic_store_n(&ring->published, ring->head, __ATOMIC_RELEASE);
+    memory_set_trace(mem, NULL);
+    if (mem->blocks) block_cache_flush(mem->blocks);
+}
+
+void trace_jit_enter(trace_ring_t* ring, ppc_block_t* block, uint64_t pc) {
+    if (ring->block_pc != TRACE_NO_BLOCK) {
+        ring->jit_retired += ring->block_n;
+        trace_block_end(ring, ring->block_n);
+    }
+    trace_block_enter(ring, block, pc);
+}
+
+void trace_ring_wait(trace_ring_t* ring, uint32_t slots) {
+    for (;;) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (ring->head + slots - ring->tail_cache <= TRACE_RING_SIZE) return;
+        sched_yield();
+    }
+}
+
+void trace_code(trace_ring_t* ring, uint64_t pc, const ppc_op_t* ops, uint32_t n) {
+    // Header and words are handed over together
+    uint64_t pos = ring->head;
+    uint32_t slots = 1 + (n + 3) / 4;
+    if (pos + slots - ring->tail_cache > TRACE_RING_SIZE) trace_ring_wait(ring, slots);
+
+    trace_record_t* rec = &ring->records[pos++ & (TRACE_RING_SIZE - 1)];
+    rec->pc = pc;
+    rec->value = 0;
+    rec->kind = TRACE_REC_CODE;
+    rec->n = n;
+    for (uint32_t i = 0; i < n; i += 4) {
+        uint32_t w[4] = { 0, 0, 0, 0 };
+        for (uint32_t j = 0; j < 4 && i + j < n; j++) w[j] = ops[i + j].raw;
+        rec = &ring->records[pos++ & (TRACE_RING_SIZE - 1)];
+        rec->pc = w[0] | (uint64_t)w[1] << 32;
+        rec->value = w[2] | (uint64_t)w[3] << 32;
+        rec->kind = TRACE_REC_CODE;
+        rec->n = 0;
+    }
+    ring->head = pos;
+    __atomic_store_n(&ring->published, pos, __ATOMIC_RELEASE);
+}
+
+// Reader
+
+typedef struct {
+    uint64_t pc;                // TRACE_NO_BLOCK when empty
+    ppc_instruction_t inst;
+} code_slot_t;
+
+typedef struct {
+    trace_event_kind_t kind;
+    uint32_t word;              // Offset in the block, in words
+    uint64_t addr;
+    uint64_t value;
+    unsigned size;
+} access_t;
+
+typedef struct {
+    delta_t delta;
+    code_slot_t* code;          // Open addressing on pc
+    size_t code_mask;
+    size_t code_used;
+    access_t* accesses;         // Of the block not yet read
+    size_t n_accesses;
+    size_t accesses_cap;
+} reader_thread_t;
+
+struct trace_reader {
+    FILE* file;
+    const char* error;
+    reader_thread_t threads[MEMORY_MAX_VIEWS];
+
+    uint8_t* chunk;
+    size_t chunk_cap;
+    const uint8_t* p;
+    const uint8_t* end;
+    unsigned thread;            // Of the current chunk
+
+    // Block being expanded into events
+    bool in_block;
+    unsigned block_thread;
+    uint64_t block_pc;
+    uint32_t block_n;
+    uint32_t next_word;
+    uint32_t last_word;         // Of the instruction last returned
+    size_t next_access;
+};
+
+trace_reader_t* trace_reader_open(const char* path) {
+    trace_reader_t* reader = calloc(1, sizeof(trace_reader_t));
+    if (!reader) return NULL;
+    reader->file = fopen(path, "rb");
+    char magic[sizeof(trace_magic)];
+    if (!reader->file || fread(magic, 1, sizeof(magic), reader->file) != sizeof(magic) ||
+        memcmp(magic, trace_magic, sizeof(magic))) {
+        if (reader->file) fclose(reader->file);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void trace_reader_close(trace_reader_t* reader) {
+    if (!reader) return;
+    for (int i = 0; i < MEMORY_MAX_VIEWS; i++) {
+        free(reader->threads[i].code);
+        free(reader->threads[i].accesses);
+    }
+    free(reader->chunk);
+    fclose(reader->file);
+    free(reader);
+}
+
+const char* trace_reader_error(const trace_reader_t* reader) {
+    return reader->error;
+}
+
+static bool get_uleb(trace_reader_t* reader, uint64_t* v) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; reader->p < reader->end && shift < 64; shift += 7) {
+        uint8_t b = *reader->p++;
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = value;
+            return true;
+        }
+    }
+    reader->error = "truncated record";
+    return false;
+}
+
+static bool get_sleb(trace_reader_t* reader, int64_t* v) {
+    uint64_t u;
+    if (!get_uleb(reader, &u)) return false;
+    *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return true;
+}
+
+static code_slot_t* code_find(reader_thread_t* t, uint64_t pc) {
+    if (!t->code) return NULL;
+    for (size_t i = (pc >> 2) & t->code_mask;; i = (i + 1) & t->code_mask) {
+        if (t->code[i].pc == pc || t->code[i].pc == TRACE_NO_BLOCK) return &t->code[i];
+    }
+}
+
+static bool code_insert(reader_thread_t* t, uint64_t pc, uint32_t word) {
+    if (!t->code || (t->code_used + 1) * 2 > t->code_mask + 1) {
+        size_t old_size = t->code ? t->code_mask + 1 : 0;
+        size_t size = old_size ? old_size * 2 : 1024;
+        code_slot_t* old = t->code;
+        t->code = malloc(size * sizeof(code_slot_t));
+        if (!t->code) {
+            t->code = old;
+            return false;
+        }
+        t->code_mask = size - 1;
+        t->code_used = 0;
+        for (size_t i = 0; i < size; i++) t->code[i].pc = TRACE_NO_BLOCK;
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i].pc != TRACE_NO_BLOCK) {
+                *code_find(t, old[i].pc) = old[i];
+                t->code_used++;
+            }
+        }
+        free(old);
+    }
+    code_slot_t* slot = code_find(t, pc);
+    if (slot->pc == TRACE_NO_BLOCK) t->code_used++;
+    slot->pc = pc;
+    slot->inst = decode_instruction(word);
+    return true;
+}
+
+static ppc_instruction_t code_at(reader_thread_t* t, uint64_t pc) {
+    code_slot_t* slot = code_find(t, pc);
+    return slot && slot->pc == pc ? slot->inst : decode_instruction(0);
+}
+
+static bool read_chunk(trace_reader_t* reader) {
+    uint8_t header[8];
+    size_t got = fread(header, 1, sizeof(header), reader->file);
+    if (got == 0) return false;
+    if (got != sizeof(header)) {
+        reader->error = "truncated chunk";
+        return false;
+    }
+    uint32_t thread = 0, len = 0;
+    for (int i = 3; i >= 0; i--) {
+        thread = thread << 8 | header[i];
+        len = len << 8 | header[4 + i];
+    }
+    if (thread >= MEMORY_MAX_VIEWS) {
+        reader->error = "bad thread number";
+        return false;
+    }
+    if (len > reader->chunk_cap) {
+        uint8_t* chunk = realloc(reader->chunk, len);
+        if (!chunk) {
+            reader->error = "out of memory";
+            return false;
+        }
+        reader->chunk = chunk;
+        reader->chunk_cap = len;
+    }
+    if (fread(reader->chunk, 1, len, reader->file) != len) {
+        reader->error = "truncated chunk";
+        return false;
+    }
+    reader->thread = thread;
+    reader->p = reader->chunk;
+    reader->end = reader->chunk + len;
+    return true;
+}
+
+// Reads records up to the next block; false at the end or on an error
+static bool read_block(trace_reader_t* reader) {
+    for (;;) {
+        if (reader->p == reader->end && !read_chunk(reader)) return false;
+        reader_thread_t* t = &reader->threads[reader->thread];
+        uint8_t tag = *reader->p++;
+        uint64_t n;
+        int64_t delta;
+        switch (tag & 7) {
+            case TRACE_REC_BLOCK:
+                if (!get_sleb(reader, &delta) || !get_uleb(reader, &n)) return false;
+                reader->in_block = true;
+                reader->block_thread = reader->thread;
+                reader->block_pc = t->delta.block_end + (uint64_t)delta * 4;
+                reader->block_n = (uint32_t)n;
+                reader->next_word = 0;
+                reader->last_word = UINT32_MAX;
+                reader->next_access = 0;
+                t->delta.block_end = reader->block_pc + n * 4;
+                return true;
+            case TRACE_REC_CODE: {
+                if (!get_sleb(reader, &delta) || !get_uleb(reader, &n)) return false;
+                uint64_t pc = t->delta.block_end + (uint64_t)delta * 4;
+                if ((size_t)(reader->end - reader->p) < n * 4) {
+                    reader->error = "truncated code";
+                    return false;
+                }
+                for (uint64_t i = 0; i < n; i++, reader->p += 4) {
+                    const uint8_t* w = reader->p;
+                    uint32_t word = (uint32_t)w[0] << 24 | w[1] << 16 | w[2] << 8 | w[3];
+                    if (!code_insert(t, pc + i * 4, word)) {
+                        reader->error = "out of memory";
+                        return false;
+                    }
+                }
+                break;
+            }
+            case TRACE_REC_LOAD:
+            case TRACE_REC_STORE: {
+                uint64_t word, value;
+                if (!get_uleb(reader, &word) || !get_sleb(reader, &delta) ||
+                    !get_uleb(reader, &value)) {
+                    return false;
+                }
+                if (t->n_accesses == t->accesses_cap) {
+                    size_t cap = t->accesses_cap ? t->accesses_cap * 2 : 64;
+                    access_t* accesses = realloc(t->accesses, cap * sizeof(access_t));
+                    if (!accesses) {
+                        reader->error = "out of memory";
+                        return false;
+                    }
+                    t->accesses = accesses;
+                    t->accesses_cap = cap;
+                }
+                access_t* a = &t->accesses[t->n_accesses++];
+                a->kind = (tag & 7) == TRACE_REC_LOAD ? TRACE_EVENT_LOAD : TRACE_EVENT_STORE;
+                a->word = (uint32_t)word;
+                a->addr = t->delta.access_end + (uint64_t)delta;
+                a->value = value;
+                a->size = 1U << (tag >> 3);
+                t->delta.access_end = a->addr + a->size;
+                break;
+            }
+            default:
+                reader->error = "bad record";
+                return false;
+        }
+    }
+}
+
+bool trace_reader_next(trace_reader_t* reader, trace_event_t* event) {
+    for (;;) {
+        if (!reader->in_block && !read_block(reader)) return false;
+
+        reader_thread_t* t = &reader->threads[reader->block_thread];
+        uint64_t base = reader->block_pc;
+        event->thread = reader->block_thread;
+
+        // Accesses follow the instruction that made them
+        while (reader->last_word != UINT32_MAX && reader->next_access < t->n_accesses &&
+               t->accesses[reader->next_access].word < reader->last_word) {
+            reader->next_access++;
+        }
+        if (reader->last_word != UINT32_MAX && reader->next_access < t->n_accesses &&
+            t->accesses[reader->next_access].word == reader->last_word) {
+            const access_t* a = &t->accesses[reader->next_access++];
+            event->kind = a->kind;
+            event->pc = base + (uint64_t)a->word * 4;
+            event->addr = a->addr;
+            event->value = a->value;
+            event->size = a->size;
+            return true;
+        }
+
+        if (reader->next_word < reader->block_n) {
+            uint64_t pc = base + (uint64_t)reader->next_word * 4;
+            event->kind = TRACE_EVENT_INSN;
+            event->pc = pc;
+            event->inst = code_at(t, pc);
+            reader->last_word = reader->next_word++;
+            if (event->inst.id == PPC_INST_PREFIX && reader->next_word < reader->block_n) {
+                event->suffix = code_at(t, pc + 4);
+                reader->next_word++;
+            }
+            return true;
+        }
+
+        reader->in_block = false;
+        t->n_accesses = 0;
+    }
+}
@@ -0,0 +1,182 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "block.h"
+
+// Binary execution traces. A trace_t owns an output file and a writer
+// thread; each memory view (vCPU) being traced records into its own ring
+// of fixed-size records, and the writer drains the rings, delta-encodes
+// them and appends the result to the file. Recording a block costs one
+// record, and blocks whose code the trace has not seen yet add their
+// instruction words, so a reader can decode the PC stream offline.
+//
+// With TRACE_MEMORY the view's DTLB fast path is turned off and every
+// load and store through the memory accessors is recorded too: address,
+// size, value and the instruction it belongs to. Atomics and bulk host
+// copies (memory_atomic_ptr, memory_host_page) are not recorded.
+//
+// Blocks translated while a view is traced call trace_jit_enter on entry,
+// so chained blocks are recorded without returning to the dispatcher.
+
+#define TRACE_MEMORY    (1U << 0)   // Record data accesses as well
+
+#define TRACE_RING_BITS 16          // Records per ring, as a power of two
+#define TRACE_RING_SIZE (1U << TRACE_RING_BITS)
+#define TRACE_BATCH     64          // Records the writer is handed at once
+
+// Record kinds
+enum {
+    TRACE_REC_BLOCK,    // pc, n instructions retired from it
+    TRACE_REC_CODE,     // pc, n instruction words in the records after it
+    TRACE_REC_LOAD,     // pc: address, value, n: block offset, size in kind
+    TRACE_REC_STORE,
+};
+
+#define TRACE_REC_KIND(kind)        ((kind) & 0xFF)
+#define TRACE_REC_SIZE(kind)        ((kind) >> 8)
+
+// One ring slot; code records are followed by the words, four per slot
+typedef struct {
+    uint64_t pc;
+    uint64_t value;
+    uint32_t kind;
+    uint32_t n;
+} trace_record_t;
+
+#define TRACE_NO_BLOCK  UINT64_MAX
+
+// Single producer (the view's thread), single consumer (the writer). The
+// producer hands records over in batches, so the line the writer polls
+// changes once per TRACE_BATCH records.
+typedef struct trace_ring {
+    trace_record_t* records;
+    uint64_t head;              // Next slot the producer fills
+    uint64_t tail_cache;        // Producer's copy of tail
+    uint64_t block_pc;          // Block being executed, or TRACE_NO_BLOCK
+    uint32_t block_n;
+    uint64_t jit_retired;       // By blocks chained from, this jit_execute
+    bool memory;                // TRACE_MEMORY
+    const ppc_cpu_state_t* cpu; // For the block offset of accesses
+    unsigned index;             // Thread number in the file
+
+    uint64_t published __attribute__((aligned(64)));    // head, as the writer sees it
+    uint64_t tail __attribute__((aligned(64)));         // Written by the writer
+} trace_ring_t;
+
+typedef struct trace trace_t;
+
+// Creates path and starts the writer; NULL on failure
+trace_t* trace_open(const char* path, uint32_t flags);
+
+// Stops recording, drains every ring and closes the file. Views must be
+// detached first.
+bool trace_close(trace_t* trace);
+
+// Starts recording the view cpu runs on. Its decoded blocks are dropped,
+// so that all of them are recorded with their code.
+bool trace_attach(trace_t* trace, const ppc_cpu_state_t* cpu, memory_system_t* mem);
+void trace_detach(memory_system_t* mem);
+
+// Producer side, from the view's own thread. A full ring makes it wait
+// for the writer, so nothing is dropped.
+void trace_ring_wait(trace_ring_t* ring, uint32_t slots);
+
+static inline trace_record_t* trace_slot(trace_ring_t* ring) {
+    if (__builtin_expect(ring->head - ring->tail_cache == TRACE_RING_SIZE, 0)) {
+        trace_ring_wait(ring, 1);
+    }
+    return &ring->records[ring->head & (TRACE_RING_SIZE - 1)];
+}
+
+static inline void trace_publish(trace_ring_t* ring) {
+    if (!(++ring->head & (TRACE_BATCH - 1))) {
+        __atomic_store_n(&ring->published, ring->head, __ATOMIC_RELEASE);
+    }
+}
+
+static inline void trace_push(trace_ring_t* ring, uint32_t kind, uint32_t n, uint64_t pc, uint64_t value) {
+    trace_record_t* rec = trace_slot(ring);
+    rec->pc = pc;
+    rec->value = value;
+    rec->kind = kind;
+    rec->n = n;
+    trace_publish(ring);
+}
+
+// The words of the n instructions in ops, about to run at pc
+void trace_code(trace_ring_t* ring, uint64_t pc, const ppc_op_t* ops, uint32_t n);
+
+// A block of n instructions at pc starts; its accesses are recorded
+// until trace_block_end gives the number retired
+static inline void trace_block_begin(trace_ring_t* ring, uint64_t pc, uint32_t n) {
+    ring->block_pc = pc;
+    ring->block_n = n;
+}
+
+static inline void trace_block_end(trace_ring_t* ring, uint64_t retired) {
+    trace_push(ring, TRACE_REC_BLOCK, (uint32_t)retired, ring->block_pc, 0);
+    ring->block_pc = TRACE_NO_BLOCK;
+}
+
+// The same for a decoded block, recording its code the first time it
+// runs at pc
+static inline void trace_block_enter(trace_ring_t* ring, ppc_block_t* block, uint64_t pc) {
+    if (block->trace_pc != pc) {
+        trace_code(ring, pc, block->ops, block->n_insns);
+        block->trace_pc = pc;
+    }
+    trace_block_begin(ring, pc, block->n_insns);
+}
+
+// Called by translated code as a block is entered; the block chained
+// from, if any, ran to the end. Whatever ran last is ended by the
+// dispatcher once jit_execute returns.
+void trace_jit_enter(trace_ring_t* ring, ppc_block_t* block, uint64_t pc);
+
+// A fault unwound the block at pc, the instruction that did not retire
+static inline void trace_block_unwound(trace_ring_t* ring, uint64_t pc) {
+    if (ring->block_pc == TRACE_NO_BLOCK) return;
+    uint64_t retired = (pc - ring->block_pc) >> 2;
+    trace_block_end(ring, retired < ring->block_n ? retired : 0);
+}
+
+// A data access through the slow path (memory.c); host accesses outside
+// any block are not the guest's
+static inline void trace_access(trace_ring_t* ring, uint32_t kind, uint64_t addr, uint64_t value,
+                                unsigned size) {
+    if (!ring->memory || ring->block_pc == TRACE_NO_BLOCK) return;
+    trace_push(ring, kind | (size << 8), ring->cpu->exec_state.mem_pc_off, addr, value);
+}
+
+// Reading a trace back: instructions in the order each thread executed
+// them, decoded with decode_instruction, each followed by its accesses.
+// Threads come interleaved in the order the writer drained them.
+typedef enum {
+    TRACE_EVENT_INSN,
+    TRACE_EVENT_LOAD,
+    TRACE_EVENT_STORE,
+} trace_event_kind_t;
+
+typedef struct {
+    trace_event_kind_t kind;
+    unsigned thread;
+    uint64_t pc;                // Of the instruction, for accesses too
+    ppc_instruction_t inst;     // INSN; a prefixed one has the suffix in
+    ppc_instruction_t suffix;   // suffix and takes two words
+    uint64_t addr;              // LOAD and STORE
+    uint64_t value;
+    unsigned size;
+} trace_event_t;
+
+typedef struct trace_reader trace_reader_t;
+
+trace_reader_t* trace_reader_open(const char* path);
+void trace_reader_close(trace_reader_t* reader);
+
+// False at the end of the trace, or if it is damaged (trace_reader_error)
+bool trace_reader_next(trace_reader_t* reader, trace_event_t* event);
+const char* trace_reader_error(const trace_reader_t* reader);
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <immintrin.h>
+#include <string.h>
+#include "cpu.h"
+
+// Host SIMD kernels for the VMX/VSX unit. Registers keep their bytes
+// reversed (see ppc_vsr_t), so one SSE lane is one guest element and
+// element-wise operations need no lane fixups at all. Only operations that
+// name element positions (permutes, splats, merges, packs, even/odd
+// multiplies) mirror their indices, and memory accesses reverse the 16
+// bytes with a single pshufb.
+//
+// SSE4.2 is the baseline; AVX2 and FMA are used when the build targets
+// them (-march=native does on any recent host).
+
+#ifndef __SSE4_2__
+#error "the vector unit needs SSE4.2; build with -march=native or -msse4.2"
+#endif
+
+// Register access. VMX register n is VSR 32 + n, which never overlaps
+// the FPRs.
+static inline __m128i vr_read(const ppc_cpu_state_t* cpu, unsigned n) {
+    return _mm_load_si128((const __m128i*)&cpu->vsr[32 + n]);
+}
+
+static inline void vr_write(ppc_cpu_state_t* cpu, unsigned n, __m128i v) {
+    _mm_store_si128((__m128i*)&cpu->vsr[32 + n], v);
+}
+
+// VSRs 0-31 take doubleword 0 (the high host half) from the FPR
+static inline __m128i vsr_read(const ppc_cpu_state_t* cpu, unsigned n) {
+    __m128i v = _mm_load_si128((const __m128i*)&cpu->vsr[n]);
+    if (n < 32) {
+        int64_t bits;
+        memcpy(&bits, &cpu->fpr[n], sizeof(bits));
+        v = _mm_insert_epi64(v, bits, 1);
+    }
+    return v;
+}
+
+static inline void vsr_write(ppc_cpu_state_t* cpu, unsigned n, __m128i v) {
+    _mm_store_si128((__m128i*)&cpu->vsr[n], v);
+    if (n < 32) {
+        int64_t bits = _mm_extract_epi64(v, 1);
+        memcpy(&cpu->fpr[n], &bits, sizeof(bits));
+    }
+}
+
+// Scalar VSX operations use doubleword 0 and leave doubleword 1 zero
+static inline double vsr_read_dw0(const ppc_cpu_state_t* cpu, unsigned n) {
+    return n < 32 ? cpu->fpr[n] : cpu->vsr[n].fd[1];
+}
+
+static inline void vsr_write_dw0(ppc_cpu_state_t* cpu, unsigned n, double value) {
+    cpu->vsr[n].d[0] = 0;
+    if (n < 32) {
+        cpu->fpr[n] = value;
+    } else {
+        cpu->vsr[n].fd[1] = value;
+    }
+}
+
+// Guest byte order <-> register layout
+static inline __m128i vec_reverse(__m128i v) {
+    return _mm_shuffle_epi8(v, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+// 16-byte big-endian loads and stores: one host access when the quadword
+// sits in a page the DTLB has, two doubleword accesses otherwise
+static inline bool vec_fast_page(uint64_t tag, uint64_t ea) {
+    return tlb_compare_addr(ea, 1) == tag && (ea & PAGE_MASK) <= PAGE_SIZE - 16;
+}
+
+static inline __m128i vec_load(memory_system_t* mem, uint64_t ea) {
+    tlb_entry_t* entry = dtlb_entry(mem, ea);
+    if (__builtin_expect(vec_fast_page(entry->addr_read, ea), 1)) {
+        return vec_reverse(_mm_loadu_si128((const __m128i*)(uintptr_t)(ea + entry->addend)));
+    }
+    uint64_t hi = memory_read64(mem, ea);
+    return _mm_set_epi64x((int64_t)hi, (int64_t)memory_read64(mem, ea + 8));
+}
+
+static inline void vec_store(memory_system_t* mem, uint64_t ea, __m128i v) {
+    tlb_entry_t* entry = dtlb_entry(mem, ea);
+    if (__builtin_expect(vec_fast_page(entry->addr_write, ea), 1)) {
+        _mm_storeu_si128((__m128i*)(uintptr_t)(ea + entry->addend), vec_reverse(v));
+        return;
+    }
+    memory_write64(mem, ea, (uint64_t)_mm_extract_epi64(v, 1));
+    memory_write64(mem, ea + 8, (uint64_t)_mm_extract_epi64(v, 0));
+}
+
+// Float views
+#define VEC_PS(x)   _mm_castsi128_ps(x)
+#define VEC_PD(x)   _mm_castsi128_pd(x)
+#define VEC_I(x)    _mm_castps_si128(x)
+#define VEC_ID(x)   _mm_castpd_si128(x)
+
+static inline __m128i vec_not(__m128i v) {
+    return _mm_xor_si128(v, _mm_set1_epi32(-1));
+}
+
+static inline bool vec_all_ones(__m128i v) {
+    return _mm_movemask_epi8(v) == 0xFFFF;
+}
+
+// Unsigned compares, by flipping the sign bits
+static inline __m128i vec_cmpgt_epu8(__m128i a, __m128i b) {
+    __m128i bias = _mm_set1_epi8((char)0x80);
+    return _mm_cmpgt_epi8(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+static inline __m128i vec_cmpgt_epu16(__m128i a, __m128i b) {
+    __m128i bias = _mm_set1_epi16((short)0x8000);
+    return _mm_cmpgt_epi16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+static inline __m128i vec_cmpgt_epu32(__m128i a, __m128i b) {
+    __m128i bias = _mm_set1_epi32((int)0x80000000);
+    return _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+static inline __m128i vec_cmpgt_epu64(__m128i a, __m128i b) {
+    __m128i bias = _mm_set1_epi64x((int64_t)0x8000000000000000ULL);
+    return _mm_cmpgt_epi64(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+// Per-element variable shifts, counts taken modulo the element size
+static inline __m128i vec_sllv32(__m128i a, __m128i n) {
+    n = _mm_and_si128(n, _mm_set1_epi32(31));
+#ifdef __AVX2__
+    return _mm_sllv_epi32(a, n);
+#else
+    // 2^n per lane through the float exponent, then a multiply (2^31
+    // converts to 0x80000000, which is still right)
+    __m128i pow2 = _mm_cvttps_epi32(VEC_PS(_mm_add_epi32(_mm_slli_epi32(n, 23),
+                                                         _mm_set1_epi32(0x3F800000))));
+    return _mm_mullo_epi32(a, pow2);
+#endif
+}
+
+#ifdef __AVX2__
+static inline __m128i vec_srlv32(__m128i a, __m128i n) {
+    return _mm_srlv_epi32(a, _mm_and_si128(n, _mm_set1_epi32(31)));
+}
+
+static inline __m128i vec_srav32(__m128i a, __m128i n) {
+    return _mm_srav_epi32(a, _mm_and_si128(n, _mm_set1_epi32(31)));
+}
+
+static inline __m128i vec_sllv64(__m128i a, __m128i n) {
+    return _mm_sllv_epi64(a, _mm_and_si128(n, _mm_set1_epi64x(63)));
+}
+
+static inline __m128i vec_srlv64(__m128i a, __m128i n) {
+    return _mm_srlv_epi64(a, _mm_and_si128(n, _mm_set1_epi64x(63)));
+}
+#else
+// Without AVX2 each lane shifts by its own count through a blend tree
+static inline __m128i vec_srlv32(__m128i a, __m128i n) {
+    n = _mm_slli_epi32(n, 27);      // Count bit 4 into the sign bit
+    a = _mm_blendv_epi8(a, _mm_srli_epi32(a, 16), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    a = _mm_blendv_epi8(a, _mm_srli_epi32(a, 8), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    a = _mm_blendv_epi8(a, _mm_srli_epi32(a, 4), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    a = _mm_blendv_epi8(a, _mm_srli_epi32(a, 2), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    return _mm_blendv_epi8(a, _mm_srli_epi32(a, 1), _mm_srai_epi32(n, 31));
+}
+
+static inline __m128i vec_srav32(__m128i a, __m128i n) {
+    n = _mm_slli_epi32(n, 27);
+    a = _mm_blendv_epi8(a, _mm_srai_epi32(a, 16), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    a = _mm_blendv_epi8(a, _mm_srai_epi32(a, 8), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    a = _mm_blendv_epi8(a, _mm_srai_epi32(a, 4), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    a = _mm_blendv_epi8(a, _mm_srai_epi32(a, 2), _mm_srai_epi32(n, 31));
+    n = _mm_slli_epi32(n, 1);
+    return _mm_blendv_epi8(a, _mm_srai_epi32(a, 1), _mm_srai_epi32(n, 31));
+}
+
+static inline __m128i vec_sllv64(__m128i a, __m128i n) {
+    __m128i lo = _mm_sll_epi64(a, _mm_and_si128(n, _mm_set_epi64x(0, 63)));
+    __m128i hi = _mm_sll_epi64(a, _mm_and_si128(_mm_unpackhi_epi64(n, n), _mm_set_epi64x(0, 63)));
+    return _mm_blend_epi16(lo, hi, 0xF0);
+}
+
+static inline __m128i vec_srlv64(__m128i a, __m128i n) {
+    __m128i lo = _mm_srl_epi64(a, _mm_and_si128(n, _mm_set_epi64x(0, 63)));
+    __m128i hi = _mm_srl_epi64(a, _mm_and_si128(_mm_unpackhi_epi64(n, n), _mm_set_epi64x(0, 63)));
+    return _mm_blend_epi16(lo, hi, 0xF0);
+}
+#endif
+
+static inline __m128i vec_rlv32(__m128i a, __m128i n) {
+    __m128i left = vec_sllv32(a, n);
+    __m128i right = vec_srlv32(a, _mm_sub_epi32(_mm_setzero_si128(), n));
+    return _mm_or_si128(left, right);
+}
+
+// Fused multiply-add, a * b + c rounded once
+static inline __m128 vec_fmadd_ps(__m128 a, __m128 b, __m128 c) {
+#ifdef __FMA__
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+// -(a * b - c) rounded once; NaNs pass through with their sign
+static inline __m128 vec_fnmsub_ps(__m128 a, __m128 b, __m128 c) {
+#ifdef __FMA__
+    __m128 r = _mm_fmsub_ps(a, b, c);
+#else
+    __m128 r = _mm_sub_ps(_mm_mul_ps(a, b), c);
+#endif
+    return _mm_xor_ps(r, _mm_and_ps(_mm_cmpord_ps(r, r), _mm_set1_ps(-0.0f)));
+}
+
+static inline __m128d vec_fmadd_pd(__m128d a, __m128d b, __m128d c) {
+#ifdef __FMA__
+    return _mm_fmadd_pd(a, b, c);
+#else
+    return _mm_add_pd(_mm_mul_pd(a, b), c);
+#endif
+}
+
+// Byte permute of the 32-byte guest concatenation a || b. idx holds host
+// positions into b (0-15) then a (16-31), which is 31 - the guest index.
+static inline __m128i vec_permute_host(__m128i a, __m128i b, __m128i idx) {
+    __m128i from_b = _mm_shuffle_epi8(b, _mm_and_si128(idx, _mm_set1_epi8(0x0F)));
+    __m128i from_a = _mm_shuffle_epi8(a, _mm_and_si128(idx, _mm_set1_epi8(0x0F)));
+    __m128i use_a = _mm_slli_epi16(idx, 3);     // Bit 4 into each byte's sign
+    return _mm_blendv_epi8(from_b, from_a, use_a);
+}
+
+// vperm: guest indices, low 5 bits of each control byte
+static inline __m128i vec_perm(__m128i a, __m128i b, __m128i control) {
+    return vec_permute_host(a, b, _mm_andnot_si128(control, _mm_set1_epi8(0x1F)));
+}
+
+// vpermr: the indices count from the other end
+static inline __m128i vec_permr(__m128i a, __m128i b, __m128i control) {
+    return vec_permute_host(a, b, _mm_and_si128(control, _mm_set1_epi8(0x1F)));
+}
+
+// Guest bytes sh..sh+15 of a || b
+static inline __m128i vec_sldoi(__m128i a, __m128i b, unsigned sh) {
+    __m128i idx = _mm_add_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                               _mm_set1_epi8((char)(16 - sh)));
+    return vec_permute_host(a, b, idx);
+}
+
+// Splat of guest element i
+static inline __m128i vec_splat8(__m128i v, unsigned i) {
+    return _mm_shuffle_epi8(v, _mm_set1_epi8((char)(15 - (i & 15))));
+}
+
+static inline __m128i vec_splat16(__m128i v, unsigned i) {
+    unsigned lane = 7 - (i & 7);
+    return _mm_shuffle_epi8(v, _mm_set1_epi16((short)(((2 * lane + 1) << 8) | (2 * lane))));
+}
+
+static inline __m128i vec_splat32(__m128i v, unsigned i) {
+    unsigned lane = 3 - (i & 3);
+    return _mm_shuffle_epi8(v, _mm_set1_epi32((int)(0x03020100 + lane * 0x04040404)));
+}
+
+// Pack with saturation; *sat is set when any element did not fit
+static inline __m128i vec_packs16(__m128i a, __m128i b, bool* sat) {
+    __m128i fits_a = _mm_cmpeq_epi16(a, _mm_srai_epi16(_mm_slli_epi16(a, 8), 8));
+    __m128i fits_b = _mm_cmpeq_epi16(b, _mm_srai_epi16(_mm_slli_epi16(b, 8), 8));
+    *sat = !vec_all_ones(_mm_and_si128(fits_a, fits_b));
+    return _mm_packs_epi16(b, a);
+}
+
+static inline __m128i vec_packs32(__m128i a, __m128i b, bool* sat) {
+    __m128i fits_a = _mm_cmpeq_epi32(a, _mm_srai_epi32(_mm_slli_epi32(a, 16), 16));
+    __m128i fits_b = _mm_cmpeq_epi32(b, _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    *sat = !vec_all_ones(_mm_and_si128(fits_a, fits_b));
+    return _mm_packs_epi32(b, a);
+}
+
+static inline __m128i vec_packus16(__m128i a, __m128i b, bool* sat) {
+    __m128i high = _mm_set1_epi16((short)0xFF00);
+    *sat = !_mm_testz_si128(_mm_or_si128(a, b), high);
+    return _mm_packus_epi16(b, a);
+}
+
+static inline __m128i vec_packus32(__m128i a, __m128i b, bool* sat) {
+    __m128i high = _mm_set1_epi32((int)0xFFFF0000);
+    *sat = !_mm_testz_si128(_mm_or_si128(a, b), high);
+    return _mm_packus_epi32(b, a);
+}
+
+// Float to word conversions with the architected saturation: out of
+// range goes to the nearest bound, NaN to 0
+static inline __m128i vec_cvt_ps_sw(__m128 x, bool* sat) {
+    __m128i r = _mm_cvttps_epi32(x);
+    __m128 big = _mm_cmpge_ps(x, _mm_set1_ps(2147483648.0f));
+    __m128 nan = _mm_cmpunord_ps(x, x);
+    __m128 small = _mm_cmplt_ps(x, _mm_set1_ps(-2147483648.0f));
+    r = _mm_blendv_epi8(r, _mm_set1_epi32(0x7FFFFFFF), VEC_I(big));
+    r = _mm_andnot_si128(VEC_I(nan), r);
+    *sat = _mm_movemask_ps(_mm_or_ps(_mm_or_ps(big, nan), small)) != 0;
+    return r;
+}
+
+static inline __m128i vec_cvt_ps_uw(__m128 x, bool* sat) {
+    __m128 two31 = _mm_set1_ps(2147483648.0f);
+    __m128 upper = _mm_cmpge_ps(x, two31);
+    __m128i lo = _mm_cvttps_epi32(x);
+    __m128i hi = _mm_xor_si128(_mm_cvttps_epi32(_mm_sub_ps(x, two31)), _mm_set1_epi32((int)0x80000000));
+    __m128i r = _mm_blendv_epi8(lo, hi, VEC_I(upper));
+    __m128 big = _mm_cmpge_ps(x, _mm_set1_ps(4294967296.0f));
+    __m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+    __m128 nan = _mm_cmpunord_ps(x, x);
+    r = _mm_or_si128(r, VEC_I(big));
+    r = _mm_andnot_si128(VEC_I(_mm_or_ps(neg, nan)), r);
+    *sat = _mm_movemask_ps(_mm_or_ps(_mm_or_ps(big, neg), nan)) != 0;
+    return r;
+}
+
+static inline __m128 vec_cvt_uw_ps(__m128i v) {
+    __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(v, 16));
+    __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)));
+    return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+}
+
+// 2^-n and 2^n as floats, for the fixed-point scale of vcf*/vct*
+static inline __m128 vec_scale_ps(int n) {
+    return _mm_castsi128_ps(_mm_set1_epi32((127 + n) << 23));
+}
+
+// VMX floating point always rounds to nearest and never touches FPSCR,
+// but MXCSR holds the guest's FPSCR flags and rounding mode (fpu.h).
+// Both are put back if the operation changed them, which is rare once
+// the inexact flag is set.
+static inline uint32_t vmx_fp_begin(void) {
+    uint32_t csr = _mm_getcsr();
+    if (csr & _MM_ROUND_MASK) _mm_setcsr(csr & ~_MM_ROUND_MASK);
+    return csr;
+}
+
+static inline void vmx_fp_end(uint32_t csr) {
+    if (_mm_getcsr() != csr) _mm_setcsr(csr);
+}
+
+#define VMX_FP(EXPR)                                                    \
+    ({                                                                  \
+        uint32_t csr_ = vmx_fp_begin();                                 \
+        __m128i r_ = (EXPR);                                            \
+        vmx_fp_end(csr_);                                               \
+        r_;                                                             \
+    })
+
+// Records a saturation in VSCR[SAT], which is sticky
+static inline void vec_saturated(ppc_cpu_state_t* cpu, bool sat) {
+    if (sat) cpu->vscr |= VSCR_SAT;
+}
+
+// CR6 for record-form compares: all elements true, or none
+static inline void vec_set_cr6(ppc_cpu_state_t* cpu, __m128i mask) {
+    int bits = _mm_movemask_epi8(mask);
+    uint32_t c = (bits == 0xFFFF ? 8 : 0) | (bits == 0 ? 2 : 0);
+    cpu->cr = cr_set_field(cpu->cr, 6, c);
+}
+
+#endif
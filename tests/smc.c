@@ -0,0 +1,115 @@
+#include "test.h"
+#include "smp.h"
+
+// Self-modifying code: a guest loop that rewrites the function it calls,
+// the host writing over translated code, and one vCPU patching code
+// another vCPU is spinning in. Each must run the new instructions.
+
+#define CODE        0x1000
+#define FUNCTION    0x1200      // Same page as the loop
+#define ITERATIONS  2000        // Enough for the JIT to compile both
+
+// for (i = 0; i < ITERATIONS; i++) { *FUNCTION = li r3,i; sum += FUNCTION(); }
+static void test_guest_writes(test_machine_t* m) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    memory_system_t* mem = &m->mem;
+    uint32_t program[32];
+    size_t n = 0;
+    program[n++] = ppc_li(4, 0);                    // Sum
+    program[n++] = ppc_li(5, 0);                    // i
+    program[n++] = ppc_li(6, FUNCTION);
+    program[n++] = ppc_lis(7, 0x3860);              // li r3,0
+    program[n++] = ppc_li(9, ITERATIONS);
+    program[n++] = ppc_mtctr(9);
+    size_t loop = n;
+    program[n++] = ppc_or(8, 7, 5);                 // li r3,i
+    program[n++] = ppc_stw(8, 0, 6);
+    program[n++] = PPC_SYNC;
+    program[n++] = ppc_icbi(6);
+    program[n++] = PPC_ISYNC;
+    program[n] = ppc_bl((int32_t)(FUNCTION - (CODE + 4 * n)));
+    n++;
+    program[n++] = ppc_add(4, 4, 3);
+    program[n++] = ppc_addi(5, 5, 1);
+    program[n] = ppc_bdnz((int16_t)(4 * ((int)loop - (int)n)));
+    n++;
+    program[n++] = PPC_SC;
+    test_write_code(mem, CODE, program, n);
+    memory_write32(mem, FUNCTION, ppc_li(3, 0));
+    memory_write32(mem, FUNCTION + 4, PPC_BLR);
+
+    CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+    CHECK_EQ(cpu->gpr[4], (uint64_t)ITERATIONS * (ITERATIONS - 1) / 2);
+    CHECK_EQ(memory_read32(mem, FUNCTION), ppc_li(3, ITERATIONS - 1));
+
+    // Again under copy-on-write tracking, then after reverting the RAM
+    CHECK(memory_cow_begin(mem));
+    CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+    CHECK_EQ(cpu->gpr[4], (uint64_t)ITERATIONS * (ITERATIONS - 1) / 2);
+    CHECK(memory_cow_revert(mem));
+    CHECK_EQ(memory_read32(mem, FUNCTION), ppc_li(3, ITERATIONS - 1));
+    CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+    CHECK_EQ(cpu->gpr[4], (uint64_t)ITERATIONS * (ITERATIONS - 1) / 2);
+    memory_cow_end(mem);
+}
+
+// The host (a debugger, a loader) writes over code that was translated
+static void test_host_writes(test_machine_t* m) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    memory_system_t* mem = &m->mem;
+    const uint32_t program[] = { ppc_li(3, 1), PPC_SC };
+    test_write_code(mem, CODE, program, 2);
+    for (int i = 0; i < 100; i++) {
+        CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+    }
+    CHECK_EQ(cpu->gpr[3], 1);
+
+    uint32_t patched = ppc_li(3, 4242);
+    uint8_t bytes[4] = { patched >> 24, patched >> 16, patched >> 8, patched };
+    CHECK_EQ(memory_write_block(mem, CODE, bytes, sizeof(bytes)), sizeof(bytes));
+    CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+    CHECK_EQ(cpu->gpr[3], 4242);
+}
+
+// vCPU 0 spins until r3 is 2; vCPU 1 rewrites its li r3,1 into li r3,2
+static void test_cross_cpu(void) {
+    smp_t smp;
+    CHECK(smp_init(&smp, 2, MEMORY_SIZE));
+    memory_system_t* mem = &smp.cpus[0]->mem;
+    const uint32_t spin[] = {
+        ppc_li(3, 1),
+        0x2C030002,                                 // cmpwi r3,2
+        0x4082FFF8,                                 // bne -8
+        PPC_SC,
+    };
+    test_write_code(mem, 0x10000, spin, 4);
+    const uint32_t patch[] = {
+        ppc_lis(5, 1),
+        ppc_lis(6, 0x3860),
+        ppc_ori(6, 6, 2),                           // li r3,2
+        PPC_SYNC,
+        ppc_lis(7, 0x10),
+        ppc_mtctr(7),
+        ppc_bdnz(0),                                // Give vCPU 0 time to translate the loop
+        ppc_stw(6, 0, 5),
+        PPC_SC,
+    };
+    test_write_code(mem, 0x20000, patch, 9);
+    smp.cpus[0]->cpu.pc = 0x10000;
+    smp.cpus[1]->cpu.pc = 0x20000;
+
+    CHECK(smp_run(&smp, UINT64_MAX));
+    CHECK_EQ(smp.cpus[0]->exit, CPU_EXIT_SYSCALL);
+    CHECK_EQ(smp.cpus[0]->cpu.gpr[3], 2);
+    CHECK_EQ(smp.cpus[1]->exit, CPU_EXIT_SYSCALL);
+    smp_destroy(&smp);
+}
+
+int main(void) {
+    test_machine_t* m = test_machine_create();
+    test_guest_writes(m);
+    test_host_writes(m);
+    test_machine_destroy(m);
+    test_cross_cpu();
+    return test_result();
+}
@@ -0,0 +1,63 @@
+#include "test.h"
+#include "snapshot.h"
+
+// Snapshots put back registers and RAM, including pages the guest ran
+// code from (which the block cache write-protects) and pages that were
+// dirtied twice between restores
+
+#define CODE    0x1000
+#define DATA    0x20000
+#define PATCH   0x3000      // Shares a dirty-bitmap word with CODE
+
+static void test_restore(test_machine_t* m) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    memory_system_t* mem = &m->mem;
+    const uint32_t program[] = {
+        ppc_lis(4, DATA >> 16),
+        ppc_lwz(3, 0, 4),
+        ppc_addi(3, 3, 1),
+        ppc_stw(3, 0, 4),
+        PPC_SC,
+    };
+    test_write_code(mem, CODE, program, sizeof(program) / sizeof(program[0]));
+    memory_write32(mem, DATA, 41);
+    memory_write32(mem, PATCH + 0x100, 1);
+
+    cpu->pc = CODE;
+    cpu->gpr[3] = 7;
+    snapshot_t snap;
+    CHECK(snapshot_take(&snap, cpu, mem));
+
+    for (int round = 0; round < 3; round++) {
+        CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+        CHECK_EQ(cpu->gpr[3], 42);
+        CHECK_EQ(memory_read32(mem, DATA), 42);
+
+        // Write over the running code and run from a second page too
+        memory_write32(mem, CODE + 0x100, 0xDEADBEEF);
+        memory_write32(mem, PATCH, PPC_SC);
+        CHECK_EQ(test_run(cpu, mem, PATCH), CPU_EXIT_SYSCALL);
+        CHECK(memory_cow_dirty_pages(mem) > 0);
+
+        CHECK(snapshot_restore(&snap, cpu, mem));
+        CHECK_EQ(cpu->pc, CODE);
+        CHECK_EQ(cpu->gpr[3], 7);
+        CHECK_EQ(memory_read32(mem, DATA), 41);
+        CHECK_EQ(memory_read32(mem, CODE + 0x100), 0);
+        CHECK_EQ(memory_read32(mem, PATCH), 0);
+        CHECK_EQ(memory_read32(mem, PATCH + 0x100), 1);
+        CHECK_EQ(memory_cow_dirty_pages(mem), 0);
+    }
+
+    // After a release the RAM is left as the guest wrote it
+    snapshot_release(mem);
+    CHECK_EQ(test_run(cpu, mem, CODE), CPU_EXIT_SYSCALL);
+    CHECK_EQ(memory_read32(mem, DATA), 42);
+}
+
+int main(void) {
+    test_machine_t* m = test_machine_create();
+    test_restore(m);
+    test_machine_destroy(m);
+    return test_result();
+}
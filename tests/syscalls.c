@@ -0,0 +1,84 @@
+#include "test.h"
+#include "linux_user.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// User-mode Linux system calls made by a guest snippet: I/O through a
+// host pipe, brk and anonymous mmap, errors and exit
+
+#define CODE        0x10000
+#define MESSAGE     0x11000
+#define IMAGE_END   0x100000    // Initial program break
+
+// Runs the process the way pwrxe does; returns the reason it stopped
+static cpu_exit_t run_process(linux_process_t* proc, ppc_cpu_state_t* cpu, memory_system_t* mem) {
+    cpu_exit_t reason;
+    cpu->pc = CODE;
+    do {
+        reason = cpu_run(cpu, mem, UINT64_MAX);
+    } while (reason == CPU_EXIT_BUDGET ||
+             (reason == CPU_EXIT_SYSCALL && linux_syscall(proc, cpu, mem)));
+    return reason;
+}
+
+static void test_syscalls(test_machine_t* m) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    memory_system_t* mem = &m->mem;
+    int pipe_fds[2];
+    CHECK(pipe(pipe_fds) == 0);
+
+    const uint32_t program[] = {
+        // write(fd, MESSAGE, 3)
+        ppc_li(0, 4), ppc_li(3, (int16_t)pipe_fds[1]), ppc_lis(4, MESSAGE >> 16),
+        ppc_ori(4, 4, MESSAGE & 0xFFFF), ppc_li(5, 3), PPC_SC, ppc_mr(20, 3),
+        // brk(0), then grow the break by two pages and store above the old one
+        ppc_li(0, 45), ppc_li(3, 0), PPC_SC, ppc_mr(21, 3),
+        ppc_li(0, 45), ppc_addi(3, 21, 0x2000), PPC_SC, ppc_mr(22, 3),
+        ppc_li(9, 0x55), ppc_stw(9, 0x1000, 21),
+        // mmap(NULL, 0x2000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+        ppc_li(0, 90), ppc_li(3, 0), ppc_li(4, 0x2000), ppc_li(5, 3), ppc_li(6, 0x22),
+        ppc_li(7, -1), ppc_li(8, 0), PPC_SC, ppc_mr(23, 3),
+        ppc_stw(9, 0, 23),
+        // An unknown call fails with ENOSYS and CR0[SO]
+        ppc_li(0, 9999), PPC_SC, ppc_mr(24, 3), ppc_mfcr(25),
+        // exit(42)
+        ppc_li(0, 1), ppc_li(3, 42), PPC_SC,
+    };
+    test_write_code(mem, CODE, program, sizeof(program) / sizeof(program[0]));
+    memory_write_block(mem, MESSAGE, "hi\n", 3);
+
+    elf_image_t image = { .entry = CODE, .brk = IMAGE_END, .abi = 2 };
+    linux_process_t proc;
+    linux_process_init(&proc, mem, &image);
+    uint64_t mmap_top = proc.mmap_top;
+
+    CHECK_EQ(run_process(&proc, cpu, mem), CPU_EXIT_SYSCALL);
+    CHECK(proc.exited);
+    CHECK_EQ(proc.exit_status, 42);
+
+    char buf[4] = { 0 };
+    CHECK_EQ(cpu->gpr[20], 3);
+    CHECK(read(pipe_fds[0], buf, sizeof(buf)) == 3 && memcmp(buf, "hi\n", 3) == 0);
+
+    CHECK_EQ(cpu->gpr[21], IMAGE_END);
+    CHECK_EQ(cpu->gpr[22], IMAGE_END + 0x2000);
+    CHECK_EQ(proc.brk, IMAGE_END + 0x2000);
+    CHECK_EQ(memory_read32(mem, IMAGE_END + 0x1000), 0x55);
+
+    CHECK_EQ(cpu->gpr[23], mmap_top - 0x2000);
+    CHECK_EQ(memory_read32(mem, mmap_top - 0x2000), 0x55);
+
+    CHECK_EQ(cpu->gpr[24], ENOSYS);
+    CHECK(cpu->gpr[25] & 1U << 28);
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+int main(void) {
+    test_machine_t* m = test_machine_create();
+    test_syscalls(m);
+    test_machine_destroy(m);
+    return test_result();
+}
@@ -0,0 +1,101 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "block.h"
+#include "cpu.h"
+
+// Shared by the programs in tests/: each builds a small machine, writes a
+// hand-assembled guest snippet into RAM, runs it and checks the guest
+// state. A program exits non-zero if any CHECK failed, which is what
+// CTest looks at.
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    uint64_t actual_ = (uint64_t)(actual), expected_ = (uint64_t)(expected); \
+    if (actual_ != expected_) { \
+        fprintf(stderr, "%s:%d: %s is 0x%llx, expected 0x%llx\n", __FILE__, __LINE__, #actual, \
+                (unsigned long long)actual_, (unsigned long long)expected_); \
+        test_failures++; \
+    } \
+} while (0)
+
+static inline int test_result(void) {
+    if (test_failures) fprintf(stderr, "%d check(s) failed\n", test_failures);
+    return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// One vCPU over MEMORY_SIZE bytes of RAM, reset and in real mode
+typedef struct {
+    ppc_cpu_state_t cpu;        // First, for its alignment
+    memory_system_t mem;
+    block_cache_t blocks;
+} test_machine_t;
+
+static inline test_machine_t* test_machine_create(void) {
+    test_machine_t* m = aligned_alloc(64, (sizeof(test_machine_t) + 63) & ~(size_t)63);
+    if (!m || !memory_init(&m->mem, MEMORY_SIZE)) {
+        fprintf(stderr, "cannot allocate guest memory\n");
+        exit(EXIT_FAILURE);
+    }
+    block_cache_init(&m->blocks, &m->mem);
+    cpu_reset(&m->cpu);
+    return m;
+}
+
+static inline void test_machine_destroy(test_machine_t* m) {
+    block_cache_destroy(&m->blocks);
+    memory_destroy(&m->mem);
+    free(m);
+}
+
+static inline void test_write_code(memory_system_t* mem, uint64_t addr, const uint32_t* words, size_t n) {
+    for (size_t i = 0; i < n; i++) memory_write32(mem, addr + 4 * i, words[i]);
+}
+
+// Runs until something other than the instruction budget stops the CPU
+static inline cpu_exit_t test_run(ppc_cpu_state_t* cpu, memory_system_t* mem, uint64_t pc) {
+    cpu_exit_t reason;
+    cpu->pc = pc;
+    do {
+        reason = cpu_run(cpu, mem, 1000000);
+    } while (reason == CPU_EXIT_BUDGET);
+    return reason;
+}
+
+// Encoders for the few instructions the snippets use
+#define REG(r, shift)       ((uint32_t)(r) << (shift))
+#define IMM(v)              ((uint32_t)(v) & 0xFFFF)
+
+static inline uint32_t ppc_addi(unsigned rd, unsigned ra, int16_t v) { return 0x38000000 | REG(rd, 21) | REG(ra, 16) | IMM(v); }
+static inline uint32_t ppc_li(unsigned rd, int16_t v)                { return ppc_addi(rd, 0, v); }
+static inline uint32_t ppc_lis(unsigned rd, uint16_t v)              { return 0x3C000000 | REG(rd, 21) | IMM(v); }
+static inline uint32_t ppc_ori(unsigned ra, unsigned rs, uint16_t v) { return 0x60000000 | REG(rs, 21) | REG(ra, 16) | IMM(v); }
+static inline uint32_t ppc_add(unsigned rd, unsigned ra, unsigned rb) { return 0x7C000214 | REG(rd, 21) | REG(ra, 16) | REG(rb, 11); }
+static inline uint32_t ppc_or(unsigned ra, unsigned rs, unsigned rb)  { return 0x7C000378 | REG(rs, 21) | REG(ra, 16) | REG(rb, 11); }
+static inline uint32_t ppc_mr(unsigned ra, unsigned rs)              { return ppc_or(ra, rs, rs); }
+static inline uint32_t ppc_lwz(unsigned rd, int16_t d, unsigned ra)  { return 0x80000000 | REG(rd, 21) | REG(ra, 16) | IMM(d); }
+static inline uint32_t ppc_stw(unsigned rs, int16_t d, unsigned ra)  { return 0x90000000 | REG(rs, 21) | REG(ra, 16) | IMM(d); }
+static inline uint32_t ppc_mfcr(unsigned rd)                         { return 0x7C000026 | REG(rd, 21); }
+static inline uint32_t ppc_mtctr(unsigned rs)                        { return 0x7C0903A6 | REG(rs, 21); }
+static inline uint32_t ppc_icbi(unsigned rb)                         { return 0x7C0007AC | REG(rb, 11); }
+static inline uint32_t ppc_bdnz(int16_t offset)                      { return 0x42000000 | (IMM(offset) & 0xFFFC); }
+static inline uint32_t ppc_bl(int32_t offset)                        { return 0x48000001 | ((uint32_t)offset & 0x3FFFFFC); }
+
+#define PPC_SC      0x44000002
+#define PPC_BLR     0x4E800020
+#define PPC_SYNC    0x7C0004AC
+#define PPC_ISYNC   0x4C00012C
+
+#endif
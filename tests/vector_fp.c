@@ -0,0 +1,94 @@
+#include "test.h"
+#include <string.h>
+#include <math.h>
+
+// VMX and scalar FP instructions whose results are easy to get subtly
+// wrong: bit-level selects, fused rounding and unordered compares
+
+#define CODE    0x1000
+
+// VMX register n lives in vsr[32 + n]
+#define VR(cpu, n)  (&(cpu)->vsr[32 + (n)])
+
+static double snan(void) {
+    uint64_t bits = 0x7FF0000000000001ULL;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+// vsel picks each bit, not each byte, from vB where vC is set
+static void test_vsel(test_machine_t* m) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    memory_write32(&m->mem, CODE, 0x1000002A | 3 << 21 | 0 << 16 | 1 << 11 | 2 << 6);   // vsel v3,v0,v1,v2
+    memset(VR(cpu, 0), 0x00, 16);
+    memset(VR(cpu, 1), 0xFF, 16);
+    memset(VR(cpu, 2), 0x0F, 16);
+    cpu->pc = CODE;
+    cpu_step(cpu, &m->mem);
+    CHECK_EQ(VR(cpu, 3)->d[0], 0x0F0F0F0F0F0F0F0FULL);
+    CHECK_EQ(VR(cpu, 3)->d[1], 0x0F0F0F0F0F0F0F0FULL);
+}
+
+// vnmsubfp rounds a*c - b once; a separate multiply loses the low bits
+static void test_vnmsubfp(test_machine_t* m) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    memory_write32(&m->mem, CODE, 0x1000002F | 3 << 21 | 0 << 16 | 1 << 11 | 2 << 6);   // vnmsubfp v3,v0,v2,v1
+    float a = 1.0f + 0x1p-23f, c = 1.0f - 0x1p-23f;
+    for (int i = 0; i < 4; i++) {
+        VR(cpu, 0)->f[i] = a;
+        VR(cpu, 1)->f[i] = 1.0f;
+        VR(cpu, 2)->f[i] = c;
+    }
+    VR(cpu, 0)->f[1] = NAN;
+    VR(cpu, 0)->f[2] = 1.0f;
+    VR(cpu, 2)->f[2] = 1.0f;
+    cpu->pc = CODE;
+    cpu_step(cpu, &m->mem);
+    CHECK(VR(cpu, 3)->f[0] == 0x1p-46f);
+    CHECK(isnan(VR(cpu, 3)->f[1]));
+    CHECK(VR(cpu, 3)->f[2] == 0.0f && signbit(VR(cpu, 3)->f[2]));
+}
+
+// fcmpu/fcmpo rA,rB then mfcr r3; returns CR0
+static uint32_t fp_compare(test_machine_t* m, bool ordered, double a, double b) {
+    ppc_cpu_state_t* cpu = &m->cpu;
+    cpu_reset(cpu);
+    memory_write32(&m->mem, CODE, (ordered ? 0xFC000040 : 0xFC000000) | 1 << 16 | 2 << 11);
+    memory_write32(&m->mem, CODE + 4, ppc_mfcr(3));
+    cpu->fpr[1] = a;
+    cpu->fpr[2] = b;
+    cpu->pc = CODE;
+    cpu_step(cpu, &m->mem);
+    cpu_step(cpu, &m->mem);
+    return (uint32_t)(cpu->gpr[3] >> 28);
+}
+
+static void test_fp_compare(test_machine_t* m) {
+    for (int ordered = 0; ordered < 2; ordered++) {
+        CHECK_EQ(fp_compare(m, ordered, 1, 2), 8);
+        CHECK_EQ(fp_compare(m, ordered, 2, 1), 4);
+        CHECK_EQ(fp_compare(m, ordered, 1, 1), 2);
+
+        // A NaN is unordered, never less or greater
+        CHECK_EQ(fp_compare(m, ordered, NAN, 1), 1);
+        CHECK_EQ(m->cpu.fpscr & FPSCR_FPCC, 1U << 12);
+        CHECK_EQ(m->cpu.fpscr & FPSCR_VXVC, ordered ? FPSCR_VXVC : 0);
+        CHECK_EQ(m->cpu.fpscr & FPSCR_VXSNAN, 0);
+        CHECK_EQ(fp_compare(m, ordered, 1, NAN), 1);
+
+        CHECK_EQ(fp_compare(m, ordered, snan(), 0), 1);
+        CHECK_EQ(m->cpu.fpscr & FPSCR_VXSNAN, FPSCR_VXSNAN);
+        CHECK_EQ(m->cpu.fpscr & FPSCR_VXVC, ordered ? FPSCR_VXVC : 0);
+        CHECK(m->cpu.fpscr & FPSCR_FX);
+    }
+}
+
+int main(void) {
+    test_machine_t* m = test_machine_create();
+    test_vsel(m);
+    test_vnmsubfp(m);
+    test_fp_compare(m);
+    test_machine_destroy(m);
+    return test_result();
+}